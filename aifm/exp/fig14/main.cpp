@@ -8,6 +8,7 @@ extern "C" {
 #include "device.hpp"
 #include "helpers.hpp"
 #include "manager.hpp"
+#include "stats.hpp"
 
 #include <algorithm>
 #include <array>
@@ -64,6 +65,7 @@ void do_work(FarMemManager *manager) {
 
   flush_cache();
   delay_ms(1000);
+  Stats::reset_latencies();
 
   std::vector<rt::Thread> threads;
   const auto kNumEntriesPerIter = kMutatorAccessSizePerScope / sizeof(Data_t);
@@ -91,6 +93,13 @@ void do_work(FarMemManager *manager) {
     threads.clear();
   }
 
+  // The latency distributions of the deref slow path, and of the mutator
+  // pauses waiting for the evacuator.
+  cout << "swap_in latency histogram (bucket_max_ns count):" << endl;
+  Stats::get_swap_in_latency().dump(cout);
+  cout << "gc_cache_wait latency histogram (bucket_max_ns count):" << endl;
+  Stats::get_gc_cache_wait_latency().dump(cout);
+
   for (uint64_t i = 0; i < kNumEntries; i++) {
     ptrs[i].free();
   }
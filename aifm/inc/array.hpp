@@ -5,15 +5,27 @@
 #include "prefetcher.hpp"
 #include "prefetcher_leap.hpp"
 #include "prefetcher_lr.hpp"
+#include "prefetcher_stream.hpp"
 #include "cost_estimator.hpp"
+#include "pushdown.hpp"
 #include "rpc_router.hpp"
+#include "rpc_stub.hpp"
 
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <string>
 #include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 
+#ifdef ARRAY_STREAM_PREFETCHER
+#define ARRAY_STREAM_PREFETCHER 1
+#else
+#define ARRAY_STREAM_PREFETCHER 0
+#endif
+
 namespace far_memory {
 
 class FarMemManager;
@@ -31,9 +43,11 @@ protected:
   uint64_t kNumItems_;
   uint32_t kItemSize_;
   bool dynamic_prefetch_enabled_ = true;
-  bool dirty_ = false;
+  DirtyTracker dirty_tracker_;
   CostEstimatorMap cost_estimator_map_;
   rpc::RpcRouter rpc_router_;
+  // The method IDs of the server side, negotiated at construction.
+  std::unordered_map<std::string, rpc::MethodID> remote_method_ids_;
   constexpr static auto kInduceFn = [](Index_t idx_0,
                                        Index_t idx_1) -> Pattern_t {
     return GenericArray::induce_fn(idx_0, idx_1);
@@ -46,11 +60,20 @@ protected:
                                         Index_t idx) -> GenericUniquePtr * {
     return mapping_fn(state, idx);
   };
-  lr::Prefetcher<decltype(kInduceFn), decltype(kInferFn), decltype(kMappingFn)>
-      prefetcher_;
+  // The stream prefetcher follows several interleaved strided scans, e.g., the
+  // row and column walks over a multi-dimensional array.
+  using Prefetcher_t = std::conditional_t<
+      ARRAY_STREAM_PREFETCHER,
+      stream::Prefetcher<decltype(kInduceFn), decltype(kInferFn),
+                         decltype(kMappingFn)>,
+      lr::Prefetcher<decltype(kInduceFn), decltype(kInferFn),
+                     decltype(kMappingFn)>>;
+  Prefetcher_t prefetcher_;
 
   GenericArray(FarMemManager *manager, uint32_t item_size, uint64_t num_items);
   ~GenericArray();
+  void negotiate_methods(FarMemManager *manager);
+  uint64_t get_non_present_bytes() const;
   NOT_COPYABLE(GenericArray);
   NOT_MOVEABLE(GenericArray);
 
@@ -60,13 +83,40 @@ public:
   void static_prefetch(Index_t start, Index_t step, uint32_t num);
   GenericUniquePtr *at(bool nt, Index_t idx);
 
+  // A method resolved by its name once, so that the calls neither look the
+  // name up nor send it to the server.
+  struct Method {
+    rpc::MethodID local_id;
+    rpc::MethodID remote_id;
+    CostEstimatorPtr estimator;
+  };
+
   void flush();
+  // Resolve the method after registering it locally, since the handle does
+  // not see the later registrations.
+  Method get_method(const std::string &name);
+  // Runs the method locally on the cached items or pushes it down to the
+  // far-mem server, as the cost estimator of the method suggests. Returns
+  // whether the method is found and succeeded.
+  bool call(const Method &method, const rpc::BufferPtr &args,
+            rpc::BufferPtr &ret);
   bool call(const std::string &method, const rpc::BufferPtr &args,
             rpc::BufferPtr &ret);
+  // Ditto, but the return value is handed over to chunk_fn chunk by chunk as
+  // the method produces it, which lifts the limit of a single RPC body.
+  bool call_stream(const Method &method, const rpc::BufferPtr &args,
+                   const rpc::StreamReader::ChunkFn &chunk_fn);
+  // Returns a typed stub of the method, e.g., get_stub<int(int, int)>("Add").
+  template <typename F> rpc::Stub<F> get_stub(const std::string &name);
+
+  template<typename F>
+  rpc::MethodID register_local(const std::string &method, F func) {
+    return rpc_router_.Register(method, func);
+  }
 
   template<typename F>
-  void register_local(const std::string &method, F func) {
-    rpc_router_.Register(method, func);
+  rpc::MethodID register_local_stream(const std::string &method, F func) {
+    return rpc_router_.RegisterStream(method, func);
   }
 };
 
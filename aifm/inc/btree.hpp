@@ -0,0 +1,202 @@
+#pragma once
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "internal/dataframe_types.hpp"
+#include "pointer.hpp"
+#include "prefetcher.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#ifdef DISABLE_OFFLOAD_BTREE_AGGREGATE
+#define DISABLE_OFFLOAD_BTREE_AGGREGATE 1
+#else
+#define DISABLE_OFFLOAD_BTREE_AGGREGATE 0
+#endif
+
+namespace far_memory {
+
+class FarMemManager;
+
+// An ordered map whose inner nodes are pinned in the local memory, and whose
+// leaves are far-mem objects chained in the key order. Not thread-safe.
+class GenericBTree {
+private:
+  enum OpCode { Count = 0, Sum, Min, Max };
+
+  // The layout of a far-mem leaf is |LeafHeader|keys|values|. The memory server
+  // walks the leaves through next_id for the offloaded range aggregations.
+  struct LeafHeader {
+    uint64_t next_id;
+    uint16_t cnt;
+  };
+
+  // The local metadata of a far-mem leaf. It is recycled rather than freed, so
+  // that the prefetcher can safely follow the chain while the tree changes.
+  struct Leaf {
+    GenericUniquePtr ptr;
+    Leaf *prev;
+    Leaf *next;
+    uint64_t id;
+  };
+  // Far-mem pointer should never cross the cacheline boundary.
+  static_assert(sizeof(Leaf) == 32);
+
+  using Index_t = uint64_t;
+  using Pattern_t = int64_t;
+
+  constexpr static uint32_t kLeafHeaderSize = 16;
+  static_assert(sizeof(LeafHeader) <= kLeafHeaderSize);
+  constexpr static uint64_t kInvalidLeafId =
+      std::numeric_limits<uint64_t>::max();
+  constexpr static uint16_t kLeafSize = 4096;
+
+  // The prefetcher indices are the Leaf addrs. The pattern is the number of
+  // hops along the leaf chain, i.e., 1 for the forward range scans.
+  static Pattern_t induce_fn(Index_t idx_0, Index_t idx_1);
+  static Index_t infer_fn(Index_t idx, Pattern_t hops);
+  static GenericUniquePtr *mapping_fn(uint8_t *&state, Index_t idx);
+  constexpr static auto kInduceFn = [](Index_t idx_0,
+                                       Index_t idx_1) -> Pattern_t {
+    return induce_fn(idx_0, idx_1);
+  };
+  constexpr static auto kInferFn = [](Index_t idx,
+                                      Pattern_t hops) -> Index_t {
+    return infer_fn(idx, hops);
+  };
+  constexpr static auto kMappingFn = [](uint8_t *&state,
+                                        Index_t idx) -> GenericUniquePtr * {
+    return mapping_fn(state, idx);
+  };
+
+  const uint16_t kLeafCapacity_;
+  FarMemDevice *device_;
+  uint8_t ds_id_;
+  std::deque<Leaf> leaves_;
+  std::vector<Leaf *> free_leaves_;
+  Leaf *head_ = nullptr;
+  uint64_t size_ = 0;
+  bool dynamic_prefetch_enabled_ = true;
+  bool dirty_ = false;
+  Prefetcher<decltype(kInduceFn), decltype(kInferFn), decltype(kMappingFn)>
+      prefetcher_;
+
+  template <typename K, typename V> friend class BTree;
+  friend class ServerBTree;
+  friend class FarMemTest;
+
+  GenericBTree(FarMemManager *manager, uint8_t key_dt_id, uint8_t val_dt_id,
+               uint32_t key_size, uint32_t val_size);
+  NOT_COPYABLE(GenericBTree);
+  NOT_MOVEABLE(GenericBTree);
+  ~GenericBTree();
+
+  static uint16_t get_leaf_capacity(uint32_t key_size, uint32_t val_size);
+  template <typename V>
+  static void aggregate_value(uint8_t opcode, uint64_t *cnt, V *ret,
+                              const V &val);
+  Leaf *allocate_leaf(const DerefScope &scope, Leaf *prev);
+  void free_leaf(const DerefScope &scope, Leaf *leaf);
+  const LeafHeader *deref_leaf(const DerefScope &scope, Leaf *leaf);
+  LeafHeader *deref_leaf_mut(const DerefScope &scope, Leaf *leaf);
+  void trace_leaf(Leaf *leaf);
+
+public:
+  uint64_t size() const;
+  bool empty() const;
+  void flush();
+  void disable_prefetch();
+  void enable_prefetch();
+};
+
+template <typename K, typename V> class BTree : public GenericBTree {
+private:
+  static_assert(is_basic_dataframe_types<K>());
+  static_assert(is_basic_dataframe_types<V>());
+
+  constexpr static uint32_t kInnerNodeFanout = 64;
+  constexpr static uint64_t kNumElementsPerScope = 1024;
+
+  struct InnerNode {
+    uint32_t cnt;
+    // keys[i] is the lower bound of the keys under children[i] (i > 0).
+    K keys[kInnerNodeFanout];
+    void *children[kInnerNodeFanout];
+  };
+
+  // Points to a Leaf when height_ is 0, or to an InnerNode otherwise.
+  void *root_;
+  uint32_t height_ = 0;
+  // The inner nodes (and the child indices) visited by the last find_leaf().
+  std::vector<std::pair<InnerNode *, uint32_t>> path_;
+
+  friend class FarMemManager;
+  friend class FarMemTest;
+
+  BTree(FarMemManager *manager);
+  NOT_COPYABLE(BTree);
+  NOT_MOVEABLE(BTree);
+
+  static K *leaf_keys(const LeafHeader *header);
+  V *leaf_vals(const LeafHeader *header) const;
+  static uint32_t child_idx(const InnerNode *node, const K &key);
+  Leaf *find_leaf(const K &key, bool record_path);
+  void split_leaf(const DerefScope &scope, Leaf *leaf, LeafHeader *header);
+  void insert_child(const K &key, void *child);
+  void remove_child();
+  void free_inner_nodes(void *node, uint32_t height);
+  std::pair<uint64_t, V> aggregate(OpCode opcode, const K &lo, const K &hi);
+  std::pair<uint64_t, V> aggregate_locally(OpCode opcode, const K &lo,
+                                           const K &hi);
+  std::pair<uint64_t, V> aggregate_remotely(OpCode opcode, const K &lo,
+                                            const K &hi);
+
+public:
+  // Its lifetime is bound to the tree, and it is invalidated by the updates
+  // of the tree other than value_mut().
+  class Iterator {
+  private:
+    BTree *tree_;
+    Leaf *leaf_;
+    uint32_t pos_;
+    friend class BTree;
+
+    Iterator(BTree *tree, Leaf *leaf, uint32_t pos);
+    void skip_exhausted_leaf(const DerefScope &scope);
+
+  public:
+    void inc(const DerefScope &scope);
+    const K &key(const DerefScope &scope) const;
+    const V &value(const DerefScope &scope) const;
+    V &value_mut(const DerefScope &scope);
+    bool operator==(const Iterator &o) const;
+    bool operator!=(const Iterator &o) const;
+  };
+
+  ~BTree();
+  std::optional<V> find(const DerefScope &scope, const K &key);
+  // Inserts the pair, or assigns the value if the key exists.
+  void insert(const DerefScope &scope, const K &key, const V &value);
+  bool erase(const DerefScope &scope, const K &key);
+  // Returns the iterator of the first key that is not less than key.
+  Iterator lower_bound(const DerefScope &scope, const K &key);
+  Iterator begin(const DerefScope &scope);
+  Iterator end();
+
+  // Aggregate the values of the keys in [lo, hi). Unless disabled, they run
+  // inside the memory server next to the leaves.
+  uint64_t count_range(const K &lo, const K &hi);
+  V sum_range(const K &lo, const K &hi);
+  std::optional<V> min_range(const K &lo, const K &hi);
+  std::optional<V> max_range(const K &lo, const K &hi);
+};
+
+} // namespace far_memory
+
+#include "internal/btree.ipp"
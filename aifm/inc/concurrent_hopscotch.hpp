@@ -1,16 +1,29 @@
 #pragma once
 
 #include "sync.h"
+#include "thread.h"
 
 #include "cb.hpp"
 #include "deref_scope.hpp"
+#include "frequency_sketch.hpp"
 #include "helpers.hpp"
 #include "pointer.hpp"
+#include "rcu_lock.hpp"
 
 #include <cstdint>
 #include <memory>
 #include <optional>
 
+// Remotely fetched values are admitted into the local table as long as the
+// cache has room for them; once it has to evict, only the keys that have missed
+// often enough are admitted (TinyLFU). The exclusive hashtable drops the remote
+// copy on reads, so it always admits.
+#if defined(DISABLE_HASHTABLE_ADMISSION) || defined(HASHTABLE_EXCLUSIVE)
+#define HASHTABLE_ADMISSION 0
+#else
+#define HASHTABLE_ADMISSION 1
+#endif
+
 namespace far_memory {
 
 class GenericConcurrentHopscotch {
@@ -35,17 +48,53 @@ private:
 #pragma pack(pop)
   static_assert(sizeof(EvacNotifierMeta) == 7);
 
+  // The hash table grows by migrating the anchor buckets of a full table
+  // into the next one (twice as large) in the background. The operations on
+  // an anchor bucket that has been migrated are redirected to the next table.
+  // If the next table fills up meanwhile, it is migrated into yet another one
+  // and the chain is followed to its end.
+  struct Table {
+    const uint32_t kHashMask;
+    const uint32_t kNumEntries;
+    std::unique_ptr<uint8_t> buckets_mem;
+    BucketEntry *buckets;
+    // Set once the table starts being migrated.
+    Table *next;
+    // The anchor buckets below it have been migrated into next.
+    uint32_t num_migrated;
+
+    Table(uint32_t num_entries_shift);
+    NOT_COPYABLE(Table);
+    NOT_MOVEABLE(Table);
+  };
+
+  enum ReserveStatus { Reserved = 0, Full, Evacuating };
+
   constexpr static uint32_t kNeighborhood = 32;
   constexpr static uint32_t kMaxRetries = 2;
   constexpr static uint32_t kEvacNotifierStashSize = 1024;
-
-  const uint32_t kHashMask_;
-  const uint32_t kNumEntries_;
-  std::unique_ptr<uint8_t> buckets_mem_;
-  BucketEntry *buckets_;
+  // The batched operations work on up to this many keys at a time.
+  constexpr static uint32_t kMaxNumKeysPerBatch = 64;
+  // The admission sketch has as many counters per row as the initial local
+  // table has entries, within these bounds.
+  constexpr static uint32_t kMinAdmissionSketchShift = 10;
+  constexpr static uint32_t kMaxAdmissionSketchShift = 24;
+  // Under cache pressure, a key is admitted from its kAdmissionThreshold-th
+  // miss within the sketch window on.
+  constexpr static uint32_t kAdmissionThreshold = 2;
+
+  Table *table_;
   uint8_t ds_id_;
   CircularBuffer<EvacNotifierMeta, /* Sync = */ true, kEvacNotifierStashSize>
       evac_notifier_stash_;
+  // Guards the tables against being freed while operations walk them.
+  RCULock rcu_lock_;
+  rt::Mutex resize_mutex_;
+  bool resizing_;
+  rt::Thread resizer_;
+  // Only the misses are recorded, so that the hot keys do not make the
+  // sketch counters contended.
+  std::unique_ptr<FrequencySketch> admission_sketch_;
 
   friend class FarMemTest;
   friend class FarMemManager;
@@ -56,15 +105,35 @@ private:
                              uint64_t remote_data_size);
   NOT_COPYABLE(GenericConcurrentHopscotch);
   NOT_MOVEABLE(GenericConcurrentHopscotch);
-  bool __get(uint8_t key_len, const uint8_t *key, uint16_t *val_len,
-             uint8_t *val);
-  void forward_get(uint8_t key_len, const uint8_t *key, uint16_t *val_len,
-                   uint8_t *val);
+  bool __get(uint32_t hash, uint8_t key_len, const uint8_t *key,
+             uint16_t *val_len, uint8_t *val);
+  void forward_get(uint32_t hash, uint8_t key_len, const uint8_t *key,
+                   uint16_t *val_len, uint8_t *val);
+  void forward_get_batch(uint32_t num_keys, const uint32_t *idxes,
+                         const uint32_t *hashes, uint8_t key_len,
+                         const uint8_t *keys, uint16_t *val_lens,
+                         uint8_t *const *vals);
   void _get(uint8_t key_len, const uint8_t *key, uint16_t *val_len,
             uint8_t *val, bool *forwarded);
-  bool _put(uint8_t key_len, const uint8_t *key, uint16_t val_len,
-            const uint8_t *val, bool swap_in);
+  void _get_batch(uint32_t num_keys, uint8_t key_len, const uint8_t *keys,
+                  uint16_t *val_lens, uint8_t *const *vals);
+  bool _put(uint32_t hash, uint8_t key_len, const uint8_t *key,
+            uint16_t val_len, const uint8_t *val, bool swap_in);
+  void _put_batch(uint32_t num_keys, uint8_t key_len, const uint8_t *keys,
+                  uint16_t val_len, const uint8_t *vals, bool *key_existed);
+  void hash_and_prefetch(uint32_t num_keys, uint8_t key_len,
+                         const uint8_t *keys, uint32_t *hashes);
   bool _remove(uint8_t key_len, const uint8_t *key);
+  bool admit(uint32_t hash);
+  Table *locate(uint32_t hash);
+  Table *lock_anchor(uint32_t hash, BucketEntry **bucket);
+  ReserveStatus reserve_entry(Table *table, uint32_t anchor_idx,
+                              uint32_t *entry_idx);
+  void grow(uint32_t hash_mask);
+  void migrate(Table *from);
+  void extend(Table *table);
+  void migrate_bucket(Table *from, uint32_t bucket_idx);
+  ReserveStatus migrate_entries(BucketEntry *bucket, Table *to);
   void process_evac_notifier_stash();
   void do_evac_notifier(EvacNotifierMeta meta);
   void evac_notifier(Object object);
@@ -83,6 +152,18 @@ public:
               const uint8_t *val);
   bool remove(const DerefScope &scope, uint8_t key_len, const uint8_t *key);
   bool remove_tp(uint8_t key_len, const uint8_t *key);
+  // Batched get() and put() of the keys packed back to back in keys. The
+  // missing keys get a zero val_len, and are fetched from the remote side
+  // together.
+  void get_batch(const DerefScope &scope, uint32_t num_keys, uint8_t key_len,
+                 const uint8_t *keys, uint16_t *val_lens, uint8_t *const *vals);
+  void get_batch_tp(uint32_t num_keys, uint8_t key_len, const uint8_t *keys,
+                    uint16_t *val_lens, uint8_t *const *vals);
+  void put_batch(const DerefScope &scope, uint32_t num_keys, uint8_t key_len,
+                 const uint8_t *keys, uint16_t val_len, const uint8_t *vals,
+                 bool *key_existed);
+  void put_batch_tp(uint32_t num_keys, uint8_t key_len, const uint8_t *keys,
+                    uint16_t val_len, const uint8_t *vals, bool *key_existed);
 };
 
 template <typename K, typename V>
@@ -95,6 +176,8 @@ private:
   std::optional<V> _find(const K &key);
   void _insert(const K &key, const V &value);
   bool _erase(const K &key);
+  void _find_batch(uint32_t num_keys, const K *keys, std::optional<V> *vals);
+  void _insert_batch(uint32_t num_keys, const K *keys, const V *vals);
   ConcurrentHopscotch(uint8_t ds_id, uint32_t local_num_entries_shift,
                       uint32_t remote_num_entries_shift,
                       uint64_t remote_data_size);
@@ -110,6 +193,12 @@ public:
   void insert_tp(const K &key, const V &value);
   bool erase(const DerefScope &scope, const K &key);
   bool erase_tp(const K &key);
+  void find_batch(const DerefScope &scope, uint32_t num_keys, const K *keys,
+                  std::optional<V> *vals);
+  void find_batch_tp(uint32_t num_keys, const K *keys, std::optional<V> *vals);
+  void insert_batch(const DerefScope &scope, uint32_t num_keys, const K *keys,
+                    const V *vals);
+  void insert_batch_tp(uint32_t num_keys, const K *keys, const V *vals);
 };
 
 } // namespace far_memory
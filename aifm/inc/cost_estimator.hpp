@@ -30,7 +30,8 @@ class CostEstimator {
         compute_in_processor_time_(0),
         ret_time_(0),
         pm_ratio_(kDefaultPMRatio),
-        pushdown_ratio_(kDefaultPushdownRatio) {}
+        pushdown_ratio_(kDefaultPushdownRatio),
+        pushdown_disabled_(false) {}
 
   void SetUserData(void *user_data) { user_data_ = user_data; }
   void *GetUserData() { return user_data_; }
@@ -50,8 +51,8 @@ class CostEstimator {
   }
   virtual void ComputeInMemoryOver(uint64_t ret_bytes) {
     uint64_t us = EndBench();
-    uint64_t rtime = (ret_bytes * kSToUs) / internet_speed_;
-    uint64_t mtime = us - rtime;
+    uint64_t rtime = (ret_bytes * kSToUs) / InternetSpeed();
+    uint64_t mtime = (us > rtime) ? (us - rtime) : 1;
     uint64_t ptime = static_cast<uint64_t>(static_cast<double>(mtime) * pm_ratio_);
 //    COST_LOG("compute in memory return %ld bytes with %ld us, rtime: %ld, mtime: %ld, ptime: %ld",
 //             ret_bytes, us, rtime, mtime, ptime);
@@ -67,19 +68,25 @@ class CostEstimator {
   }
   virtual void ComputeInProcessorOver(uint64_t load_bytes) {
     uint64_t us = EndBench();
-    uint64_t ptime = us - ((load_bytes * kSToUs) / internet_speed_);
+    uint64_t ltime = (load_bytes * kSToUs) / InternetSpeed();
+    uint64_t ptime = (us > ltime) ? (us - ltime) : 1;
 //    COST_LOG("compute in processor load %ld bytes with %ld us, ptime: %ld",
 //             load_bytes, us, ptime);
     compute_in_processor_time_ = (compute_in_processor_time_ + ptime) >> 1;
+    if (compute_in_memory_time_ == 0) return; // 还未下推过
     pm_ratio_ = static_cast<double>(compute_in_processor_time_) /
         static_cast<double>(compute_in_memory_time_);
 //    COST_LOG("pm_ratio change to %f", pm_ratio_);
   }
 
+  // 下推失败（如服务端未注册该方法）后不再建议下推
+  void DisablePushdown() { pushdown_disabled_ = true; }
+
   virtual bool SuggestPushdown(uint64_t flush_bytes, uint64_t load_bytes) {
+    if (pushdown_disabled_) return false;
     if (compute_in_memory_time_ == 0) return true;
-    uint64_t ptime = (flush_bytes * kSToUs) / internet_speed_ + compute_in_memory_time_ + ret_time_;
-    uint64_t nptime = (load_bytes * kSToUs) / internet_speed_ + compute_in_processor_time_;
+    uint64_t ptime = (flush_bytes * kSToUs) / InternetSpeed() + compute_in_memory_time_ + ret_time_;
+    uint64_t nptime = (load_bytes * kSToUs) / InternetSpeed() + compute_in_processor_time_;
     uint64_t tmp = static_cast<uint64_t>(static_cast<double>(ptime) * pushdown_ratio_);
     COST_LOG("suggest_pushdown(flush %ld bytes, load %ld bytes, ptime: %ld, nptime: %ld, tmp: %ld): %s",
              flush_bytes, load_bytes, ptime, nptime, tmp,
@@ -90,7 +97,11 @@ class CostEstimator {
  protected:
   virtual uint64_t EndBench() {
     auto end = std::chrono::steady_clock::now();
-    return std::chrono::duration_cast<std::chrono::microseconds>(end - start_).count();
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(end - start_).count();
+    return (us == 0) ? 1 : us;
+  }
+  uint64_t InternetSpeed() const {
+    return (internet_speed_ == 0) ? kDefaultInternetSpeed : internet_speed_;
   }
 
   uint64_t internet_speed_; // 单位为 byte/s
@@ -99,6 +110,7 @@ class CostEstimator {
   uint64_t ret_time_; // 单位为 us
   double pm_ratio_; // processor计算时间 / memory计算时间
   double pushdown_ratio_;
+  bool pushdown_disabled_;
   std::chrono::steady_clock::time_point start_;
   void *user_data_;
 };
@@ -45,10 +45,16 @@
 #define DISABLE_OFFLOAD_AGGREGATE 0
 #endif
 
+#ifdef DISABLE_OFFLOAD_SORTED_INDICES
+#define DISABLE_OFFLOAD_SORTED_INDICES 1
+#else
+#define DISABLE_OFFLOAD_SORTED_INDICES 0
+#endif
+
 #define DISABLE_OFFLOAD                                                        \
   (DISABLE_OFFLOAD_UNIQUE & DISABLE_OFFLOAD_COPY_DATA_BY_IDX &                 \
    DISABLE_OFFLOAD_SHUFFLE_DATA_BY_IDX & DISABLE_OFFLOAD_ASSIGN &              \
-   DISABLE_OFFLOAD_AGGREGATE)
+   DISABLE_OFFLOAD_AGGREGATE & DISABLE_OFFLOAD_SORTED_INDICES)
 
 namespace far_memory {
 
@@ -64,7 +70,8 @@ private:
     Assign,
     AggregateMax,
     AggregateMin,
-    AggregateMedian
+    AggregateMedian,
+    SortedIndices
   };
 
   uint32_t chunk_size_;
@@ -137,6 +144,7 @@ private:
   bool dynamic_prefetch_enabled_ = true;  
 
   friend class FarMemTest;
+  template <typename U> friend class DataFrameVector;
   template <typename U> friend class ServerDataFrameVector;
 
   // STL compatible, but slower (since it takes GC sync overhead per
@@ -227,6 +235,12 @@ private:
   template <bool Ascending = true>
   void _get_sorted_indices_counting_sort(
       DataFrameVector<unsigned long long> *indices);
+  template <bool Ascending = true>
+  void _get_sorted_indices_radix_sort(
+      FarMemManager *manager, DataFrameVector<unsigned long long> *indices);
+  template <bool Ascending = true>
+  void
+  _get_sorted_indices_remotely(DataFrameVector<unsigned long long> *indices);
   template <typename U>
   DataFrameVector<T> aggregate_locally(FarMemManager *manager, const U &key_vec,
                                        OpCode opcode);
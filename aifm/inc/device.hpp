@@ -4,13 +4,41 @@ extern "C" {
 #include <runtime/tcp.h>
 }
 
+#include "sync.h"
+#include "thread.h"
+
 #include "helpers.hpp"
+#include "object.hpp"
 #include "server.hpp"
-#include "shared_pool.hpp"
 #include "rpc_serializer.hpp"
+#include "rpc_stream.hpp"
+
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
 
 namespace far_memory {
 
+// An entry of FarMemDevice::read_objects().
+struct ObjectReadReq {
+  uint8_t ds_id;
+  uint8_t obj_id_len;
+  const uint8_t *obj_id;
+  uint16_t *data_len;
+  uint8_t *data_buf;
+};
+
+// An entry of FarMemDevice::write_objects().
+struct ObjectWriteReq {
+  uint8_t ds_id;
+  uint8_t obj_id_len;
+  const uint8_t *obj_id;
+  uint16_t data_len;
+  const uint8_t *data_buf;
+};
+
 class FarMemDevice {
 public:
   uint64_t far_mem_size_;
@@ -26,6 +54,10 @@ public:
   virtual void write_object(uint8_t ds_id, uint8_t obj_id_len,
                             const uint8_t *obj_id, uint16_t data_len,
                             const uint8_t *data_buf) = 0;
+  // Batched variants of read_object() and write_object(). By default they
+  // fall back to one request per object.
+  virtual void read_objects(uint32_t num_objs, const ObjectReadReq *reqs);
+  virtual void write_objects(uint32_t num_objs, const ObjectWriteReq *reqs);
   virtual bool remove_object(uint64_t ds_id, uint8_t obj_id_len,
                              const uint8_t *obj_id) = 0;
   virtual void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
@@ -35,9 +67,28 @@ public:
                        const uint8_t *input_buf, uint16_t *output_len,
                        uint8_t *output_buf) = 0;
 
-  virtual bool call(uint8_t ds_id, const std::string &method, const rpc::BufferPtr &args,
-                    rpc::BufferPtr &ret) {
-    return false;
+  // A device without a server side finds no method.
+  virtual rpc::RpcErrorCode call(uint8_t ds_id, rpc::MethodID method_id,
+                                 const rpc::BufferPtr &args,
+                                 rpc::BufferPtr &ret) {
+    return rpc::RpcErrorCode::kMethodNotFound;
+  }
+  // Hands the return value over to chunk_fn chunk by chunk, in the calling
+  // thread, as the server produces it. By default, the return value comes in a
+  // single chunk.
+  virtual rpc::RpcErrorCode
+  call_stream(uint8_t ds_id, rpc::MethodID method_id,
+              const rpc::BufferPtr &args,
+              const rpc::StreamReader::ChunkFn &chunk_fn) {
+    rpc::BufferPtr ret;
+    auto error_code = call(ds_id, method_id, args, ret);
+    if (error_code != rpc::RpcErrorCode::kSuccess) {
+      return error_code;
+    }
+    if (ret && ret->ReadableBytes()) {
+      chunk_fn(ret);
+    }
+    return error_code;
   }
 };
 
@@ -65,32 +116,116 @@ public:
 class TCPDevice : public FarMemDevice {
 private:
   constexpr static uint32_t kPrefetchWinSize = 1 << 20;
+  constexpr static uint32_t kMaxNumInflightReqs = 64;
+  constexpr static uint32_t kMaxNumQueuedChunks = 8;
+
+  // The chunks of a streamed response, handed over from the receiver to the
+  // requester. It is shared by both, since the requester may return as soon as
+  // the last chunk is queued. Once kMaxNumQueuedChunks chunks are queued, the
+  // receiver stops reading the connection until the requester catches up,
+  // which pushes back on the server through TCP.
+  struct ChunkQueue {
+    rt::Spin spin;
+    rt::CondVar condvar;
+    rt::CondVar space_condvar;
+    std::deque<rpc::BufferPtr> chunks;
+    bool done = false;
+  };
+
+  // Where the receiver puts the response of an in-flight request.
+  struct Response {
+    // The fixed-size part of the response. When has_body is set, it is the
+    // 2B length of the body that follows.
+    uint8_t *head;
+    uint32_t head_len;
+    bool has_body = false;
+    uint8_t *body = nullptr;
+    // If set, the body is read into a buffer allocated by the receiver.
+    rpc::BufferPtr *body_buffer = nullptr;
+    // If set, the response is a sequence of |data_len(2B)|data| which is
+    // scattered into the read requests; head is unused.
+    const ObjectReadReq *read_reqs = nullptr;
+    uint32_t num_read_reqs = 0;
+    // If set, the response is a sequence of |chunk_len(4B)|chunk| frames,
+    // which may interleave with the frames of other requests; head is unused.
+    std::shared_ptr<ChunkQueue> chunk_queue;
+    rt::WaitGroup *completion = nullptr;
+  };
+
+  // A slave connection multiplexing up to kMaxNumInflightReqs requests. The
+  // requests are tagged by their IDs, and the responses, which may come back
+  // out of order, are dispatched by a dedicated receiver thread.
+  class Connection {
+  private:
+    tcpconn_t *remote_slave_;
+    rt::Mutex write_mutex_;
+    rt::Spin req_ids_spin_;
+    rt::CondVar req_ids_condvar_;
+    std::vector<uint16_t> free_req_ids_;
+    Response *inflight_resps_[kMaxNumInflightReqs];
+    rt::Thread receiver_;
+
+    uint16_t allocate_req_id(Response *resp);
+    void free_req_id(uint16_t req_id);
+    void receive_chunk(ChunkQueue *chunk_queue);
+    void receiver_fn();
+
+  public:
+    Connection(tcpconn_t *remote_slave);
+    ~Connection();
+    NOT_COPYABLE(Connection);
+    NOT_MOVEABLE(Connection);
+    // The request is gathered from the iovecs, which are consumed. The first
+    // one starts with |OpCode (1B)|ReqID (2B)|, where ReqID is filled here.
+    // It blocks until the whole response is received into *resp.
+    void round_trip(iovec *req_iovecs, int num_req_iovecs, Response *resp);
+    // Ditto, but the response is streamed, and each chunk is handed over to
+    // chunk_fn in the calling thread once received. A slow chunk_fn stalls
+    // the other responses on the connection, so chunk_fn must not wait for
+    // them.
+    void round_trip_stream(
+        iovec *req_iovecs, int num_req_iovecs,
+        const std::function<void(const rpc::BufferPtr &)> &chunk_fn);
+  };
 
   tcpconn_t *remote_master_;
-  SharedPool<tcpconn_t *> shared_pool_;
-
-  void _read_object(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t obj_id_len,
-                    const uint8_t *obj_id, uint16_t *data_len,
-                    uint8_t *data_buf);
-  void _write_object(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t obj_id_len,
-                     const uint8_t *obj_id, uint16_t data_len,
-                     const uint8_t *data_buf);
-  bool _remove_object(tcpconn_t *remote_slave, uint64_t ds_id,
+  std::vector<std::unique_ptr<Connection>> connections_;
+  std::atomic<uint32_t> next_connection_idx_{0};
+
+  Connection *pick_connection();
+  void _read_object(Connection *remote_slave, uint8_t ds_id,
+                    uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t *data_len, uint8_t *data_buf);
+  void _write_object(Connection *remote_slave, uint8_t ds_id,
+                     uint8_t obj_id_len, const uint8_t *obj_id,
+                     uint16_t data_len, const uint8_t *data_buf);
+  void _read_objects(Connection *remote_slave, uint32_t num_objs,
+                     const ObjectReadReq *reqs);
+  void _write_objects(Connection *remote_slave, uint32_t num_objs,
+                      const ObjectWriteReq *reqs);
+  bool _remove_object(Connection *remote_slave, uint64_t ds_id,
                       uint8_t obj_id_len, const uint8_t *obj_id);
-  void _construct(tcpconn_t *remote_slave, uint8_t ds_type, uint8_t ds_id,
+  void _construct(Connection *remote_slave, uint8_t ds_type, uint8_t ds_id,
                   uint8_t param_len, uint8_t *params);
-  void _destruct(tcpconn_t *remote_slave, uint8_t ds_id);
-  void _compute(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t opcode,
+  void _destruct(Connection *remote_slave, uint8_t ds_id);
+  void _compute(Connection *remote_slave, uint8_t ds_id, uint8_t opcode,
                 uint16_t input_len, const uint8_t *input_buf,
                 uint16_t *output_len, uint8_t *output_buf);
-  bool _call(tcpconn_t *remote_slave, uint8_t ds_id,
-             const std::string &method, const rpc::BufferPtr &args,
-             rpc::BufferPtr &ret);
+  rpc::RpcErrorCode _call_stream(Connection *remote_slave, uint8_t ds_id,
+                                 rpc::MethodID method_id,
+                                 const rpc::BufferPtr &args,
+                                 const rpc::StreamReader::ChunkFn &chunk_fn);
 
  public:
   // TCPDevice talks to remote agent via TCP.
-  // Request format:
+  // Master connection request format:
   //     |OpCode (1B)|Data (optional)|
+  // Slave connection request format:
+  //     |OpCode (1B)|ReqID (2B)|Data (optional)|
+  // Slave connection response format:
+  //     |ReqID (2B)|Data|
+  // Multiple requests can be in flight on a slave connection, and their
+  // responses may arrive out of order.
   // All possible OpCode:
   //     0. init
   //     1. shutdown
@@ -101,11 +236,21 @@ private:
   //     6. destruct
   //     7. compute
   //     8. call
+  //     9. read_objects
+  //     10. write_objects
   constexpr static uint32_t kOpcodeSize = 1;
+  constexpr static uint32_t kReqIDSize = sizeof(uint16_t);
+  constexpr static uint32_t kReqHeaderSize = kOpcodeSize + kReqIDSize;
   constexpr static uint32_t kPortSize = 2;
-  constexpr static uint32_t kLargeDataSize = 512;
   constexpr static uint32_t kMaxComputeDataLen = 65535;
-  constexpr static uint32_t kMaxCallDataLen = 65535;
+  constexpr static uint32_t kMaxCallDataLen =
+      std::numeric_limits<uint32_t>::max();
+  // Set in the chunk_len of the last chunk of a streamed call response.
+  constexpr static uint32_t kLastChunkFlag = 1U << 31;
+  constexpr static uint32_t kMaxCallChunkLen = kLastChunkFlag - 1;
+  constexpr static uint32_t kMaxBatchPayloadLen = 1 << 18;
+  constexpr static uint32_t kMaxNumObjsPerBatch =
+      std::numeric_limits<uint16_t>::max();
 
   constexpr static uint8_t kOpInit = 0;
   constexpr static uint8_t kOpShutdown = 1;
@@ -116,6 +261,8 @@ private:
   constexpr static uint8_t kOpDeconstruct = 6;
   constexpr static uint8_t kOpCompute = 7;
   constexpr static uint8_t kOpCall = 8;
+  constexpr static uint8_t kOpReadObjects = 9;
+  constexpr static uint8_t kOpWriteObjects = 10;
 
   TCPDevice(netaddr raddr, uint32_t num_connections, uint64_t far_mem_size);
   ~TCPDevice();
@@ -123,6 +270,8 @@ private:
                    uint16_t *data_len, uint8_t *data_buf);
   void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
+  void read_objects(uint32_t num_objs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_objs, const ObjectWriteReq *reqs);
   bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
   void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
                  uint8_t *params);
@@ -131,8 +280,216 @@ private:
                const uint8_t *input_buf, uint16_t *output_len,
                uint8_t *output_buf);
 
-  bool call(uint8_t ds_id, const std::string &method, const rpc::BufferPtr &args,
-            rpc::BufferPtr &ret);
+  rpc::RpcErrorCode call(uint8_t ds_id, rpc::MethodID method_id,
+                         const rpc::BufferPtr &args, rpc::BufferPtr &ret);
+  rpc::RpcErrorCode call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                                const rpc::BufferPtr &args,
+                                const rpc::StreamReader::ChunkFn &chunk_fn);
+};
+
+// StorageDevice keeps the vanilla ptr objects in local storage, either an NVMe
+// namespace driven by the Shenango runtime or a file opened with O_DIRECT
+// (mostly for testing). The remote object ID is the byte offset in the storage,
+// and the objects are laid out just as ServerPtr does in memory, so the
+// far-mem GC computations run on the region images read from storage.
+// Objects smaller than a block share it with their neighbours; writes do
+// read-modify-write of the covering blocks under a per-region lock, and the
+// batched variants merge the objects of nearby blocks into one I/O.
+// Other DS types are not supported.
+class StorageDevice : public FarMemDevice {
+private:
+  constexpr static uint32_t kPrefetchWinSize = 1 << 20;
+  constexpr static uint32_t kFileBlockSize = 4096;
+  constexpr static uint32_t kMaxBatchIOLen = 1 << 18;
+
+  int fd_ = -1;
+  uint32_t block_size_;
+  std::unique_ptr<rt::Mutex[]> region_mutexes_;
+
+  void init();
+  uint8_t *allocate_block_buf(uint64_t len);
+  void read_blocks(uint64_t lba, uint64_t num_blocks, uint8_t *buf);
+  void write_blocks(uint64_t lba, uint64_t num_blocks, const uint8_t *buf);
+  void read_range(uint64_t offset, uint32_t len, uint8_t *buf);
+  // The caller holds the lock of the region covering the range.
+  void write_range(uint64_t offset, uint32_t len, const uint8_t *buf);
+  rt::Mutex &region_mutex(uint64_t offset);
+  static bool has_back_ref(uint8_t obj_id_len);
+  static uint64_t get_offset(const uint8_t *obj_id);
+  static uint32_t encode_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                                uint16_t data_len, const uint8_t *data_buf,
+                                uint8_t *image);
+  void compute_free_objects(uint16_t input_len, const uint8_t *input_buf);
+  void compute_list_objects(uint16_t input_len, const uint8_t *input_buf,
+                            uint16_t *output_len, uint8_t *output_buf);
+  void compute_move_objects(uint16_t input_len, const uint8_t *input_buf);
+  void compute_reset_region(uint16_t input_len, const uint8_t *input_buf);
+  void compute_read_region(uint16_t input_len, const uint8_t *input_buf,
+                           uint16_t *output_len, uint8_t *output_buf);
+  void compute_write_region(uint16_t input_len, const uint8_t *input_buf);
+
+public:
+  // Uses the NVMe namespace of the runtime (enable_storage in the config).
+  StorageDevice(uint64_t far_mem_size);
+  // Uses the file at file_path, which is truncated to far_mem_size.
+  StorageDevice(const std::string &file_path, uint64_t far_mem_size);
+  ~StorageDevice();
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  void read_objects(uint32_t num_objs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_objs, const ObjectWriteReq *reqs);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
+};
+
+// TieredDevice composes a fast device (e.g., a TCPDevice) and a slow one
+// (e.g., a StorageDevice) that cover the same far-mem space. Since the vanilla
+// ptr objects are laid out in remote regions, which the far-mem GC lists and
+// resets as a whole, the tiering unit is the remote region: each region lives
+// in one tier. A background thread promotes the slow regions that are read
+// frequently and demotes the written fast regions that stay unread, by
+// copying their raw image and resetting the source region. The objects of
+// the other DS types always stay in the fast device.
+class TieredDevice : public FarMemDevice {
+private:
+  constexpr static uint8_t kFastTier = 0;
+  constexpr static uint8_t kSlowTier = 1;
+  constexpr static uint64_t kTieringIntervalUs = 10 * 1000;
+  // Cold regions are demoted and read counters are halved once per epoch.
+  constexpr static uint32_t kNumIntervalsPerEpoch = 100;
+  constexpr static uint32_t kNumColdEpochsToDemote = 2;
+  constexpr static uint32_t kNumReadsToPromote = 8;
+  constexpr static uint32_t kMaxNumDemotionsPerEpoch = 16;
+
+  struct RegionState {
+    std::atomic<int32_t> num_inflights{0};
+    std::atomic<bool> migrating{false};
+    std::atomic<uint32_t> num_reads{0};
+    uint8_t tier = kFastTier;
+    bool written = false;
+    uint8_t num_cold_epochs = 0;
+  };
+
+  std::unique_ptr<FarMemDevice> fast_device_;
+  std::unique_ptr<FarMemDevice> slow_device_;
+  std::unique_ptr<RegionState[]> region_states_;
+  uint32_t num_regions_;
+  bool exit_ = false;
+  rt::Thread tiering_thread_;
+
+  FarMemDevice *get_device(uint8_t tier);
+  static uint32_t get_region_idx(uint64_t offset);
+  static uint32_t get_region_idx(const uint8_t *obj_id);
+  // Pins the region to its current tier, which is returned.
+  uint8_t enter_region(uint32_t region_idx);
+  void exit_region(uint32_t region_idx);
+  // Sorts and dedups the regions, enters them and returns their tiers.
+  void enter_regions(std::vector<uint32_t> *region_idxes,
+                     std::vector<uint8_t> *tiers);
+  void exit_regions(const std::vector<uint32_t> &region_idxes);
+  static uint8_t get_tier(const std::vector<uint32_t> &region_idxes,
+                          const std::vector<uint8_t> &tiers,
+                          uint32_t region_idx);
+  // Waits for the in-flight operations and blocks the new ones.
+  void lock_region(uint32_t region_idx);
+  void unlock_region(uint32_t region_idx);
+  void migrate_region(uint32_t region_idx, uint8_t to_tier);
+  void tiering_fn();
+  void compute_free_objects(uint16_t input_len, const uint8_t *input_buf);
+  void compute_move_objects(uint16_t input_len, const uint8_t *input_buf);
+  void compute_reset_region(uint16_t input_len, const uint8_t *input_buf);
+
+public:
+  // Takes the ownership of both devices.
+  TieredDevice(FarMemDevice *fast_device, FarMemDevice *slow_device);
+  ~TieredDevice();
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  void read_objects(uint32_t num_objs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_objs, const ObjectWriteReq *reqs);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
+  rpc::RpcErrorCode call(uint8_t ds_id, rpc::MethodID method_id,
+                         const rpc::BufferPtr &args, rpc::BufferPtr &ret);
+  rpc::RpcErrorCode call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                                const rpc::BufferPtr &args,
+                                const rpc::StreamReader::ChunkFn &chunk_fn);
+  uint32_t get_num_slow_regions();
+};
+
+// CompressingDevice wraps another device and compresses the objects it stores
+// there. A stored object is |Codec (1B)|Payload|, where the codec is picked
+// per object: snappy if it shrinks the data enough, raw otherwise.
+// Only the DS types whose remote side keeps opaque variable-length values are
+// compressed. The others are passed through, since the far-mem GC region
+// walker and the server-side computations rely on their exact object sizes.
+class CompressingDevice : public FarMemDevice {
+private:
+  constexpr static uint8_t kCodecRaw = 0;
+  constexpr static uint8_t kCodecSnappy = 1;
+  constexpr static uint32_t kCodecSize = sizeof(uint8_t);
+  // The stored object, codec included, is bounded by what the server side
+  // can hold. The compressed DS types leave room for the codec, e.g., the
+  // hashtable objects carry their evac notifier metadata locally only.
+  constexpr static uint32_t kMaxStoredDataLen = Object::kMaxObjectDataSize;
+  // Smaller objects are always stored raw.
+  constexpr static uint32_t kMinCompressDataLen = 64;
+  // Snappy is used only if it saves at least 1 / kMinSavingDenom of the data.
+  constexpr static uint32_t kMinSavingDenom = 8;
+  // After kMaxNumMisses consecutive incompressible objects of a DS, only every
+  // kProbeInterval-th object of it is tried.
+  constexpr static uint32_t kMaxNumMisses = 16;
+  constexpr static uint32_t kProbeInterval = 64;
+
+  std::unique_ptr<FarMemDevice> device_;
+  bool compressed_ds_ids_[kMaxNumDSIDs];
+  uint32_t num_misses_[kMaxNumDSIDs];
+
+  static bool is_compressible_ds_type(uint8_t ds_type);
+  bool should_try_compress(uint8_t ds_id, uint16_t data_len);
+  uint16_t encode(uint8_t ds_id, uint16_t data_len, const uint8_t *data_buf,
+                  uint8_t *stored_buf);
+  void decode(uint16_t stored_len, const uint8_t *stored_buf,
+              uint16_t *data_len, uint8_t *data_buf);
+  bool any_compressed(uint32_t num_objs, const ObjectReadReq *reqs) const;
+  bool any_compressed(uint32_t num_objs, const ObjectWriteReq *reqs) const;
+
+public:
+  // Takes the ownership of device.
+  CompressingDevice(FarMemDevice *device);
+  ~CompressingDevice();
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  void read_objects(uint32_t num_objs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_objs, const ObjectWriteReq *reqs);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
+  rpc::RpcErrorCode call(uint8_t ds_id, rpc::MethodID method_id,
+                         const rpc::BufferPtr &args, rpc::BufferPtr &ret);
+  rpc::RpcErrorCode call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                                const rpc::BufferPtr &args,
+                                const rpc::StreamReader::ChunkFn &chunk_fn);
 };
 
 } // namespace far_memory
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace far_memory {
+
+// A TinyLFU frequency sketch of the key hashes: a doorkeeper Bloom filter that
+// absorbs the first access of each key, in front of a Count-Min sketch of
+// 4-bit counters. After a window of 2^kSampleFactorShift accesses per counter,
+// the counters are halved and the doorkeeper is cleared, so that the estimates
+// age out. The aging pass is spread over the following accesses, each of which
+// ages kAgingSliceWords words, so that no access stalls on the whole sketch.
+// The updates are lock-free and may be lost under races, which only makes the
+// estimates a bit lower.
+class FrequencySketch {
+private:
+  constexpr static uint32_t kNumRows = 4;
+  constexpr static uint32_t kCounterBits = 4;
+  constexpr static uint32_t kMaxCount = (1 << kCounterBits) - 1;
+  constexpr static uint32_t kCountersPerWord = 64 / kCounterBits;
+  constexpr static uint32_t kSampleFactorShift = 4;
+  constexpr static uint32_t kNumDoorkeeperHashes = 2;
+  constexpr static uint32_t kAgingSliceWords = 128;
+  constexpr static uint32_t kSeeds[kNumRows + kNumDoorkeeperHashes] = {
+      0x97CB3127, 0xB492B66F, 0x9AE16A3B, 0xC2B2AE35, 0x85EBCA6B, 0x27D4EB2F};
+
+  const uint32_t kIdxMask_;
+  // The doorkeeper has a bit per expected key of the sample window.
+  const uint32_t kDoorkeeperMask_;
+  const uint64_t kSampleSize_;
+  const uint64_t kNumCounterWords_;
+  const uint64_t kNumDoorkeeperWords_;
+  std::unique_ptr<uint64_t[]> counters_;
+  std::unique_ptr<uint64_t[]> doorkeeper_;
+  uint64_t num_samples_;
+  // The words of the counters and then of the doorkeeper are aged in slices.
+  // A pass is started by the access that fills the window.
+  bool aging_;
+  uint64_t next_aging_word_;
+  uint64_t num_aged_words_;
+
+  static uint32_t rehash(uint32_t hash, uint32_t seed_idx);
+  uint64_t *counter_word(uint32_t row, uint32_t idx) const;
+  bool doorkeeper_test_and_set(uint32_t hash);
+  bool doorkeeper_contains(uint32_t hash) const;
+  uint32_t sketch_estimate(uint32_t hash) const;
+  void sketch_increment(uint32_t hash);
+  void start_aging();
+  void age_slice();
+
+public:
+  // Each row has 2^num_counters_shift counters.
+  FrequencySketch(uint32_t num_counters_shift);
+  NOT_COPYABLE(FrequencySketch);
+  NOT_MOVEABLE(FrequencySketch);
+  // Records an access of the key hash, and returns its estimated frequency
+  // including this access.
+  uint32_t record(uint32_t hash);
+  uint32_t estimate(uint32_t hash) const;
+};
+
+} // namespace far_memory
+
+#include "internal/frequency_sketch.ipp"
@@ -66,9 +66,13 @@ constexpr uint8_t kHugepageShift = 21;
 constexpr uint32_t kHugepageSize = (1 << kHugepageShift);
 constexpr uint8_t kNumCPUs = 20;
 constexpr uint8_t kNumSocket1CPUs = 24;
+constexpr uint8_t kMaxNumNUMANodes = 4;
 
 static uint64_t round_to_hugepage_size(uint64_t size);
 static void *allocate_hugepage(uint64_t size);
+static uint32_t get_num_configured_cpus();
+static uint32_t get_numa_node_of_core(uint32_t core_id);
+static void bind_to_numa_node(void *ptr, uint64_t size, uint32_t node);
 static int get_num_cores();
 static void timer_start(unsigned *cycles_high_start,
                         unsigned *cycles_low_start);
@@ -96,6 +100,7 @@ static void tcp_read_until(tcpconn_t *c, void *buf, size_t expect);
 static void tcp_write_until(tcpconn_t *c, const void *buf, size_t expect);
 static void tcp_write2_until(tcpconn_t *c, const void *buf_0, size_t expect_0,
                              const void *buf_1, size_t expect_1);
+static void tcp_writev_until(tcpconn_t *c, iovec *iovecs, int num_iovecs);
 static constexpr size_t static_log(uint64_t b, uint64_t n);
 static uint32_t align_to(uint32_t n, uint32_t factor);
 static uint64_t align_to(uint64_t n, uint64_t factor);
@@ -34,6 +34,15 @@ FORCE_INLINE GenericUniquePtr *GenericArray::at(bool nt, Index_t idx) {
   return &ptrs_[idx];
 }
 
+template <typename F>
+FORCE_INLINE rpc::Stub<F> GenericArray::get_stub(const std::string &name) {
+  return rpc::Stub<F>(
+      [this, method = get_method(name)](const rpc::BufferPtr &args,
+                                        rpc::BufferPtr &ret) {
+        return call(method, args, ret);
+      });
+}
+
 template <typename T, uint64_t... Dims>
 FORCE_INLINE Array<T, Dims...>::Array(FarMemManager *manager)
     : GenericArray(manager, sizeof(T), kSize) {}
@@ -117,8 +126,8 @@ template <typename T, uint64_t... Dims>
 template <bool Nt, typename... Indices>
 FORCE_INLINE T &Array<T, Dims...>::at_mut(const DerefScope &scope,
                                           Indices... indices) noexcept {
-  dirty_ = true;
   auto idx = get_flat_idx(indices...);
+  dirty_tracker_.mark(idx);
   auto ptr = reinterpret_cast<UniquePtr<T> *>(GenericArray::at(Nt, idx));
   return *(ptr->template deref_mut<Nt>(scope));
 }
@@ -0,0 +1,463 @@
+#pragma once
+
+#include "manager.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace far_memory {
+
+FORCE_INLINE GenericBTree::Pattern_t GenericBTree::induce_fn(Index_t idx_0,
+                                                             Index_t idx_1) {
+  auto *leaf = reinterpret_cast<Leaf *>(idx_0);
+  if (!leaf) {
+    return 0;
+  }
+  if (reinterpret_cast<Index_t>(ACCESS_ONCE(leaf->next)) == idx_1) {
+    return 1;
+  }
+  if (reinterpret_cast<Index_t>(ACCESS_ONCE(leaf->prev)) == idx_1) {
+    return -1;
+  }
+  return 0;
+}
+
+FORCE_INLINE GenericBTree::Index_t GenericBTree::infer_fn(Index_t idx,
+                                                          Pattern_t hops) {
+  auto *leaf = hops ? reinterpret_cast<Leaf *>(idx) : nullptr;
+  for (; leaf && hops > 0; hops--) {
+    leaf = ACCESS_ONCE(leaf->next);
+  }
+  for (; leaf && hops < 0; hops++) {
+    leaf = ACCESS_ONCE(leaf->prev);
+  }
+  return reinterpret_cast<Index_t>(leaf);
+}
+
+FORCE_INLINE GenericUniquePtr *GenericBTree::mapping_fn(uint8_t *&state,
+                                                        Index_t idx) {
+  return idx ? &(reinterpret_cast<Leaf *>(idx)->ptr) : nullptr;
+}
+
+FORCE_INLINE uint16_t GenericBTree::get_leaf_capacity(uint32_t key_size,
+                                                      uint32_t val_size) {
+  return (kLeafSize - kLeafHeaderSize) / (key_size + val_size);
+}
+
+template <typename V>
+FORCE_INLINE void GenericBTree::aggregate_value(uint8_t opcode, uint64_t *cnt,
+                                                V *ret, const V &val) {
+  switch (opcode) {
+  case OpCode::Count:
+    break;
+  case OpCode::Sum:
+    if constexpr (std::is_arithmetic<V>::value) {
+      *ret = *cnt ? *ret + val : val;
+    } else {
+      BUG();
+    }
+    break;
+  case OpCode::Min:
+    if (!*cnt || val < *ret) {
+      *ret = val;
+    }
+    break;
+  case OpCode::Max:
+    if (!*cnt || *ret < val) {
+      *ret = val;
+    }
+    break;
+  default:
+    BUG();
+  }
+  (*cnt)++;
+}
+
+FORCE_INLINE const GenericBTree::LeafHeader *
+GenericBTree::deref_leaf(const DerefScope &scope, Leaf *leaf) {
+  return static_cast<const LeafHeader *>(leaf->ptr.deref(scope));
+}
+
+FORCE_INLINE GenericBTree::LeafHeader *
+GenericBTree::deref_leaf_mut(const DerefScope &scope, Leaf *leaf) {
+  dirty_ = true;
+  return static_cast<LeafHeader *>(leaf->ptr.deref_mut(scope));
+}
+
+FORCE_INLINE void GenericBTree::trace_leaf(Leaf *leaf) {
+  if (ACCESS_ONCE(dynamic_prefetch_enabled_)) {
+    prefetcher_.add_trace(/* nt = */ false, reinterpret_cast<Index_t>(leaf));
+  }
+}
+
+FORCE_INLINE uint64_t GenericBTree::size() const { return size_; }
+
+FORCE_INLINE bool GenericBTree::empty() const { return size_ == 0; }
+
+template <typename K, typename V>
+FORCE_INLINE BTree<K, V>::BTree(FarMemManager *manager)
+    : GenericBTree(manager, get_dataframe_type_id<K>(),
+                   get_dataframe_type_id<V>(), sizeof(K), sizeof(V)) {
+  // The tree always has a (possibly empty) leaf.
+  DerefScope scope;
+  root_ = allocate_leaf(scope, nullptr);
+}
+
+template <typename K, typename V> FORCE_INLINE BTree<K, V>::~BTree() {
+  free_inner_nodes(root_, height_);
+}
+
+template <typename K, typename V>
+void BTree<K, V>::free_inner_nodes(void *node, uint32_t height) {
+  if (!height) {
+    return;
+  }
+  auto *inner_node = static_cast<InnerNode *>(node);
+  for (uint32_t i = 0; i < inner_node->cnt; i++) {
+    free_inner_nodes(inner_node->children[i], height - 1);
+  }
+  delete inner_node;
+}
+
+template <typename K, typename V>
+FORCE_INLINE K *BTree<K, V>::leaf_keys(const LeafHeader *header) {
+  return reinterpret_cast<K *>(
+      reinterpret_cast<uint64_t>(header) + kLeafHeaderSize);
+}
+
+template <typename K, typename V>
+FORCE_INLINE V *BTree<K, V>::leaf_vals(const LeafHeader *header) const {
+  return reinterpret_cast<V *>(leaf_keys(header) + kLeafCapacity_);
+}
+
+template <typename K, typename V>
+FORCE_INLINE uint32_t BTree<K, V>::child_idx(const InnerNode *node,
+                                             const K &key) {
+  return std::upper_bound(node->keys + 1, node->keys + node->cnt, key) -
+         node->keys - 1;
+}
+
+template <typename K, typename V>
+FORCE_INLINE GenericBTree::Leaf *BTree<K, V>::find_leaf(const K &key,
+                                                        bool record_path) {
+  if (record_path) {
+    path_.clear();
+  }
+  auto *node = root_;
+  for (uint32_t level = height_; level > 0; level--) {
+    auto *inner_node = static_cast<InnerNode *>(node);
+    auto idx = child_idx(inner_node, key);
+    if (record_path) {
+      path_.emplace_back(inner_node, idx);
+    }
+    node = inner_node->children[idx];
+  }
+  return static_cast<Leaf *>(node);
+}
+
+template <typename K, typename V>
+FORCE_INLINE std::optional<V> BTree<K, V>::find(const DerefScope &scope,
+                                                const K &key) {
+  auto *header = deref_leaf(scope, find_leaf(key, /* record_path = */ false));
+  auto *keys = leaf_keys(header);
+  auto pos = std::lower_bound(keys, keys + header->cnt, key) - keys;
+  if (pos == header->cnt || key < keys[pos]) {
+    return std::nullopt;
+  }
+  return leaf_vals(header)[pos];
+}
+
+template <typename K, typename V>
+FORCE_INLINE void BTree<K, V>::insert(const DerefScope &scope, const K &key,
+                                      const V &value) {
+  auto *leaf = find_leaf(key, /* record_path = */ true);
+  auto *header = deref_leaf_mut(scope, leaf);
+  auto *keys = leaf_keys(header);
+  auto pos = std::lower_bound(keys, keys + header->cnt, key) - keys;
+  if (pos < header->cnt && !(key < keys[pos])) {
+    leaf_vals(header)[pos] = value;
+    return;
+  }
+  if (unlikely(header->cnt == kLeafCapacity_)) {
+    split_leaf(scope, leaf, header);
+    insert(scope, key, value);
+    return;
+  }
+  auto *vals = leaf_vals(header);
+  memmove(keys + pos + 1, keys + pos, (header->cnt - pos) * sizeof(K));
+  memmove(vals + pos + 1, vals + pos, (header->cnt - pos) * sizeof(V));
+  keys[pos] = key;
+  vals[pos] = value;
+  header->cnt++;
+  size_++;
+}
+
+template <typename K, typename V>
+void BTree<K, V>::split_leaf(const DerefScope &scope, Leaf *leaf,
+                             LeafHeader *header) {
+  auto *new_leaf = allocate_leaf(scope, leaf);
+  auto *new_header = deref_leaf_mut(scope, new_leaf);
+  uint16_t half = header->cnt / 2;
+  new_header->cnt = header->cnt - half;
+  memcpy(leaf_keys(new_header), leaf_keys(header) + half,
+         new_header->cnt * sizeof(K));
+  memcpy(leaf_vals(new_header), leaf_vals(header) + half,
+         new_header->cnt * sizeof(V));
+  header->cnt = half;
+  insert_child(leaf_keys(new_header)[0], new_leaf);
+}
+
+template <typename K, typename V>
+void BTree<K, V>::insert_child(const K &key, void *child) {
+  // Inserts child right after the path_ entries, from the bottom up.
+  K sep_key = key;
+  void *new_child = child;
+  while (!path_.empty()) {
+    auto [node, idx] = path_.back();
+    path_.pop_back();
+    if (node->cnt < kInnerNodeFanout) {
+      std::move_backward(node->keys + idx + 1, node->keys + node->cnt,
+                         node->keys + node->cnt + 1);
+      std::move_backward(node->children + idx + 1, node->children + node->cnt,
+                         node->children + node->cnt + 1);
+      node->keys[idx + 1] = sep_key;
+      node->children[idx + 1] = new_child;
+      node->cnt++;
+      return;
+    }
+    // Split the full node into two halves.
+    K keys[kInnerNodeFanout + 1];
+    void *children[kInnerNodeFanout + 1];
+    std::copy(node->keys, node->keys + idx + 1, keys);
+    std::copy(node->children, node->children + idx + 1, children);
+    keys[idx + 1] = sep_key;
+    children[idx + 1] = new_child;
+    std::copy(node->keys + idx + 1, node->keys + node->cnt, keys + idx + 2);
+    std::copy(node->children + idx + 1, node->children + node->cnt,
+              children + idx + 2);
+    auto *new_node = new InnerNode();
+    uint32_t half = (kInnerNodeFanout + 1) / 2;
+    node->cnt = half;
+    new_node->cnt = kInnerNodeFanout + 1 - half;
+    std::copy(keys, keys + half, node->keys);
+    std::copy(children, children + half, node->children);
+    std::copy(keys + half, keys + kInnerNodeFanout + 1, new_node->keys);
+    std::copy(children + half, children + kInnerNodeFanout + 1,
+              new_node->children);
+    sep_key = new_node->keys[0];
+    new_child = new_node;
+  }
+  // The root is split.
+  auto *new_root = new InnerNode();
+  new_root->cnt = 2;
+  new_root->keys[1] = sep_key;
+  new_root->children[0] = root_;
+  new_root->children[1] = new_child;
+  root_ = new_root;
+  height_++;
+}
+
+template <typename K, typename V>
+FORCE_INLINE bool BTree<K, V>::erase(const DerefScope &scope, const K &key) {
+  auto *leaf = find_leaf(key, /* record_path = */ true);
+  auto *header = deref_leaf(scope, leaf);
+  auto *keys = leaf_keys(header);
+  auto pos = std::lower_bound(keys, keys + header->cnt, key) - keys;
+  if (pos == header->cnt || key < keys[pos]) {
+    return false;
+  }
+  auto *mut_header = deref_leaf_mut(scope, leaf);
+  keys = leaf_keys(mut_header);
+  auto *vals = leaf_vals(mut_header);
+  memmove(keys + pos, keys + pos + 1, (mut_header->cnt - pos - 1) * sizeof(K));
+  memmove(vals + pos, vals + pos + 1, (mut_header->cnt - pos - 1) * sizeof(V));
+  mut_header->cnt--;
+  size_--;
+  // Leaves are never merged, but the empty ones are removed unless it is the
+  // last one. The separators in the inner nodes remain valid bounds.
+  if (!mut_header->cnt && height_) {
+    free_leaf(scope, leaf);
+    remove_child();
+  }
+  return true;
+}
+
+template <typename K, typename V> void BTree<K, V>::remove_child() {
+  // Removes the child at the bottom of path_, and then the emptied nodes.
+  while (!path_.empty()) {
+    auto [node, idx] = path_.back();
+    path_.pop_back();
+    std::move(node->keys + idx + 1, node->keys + node->cnt, node->keys + idx);
+    std::move(node->children + idx + 1, node->children + node->cnt,
+              node->children + idx);
+    if (--node->cnt) {
+      break;
+    }
+    delete node;
+  }
+  while (height_ && static_cast<InnerNode *>(root_)->cnt == 1) {
+    auto *old_root = static_cast<InnerNode *>(root_);
+    root_ = old_root->children[0];
+    delete old_root;
+    height_--;
+  }
+}
+
+template <typename K, typename V>
+FORCE_INLINE BTree<K, V>::Iterator
+BTree<K, V>::lower_bound(const DerefScope &scope, const K &key) {
+  auto *leaf = find_leaf(key, /* record_path = */ false);
+  trace_leaf(leaf);
+  auto *header = deref_leaf(scope, leaf);
+  auto *keys = leaf_keys(header);
+  auto it = Iterator(
+      this, leaf, std::lower_bound(keys, keys + header->cnt, key) - keys);
+  it.skip_exhausted_leaf(scope);
+  return it;
+}
+
+template <typename K, typename V>
+FORCE_INLINE BTree<K, V>::Iterator
+BTree<K, V>::begin(const DerefScope &scope) {
+  trace_leaf(head_);
+  auto it = Iterator(this, head_, 0);
+  it.skip_exhausted_leaf(scope);
+  return it;
+}
+
+template <typename K, typename V>
+FORCE_INLINE BTree<K, V>::Iterator BTree<K, V>::end() {
+  return Iterator(this, nullptr, 0);
+}
+
+template <typename K, typename V>
+FORCE_INLINE BTree<K, V>::Iterator::Iterator(BTree *tree, Leaf *leaf,
+                                             uint32_t pos)
+    : tree_(tree), leaf_(leaf), pos_(pos) {}
+
+template <typename K, typename V>
+FORCE_INLINE void
+BTree<K, V>::Iterator::skip_exhausted_leaf(const DerefScope &scope) {
+  // Only the last leaf of the tree can be empty.
+  if (leaf_ && pos_ == tree_->deref_leaf(scope, leaf_)->cnt) {
+    leaf_ = leaf_->next;
+    pos_ = 0;
+    if (leaf_) {
+      tree_->trace_leaf(leaf_);
+    }
+  }
+}
+
+template <typename K, typename V>
+FORCE_INLINE void BTree<K, V>::Iterator::inc(const DerefScope &scope) {
+  pos_++;
+  skip_exhausted_leaf(scope);
+}
+
+template <typename K, typename V>
+FORCE_INLINE const K &
+BTree<K, V>::Iterator::key(const DerefScope &scope) const {
+  return leaf_keys(tree_->deref_leaf(scope, leaf_))[pos_];
+}
+
+template <typename K, typename V>
+FORCE_INLINE const V &
+BTree<K, V>::Iterator::value(const DerefScope &scope) const {
+  return tree_->leaf_vals(tree_->deref_leaf(scope, leaf_))[pos_];
+}
+
+template <typename K, typename V>
+FORCE_INLINE V &BTree<K, V>::Iterator::value_mut(const DerefScope &scope) {
+  return tree_->leaf_vals(tree_->deref_leaf_mut(scope, leaf_))[pos_];
+}
+
+template <typename K, typename V>
+FORCE_INLINE bool BTree<K, V>::Iterator::operator==(const Iterator &o) const {
+  return leaf_ == o.leaf_ && pos_ == o.pos_;
+}
+
+template <typename K, typename V>
+FORCE_INLINE bool BTree<K, V>::Iterator::operator!=(const Iterator &o) const {
+  return !(*this == o);
+}
+
+template <typename K, typename V>
+FORCE_INLINE std::pair<uint64_t, V>
+BTree<K, V>::aggregate(OpCode opcode, const K &lo, const K &hi) {
+  if constexpr (DISABLE_OFFLOAD_BTREE_AGGREGATE) {
+    return aggregate_locally(opcode, lo, hi);
+  } else {
+    return aggregate_remotely(opcode, lo, hi);
+  }
+}
+
+template <typename K, typename V>
+FORCE_INLINE std::pair<uint64_t, V>
+BTree<K, V>::aggregate_locally(OpCode opcode, const K &lo, const K &hi) {
+  uint64_t cnt = 0;
+  V ret{};
+  DerefScope scope;
+  uint64_t i = 0;
+  for (auto it = lower_bound(scope, lo); it != end(); it.inc(scope), i++) {
+    if (unlikely(i % kNumElementsPerScope == 0)) {
+      scope.renew();
+    }
+    if (!(it.key(scope) < hi)) {
+      break;
+    }
+    aggregate_value(opcode, &cnt, &ret, it.value(scope));
+  }
+  return std::make_pair(cnt, ret);
+}
+
+template <typename K, typename V>
+FORCE_INLINE std::pair<uint64_t, V>
+BTree<K, V>::aggregate_remotely(OpCode opcode, const K &lo, const K &hi) {
+  flush();
+  // The start leaf is located by the local inner nodes.
+  auto start_id = find_leaf(lo, /* record_path = */ false)->id;
+  uint8_t input_data[sizeof(start_id) + sizeof(K) + sizeof(K)];
+  uint16_t input_len = sizeof(input_data);
+  __builtin_memcpy(input_data, &start_id, sizeof(start_id));
+  __builtin_memcpy(input_data + sizeof(start_id), &lo, sizeof(K));
+  __builtin_memcpy(input_data + sizeof(start_id) + sizeof(K), &hi, sizeof(K));
+  uint8_t output_data[sizeof(uint64_t) + sizeof(V)];
+  uint16_t output_len;
+  device_->compute(ds_id_, opcode, input_len, input_data, &output_len,
+                   output_data);
+  assert(output_len == sizeof(output_data));
+  uint64_t cnt;
+  V ret;
+  __builtin_memcpy(&cnt, output_data, sizeof(cnt));
+  __builtin_memcpy(&ret, output_data + sizeof(cnt), sizeof(V));
+  return std::make_pair(cnt, ret);
+}
+
+template <typename K, typename V>
+FORCE_INLINE uint64_t BTree<K, V>::count_range(const K &lo, const K &hi) {
+  return aggregate(OpCode::Count, lo, hi).first;
+}
+
+template <typename K, typename V>
+FORCE_INLINE V BTree<K, V>::sum_range(const K &lo, const K &hi) {
+  static_assert(std::is_arithmetic<V>::value);
+  auto [cnt, ret] = aggregate(OpCode::Sum, lo, hi);
+  return cnt ? ret : V{};
+}
+
+template <typename K, typename V>
+FORCE_INLINE std::optional<V> BTree<K, V>::min_range(const K &lo,
+                                                     const K &hi) {
+  auto [cnt, ret] = aggregate(OpCode::Min, lo, hi);
+  return cnt ? std::make_optional(ret) : std::nullopt;
+}
+
+template <typename K, typename V>
+FORCE_INLINE std::optional<V> BTree<K, V>::max_range(const K &lo,
+                                                     const K &hi) {
+  auto [cnt, ret] = aggregate(OpCode::Max, lo, hi);
+  return cnt ? std::make_optional(ret) : std::nullopt;
+}
+
+} // namespace far_memory
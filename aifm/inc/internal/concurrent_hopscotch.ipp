@@ -1,7 +1,9 @@
 #pragma once
 
 #include "hash.hpp"
+#include "stats.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 namespace far_memory {
@@ -16,12 +18,15 @@ FORCE_INLINE void GenericConcurrentHopscotch::_get(uint8_t key_len,
                                                    uint16_t *val_len,
                                                    uint8_t *val,
                                                    bool *forwarded) {
-  bool miss = __get(key_len, key, val_len, val);
+  uint32_t hash = hash_32(reinterpret_cast<const void *>(key), key_len);
+  bool miss = __get(hash, key_len, key, val_len, val);
   if (very_unlikely(miss)) {
     if (forwarded) {
       *forwarded = true;
     }
-    forward_get(key_len, key, val_len, val);
+    forward_get(hash, key_len, key, val_len, val);
+  } else {
+    Stats::inc_deref_hits(ds_id_, 1);
   }
 }
 
@@ -46,7 +51,8 @@ FORCE_INLINE bool GenericConcurrentHopscotch::put(const DerefScope &scope,
                                                   const uint8_t *key,
                                                   uint16_t val_len,
                                                   const uint8_t *val) {
-  return _put(key_len, key, val_len, val, /* swap_in = */ false);
+  uint32_t hash = hash_32(reinterpret_cast<const void *>(key), key_len);
+  return _put(hash, key_len, key, val_len, val, /* swap_in = */ false);
 }
 
 FORCE_INLINE bool GenericConcurrentHopscotch::put_tp(uint8_t key_len,
@@ -69,6 +75,33 @@ FORCE_INLINE bool GenericConcurrentHopscotch::remove_tp(uint8_t key_len,
   return remove(scope, key_len, key);
 }
 
+FORCE_INLINE void GenericConcurrentHopscotch::get_batch(
+    const DerefScope &scope, uint32_t num_keys, uint8_t key_len,
+    const uint8_t *keys, uint16_t *val_lens, uint8_t *const *vals) {
+  _get_batch(num_keys, key_len, keys, val_lens, vals);
+}
+
+FORCE_INLINE void GenericConcurrentHopscotch::get_batch_tp(
+    uint32_t num_keys, uint8_t key_len, const uint8_t *keys,
+    uint16_t *val_lens, uint8_t *const *vals) {
+  DerefScope scope;
+  get_batch(scope, num_keys, key_len, keys, val_lens, vals);
+}
+
+FORCE_INLINE void GenericConcurrentHopscotch::put_batch(
+    const DerefScope &scope, uint32_t num_keys, uint8_t key_len,
+    const uint8_t *keys, uint16_t val_len, const uint8_t *vals,
+    bool *key_existed) {
+  _put_batch(num_keys, key_len, keys, val_len, vals, key_existed);
+}
+
+FORCE_INLINE void GenericConcurrentHopscotch::put_batch_tp(
+    uint32_t num_keys, uint8_t key_len, const uint8_t *keys, uint16_t val_len,
+    const uint8_t *vals, bool *key_existed) {
+  DerefScope scope;
+  put_batch(scope, num_keys, key_len, keys, val_len, vals, key_existed);
+}
+
 FORCE_INLINE void GenericConcurrentHopscotch::process_evac_notifier_stash() {
   if (unlikely(evac_notifier_stash_.size())) {
     EvacNotifierMeta meta;
@@ -85,15 +118,48 @@ FORCE_INLINE void GenericConcurrentHopscotch::evac_notifier(Object object) {
   do_evac_notifier(*meta);
 }
 
-FORCE_INLINE bool GenericConcurrentHopscotch::__get(uint8_t key_len,
+FORCE_INLINE GenericConcurrentHopscotch::Table *
+GenericConcurrentHopscotch::locate(uint32_t hash) {
+  auto *table = load_acquire(&table_);
+  while (unlikely((hash & table->kHashMask) <
+                  load_acquire(&table->num_migrated))) {
+    table = table->next;
+  }
+  return table;
+}
+
+FORCE_INLINE GenericConcurrentHopscotch::Table *
+GenericConcurrentHopscotch::lock_anchor(uint32_t hash, BucketEntry **bucket) {
+  while (true) {
+    auto *table = locate(hash);
+    auto bucket_idx = hash & table->kHashMask;
+    *bucket = &(table->buckets[bucket_idx]);
+    while (unlikely(!(*bucket)->spin.TryLockWp())) {
+      thread_yield();
+    }
+    // The migration of an anchor bucket is done with its lock held.
+    if (likely(bucket_idx >= load_acquire(&table->num_migrated))) {
+      return table;
+    }
+    (*bucket)->spin.UnlockWp();
+  }
+}
+
+FORCE_INLINE bool GenericConcurrentHopscotch::__get(uint32_t hash,
+                                                    uint8_t key_len,
                                                     const uint8_t *key,
                                                     uint16_t *val_len,
                                                     uint8_t *val) {
-  uint32_t hash = hash_32(reinterpret_cast<const void *>(key), key_len);
-  uint32_t bucket_idx = hash & kHashMask_;
-  auto *bucket = buckets_ + bucket_idx;
+  rcu_lock_.reader_lock();
+  auto rcu_guard = helpers::finally([&]() { rcu_lock_.reader_unlock(); });
+
+relocate:
+  auto *table = locate(hash);
+  uint32_t bucket_idx = hash & table->kHashMask;
+  auto *bucket = table->buckets + bucket_idx;
   uint64_t timestamp;
   uint32_t retry_counter = 0;
+  bool migrated = false;
 
   auto get_once = [&]<bool Lock>() -> bool {
     retry:
@@ -107,11 +173,17 @@ FORCE_INLINE bool GenericConcurrentHopscotch::__get(uint8_t key_len,
           bucket->spin.UnlockWp();
         }
       });
+      if constexpr (Lock) {
+        if (unlikely(bucket_idx < load_acquire(&table->num_migrated))) {
+          migrated = true;
+          return false;
+        }
+      }
       timestamp = load_acquire(&(bucket->timestamp));
       uint32_t bitmap = bucket->bitmap;
       while (bitmap) {
         auto offset = helpers::bsf_32(bitmap);
-        auto &ptr = buckets_[bucket_idx + offset].ptr;
+        auto &ptr = table->buckets[bucket_idx + offset].ptr;
         if (likely(!ptr.is_null())) {
           auto *obj_val_ptr = ptr._deref<false, false>();
           if (unlikely(!obj_val_ptr)) {
@@ -146,11 +218,16 @@ FORCE_INLINE bool GenericConcurrentHopscotch::__get(uint8_t key_len,
   } while (timestamp != ACCESS_ONCE(bucket->timestamp) &&
            retry_counter++ < kMaxRetries);
 
-  // Slow path.
-  if (timestamp != ACCESS_ONCE(bucket->timestamp)) {
+  // Slow path. While the table is being migrated, a miss is only trusted
+  // with the bucket lock held, since the key may be moving to the next table.
+  if (timestamp != ACCESS_ONCE(bucket->timestamp) ||
+      unlikely(load_acquire(&table->next))) {
     if (get_once.template operator()<true>()) {
       return false;
     }
+    if (unlikely(migrated)) {
+      goto relocate;
+    }
   }
   return true;
 }
@@ -178,9 +255,11 @@ FORCE_INLINE std::optional<V> ConcurrentHopscotch<K, V>::_find(const K &key) {
 template <typename K, typename V>
 FORCE_INLINE void ConcurrentHopscotch<K, V>::_insert(const K &key,
                                                      const V &val) {
-  bool key_existed =
-      _put(sizeof(key), reinterpret_cast<const uint8_t *>(&key), sizeof(val),
-           reinterpret_cast<const uint8_t *>(&val), /* swap_in = */ false);
+  uint32_t hash = hash_32(reinterpret_cast<const void *>(&key), sizeof(key));
+  bool key_existed = _put(hash, sizeof(key),
+                          reinterpret_cast<const uint8_t *>(&key), sizeof(val),
+                          reinterpret_cast<const uint8_t *>(&val),
+                          /* swap_in = */ false);
   if (!key_existed) {
     preempt_disable();
     per_core_size_[get_core_num()].data++;
@@ -200,6 +279,47 @@ FORCE_INLINE bool ConcurrentHopscotch<K, V>::_erase(const K &key) {
   return key_existed;
 }
 
+template <typename K, typename V>
+FORCE_INLINE void ConcurrentHopscotch<K, V>::_find_batch(uint32_t num_keys,
+                                                         const K *keys,
+                                                         std::optional<V> *vals) {
+  uint16_t val_lens[kMaxNumKeysPerBatch];
+  uint8_t *val_bufs[kMaxNumKeysPerBatch];
+  for (uint32_t i = 0; i < num_keys; i += kMaxNumKeysPerBatch) {
+    auto num = std::min(num_keys - i, kMaxNumKeysPerBatch);
+    for (uint32_t j = 0; j < num; j++) {
+      val_bufs[j] = reinterpret_cast<uint8_t *>(&vals[i + j].emplace());
+    }
+    _get_batch(num, sizeof(K), reinterpret_cast<const uint8_t *>(keys + i),
+               val_lens, val_bufs);
+    for (uint32_t j = 0; j < num; j++) {
+      if (val_lens[j] == 0) {
+        vals[i + j].reset();
+      }
+    }
+  }
+}
+
+template <typename K, typename V>
+FORCE_INLINE void ConcurrentHopscotch<K, V>::_insert_batch(uint32_t num_keys,
+                                                           const K *keys,
+                                                           const V *vals) {
+  bool key_existed[kMaxNumKeysPerBatch];
+  int64_t num_inserted = 0;
+  for (uint32_t i = 0; i < num_keys; i += kMaxNumKeysPerBatch) {
+    auto num = std::min(num_keys - i, kMaxNumKeysPerBatch);
+    _put_batch(num, sizeof(K), reinterpret_cast<const uint8_t *>(keys + i),
+               sizeof(V), reinterpret_cast<const uint8_t *>(vals + i),
+               key_existed);
+    for (uint32_t j = 0; j < num; j++) {
+      num_inserted += !key_existed[j];
+    }
+  }
+  preempt_disable();
+  per_core_size_[get_core_num()].data += num_inserted;
+  preempt_enable();
+}
+
 template <typename K, typename V>
 FORCE_INLINE bool ConcurrentHopscotch<K, V>::empty() const {
   return size() == 0;
@@ -249,4 +369,34 @@ FORCE_INLINE bool ConcurrentHopscotch<K, V>::erase_tp(const K &key) {
   DerefScope scope;
   return _erase(key);
 }
+
+template <typename K, typename V>
+FORCE_INLINE void
+ConcurrentHopscotch<K, V>::find_batch(const DerefScope &scope,
+                                      uint32_t num_keys, const K *keys,
+                                      std::optional<V> *vals) {
+  _find_batch(num_keys, keys, vals);
+}
+
+template <typename K, typename V>
+FORCE_INLINE void
+ConcurrentHopscotch<K, V>::find_batch_tp(uint32_t num_keys, const K *keys,
+                                         std::optional<V> *vals) {
+  DerefScope scope;
+  _find_batch(num_keys, keys, vals);
+}
+
+template <typename K, typename V>
+FORCE_INLINE void ConcurrentHopscotch<K, V>::insert_batch(
+    const DerefScope &scope, uint32_t num_keys, const K *keys, const V *vals) {
+  _insert_batch(num_keys, keys, vals);
+}
+
+template <typename K, typename V>
+FORCE_INLINE void ConcurrentHopscotch<K, V>::insert_batch_tp(uint32_t num_keys,
+                                                             const K *keys,
+                                                             const V *vals) {
+  DerefScope scope;
+  _insert_batch(num_keys, keys, vals);
+}
 } // namespace far_memory
@@ -62,4 +62,53 @@ template <typename T> FORCE_INLINE constexpr int8_t get_dataframe_type_id() {
 template <typename T> FORCE_INLINE constexpr bool is_basic_dataframe_types() {
   return get_dataframe_type_id<T>() != -1;
 }
+
+// The radix sort of dataframe vectors works on unsigned keys whose order is the
+// same as the one of the original values. Every digit has kRadixBits bits.
+template <typename T>
+using RadixKey_t = typename std::conditional<sizeof(T) <= sizeof(unsigned int),
+                                             unsigned int,
+                                             unsigned long long>::type;
+constexpr uint32_t kRadixBits = 8;
+constexpr uint32_t kRadixNumBuckets = 1 << kRadixBits;
+
+template <typename T>
+FORCE_INLINE constexpr uint32_t get_radix_num_digits() {
+  return sizeof(RadixKey_t<T>) * 8 / kRadixBits;
+}
+
+template <typename T>
+FORCE_INLINE RadixKey_t<T> get_radix_key(const T &t) {
+  // Flips the sign bit so that negative values go before the positive ones.
+  auto flip_sign = [](auto v) -> RadixKey_t<T> {
+    using U = decltype(v);
+    auto u = static_cast<typename std::make_unsigned<U>::type>(v);
+    if constexpr (std::is_signed<U>::value) {
+      u ^= static_cast<decltype(u)>(1) << (sizeof(U) * 8 - 1);
+    }
+    return u;
+  };
+
+  if constexpr (std::is_same<T, SimpleTime>::value) {
+    static_assert(sizeof(RadixKey_t<T>) == 8);
+    RadixKey_t<T> key = flip_sign(t.year_);
+    key = (key << 8) | flip_sign(t.month_);
+    key = (key << 8) | flip_sign(t.day_);
+    key = (key << 8) | flip_sign(t.hour_);
+    key = (key << 8) | flip_sign(t.min_);
+    key = (key << 8) | flip_sign(t.second_);
+    return key;
+  } else if constexpr (std::is_floating_point<T>::value) {
+    // Negative values are flipped entirely to reverse their order.
+    static_assert(sizeof(RadixKey_t<T>) == sizeof(T));
+    RadixKey_t<T> key;
+    __builtin_memcpy(&key, &t, sizeof(T));
+    constexpr auto kSignBit = static_cast<RadixKey_t<T>>(1)
+                              << (sizeof(T) * 8 - 1);
+    return (key & kSignBit) ? ~key : (key | kSignBit);
+  } else {
+    static_assert(std::is_integral<T>::value);
+    return flip_sign(t);
+  }
+}
 } // namespace far_memory
@@ -4,6 +4,7 @@
 #include "helpers.hpp"
 #include "manager.hpp"
 
+#include <array>
 #include <cstring>
 #include <ctime>
 #include <unordered_set>
@@ -942,14 +943,17 @@ DataFrameVector<T>::get_sorted_indices(FarMemManager *manager,
       auto idx = Ascending ? i : size_ - i - 1;
       indices.push_back(scope, idx);
     }
+    return indices;
   }
   if constexpr (sizeof(T) <= 2 && std::is_integral<T>::value) {
     // T is small. Use counting sort.
     _get_sorted_indices_counting_sort<Ascending>(&indices);
-  } else {
+  } else if constexpr (DISABLE_OFFLOAD_SORTED_INDICES) {
     // T is large. Use radix sort which iteratively invokes counting on its
-    // digits. Not implemented yet.
-    BUG();
+    // digits.
+    _get_sorted_indices_radix_sort<Ascending>(manager, &indices);
+  } else {
+    _get_sorted_indices_remotely<Ascending>(&indices);
   }
   return indices;
 }
@@ -994,6 +998,186 @@ FORCE_INLINE void DataFrameVector<T>::_get_sorted_indices_counting_sort(
   }
 }
 
+template <typename T>
+template <bool Ascending>
+FORCE_INLINE void DataFrameVector<T>::_get_sorted_indices_radix_sort(
+    FarMemManager *manager, DataFrameVector<unsigned long long> *indices) {
+  using Key_t = RadixKey_t<T>;
+  using Histogram_t = std::array<uint64_t, kRadixNumBuckets>;
+  constexpr uint32_t kNumDigits = get_radix_num_digits<T>();
+  constexpr Key_t kDigitMask = kRadixNumBuckets - 1;
+  indices->resize(size_);
+  if (unlikely(!size_)) {
+    return;
+  }
+
+  // Every uthread owns the same range of whole chunks across all passes, so
+  // that its histograms stay valid for the scatter that follows.
+  auto num_chunks = (size_ - 1) / kRealChunkNumEntries + 1;
+  auto num_entries_per_thread =
+      ((num_chunks - 1) / helpers::kNumCPUs + 1) * kRealChunkNumEntries;
+  auto parallel_for = [&](auto &&fn) {
+    std::vector<rt::Thread> threads;
+    for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+      threads.emplace_back([&, tid]() {
+        auto left = std::min(num_entries_per_thread * tid, size_);
+        auto right = std::min(left + num_entries_per_thread, size_);
+        if (left < right) {
+          fn(tid, left, right);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.Join();
+    }
+  };
+
+  // Double buffers of the (key, source index) pairs between the passes.
+  std::vector<DataFrameVector<Key_t>> keys;
+  std::vector<DataFrameVector<unsigned long long>> srcs;
+  // Streams the keys of [left, right) of the pass input. The first pass reads
+  // the vector itself, whose source indices are the positions.
+  auto for_each_key = [&](uint32_t pass, uint64_t left, uint64_t right,
+                          auto &&fn) {
+    DerefScope scope;
+    if (pass == 0) {
+      auto it = FastIterator<false>(scope, this, left);
+      for (uint64_t i = left; i < right; ++i, ++it) {
+        if (unlikely((i - left) % kNumElementsPerScope == 0)) {
+          scope.renew();
+          it.renew(scope);
+        }
+        fn(scope, get_radix_key(*it), i);
+      }
+    } else {
+      auto &from_keys = keys[(pass - 1) % 2];
+      auto &from_srcs = srcs[(pass - 1) % 2];
+      auto key_it = from_keys.cfbegin(scope) + left;
+      auto src_it = from_srcs.cfbegin(scope) + left;
+      for (uint64_t i = left; i < right; ++i, ++key_it, ++src_it) {
+        if (unlikely((i - left) % kNumElementsPerScope == 0)) {
+          scope.renew();
+          key_it.renew(scope);
+          src_it.renew(scope);
+        }
+        fn(scope, *key_it, *src_it);
+      }
+    }
+  };
+
+  // The first scan builds the per-thread histograms of all digits at once.
+  preempt_disable();
+  auto hists = std::make_unique<Histogram_t[]>(helpers::kNumCPUs * kNumDigits);
+  preempt_enable();
+  parallel_for([&](uint32_t tid, uint64_t left, uint64_t right) {
+    auto *hist = &hists[tid * kNumDigits];
+    for_each_key(0, left, right,
+                 [&](const DerefScope &scope, Key_t key, uint64_t src) {
+                   for (uint32_t d = 0; d < kNumDigits; d++) {
+                     hist[d][(key >> (d * kRadixBits)) & kDigitMask]++;
+                   }
+                 });
+  });
+
+  // Skip the digits that are the same across all keys.
+  std::vector<uint32_t> digits;
+  for (uint32_t d = 0; d < kNumDigits; d++) {
+    for (uint32_t b = 0; b < kRadixNumBuckets; b++) {
+      uint64_t cnt = 0;
+      for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+        cnt += hists[tid * kNumDigits + d][b];
+      }
+      if (cnt) {
+        if (cnt != size_) {
+          digits.push_back(d);
+        }
+        break;
+      }
+    }
+  }
+  if (digits.empty()) {
+    // All keys are equal, a single pass yields the stable ranks.
+    digits.push_back(0);
+  }
+  auto num_buffers = std::min(static_cast<std::size_t>(2), digits.size() - 1);
+  keys.reserve(num_buffers);
+  srcs.reserve(num_buffers);
+  for (uint32_t i = 0; i < num_buffers; i++) {
+    keys.emplace_back(manager);
+    keys.back().resize(size_);
+    srcs.emplace_back(manager);
+    srcs.back().resize(size_);
+  }
+
+  for (uint32_t pass = 0; pass < digits.size(); pass++) {
+    auto digit = digits[pass];
+    auto shift = digit * kRadixBits;
+    bool last_pass = (pass == digits.size() - 1);
+    if (pass != 0) {
+      // The keys were permuted by the last pass.
+      parallel_for([&](uint32_t tid, uint64_t left, uint64_t right) {
+        auto &hist = hists[tid * kNumDigits + digit];
+        hist.fill(0);
+        for_each_key(pass, left, right,
+                     [&](const DerefScope &scope, Key_t key, uint64_t src) {
+                       hist[(key >> shift) & kDigitMask]++;
+                     });
+      });
+    }
+    // Turn the counts into the scatter offsets. Lower threads go first within
+    // a bucket to keep the sort stable.
+    uint64_t offset = 0;
+    for (uint32_t b = 0; b < kRadixNumBuckets; b++) {
+      for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+        auto &cnt = hists[tid * kNumDigits + digit][b];
+        auto next_offset = offset + cnt;
+        cnt = offset;
+        offset = next_offset;
+      }
+    }
+    parallel_for([&](uint32_t tid, uint64_t left, uint64_t right) {
+      auto &hist = hists[tid * kNumDigits + digit];
+      for_each_key(
+          pass, left, right,
+          [&](const DerefScope &scope, Key_t key, uint64_t src) {
+            auto pos = hist[(key >> shift) & kDigitMask]++;
+            if (last_pass) {
+              indices->template at_mut</* Prefetch = */ false>(scope, src) =
+                  Ascending ? pos : size_ - pos - 1;
+            } else {
+              keys[pass % 2].template at_mut</* Prefetch = */ false>(
+                  scope, pos) = key;
+              srcs[pass % 2].template at_mut</* Prefetch = */ false>(
+                  scope, pos) = src;
+            }
+          });
+    });
+  }
+}
+
+template <typename T>
+template <bool Ascending>
+FORCE_INLINE void DataFrameVector<T>::_get_sorted_indices_remotely(
+    DataFrameVector<unsigned long long> *indices) {
+  flush();
+  uint8_t ascending = Ascending;
+  uint8_t input_data[sizeof(indices->ds_id_) + sizeof(size_) +
+                     sizeof(ascending)];
+  uint16_t input_len = sizeof(input_data);
+  __builtin_memcpy(input_data, &indices->ds_id_, sizeof(indices->ds_id_));
+  __builtin_memcpy(input_data + sizeof(indices->ds_id_), &size_,
+                   sizeof(size_));
+  __builtin_memcpy(input_data + sizeof(indices->ds_id_) + sizeof(size_),
+                   &ascending, sizeof(ascending));
+  uint16_t output_len;
+  device_->compute(ds_id_, OpCode::SortedIndices, input_len, input_data,
+                   &output_len,
+                   reinterpret_cast<uint8_t *>(&indices->remote_vec_capacity_));
+  assert(output_len == sizeof(indices->remote_vec_capacity_));
+  indices->size_ = size_;
+  indices->expand_no_alloc(indices->remote_vec_capacity_);
+}
+
 template <typename T>
 template <typename U>
 FORCE_INLINE DataFrameVector<T>
@@ -13,6 +13,8 @@ constexpr static uint8_t kVanillaPtrDSType = 0;
 constexpr static uint8_t kVanillaPtrDSID = 0; // Reserve 0 as its fixed DS ID.
 constexpr static uint32_t kVanillaPtrObjectIDSize =
     sizeof(uint64_t); // Its object ID is always the remote object addr.
+constexpr static uint32_t kVanillaPtrBackRefSize =
+    6; // Writes piggyback the far-mem pointer addr for the far-mem GC.
 
 // Hashtable.
 constexpr static uint8_t kHashTableDSType = 1;
@@ -22,4 +24,7 @@ constexpr static uint8_t kDataFrameVectorDSType = 2;
 
 constexpr static uint8_t kArrayDSType = 3;
 
+// BTree.
+constexpr static uint8_t kBTreeDSType = 4;
+
 } // namespace far_memory
@@ -0,0 +1,97 @@
+#pragma once
+
+extern "C" {
+#include <asm/atomic.h>
+#include <base/compiler.h>
+}
+
+#include <algorithm>
+
+namespace far_memory {
+
+FORCE_INLINE uint32_t FrequencySketch::rehash(uint32_t hash,
+                                              uint32_t seed_idx) {
+  hash *= kSeeds[seed_idx];
+  return hash ^ (hash >> 17);
+}
+
+FORCE_INLINE uint64_t *FrequencySketch::counter_word(uint32_t row,
+                                                     uint32_t idx) const {
+  return &counters_[(static_cast<uint64_t>(row) * (kIdxMask_ + 1) + idx) /
+                    kCountersPerWord];
+}
+
+FORCE_INLINE bool FrequencySketch::doorkeeper_contains(uint32_t hash) const {
+  for (uint32_t i = 0; i < kNumDoorkeeperHashes; i++) {
+    auto bit = rehash(hash, kNumRows + i) & kDoorkeeperMask_;
+    if (!(ACCESS_ONCE(doorkeeper_[bit / 64]) & (1ULL << (bit % 64)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FORCE_INLINE bool FrequencySketch::doorkeeper_test_and_set(uint32_t hash) {
+  bool contained = true;
+  for (uint32_t i = 0; i < kNumDoorkeeperHashes; i++) {
+    auto bit = rehash(hash, kNumRows + i) & kDoorkeeperMask_;
+    auto mask = 1ULL << (bit % 64);
+    if (!(__atomic_fetch_or(&doorkeeper_[bit / 64], mask, __ATOMIC_RELAXED) &
+          mask)) {
+      contained = false;
+    }
+  }
+  return contained;
+}
+
+FORCE_INLINE uint32_t FrequencySketch::sketch_estimate(uint32_t hash) const {
+  uint32_t ret = kMaxCount;
+  for (uint32_t row = 0; row < kNumRows; row++) {
+    auto idx = rehash(hash, row) & kIdxMask_;
+    auto shift = (idx % kCountersPerWord) * kCounterBits;
+    auto count = (ACCESS_ONCE(*counter_word(row, idx)) >> shift) & kMaxCount;
+    ret = std::min(ret, static_cast<uint32_t>(count));
+  }
+  return ret;
+}
+
+FORCE_INLINE void FrequencySketch::sketch_increment(uint32_t hash) {
+  for (uint32_t row = 0; row < kNumRows; row++) {
+    auto idx = rehash(hash, row) & kIdxMask_;
+    auto shift = (idx % kCountersPerWord) * kCounterBits;
+    auto *word = counter_word(row, idx);
+    auto old_word = ACCESS_ONCE(*word);
+    // Saturate rather than overflow into the neighbor counter.
+    while (((old_word >> shift) & kMaxCount) != kMaxCount &&
+           !__atomic_compare_exchange_n(word, &old_word,
+                                        old_word + (1ULL << shift),
+                                        /* weak = */ true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED))
+      ;
+  }
+}
+
+FORCE_INLINE uint32_t FrequencySketch::estimate(uint32_t hash) const {
+  if (!doorkeeper_contains(hash)) {
+    return 0;
+  }
+  return sketch_estimate(hash) + 1;
+}
+
+FORCE_INLINE uint32_t FrequencySketch::record(uint32_t hash) {
+  if (unlikely(__atomic_add_fetch(&num_samples_, 1, __ATOMIC_RELAXED) ==
+               kSampleSize_)) {
+    start_aging();
+  }
+  if (unlikely(load_acquire(&aging_))) {
+    age_slice();
+  }
+  // The first access of a key only goes into the doorkeeper.
+  if (!doorkeeper_test_and_set(hash)) {
+    return 1;
+  }
+  sketch_increment(hash);
+  return sketch_estimate(hash) + 1;
+}
+
+} // namespace far_memory
@@ -10,6 +10,8 @@ extern "C" {
 #include <chrono>
 #include <cstdlib>
 #include <memory>
+#include <numa.h>
+#include <numaif.h>
 #include <signal.h>
 #include <sys/mman.h>
 #include <sys/sysinfo.h>
@@ -31,6 +33,29 @@ static FORCE_INLINE void *allocate_hugepage(uint64_t size) {
   return ptr;
 }
 
+static FORCE_INLINE uint32_t get_num_configured_cpus() {
+  if (numa_available() < 0) {
+    return get_nprocs_conf();
+  }
+  return numa_num_configured_cpus();
+}
+
+static FORCE_INLINE uint32_t get_numa_node_of_core(uint32_t core_id) {
+  if (numa_available() < 0) {
+    return 0;
+  }
+  auto node = numa_node_of_cpu(core_id);
+  return node < 0 ? 0 : node;
+}
+
+// Binds the pages of [ptr, ptr + size) to the node before they are touched.
+static FORCE_INLINE void bind_to_numa_node(void *ptr, uint64_t size,
+                                           uint32_t node) {
+  unsigned long node_mask = 1UL << node;
+  BUG_ON(mbind(ptr, size, MPOL_BIND, &node_mask, sizeof(node_mask) * 8, 0) !=
+         0);
+}
+
 static FORCE_INLINE int get_num_cores() { return get_nprocs(); }
 
 static FORCE_INLINE void timer_start(unsigned *cycles_high_start,
@@ -222,28 +247,40 @@ static FORCE_INLINE void tcp_write_until(tcpconn_t *c, const void *buf,
   }
 }
 
+// The iovecs are consumed (i.e., modified) in the slow path. They should not be
+// empty, since tcp_writev() stops at an empty one.
+static FORCE_INLINE void tcp_writev_until(tcpconn_t *c, iovec *iovecs,
+                                          int num_iovecs) {
+  size_t expect = 0;
+  for (int i = 0; i < num_iovecs; i++) {
+    expect += iovecs[i].iov_len;
+  }
+  size_t real = tcp_writev(c, iovecs, num_iovecs);
+  if (unlikely(real != expect)) {
+    // Slow path.
+    size_t done = real;
+    do {
+      while (done >= iovecs->iov_len) {
+        done -= iovecs->iov_len;
+        iovecs++;
+        num_iovecs--;
+      }
+      iovecs->iov_base = reinterpret_cast<void *>(
+          reinterpret_cast<uint8_t *>(iovecs->iov_base) + done);
+      iovecs->iov_len -= done;
+      done = tcp_writev(c, iovecs, num_iovecs);
+      real += done;
+    } while (real < expect);
+  }
+}
+
 static FORCE_INLINE void tcp_write2_until(tcpconn_t *c, const void *buf_0,
                                           size_t expect_0, const void *buf_1,
                                           size_t expect_1) {
   iovec iovecs[2];
   iovecs[0] = {.iov_base = const_cast<void *>(buf_0), .iov_len = expect_0};
   iovecs[1] = {.iov_base = const_cast<void *>(buf_1), .iov_len = expect_1};
-  size_t real = tcp_writev(c, iovecs, 2);
-  if (unlikely(real != expect_0 + expect_1)) {
-    // Slow path.
-    do {
-      if (likely(real >= expect_0)) {
-        real += tcp_write(
-            c, reinterpret_cast<const uint8_t *>(buf_1) + (real - expect_0),
-            expect_1 - (real - expect_0));
-      } else {
-        iovecs[0].iov_base = reinterpret_cast<void *>(
-            reinterpret_cast<uint8_t *>(iovecs[0].iov_base) + real);
-        iovecs[0].iov_len -= real;
-        real += tcp_writev(c, iovecs, 2);
-      }
-    } while (real < expect_0 + expect_1);
-  }
+  tcp_writev_until(c, iovecs, expect_1 ? 2 : 1);
 }
 
 static FORCE_INLINE constexpr size_t static_log(uint64_t b, uint64_t n) {
@@ -0,0 +1,38 @@
+#pragma once
+
+extern "C" {
+#include <asm/ops.h>
+#include <base/compiler.h>
+#include <base/time.h>
+#include <runtime/preempt.h>
+#include <runtime/thread.h>
+}
+
+#include <algorithm>
+
+namespace far_memory {
+
+FORCE_INLINE uint32_t LatencyHistogram::bucket_idx(uint64_t latency_ns) {
+  latency_ns =
+      std::min(latency_ns, static_cast<uint64_t>((1ULL << kMaxValueBits) - 1));
+  if (latency_ns < (1ULL << kSubBucketBits)) {
+    return latency_ns;
+  }
+  uint32_t msb = 63 - __builtin_clzll(latency_ns);
+  uint32_t shift = msb - kSubBucketBits + 1;
+  return (1 << kSubBucketBits) + (shift - 1) * kNumSubBuckets +
+         ((latency_ns >> shift) - kNumSubBuckets);
+}
+
+FORCE_INLINE void LatencyHistogram::record(uint64_t latency_ns) {
+  auto idx = bucket_idx(latency_ns);
+  preempt_disable();
+  ACCESS_ONCE(counts_[get_core_num()][idx])++;
+  preempt_enable();
+}
+
+FORCE_INLINE void LatencyHistogram::record_since(uint64_t start_tsc) {
+  record((rdtsc() - start_tsc) * 1000 / cycles_per_us);
+}
+
+} // namespace far_memory
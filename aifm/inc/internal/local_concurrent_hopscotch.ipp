@@ -64,4 +64,32 @@ FORCE_INLINE LocalGenericConcurrentHopscotch::BucketEntry::BucketEntry() {
   bitmap = timestamp = 0;
   ptr = nullptr;
 }
+
+FORCE_INLINE LocalGenericConcurrentHopscotch::Table *
+LocalGenericConcurrentHopscotch::locate(uint32_t hash) {
+  auto *table = load_acquire(&table_);
+  while (unlikely((hash & table->kHashMask) <
+                  load_acquire(&table->num_migrated))) {
+    table = table->next;
+  }
+  return table;
+}
+
+FORCE_INLINE LocalGenericConcurrentHopscotch::Table *
+LocalGenericConcurrentHopscotch::lock_anchor(uint32_t hash,
+                                             BucketEntry **bucket) {
+  while (true) {
+    auto *table = locate(hash);
+    auto bucket_idx = hash & table->kHashMask;
+    *bucket = &(table->buckets[bucket_idx]);
+    while (unlikely(!(*bucket)->spin.TryLockWp())) {
+      thread_yield();
+    }
+    // The migration of an anchor bucket is done with its lock held.
+    if (likely(bucket_idx >= load_acquire(&table->num_migrated))) {
+      return table;
+    }
+    (*bucket)->spin.UnlockWp();
+  }
+}
 } // namespace far_memory
\ No newline at end of file
@@ -17,13 +17,64 @@ FarMemManager::RegionManager::core_local_free_region(bool nt) {
             : core_local_free_regions_[core_num];
 }
 
+FORCE_INLINE uint32_t
+FarMemManager::RegionManager::get_region_node(uint32_t region_idx) const {
+  return std::min(region_idx / num_regions_per_node_, num_nodes_ - 1);
+}
+
+FORCE_INLINE uint32_t FarMemManager::RegionManager::get_core_node() const {
+  return core_nodes_[get_core_num()];
+}
+
 FORCE_INLINE double
 FarMemManager::RegionManager::get_free_region_ratio() const {
-  return static_cast<double>(free_regions_.size()) / get_num_regions();
+  uint32_t num_free_regions = 0;
+  for (uint32_t node = 0; node < num_nodes_; node++) {
+    num_free_regions += free_regions_[node].size();
+  }
+  return static_cast<double>(num_free_regions) / get_num_regions();
 }
 
 FORCE_INLINE uint32_t FarMemManager::RegionManager::get_num_regions() const {
-  return free_regions_.capacity();
+  return num_regions_;
+}
+
+FORCE_INLINE uint32_t FarMemManager::RegionManager::get_num_nodes() const {
+  return num_nodes_;
+}
+
+FORCE_INLINE uint32_t
+FarMemManager::RegionManager::get_num_free_regions(uint32_t node) const {
+  return free_regions_[node].size();
+}
+
+FORCE_INLINE bool FarMemManager::RegionManager::contains(uint64_t addr) const {
+  auto start = reinterpret_cast<uint64_t>(local_cache_ptr_.get());
+  return addr >= start &&
+         addr < start + static_cast<uint64_t>(get_num_regions()) * Region::kSize;
+}
+
+FORCE_INLINE void
+FarMemManager::RegionManager::inc_live_bytes(uint64_t object_addr,
+                                             int32_t delta) {
+  assert(!local_cache_ptr_);
+  __atomic_add_fetch(&live_bytes_[object_addr >> Region::kShift], delta,
+                     __ATOMIC_SEQ_CST);
+}
+
+FORCE_INLINE void
+FarMemManager::RegionManager::seal_region(const Region &region) {
+  __atomic_add_fetch(&live_bytes_[region.get_idx()], kSealedBit,
+                     __ATOMIC_SEQ_CST);
+}
+
+FORCE_INLINE std::optional<uint32_t>
+FarMemManager::RegionManager::get_sealed_live_bytes(uint32_t region_idx) const {
+  auto live_bytes = __atomic_load_n(&live_bytes_[region_idx], __ATOMIC_ACQUIRE);
+  if (!(live_bytes & kSealedBit)) {
+    return std::nullopt;
+  }
+  return live_bytes & (~kSealedBit);
 }
 
 FORCE_INLINE double FarMemManager::get_free_mem_ratio() const {
@@ -54,11 +105,13 @@ template <typename T>
 FORCE_INLINE UniquePtr<T> FarMemManager::allocate_unique_ptr(uint8_t ds_id) {
   static_assert(sizeof(T) <= Object::kMaxObjectDataSize);
   auto object_size = Object::kHeaderSize + sizeof(T) + kVanillaPtrObjectIDSize;
-  auto local_object_addr = allocate_local_object(false, object_size);
+  auto local_object_addr =
+      allocate_local_object(is_over_soft_quota(ds_id), object_size);
   auto remote_object_addr = allocate_remote_object(false, object_size);
   Object(local_object_addr, ds_id, static_cast<uint16_t>(sizeof(T)),
          static_cast<uint8_t>(sizeof(remote_object_addr)),
          reinterpret_cast<const uint8_t *>(&remote_object_addr));
+  inc_ds_local_bytes(ds_id, object_size);
   auto ptr = UniquePtr<T>(local_object_addr);
   Region::atomic_inc_ref_cnt(local_object_addr, -1);
   return ptr;
@@ -68,11 +121,13 @@ template <typename T>
 FORCE_INLINE SharedPtr<T> FarMemManager::allocate_shared_ptr(uint8_t ds_id) {
   static_assert(sizeof(T) <= Object::kMaxObjectDataSize);
   auto object_size = Object::kHeaderSize + sizeof(T) + kVanillaPtrObjectIDSize;
-  auto local_object_addr = allocate_local_object(false, object_size);
+  auto local_object_addr =
+      allocate_local_object(is_over_soft_quota(ds_id), object_size);
   auto remote_object_addr = allocate_remote_object(false, object_size);
   Object(local_object_addr, ds_id, static_cast<uint16_t>(sizeof(T)),
          static_cast<uint8_t>(sizeof(remote_object_addr)),
          reinterpret_cast<const uint8_t *>(&remote_object_addr));
+  inc_ds_local_bytes(ds_id, object_size);
   auto ptr = SharedPtr<T>(local_object_addr);
   Region::atomic_inc_ref_cnt(local_object_addr, -1);
   return ptr;
@@ -115,6 +170,16 @@ FarMemManager::allocate_dataframe_vector_heap() {
   return new DataFrameVector<T>(this);
 }
 
+template <typename K, typename V>
+FORCE_INLINE BTree<K, V> FarMemManager::allocate_btree() {
+  return BTree<K, V>(this);
+}
+
+template <typename K, typename V>
+FORCE_INLINE BTree<K, V> *FarMemManager::allocate_btree_heap() {
+  return new BTree<K, V>(this);
+}
+
 FORCE_INLINE FarMemManager *FarMemManagerFactory::get() { return ptr_; }
 
 FORCE_INLINE void FarMemManager::register_eval_notifier(uint8_t ds_id,
@@ -134,6 +199,36 @@ FORCE_INLINE void FarMemManager::read_object(uint8_t ds_id, uint8_t obj_id_len,
   device_ptr_->read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
 }
 
+FORCE_INLINE void FarMemManager::read_objects(uint32_t num_objs,
+                                              const ObjectReadReq *reqs) {
+  device_ptr_->read_objects(num_objs, reqs);
+}
+
+FORCE_INLINE uint8_t FarMemManager::append_back_ref(uint8_t ds_id,
+                                                   uint8_t obj_id_len,
+                                                   const uint8_t *obj_id,
+                                                   uint64_t ptr_addr,
+                                                   uint8_t *buf) {
+  memcpy(buf, obj_id, obj_id_len);
+  if (ds_id != kVanillaPtrDSID || obj_id_len != kVanillaPtrObjectIDSize) {
+    return obj_id_len;
+  }
+  // Piggyback the far-mem pointer addr so that the far-mem GC is able to
+  // find the pointer of the remote object.
+  __builtin_memcpy(buf + obj_id_len, &ptr_addr, kVanillaPtrBackRefSize);
+  return obj_id_len + kVanillaPtrBackRefSize;
+}
+
+FORCE_INLINE void FarMemManager::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                              const uint8_t *obj_id,
+                                              uint16_t data_len,
+                                              const uint8_t *data_buf,
+                                              uint64_t ptr_addr) {
+  uint8_t buf[Object::kMaxObjectIDSize + kVanillaPtrBackRefSize];
+  auto buf_len = append_back_ref(ds_id, obj_id_len, obj_id, ptr_addr, buf);
+  device_ptr_->write_object(ds_id, buf_len, buf, data_len, data_buf);
+}
+
 FORCE_INLINE bool FarMemManager::remove_object(uint64_t ds_id,
                                                uint8_t obj_id_len,
                                                const uint8_t *obj_id) {
@@ -151,11 +246,17 @@ FORCE_INLINE void FarMemManager::destruct(uint8_t ds_id) {
   device_ptr_->destruct(ds_id);
 }
 
-FORCE_INLINE bool FarMemManager::call(uint8_t ds_id,
-                         const std::string &method,
-                         const rpc::BufferPtr &args,
-                         rpc::BufferPtr &ret) {
-  return device_ptr_->call(ds_id, method, args, ret);
+FORCE_INLINE rpc::RpcErrorCode
+FarMemManager::call(uint8_t ds_id, rpc::MethodID method_id,
+                    const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
+  return device_ptr_->call(ds_id, method_id, args, ret);
+}
+
+FORCE_INLINE rpc::RpcErrorCode
+FarMemManager::call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                           const rpc::BufferPtr &args,
+                           const rpc::StreamReader::ChunkFn &chunk_fn) {
+  return device_ptr_->call_stream(ds_id, method_id, args, chunk_fn);
 }
 
 FORCE_INLINE uint64_t get_obj_id_fragment(uint8_t obj_id_len,
@@ -176,18 +277,82 @@ FORCE_INLINE void FarMemManager::lock_object(uint8_t obj_id_len,
                                              const uint8_t *obj_id) {
   // So far we only use at most 8 bytes of obj_id in locker.
   auto obj_id_fragment = get_obj_id_fragment(obj_id_len, obj_id);
-  while (!obj_locker_.try_insert(obj_id_fragment))
-    ;
+  obj_locker_.lock(obj_id_fragment);
+}
+
+FORCE_INLINE bool FarMemManager::try_lock_object(uint8_t obj_id_len,
+                                                 const uint8_t *obj_id) {
+  auto obj_id_fragment = get_obj_id_fragment(obj_id_len, obj_id);
+  return obj_locker_.try_lock(obj_id_fragment);
 }
 
 FORCE_INLINE void FarMemManager::unlock_object(uint8_t obj_id_len,
                                                const uint8_t *obj_id) {
   auto obj_id_fragment = get_obj_id_fragment(obj_id_len, obj_id);
-  obj_locker_.remove(obj_id_fragment);
+  obj_locker_.unlock(obj_id_fragment);
+}
+
+FORCE_INLINE void FarMemManager::free_remote_object(Object obj) {
+  // Only the vanilla pointers' remote space is allocated by the manager.
+  if (obj.get_ds_id() == kVanillaPtrDSID &&
+      obj.get_obj_id_len() == kVanillaPtrObjectIDSize) {
+    free_remote_object(*reinterpret_cast<const uint64_t *>(obj.get_obj_id()),
+                       obj.size());
+  }
+}
+
+FORCE_INLINE std::optional<uint64_t>
+FarMemManager::erase_moved_ptr(uint64_t obj_id) {
+  if (likely(!num_moved_ptrs_.load(std::memory_order_acquire))) {
+    return std::nullopt;
+  }
+  moved_ptrs_spin_.Lock();
+  auto guard = helpers::finally([&]() { moved_ptrs_spin_.Unlock(); });
+  auto iter = moved_ptrs_.find(obj_id);
+  if (iter == moved_ptrs_.end()) {
+    return std::nullopt;
+  }
+  auto ptr_addr = iter->second;
+  moved_ptrs_.erase(iter);
+  num_moved_ptrs_--;
+  return ptr_addr;
+}
+
+FORCE_INLINE void FarMemManager::inc_ds_local_bytes(uint8_t ds_id,
+                                                    int64_t delta) {
+  __atomic_fetch_add(&ds_local_bytes_[ds_id].data, delta, __ATOMIC_RELAXED);
+}
+
+FORCE_INLINE uint64_t FarMemManager::get_ds_local_bytes(uint8_t ds_id) const {
+  auto bytes = __atomic_load_n(&ds_local_bytes_[ds_id].data, __ATOMIC_RELAXED);
+  return bytes > 0 ? bytes : 0;
+}
+
+FORCE_INLINE bool FarMemManager::is_over_soft_quota(uint8_t ds_id) const {
+  return get_ds_local_bytes(ds_id) > ACCESS_ONCE(ds_quotas_[ds_id].soft_limit);
+}
+
+FORCE_INLINE bool FarMemManager::is_over_hard_quota(uint8_t ds_id) const {
+  return get_ds_local_bytes(ds_id) > ACCESS_ONCE(ds_quotas_[ds_id].hard_limit);
+}
+
+FORCE_INLINE bool FarMemManager::is_any_hard_quota_exceeded() const {
+  auto num_quota_ds_ids = load_acquire(&num_quota_ds_ids_);
+  for (uint32_t i = 0; i < num_quota_ds_ids; i++) {
+    if (is_over_hard_quota(quota_ds_ids_[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+FORCE_INLINE void FarMemManager::free_local_object(Object obj) {
+  inc_ds_local_bytes(obj.get_ds_id(), -static_cast<int64_t>(obj.size()));
+  obj.free();
 }
 
 FORCE_INLINE void FarMemManager::gc_check() {
-  if (unlikely(is_free_cache_low())) {
+  if (unlikely(is_free_cache_low() || is_any_hard_quota_exceeded())) {
     Stats::add_free_mem_ratio_record();
     ACCESS_ONCE(almost_empty) = is_free_cache_almost_empty();
 #ifndef STW_GC
@@ -0,0 +1,116 @@
+#pragma once
+
+extern "C" {
+#include <asm/atomic.h>
+#include <asm/ops.h>
+#include <base/assert.h>
+#include <base/compiler.h>
+#include <runtime/preempt.h>
+#include <runtime/thread.h>
+}
+
+#include "helpers.hpp"
+
+namespace far_memory {
+
+FORCE_INLINE uint32_t ObjLocker::hash_func(uint64_t obj_id) {
+  // The object IDs are mostly aligned offsets, so their low bits are mixed in
+  // by the Fibonacci hashing.
+  return (obj_id * 0x9E3779B97F4A7C15ULL) >> (64 - kNumBucketsShift);
+}
+
+FORCE_INLINE ObjLocker::Entry *ObjLocker::probe(uint32_t start, uint32_t i) {
+  return &entries_[(start + i) & (kNumEntries - 1)];
+}
+
+FORCE_INLINE ObjLocker::ClaimResult ObjLocker::try_claim(uint64_t obj_id,
+                                                         Entry **holder) {
+  auto start = hash_func(obj_id) * kNumEntriesPerBucket;
+  *holder = nullptr;
+  // Others spin on a claiming entry, so don't get preempted while claiming.
+  preempt_disable();
+  auto guard = helpers::finally([&]() { preempt_enable(); });
+
+retry:
+  Entry *claimed = nullptr;
+  for (uint32_t i = 0; i < kNumProbeEntries; i++) {
+    auto *entry = probe(start, i);
+    auto state = load_acquire(&entry->state);
+    if (state == Free) {
+      if (!claimed) {
+        claimed = entry;
+      }
+    } else if (ACCESS_ONCE(entry->obj_id) == obj_id) {
+      if (state != Claiming) {
+        *holder = entry;
+      }
+      return ClaimResult::Held;
+    }
+  }
+  if (unlikely(!claimed)) {
+    return ClaimResult::Full;
+  }
+  if (unlikely(!__sync_bool_compare_and_swap(&claimed->state, Free, Claiming))) {
+    goto retry;
+  }
+  ACCESS_ONCE(claimed->obj_id) = obj_id;
+  mb();
+  // Someone else may have claimed another entry for the same object since the
+  // scan. Either of the two sees the other here and backs off.
+  for (uint32_t i = 0; i < kNumProbeEntries; i++) {
+    auto *entry = probe(start, i);
+    if (entry != claimed && ACCESS_ONCE(entry->state) != Free &&
+        ACCESS_ONCE(entry->obj_id) == obj_id) {
+      store_release(&claimed->state, Free);
+      return ClaimResult::Held;
+    }
+  }
+  store_release(&claimed->state, Locked);
+  return ClaimResult::Acquired;
+}
+
+FORCE_INLINE void ObjLocker::lock(uint64_t obj_id) {
+  while (true) {
+    Entry *holder;
+    switch (try_claim(obj_id, &holder)) {
+    case ClaimResult::Acquired:
+      return;
+    case ClaimResult::Held:
+      if (holder) {
+        if (wait(obj_id, holder)) {
+          return;
+        }
+      } else {
+        cpu_relax();
+      }
+      break;
+    case ClaimResult::Full:
+      thread_yield();
+      break;
+    }
+  }
+}
+
+FORCE_INLINE bool ObjLocker::try_lock(uint64_t obj_id) {
+  Entry *holder;
+  return try_claim(obj_id, &holder) == ClaimResult::Acquired;
+}
+
+FORCE_INLINE void ObjLocker::unlock(uint64_t obj_id) {
+  auto start = hash_func(obj_id) * kNumEntriesPerBucket;
+  for (uint32_t i = 0; i < kNumProbeEntries; i++) {
+    auto *entry = probe(start, i);
+    auto state = ACCESS_ONCE(entry->state);
+    if ((state == Locked || state == Contended) &&
+        ACCESS_ONCE(entry->obj_id) == obj_id) {
+      if (likely(__sync_bool_compare_and_swap(&entry->state, Locked, Free))) {
+        return;
+      }
+      handoff(entry);
+      return;
+    }
+  }
+  BUG();
+}
+
+} // namespace far_memory
@@ -2,8 +2,10 @@
 
 #include "helpers.hpp"
 #include "region.hpp"
+#include "stats.hpp"
 
 #include <type_traits>
+#include <utility>
 
 namespace far_memory {
 
@@ -168,6 +170,7 @@ FORCE_INLINE uint8_t FarMemPtrMeta::get_ds_id() const {
 
 template <bool Mut, bool Nt, bool Shared>
 FORCE_INLINE void *GenericFarMemPtr::_deref() {
+  [[maybe_unused]] bool swapped_in = false;
 retry:
   // 1) movq.
   auto metadata = meta().to_uint64_t();
@@ -187,6 +190,7 @@ retry:
           return nullptr;
         }
         swap_in(Nt);
+        swapped_in = true;
         // Just swapped in, need to update metadata (for the obj data addr).
         metadata = meta().to_uint64_t();
       } else {
@@ -213,8 +217,44 @@ retry:
   }
 
   // 4) shrq.
-  return reinterpret_cast<void *>(metadata >>
-                                  FarMemPtrMeta::kObjectDataAddrBitPos);
+  auto *data_ptr = reinterpret_cast<void *>(
+      metadata >> FarMemPtrMeta::kObjectDataAddrBitPos);
+  if constexpr (MONITOR_DEREF_HITS) {
+    if (!swapped_in) {
+      Stats::inc_deref_hits(
+          Object(reinterpret_cast<uint64_t>(data_ptr) - Object::kHeaderSize)
+              .get_ds_id(),
+          1);
+    }
+  }
+  return data_ptr;
+}
+
+FORCE_INLINE SwapInFuture::SwapInFuture() {}
+
+FORCE_INLINE SwapInFuture::SwapInFuture(std::function<void()> &&swap_in_fn)
+    : thread_(std::move(swap_in_fn)), pending_(true) {}
+
+FORCE_INLINE SwapInFuture::~SwapInFuture() { wait(); }
+
+FORCE_INLINE SwapInFuture::SwapInFuture(SwapInFuture &&other) {
+  *this = std::move(other);
+}
+
+FORCE_INLINE SwapInFuture &SwapInFuture::operator=(SwapInFuture &&other) {
+  wait();
+  thread_ = std::move(other.thread_);
+  pending_ = std::exchange(other.pending_, false);
+  return *this;
+}
+
+FORCE_INLINE bool SwapInFuture::is_pending() const { return pending_; }
+
+FORCE_INLINE void SwapInFuture::wait() {
+  if (pending_) {
+    thread_.Join();
+    pending_ = false;
+  }
 }
 
 template <bool Shared>
@@ -276,6 +316,40 @@ FORCE_INLINE void *GenericUniquePtr::deref_mut(const DerefScope &scope) {
   return _deref</* Mut = */ true, Nt>();
 }
 
+template <bool Nt>
+FORCE_INLINE void GenericUniquePtr::deref_many(const DerefScope &scope,
+                                              GenericUniquePtr *const *ptrs,
+                                              uint32_t num_ptrs,
+                                              const void **raw_ptrs) {
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    if (!ptrs[i]->is_present() && !ptrs[i]->is_null()) {
+      swap_in_all(Nt, reinterpret_cast<GenericFarMemPtr *const *>(ptrs),
+                  num_ptrs);
+      break;
+    }
+  }
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    raw_ptrs[i] = ptrs[i]->deref<Nt>(scope);
+  }
+}
+
+template <bool Nt>
+FORCE_INLINE void GenericUniquePtr::deref_mut_many(const DerefScope &scope,
+                                                  GenericUniquePtr *const *ptrs,
+                                                  uint32_t num_ptrs,
+                                                  void **raw_ptrs) {
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    if (!ptrs[i]->is_present() && !ptrs[i]->is_null()) {
+      swap_in_all(Nt, reinterpret_cast<GenericFarMemPtr *const *>(ptrs),
+                  num_ptrs);
+      break;
+    }
+  }
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    raw_ptrs[i] = ptrs[i]->deref_mut<Nt>(scope);
+  }
+}
+
 template <typename T>
 FORCE_INLINE UniquePtr<T>::UniquePtr(uint64_t object_addr)
     : GenericUniquePtr(object_addr) {}
@@ -303,6 +377,26 @@ FORCE_INLINE T *UniquePtr<T>::deref_mut(const DerefScope &scope) {
   return reinterpret_cast<T *>(GenericUniquePtr::deref_mut<Nt>(scope));
 }
 
+template <typename T>
+template <bool Nt>
+FORCE_INLINE void UniquePtr<T>::deref_many(const DerefScope &scope,
+                                          UniquePtr *const *ptrs,
+                                          uint32_t num_ptrs, const T **raw_ptrs) {
+  GenericUniquePtr::deref_many<Nt>(
+      scope, reinterpret_cast<GenericUniquePtr *const *>(ptrs), num_ptrs,
+      reinterpret_cast<const void **>(raw_ptrs));
+}
+
+template <typename T>
+template <bool Nt>
+FORCE_INLINE void UniquePtr<T>::deref_mut_many(const DerefScope &scope,
+                                              UniquePtr *const *ptrs,
+                                              uint32_t num_ptrs, T **raw_ptrs) {
+  GenericUniquePtr::deref_mut_many<Nt>(
+      scope, reinterpret_cast<GenericUniquePtr *const *>(ptrs), num_ptrs,
+      reinterpret_cast<void **>(raw_ptrs));
+}
+
 template <typename T> FORCE_INLINE UniquePtr<T>::UniquePtr(UniquePtr &&other) {
   *this = std::move(other);
 }
@@ -329,7 +423,7 @@ FORCE_INLINE void UniquePtr<T>::write(U &&u) {
 
 template <typename T> FORCE_INLINE void UniquePtr<T>::free() {
   if constexpr (std::is_trivially_destructible<T>::value) {
-    if (!meta().is_present()) {
+    if (!meta().is_present() && free_swapped_out()) {
       return;
     }
   }
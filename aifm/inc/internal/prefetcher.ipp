@@ -2,6 +2,7 @@
 
 #include "device.hpp"
 
+#include <cstring>
 #include <optional>
 
 //#define PREFECHER_LOG 1
@@ -23,7 +24,7 @@ FORCE_INLINE Prefetcher<InduceFn, InferFn, MappingFn>::Prefetcher(
   prefetch_threads_.emplace_back([&]() { prefetch_master_fn(); });
   for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
     auto &status = slave_status_[i].data;
-    status.task = nullptr;
+    status.num_tasks = 0;
     status.is_exited = false;
     wmb();
     prefetch_threads_.emplace_back([&, i]() { prefetch_slave_fn(i); });
@@ -55,9 +56,11 @@ FORCE_INLINE void
 Prefetcher<InduceFn, InferFn, MappingFn>::generate_prefetch_tasks() {
   InferFn inferer;
   MappingFn mapper;
+  GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
+  uint32_t num_tasks = 0;
   for (uint32_t i = 0; i < kGenTasksBurstSize; i++) {
     if (!num_objs_to_prefetch) {
-      return;
+      break;
     }
     num_objs_to_prefetch--;
     Index_t tmp_idx = next_prefetch_idx_;
@@ -71,57 +74,69 @@ Prefetcher<InduceFn, InferFn, MappingFn>::generate_prefetch_tasks() {
       if (!task) {
         continue;
       }
-      bool dispatched = false;
-      std::optional<uint32_t> inactive_slave_id = std::nullopt;
-      for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
-        auto &status = slave_status_[i].data;
-        if (status.cv.HasWaiters()) {
-          inactive_slave_id = i;
-          continue;
-        }
-        if (ACCESS_ONCE(status.task) == nullptr) {
-          ACCESS_ONCE(status.task) = task;
-          dispatched = true;
-          break;
-        }
-      }
-      if (!dispatched) {
-        if (likely(inactive_slave_id)) {
-          auto &status = slave_status_[*inactive_slave_id].data;
-          status.task = task;
-          wmb();
-          status.cv.Signal();
-        } else {
-          DerefScope scope;
-          task->swap_in(nt_);
-        }
-      }
+      tasks[num_tasks++] = task;
     }
   }
+  if (num_tasks) {
+    dispatch_prefetch_tasks(tasks, num_tasks);
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::dispatch_prefetch_tasks(
+    GenericUniquePtr **tasks, uint32_t num_tasks) {
+  std::optional<uint32_t> inactive_slave_id = std::nullopt;
+  for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
+    auto &status = slave_status_[i].data;
+    if (status.cv.HasWaiters()) {
+      inactive_slave_id = i;
+      continue;
+    }
+    if (ACCESS_ONCE(status.num_tasks) == 0) {
+      memcpy(status.tasks, tasks, num_tasks * sizeof(*tasks));
+      wmb();
+      ACCESS_ONCE(status.num_tasks) = num_tasks;
+      return;
+    }
+  }
+  if (likely(inactive_slave_id)) {
+    auto &status = slave_status_[*inactive_slave_id].data;
+    memcpy(status.tasks, tasks, num_tasks * sizeof(*tasks));
+    status.num_tasks = num_tasks;
+    wmb();
+    status.cv.Signal();
+  } else {
+    DerefScope scope;
+    GenericUniquePtr::swap_in_batch(nt_, tasks, num_tasks);
+  }
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
 FORCE_INLINE void
 Prefetcher<InduceFn, InferFn, MappingFn>::prefetch_slave_fn(uint32_t tid) {
   auto &status = slave_status_[tid].data;
-  GenericUniquePtr **task_ptr = &status.task;
+  uint32_t *num_tasks_ptr = &status.num_tasks;
   bool *is_exited = &status.is_exited;
   rt::CondVar *cv = &status.cv;
+  GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
   cv->Wait();
 
   while (likely(!ACCESS_ONCE(exit_))) {
-    if (likely(ACCESS_ONCE(*task_ptr))) {
-      GenericUniquePtr *task = *task_ptr;
-      ACCESS_ONCE(*task_ptr) = nullptr;
+    if (likely(ACCESS_ONCE(*num_tasks_ptr))) {
+      uint32_t num_tasks = *num_tasks_ptr;
+      rmb();
+      memcpy(tasks, status.tasks, num_tasks * sizeof(*tasks));
+      ACCESS_ONCE(*num_tasks_ptr) = 0;
       DerefScope scope;
-      task->swap_in(nt_);
+      GenericUniquePtr::swap_in_batch(nt_, tasks, num_tasks);
     } else {
       auto start_us = microtime();
-      while (ACCESS_ONCE(*task_ptr) == nullptr &&
+      while (ACCESS_ONCE(*num_tasks_ptr) == 0 &&
              microtime() - start_us <= kMaxSlaveWaitUs) {
         cpu_relax();
       }
-      if (unlikely(ACCESS_ONCE(*task_ptr) == nullptr)) {
+      if (unlikely(ACCESS_ONCE(*num_tasks_ptr) == 0)) {
         cv->Wait();
       }
     }
@@ -189,9 +204,11 @@ Prefetcher<InduceFn, InferFn, MappingFn>::add_trace(bool nt, Index_t idx) {
 #ifdef PREFECHER_LOG
   printf("add_trace(%ld)\n", idx);
 #endif
-  traces_[traces_tail_++] = {
-      .counter = ++traces_counter_, .idx = idx, .nt = nt};
-  traces_tail_ %= kIdxTracesSize;
+  // Mutator threads that share the data structure may race on the tail and
+  // lose traces, but the tail never goes out of the buffer.
+  auto tail = ACCESS_ONCE(traces_tail_);
+  traces_[tail] = {.counter = ++traces_counter_, .idx = idx, .nt = nt};
+  ACCESS_ONCE(traces_tail_) = (tail + 1) % kIdxTracesSize;
   if (unlikely(cv_prefetch_master_.HasWaiters())) {
     cv_prefetch_master_.Signal();
   }
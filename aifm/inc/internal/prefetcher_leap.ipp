@@ -2,6 +2,7 @@
 
 #include "device.hpp"
 
+#include <cstring>
 #include <optional>
 
 //#define PREFECHER_LEAP_LOG 1
@@ -25,7 +26,7 @@ FORCE_INLINE Prefetcher<InduceFn, InferFn, MappingFn>::Prefetcher(
   prefetch_threads_.emplace_back([&]() { prefetch_master_fn(); });
   for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
     auto &status = slave_status_[i].data;
-    status.task = nullptr;
+    status.num_tasks = 0;
     status.is_exited = false;
     wmb();
     prefetch_threads_.emplace_back([&, i]() { prefetch_slave_fn(i); });
@@ -57,9 +58,11 @@ FORCE_INLINE void
 Prefetcher<InduceFn, InferFn, MappingFn>::generate_prefetch_tasks() {
   InferFn inferer;
   MappingFn mapper;
+  GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
+  uint32_t num_tasks = 0;
   for (uint32_t i = 0; i < kGenTasksBurstSize; i++) {
     if (!num_objs_to_prefetch) {
-      return;
+      break;
     }
     num_objs_to_prefetch--;
     Index_t tmp_idx = next_prefetch_idx_;
@@ -73,57 +76,69 @@ Prefetcher<InduceFn, InferFn, MappingFn>::generate_prefetch_tasks() {
       if (!task) {
         continue;
       }
-      bool dispatched = false;
-      std::optional<uint32_t> inactive_slave_id = std::nullopt;
-      for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
-        auto &status = slave_status_[i].data;
-        if (status.cv.HasWaiters()) {
-          inactive_slave_id = i;
-          continue;
-        }
-        if (ACCESS_ONCE(status.task) == nullptr) {
-          ACCESS_ONCE(status.task) = task;
-          dispatched = true;
-          break;
-        }
-      }
-      if (!dispatched) {
-        if (likely(inactive_slave_id)) {
-          auto &status = slave_status_[*inactive_slave_id].data;
-          status.task = task;
-          wmb();
-          status.cv.Signal();
-        } else {
-          DerefScope scope;
-          task->swap_in(nt_);
-        }
-      }
+      tasks[num_tasks++] = task;
     }
   }
+  if (num_tasks) {
+    dispatch_prefetch_tasks(tasks, num_tasks);
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::dispatch_prefetch_tasks(
+    GenericUniquePtr **tasks, uint32_t num_tasks) {
+  std::optional<uint32_t> inactive_slave_id = std::nullopt;
+  for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
+    auto &status = slave_status_[i].data;
+    if (status.cv.HasWaiters()) {
+      inactive_slave_id = i;
+      continue;
+    }
+    if (ACCESS_ONCE(status.num_tasks) == 0) {
+      memcpy(status.tasks, tasks, num_tasks * sizeof(*tasks));
+      wmb();
+      ACCESS_ONCE(status.num_tasks) = num_tasks;
+      return;
+    }
+  }
+  if (likely(inactive_slave_id)) {
+    auto &status = slave_status_[*inactive_slave_id].data;
+    memcpy(status.tasks, tasks, num_tasks * sizeof(*tasks));
+    status.num_tasks = num_tasks;
+    wmb();
+    status.cv.Signal();
+  } else {
+    DerefScope scope;
+    GenericUniquePtr::swap_in_batch(nt_, tasks, num_tasks);
+  }
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
 FORCE_INLINE void
 Prefetcher<InduceFn, InferFn, MappingFn>::prefetch_slave_fn(uint32_t tid) {
   auto &status = slave_status_[tid].data;
-  GenericUniquePtr **task_ptr = &status.task;
+  uint32_t *num_tasks_ptr = &status.num_tasks;
   bool *is_exited = &status.is_exited;
   rt::CondVar *cv = &status.cv;
+  GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
   cv->Wait();
 
   while (likely(!ACCESS_ONCE(exit_))) {
-    if (likely(ACCESS_ONCE(*task_ptr))) {
-      GenericUniquePtr *task = *task_ptr;
-      ACCESS_ONCE(*task_ptr) = nullptr;
+    if (likely(ACCESS_ONCE(*num_tasks_ptr))) {
+      uint32_t num_tasks = *num_tasks_ptr;
+      rmb();
+      memcpy(tasks, status.tasks, num_tasks * sizeof(*tasks));
+      ACCESS_ONCE(*num_tasks_ptr) = 0;
       DerefScope scope;
-      task->swap_in(nt_);
+      GenericUniquePtr::swap_in_batch(nt_, tasks, num_tasks);
     } else {
       auto start_us = microtime();
-      while (ACCESS_ONCE(*task_ptr) == nullptr &&
-          microtime() - start_us <= kMaxSlaveWaitUs) {
+      while (ACCESS_ONCE(*num_tasks_ptr) == 0 &&
+             microtime() - start_us <= kMaxSlaveWaitUs) {
         cpu_relax();
       }
-      if (unlikely(ACCESS_ONCE(*task_ptr) == nullptr)) {
+      if (unlikely(ACCESS_ONCE(*num_tasks_ptr) == 0)) {
         cv->Wait();
       }
     }
@@ -0,0 +1,333 @@
+#pragma once
+
+#include "device.hpp"
+
+#include <cstring>
+#include <optional>
+
+//#define PREFECHER_STREAM_LOG 1
+
+#ifdef PREFECHER_STREAM_LOG
+#include <iostream>
+#endif
+
+namespace far_memory {
+
+namespace stream {
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE Prefetcher<InduceFn, InferFn, MappingFn>::Prefetcher(
+    FarMemDevice *device, uint8_t *state, uint32_t object_data_size)
+    : kPrefetchWinSize_(device->get_prefetch_win_size() / (object_data_size)),
+      state_(state), object_data_size_(object_data_size) {
+  for (auto &trace : traces_) {
+    trace.counter = 0;
+  }
+  prefetch_threads_.emplace_back([&]() { prefetch_master_fn(); });
+  for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
+    auto &status = slave_status_[i].data;
+    status.num_tasks = 0;
+    status.is_exited = false;
+    wmb();
+    prefetch_threads_.emplace_back([&, i]() { prefetch_slave_fn(i); });
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE Prefetcher<InduceFn, InferFn, MappingFn>::~Prefetcher() {
+  exit_ = true;
+  wmb();
+  while (!ACCESS_ONCE(master_exited)) {
+    cv_prefetch_master_.Signal();
+    thread_yield();
+  }
+  for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
+    auto &status = slave_status_[i].data;
+    while (!ACCESS_ONCE(status.is_exited)) {
+      status.cv.Signal();
+      thread_yield();
+    }
+  }
+  for (auto &thread : prefetch_threads_) {
+    thread.Join();
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE typename Prefetcher<InduceFn, InferFn, MappingFn>::Stream *
+Prefetcher<InduceFn, InferFn, MappingFn>::allocate_stream() {
+  // Prefers an empty entry, and otherwise replaces the least recently hit one.
+  Stream *victim = &streams_[0];
+  for (auto &stream : streams_) {
+    if (!stream.valid) {
+      return &stream;
+    }
+    if (stream.last_hit < victim->last_hit) {
+      victim = &stream;
+    }
+  }
+  return victim;
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::hit_stream(Stream *stream,
+                                                    Index_t idx) {
+  InferFn inferer;
+  stream->last_idx = idx;
+  stream->last_hit = ++num_hits_;
+  if (stream->confidence < kMaxConfidence) {
+    stream->confidence++;
+  }
+  if (stream->confidence < kConfidenceThresh) {
+    return;
+  }
+  if (unlikely(stream->confidence == kConfidenceThresh)) {
+#ifdef PREFECHER_STREAM_LOG
+    printf("stream(%ld, %ld)\n", idx, stream->stride);
+#endif
+    stream->next_prefetch_idx = inferer(idx, stream->stride);
+    stream->num_objs_to_prefetch = kPrefetchWinSize_;
+  } else {
+    // Slides the window by the hit.
+    stream->num_objs_to_prefetch++;
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::detect_stream(Index_t idx) {
+  InduceFn inducer;
+  // Looks for h1 and h2 in the history such that h2, h1 and idx are evenly
+  // spaced, from the most recent h1 on.
+  for (uint32_t i = 1; i <= history_size_; i++) {
+    auto h1 = history_[(history_tail_ + kHistorySize - i) % kHistorySize];
+    auto stride = inducer(h1, idx);
+    if (stride == Pattern_t{}) {
+      continue;
+    }
+    for (uint32_t j = i + 1; j <= history_size_; j++) {
+      auto h2 = history_[(history_tail_ + kHistorySize - j) % kHistorySize];
+      if (inducer(h2, h1) == stride) {
+        auto *stream = allocate_stream();
+        *stream = {.valid = true,
+                   .last_idx = h1,
+                   .stride = stride,
+                   .confidence = 1};
+        hit_stream(stream, idx);
+        return;
+      }
+    }
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::add_history(Index_t idx) {
+  history_[history_tail_] = idx;
+  history_tail_ = (history_tail_ + 1) % kHistorySize;
+  if (history_size_ < kHistorySize) {
+    history_size_++;
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::process_trace(Index_t idx) {
+  InferFn inferer;
+  for (auto &stream : streams_) {
+    if (!stream.valid) {
+      continue;
+    }
+    if (unlikely(stream.last_idx == idx)) {
+      // Repeated accesses of the same object tell nothing.
+      return;
+    }
+    if (inferer(stream.last_idx, stream.stride) == idx) {
+      hit_stream(&stream, idx);
+      add_history(idx);
+      return;
+    }
+  }
+  detect_stream(idx);
+  add_history(idx);
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE bool
+Prefetcher<InduceFn, InferFn, MappingFn>::has_prefetch_tasks() const {
+  for (auto &stream : streams_) {
+    if (stream.valid && stream.num_objs_to_prefetch) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::generate_prefetch_tasks() {
+  InferFn inferer;
+  MappingFn mapper;
+  GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
+  uint32_t num_tasks = 0;
+  // The streams take turns so that their windows advance independently.
+  uint32_t num_gens = 0;
+  uint32_t num_idles = 0;
+  while (num_gens < kGenTasksBurstSize && num_idles < kNumStreams) {
+    auto &stream = streams_[next_stream_];
+    next_stream_ = (next_stream_ + 1) % kNumStreams;
+    if (!stream.valid || !stream.num_objs_to_prefetch) {
+      num_idles++;
+      continue;
+    }
+    num_idles = 0;
+    num_gens++;
+    stream.num_objs_to_prefetch--;
+    auto idx = stream.next_prefetch_idx;
+    stream.next_prefetch_idx = inferer(idx, stream.stride);
+#ifdef PREFECHER_STREAM_LOG
+    printf("prefetch(%ld)\n", idx);
+#endif
+    GenericUniquePtr *task = mapper(state_, idx);
+    if (!task) {
+      // Out of the data structure, so the stream is over.
+      stream.num_objs_to_prefetch = 0;
+      continue;
+    }
+    tasks[num_tasks++] = task;
+  }
+  if (num_tasks) {
+    dispatch_prefetch_tasks(tasks, num_tasks);
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::dispatch_prefetch_tasks(
+    GenericUniquePtr **tasks, uint32_t num_tasks) {
+  std::optional<uint32_t> inactive_slave_id = std::nullopt;
+  for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
+    auto &status = slave_status_[i].data;
+    if (status.cv.HasWaiters()) {
+      inactive_slave_id = i;
+      continue;
+    }
+    if (ACCESS_ONCE(status.num_tasks) == 0) {
+      memcpy(status.tasks, tasks, num_tasks * sizeof(*tasks));
+      wmb();
+      ACCESS_ONCE(status.num_tasks) = num_tasks;
+      return;
+    }
+  }
+  if (likely(inactive_slave_id)) {
+    auto &status = slave_status_[*inactive_slave_id].data;
+    memcpy(status.tasks, tasks, num_tasks * sizeof(*tasks));
+    status.num_tasks = num_tasks;
+    wmb();
+    status.cv.Signal();
+  } else {
+    DerefScope scope;
+    GenericUniquePtr::swap_in_batch(nt_, tasks, num_tasks);
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::prefetch_slave_fn(uint32_t tid) {
+  auto &status = slave_status_[tid].data;
+  uint32_t *num_tasks_ptr = &status.num_tasks;
+  bool *is_exited = &status.is_exited;
+  rt::CondVar *cv = &status.cv;
+  GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
+  cv->Wait();
+
+  while (likely(!ACCESS_ONCE(exit_))) {
+    if (likely(ACCESS_ONCE(*num_tasks_ptr))) {
+      uint32_t num_tasks = *num_tasks_ptr;
+      rmb();
+      memcpy(tasks, status.tasks, num_tasks * sizeof(*tasks));
+      ACCESS_ONCE(*num_tasks_ptr) = 0;
+      DerefScope scope;
+      GenericUniquePtr::swap_in_batch(nt_, tasks, num_tasks);
+    } else {
+      auto start_us = microtime();
+      while (ACCESS_ONCE(*num_tasks_ptr) == 0 &&
+             microtime() - start_us <= kMaxSlaveWaitUs) {
+        cpu_relax();
+      }
+      if (unlikely(ACCESS_ONCE(*num_tasks_ptr) == 0)) {
+        cv->Wait();
+      }
+    }
+  }
+  ACCESS_ONCE(*is_exited) = true;
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::prefetch_master_fn() {
+  uint64_t local_counter = 0;
+
+  while (likely(!ACCESS_ONCE(exit_))) {
+    auto [counter, idx, nt] = traces_[traces_head_];
+
+    if (likely(local_counter < counter)) {
+      local_counter = counter;
+      traces_head_ = (traces_head_ + 1) % kIdxTracesSize;
+      process_trace(idx);
+      if (unlikely(nt_ != nt)) {
+        // nt_ is shared by all slaves. Use the store instruction only when
+        // neccesary to reduce cache traffic.
+        nt_ = nt;
+      }
+    } else if (!has_prefetch_tasks()) {
+      cv_prefetch_master_.Wait();
+      continue;
+    }
+    generate_prefetch_tasks();
+  }
+  ACCESS_ONCE(master_exited) = true;
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::add_trace(bool nt, Index_t idx) {
+  // Ditto to the single-stream prefetcher, the mutator side only appends the
+  // trace; the stream detection runs in the backend master thread.
+#ifdef PREFECHER_STREAM_LOG
+  printf("add_trace(%ld)\n", idx);
+#endif
+  auto tail = ACCESS_ONCE(traces_tail_);
+  traces_[tail] = {.counter = ++traces_counter_, .idx = idx, .nt = nt};
+  ACCESS_ONCE(traces_tail_) = (tail + 1) % kIdxTracesSize;
+  if (unlikely(cv_prefetch_master_.HasWaiters())) {
+    cv_prefetch_master_.Signal();
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void Prefetcher<InduceFn, InferFn, MappingFn>::static_prefetch(
+    Index_t start_idx, Pattern_t pattern, uint32_t num) {
+  auto *stream = allocate_stream();
+  *stream = {.valid = true,
+             .last_idx = start_idx,
+             .stride = pattern,
+             .confidence = kConfidenceThresh,
+             .last_hit = ++num_hits_,
+             .next_prefetch_idx = start_idx,
+             .num_objs_to_prefetch = num};
+  if (unlikely(cv_prefetch_master_.HasWaiters())) {
+    cv_prefetch_master_.Signal();
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void
+Prefetcher<InduceFn, InferFn, MappingFn>::update_state(uint8_t *state) {
+  ACCESS_ONCE(state_) = state;
+}
+
+} // namespace stream
+
+} // namespace far_memory
@@ -0,0 +1,106 @@
+#pragma once
+
+extern "C" {
+#include <base/compiler.h>
+}
+#include "thread.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace far_memory {
+
+FORCE_INLINE void DirtyTracker::mark(uint64_t idx) {
+  auto chunk_idx = idx / kNumItemsPerChunk_;
+  auto *word = &bitmap_[chunk_idx / kNumBitsPerWord];
+  auto bit = 1ULL << (chunk_idx % kNumBitsPerWord);
+  // Most writes hit an already dirty chunk, which only takes a load.
+  if (likely(ACCESS_ONCE(*word) & bit)) {
+    return;
+  }
+  if (!(__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit)) {
+    __atomic_fetch_add(&num_dirty_chunks_, 1, __ATOMIC_RELAXED);
+  }
+}
+
+FORCE_INLINE uint64_t DirtyTracker::get_dirty_bytes() const {
+  auto num_dirty_items = std::min(
+      __atomic_load_n(&num_dirty_chunks_, __ATOMIC_RELAXED) * kNumItemsPerChunk_,
+      kNumItems_);
+  return num_dirty_items * kItemSize_;
+}
+
+template <typename F> FORCE_INLINE void DirtyTracker::flush(F &&flush_fn) {
+  if (!__atomic_load_n(&num_dirty_chunks_, __ATOMIC_RELAXED)) {
+    return;
+  }
+  auto num_words = (kNumChunks_ - 1) / kNumBitsPerWord + 1;
+  std::vector<rt::Thread> threads;
+  for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+    threads.emplace_back([&, tid]() {
+      auto num_words_per_thread = (num_words - 1) / helpers::kNumCPUs + 1;
+      auto left = num_words_per_thread * tid;
+      auto right = std::min(left + num_words_per_thread, num_words);
+      for (uint64_t i = left; i < right; i++) {
+        if (!ACCESS_ONCE(bitmap_[i])) {
+          continue;
+        }
+        // Clears the bits before the flush, so that the chunks dirtied again
+        // meanwhile stay tracked.
+        auto word = __atomic_exchange_n(&bitmap_[i], 0, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&num_dirty_chunks_, __builtin_popcountll(word),
+                           __ATOMIC_RELAXED);
+        while (word) {
+          auto chunk_idx = i * kNumBitsPerWord + __builtin_ctzll(word);
+          word &= word - 1;
+          auto begin_idx = chunk_idx * kNumItemsPerChunk_;
+          auto end_idx = std::min(begin_idx + kNumItemsPerChunk_, kNumItems_);
+          flush_fn(begin_idx, end_idx);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+}
+
+template <typename FlushFn, typename LocalFn, typename RemoteFn>
+FORCE_INLINE rpc::RpcErrorCode
+Pushdown::call(CostEstimator *estimator, uint64_t flush_bytes,
+               uint64_t load_bytes, FlushFn &&flush_fn, LocalFn &&local_fn,
+               RemoteFn &&remote_fn, const rpc::BufferPtr &args,
+               rpc::BufferPtr &ret, const uint64_t *streamed_bytes) {
+  if (estimator->SuggestPushdown(flush_bytes, load_bytes)) {
+    estimator->StartBench();
+    flush_fn();
+    estimator->FlushOver(flush_bytes);
+    estimator->StartBench();
+    auto error_code = remote_fn(args, ret);
+    if (likely(error_code == rpc::RpcErrorCode::kSuccess)) {
+      estimator->ComputeInMemoryOver(
+          streamed_bytes ? *streamed_bytes : (ret ? ret->ReadableBytes() : 0));
+      return error_code;
+    }
+    if (error_code != rpc::RpcErrorCode::kMethodNotFound) {
+      return error_code;
+    }
+    // E.g., the method is not registered at the server, or the device has no
+    // server side at all. Stop suggesting the pushdown of the method.
+    estimator->DisablePushdown();
+    return local_fn(args, ret);
+  }
+  estimator->StartBench();
+  auto error_code = local_fn(args, ret);
+  if (likely(error_code == rpc::RpcErrorCode::kSuccess)) {
+    estimator->ComputeInProcessorOver(load_bytes);
+    return error_code;
+  }
+  if (error_code != rpc::RpcErrorCode::kMethodNotFound) {
+    return error_code;
+  }
+  flush_fn();
+  return remote_fn(args, ret);
+}
+
+} // namespace far_memory
@@ -0,0 +1,79 @@
+#pragma once
+
+extern "C" {
+#include <base/compiler.h>
+#include <runtime/thread.h>
+}
+
+namespace far_memory {
+
+FORCE_INLINE uint64_t RangeLock::begin_stripe_idx(uint64_t begin_idx) const {
+  return begin_idx / kNumItemsPerStripe_;
+}
+
+FORCE_INLINE uint64_t RangeLock::end_stripe_idx(uint64_t end_idx) const {
+  return end_idx ? (end_idx - 1) / kNumItemsPerStripe_ + 1 : 0;
+}
+
+FORCE_INLINE void RangeLock::lock_reader(uint64_t begin_idx,
+                                         uint64_t end_idx) {
+  assert(end_idx <= kNumItems_);
+  auto end = end_stripe_idx(end_idx);
+  for (auto i = begin_stripe_idx(begin_idx); i < end; i++) {
+    auto *stripe = &stripes_[i];
+    while (true) {
+      auto cnt = ACCESS_ONCE(*stripe);
+      if (unlikely(cnt == kWriterLocked)) {
+        thread_yield();
+        continue;
+      }
+      if (likely(__atomic_compare_exchange_n(stripe, &cnt, cnt + 1,
+                                             /* weak = */ false,
+                                             __ATOMIC_ACQUIRE,
+                                             __ATOMIC_RELAXED))) {
+        break;
+      }
+    }
+  }
+}
+
+FORCE_INLINE void RangeLock::unlock_reader(uint64_t begin_idx,
+                                           uint64_t end_idx) {
+  auto end = end_stripe_idx(end_idx);
+  for (auto i = begin_stripe_idx(begin_idx); i < end; i++) {
+    __atomic_fetch_sub(&stripes_[i], 1, __ATOMIC_RELEASE);
+  }
+}
+
+FORCE_INLINE void RangeLock::lock_writer(uint64_t begin_idx,
+                                         uint64_t end_idx) {
+  assert(end_idx <= kNumItems_);
+  auto end = end_stripe_idx(end_idx);
+  for (auto i = begin_stripe_idx(begin_idx); i < end; i++) {
+    auto *stripe = &stripes_[i];
+    while (true) {
+      int32_t cnt = 0;
+      if (likely(__atomic_compare_exchange_n(stripe, &cnt, kWriterLocked,
+                                             /* weak = */ false,
+                                             __ATOMIC_ACQUIRE,
+                                             __ATOMIC_RELAXED))) {
+        break;
+      }
+      thread_yield();
+    }
+  }
+}
+
+FORCE_INLINE void RangeLock::unlock_writer(uint64_t begin_idx,
+                                           uint64_t end_idx) {
+  auto end = end_stripe_idx(end_idx);
+  for (auto i = begin_stripe_idx(begin_idx); i < end; i++) {
+    __atomic_store_n(&stripes_[i], 0, __ATOMIC_RELEASE);
+  }
+}
+
+FORCE_INLINE uint64_t RangeLock::get_num_items_per_stripe() const {
+  return kNumItemsPerStripe_;
+}
+
+} // namespace far_memory
@@ -14,6 +14,11 @@ FORCE_INLINE bool Region::is_invalid() const {
 
 FORCE_INLINE void Region::invalidate() { region_idx_ = kInvalidIdx; }
 
+FORCE_INLINE uint32_t Region::get_idx() const {
+  assert(!is_invalid());
+  return region_idx_;
+}
+
 FORCE_INLINE void Region::reset() {
   first_free_byte_idx_ = kObjectPos;
   num_boundaries_ = 0;
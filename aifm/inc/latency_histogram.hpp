@@ -0,0 +1,54 @@
+#pragma once
+
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <ostream>
+
+namespace far_memory {
+
+struct LatencySummary {
+  uint64_t count;
+  uint64_t p50_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+};
+
+// An HDR-style log-linear histogram of latencies in ns. The first
+// 2^kSubBucketBits buckets are 1ns wide, and each later power of two is split
+// into 2^(kSubBucketBits - 1) buckets, so the reported percentiles are within
+// ~3% of the recorded latencies. Each core records into its own row of
+// buckets, so that recording is lock-free and never shares cachelines.
+class LatencyHistogram {
+private:
+  constexpr static uint32_t kSubBucketBits = 6;
+  constexpr static uint32_t kNumSubBuckets = 1 << (kSubBucketBits - 1);
+  // Larger latencies (i.e., > 18min) are clamped.
+  constexpr static uint32_t kMaxValueBits = 40;
+  constexpr static uint32_t kNumBuckets =
+      (1 << kSubBucketBits) + (kMaxValueBits - kSubBucketBits) * kNumSubBuckets;
+  static_assert(kNumBuckets * sizeof(uint64_t) % 64 == 0);
+
+  alignas(64) uint64_t counts_[helpers::kNumCPUs][kNumBuckets];
+
+  static uint32_t bucket_idx(uint64_t latency_ns);
+  // The highest latency that falls into the bucket.
+  static uint64_t bucket_max_ns(uint32_t idx);
+  void merge(uint64_t *counts) const;
+
+public:
+  LatencyHistogram();
+  NOT_COPYABLE(LatencyHistogram);
+  NOT_MOVEABLE(LatencyHistogram);
+  void record(uint64_t latency_ns);
+  // Records the latency since start_tsc, which is taken from rdtsc().
+  void record_since(uint64_t start_tsc);
+  void reset();
+  LatencySummary summary() const;
+  // Writes a |bucket_max_ns count| line per non-empty bucket.
+  void dump(std::ostream &os) const;
+};
+
+} // namespace far_memory
+
+#include "internal/latency_histogram.ipp"
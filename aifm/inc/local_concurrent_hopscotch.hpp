@@ -1,8 +1,10 @@
 #pragma once
 
 #include "sync.h"
+#include "thread.h"
 
 #include "helpers.hpp"
+#include "rcu_lock.hpp"
 #include "slab.hpp"
 
 #include <cstdint>
@@ -35,18 +37,44 @@ private:
 #pragma pack(pop)
   static_assert(sizeof(BucketEntry) == 24);
 
+  // Grows the same way as GenericConcurrentHopscotch, i.e., the anchor
+  // buckets are migrated into the next table in the background.
+  struct Table {
+    const uint32_t kHashMask;
+    const uint32_t kNumEntries;
+    std::unique_ptr<uint8_t> buckets_mem;
+    BucketEntry *buckets;
+    // Set once the table starts being migrated.
+    Table *next;
+    // The anchor buckets below it have been migrated into next.
+    uint32_t num_migrated;
+
+    Table(uint32_t num_entries_shift);
+    NOT_COPYABLE(Table);
+    NOT_MOVEABLE(Table);
+  };
+
   constexpr static uint32_t kNeighborhood = 32;
   constexpr static uint32_t kMaxRetries = 2;
 
-  const uint32_t kHashMask_;
-  const uint32_t kNumEntries_;
-  std::unique_ptr<uint8_t> buckets_mem_;
+  Table *table_;
   uint64_t slab_base_addr_;
   Slab slab_;
-  BucketEntry *buckets_;
+  RCULock rcu_lock_;
+  rt::Mutex resize_mutex_;
+  bool resizing_;
+  rt::Thread resizer_;
   friend class FarMemTest;
 
   void do_remove(BucketEntry *bucket, BucketEntry *entry);
+  Table *locate(uint32_t hash);
+  Table *lock_anchor(uint32_t hash, BucketEntry **bucket);
+  uint32_t reserve_entry(Table *table, uint32_t anchor_idx);
+  void grow(uint32_t hash_mask);
+  void migrate(Table *from);
+  void extend(Table *table);
+  void migrate_bucket(Table *from, uint32_t bucket_idx);
+  bool migrate_entries(BucketEntry *bucket, Table *to);
 
 public:
   LocalGenericConcurrentHopscotch(uint32_t num_entries_shift,
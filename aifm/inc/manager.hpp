@@ -14,19 +14,24 @@
 #include "pointer.hpp"
 #include "queue.hpp"
 #include "region.hpp"
+#include "server_ptr.hpp"
 #include "stack.hpp"
+#include "victim_policy.hpp"
 
 #include <atomic>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <queue>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 namespace far_memory {
 
 template <typename T> class DataFrameVector;
+template <typename K, typename V> class BTree;
 
 // A GCTask is an interval of (to be GCed) local region.
 using GCTask = std::pair<uint64_t, uint64_t>;
@@ -64,28 +69,119 @@ private:
   constexpr static uint32_t kMaxNumRegionsPerGCRound = 128;
   constexpr static double kMaxRatioRegionsPerGCRound = 0.1;
   constexpr static double kMinRatioRegionsPerGCRound = 0.03;
+  constexpr static uint32_t kMaxNumSampledObjectsPerRegion = 64;
+  constexpr static double kFreeFarMemLowThresh = 0.05;
+  constexpr static double kFarMemCompactThresh = 0.5;
+  constexpr static uint32_t kMaxNumRegionsPerFarMemGCRound = 128;
+  constexpr static uint32_t kRemoteFreeBufferSize = 256;
+  constexpr static uint32_t kMaxNumFarMemGCTasksPerMove =
+      ServerPtr::kMaxComputeDataLen / ServerPtr::kMoveEntrySize;
 
   class RegionManager {
   private:
     constexpr static double kPickRegionMaxRetryTimes = 3;
+    constexpr static uint32_t kSealedBit = (1U << 31);
+    static_assert(Region::kSize < kSealedBit);
 
     std::unique_ptr<uint8_t> local_cache_ptr_;
-    CircularBuffer<Region, false> free_regions_;
+    // The local regions are split into contiguous per-NUMA-node slices, whose
+    // pages are bound to their nodes. Only the nodes owning some of the
+    // helpers::kNumCPUs runtime cores get a slice; the other configured CPUs
+    // are folded into them. A core allocates from the free regions of its own
+    // node first. The far-mem regions are in a single pool.
+    uint32_t num_nodes_ = 1;
+    uint32_t num_regions_;
+    uint32_t num_regions_per_node_;
+    uint32_t num_cpus_;
+    // The NUMA node of each slice, and the slice of each configured CPU.
+    uint32_t node_ids_[helpers::kMaxNumNUMANodes] = {};
+    std::unique_ptr<uint8_t[]> core_nodes_;
+    CircularBuffer<Region, false> free_regions_[helpers::kMaxNumNUMANodes];
     CircularBuffer<Region, false> used_regions_;
     CircularBuffer<Region, false> nt_used_regions_;
     rt::Spin region_spin_;
     Region core_local_free_regions_[helpers::kNumCPUs];
     Region core_local_free_nt_regions_[helpers::kNumCPUs];
+    // Only used by the far-mem regions. Each element tracks the bytes of live
+    // objects within the region; the highest bit is set once the region is
+    // full and no longer allocates.
+    std::unique_ptr<uint32_t[]> live_bytes_;
+    // Only used by the local regions. Each element records when the region
+    // was pushed into the used lists.
+    std::unique_ptr<uint64_t[]> used_since_us_;
     friend class FarMemTest;
 
+    uint32_t get_region_node(uint32_t region_idx) const;
+    uint32_t get_core_node() const;
+    // Pops from the node first, and then from the other nodes. The caller
+    // holds region_spin_.
+    bool pop_free_region_locked(uint32_t node, Region *region);
+
   public:
     RegionManager(uint64_t size, bool is_local);
     void push_free_region(Region &region);
+    bool pop_free_region(Region *region);
     std::optional<Region> pop_used_region();
+    void push_front_used_region(Region &region);
+    uint64_t get_used_since_us(const Region &region) const;
     bool try_refill_core_local_free_region(bool nt, Region *full_region);
     Region &core_local_free_region(bool nt);
     double get_free_region_ratio() const;
     uint32_t get_num_regions() const;
+    uint32_t get_num_nodes() const;
+    uint32_t get_num_free_regions(uint32_t node) const;
+    bool contains(uint64_t addr) const;
+    void inc_live_bytes(uint64_t object_addr, int32_t delta);
+    void seal_region(const Region &region);
+    std::optional<uint32_t> get_sealed_live_bytes(uint32_t region_idx) const;
+    void reclaim_region(uint32_t region_idx);
+  };
+
+  struct RemoteFreeBuffer {
+    rt::Spin spin;
+    uint32_t num_entries = 0;
+    uint8_t entries[kRemoteFreeBufferSize * ServerPtr::kFreeEntrySize];
+  };
+
+  constexpr static uint32_t kMaxNumSwapOutsPerBatch = 64;
+  constexpr static uint32_t kMaxNumSwapInsPerBatch = 64;
+  constexpr static uint32_t kMaxSwapOutBatchDataLen = 1 << 16;
+
+  struct PendingSwapOut {
+    GenericFarMemPtr *ptr;
+    Object obj;
+    // The object ID possibly followed by the back reference, see
+    // append_back_ref().
+    uint8_t obj_id[Object::kMaxObjectIDSize + kVanillaPtrBackRefSize];
+    uint8_t obj_id_len;
+  };
+
+  // Swap-outs whose write backs are coalesced into a single device request.
+  struct SwapOutBatch {
+    std::vector<PendingSwapOut> pendings;
+    uint32_t data_len = 0;
+
+    bool is_full() const {
+      return pendings.size() >= kMaxNumSwapOutsPerBatch ||
+             data_len >= kMaxSwapOutBatchDataLen;
+    }
+  };
+
+  // The local memory quota of a DS. The objects of a DS exceeding its soft
+  // limit are allocated in the NT regions and favored by the victim policy;
+  // exceeding the hard limit further disables the hot-object copy back and
+  // makes the GC run even if the free cache is not low.
+  struct DSQuota {
+    uint64_t soft_limit;
+    uint64_t hard_limit;
+    double eviction_weight;
+  };
+
+  struct FarMemGCTask {
+    uint64_t old_obj_id;
+    uint64_t new_obj_id;
+    uint16_t obj_size;
+    FarMemPtrMeta *meta;
   };
 
   RegionManager cache_region_manager_;
@@ -96,9 +192,34 @@ private:
   rt::CondVar mutator_cache_condvar_;
   rt::CondVar mutator_far_mem_condvar_;
   rt::Spin gc_lock_;
+  rt::Spin far_mem_gc_lock_;
+  bool far_mem_gc_active_ = false;
+  std::atomic<bool> far_mem_gc_spawned_{false};
+  Region far_mem_gc_region_;
+  RemoteFreeBuffer remote_free_buffers_[helpers::kNumCPUs];
+  // Far-mem pointers that were moved while being swapped out. Their back
+  // references stored at the far-mem side are stale.
+  rt::Spin moved_ptrs_spin_;
+  std::unordered_map<uint64_t, uint64_t> moved_ptrs_;
+  std::atomic<uint32_t> num_moved_ptrs_{0};
+  // Remote objects freed while the far-mem regions are being compacted. They
+  // may still be listed, but their back references may point to pointers
+  // that are gone.
+  bool far_mem_compacting_ = false;
+  rt::Spin compaction_freed_spin_;
+  std::unordered_set<uint64_t> compaction_freed_obj_ids_;
   GCParallelMarker parallel_marker_;
   GCParallelWriteBacker parallel_write_backer_;
   std::vector<Region> from_regions_{kMaxNumRegionsPerGCRound};
+  std::unique_ptr<VictimRegionPolicy> victim_policy_;
+  std::vector<Region> candidate_regions_;
+  DSQuota ds_quotas_[kMaxNumDSIDs];
+  // Bytes of the local objects of each DS.
+  CachelineAligned(int64_t) ds_local_bytes_[kMaxNumDSIDs];
+  rt::Spin ds_quotas_spin_;
+  // The DSes that have ever been assigned a quota. Append-only.
+  uint8_t quota_ds_ids_[kMaxNumDSIDs];
+  uint32_t num_quota_ds_ids_ = 0;
   int ksched_fd_;
   std::queue<uint8_t> available_ds_ids_;
   static ObjLocker obj_locker_;
@@ -106,23 +227,35 @@ private:
   friend class FarMemTest;
   friend class FarMemManagerFactory;
   friend class GenericFarMemPtr;
+  friend class GenericUniquePtr;
+  friend class GenericSharedPtr;
   friend class FarMemPtrMeta;
   friend class GenericArray;
   friend class GCParallelWriteBacker;
   friend class DerefScope;
   friend class GenericDataFrameVector;
   friend class GenericConcurrentHopscotch;
+  friend class GenericBTree;
   template <typename T> friend class DataFrameVector;
 
   FarMemManager(uint64_t cache_size, uint64_t far_mem_size,
-                uint32_t num_gc_threads, FarMemDevice *device);
+                uint32_t num_gc_threads, FarMemDevice *device,
+                VictimRegionPolicy *victim_policy);
   bool is_free_cache_almost_empty() const;
   bool is_free_cache_low() const;
   bool is_free_cache_high() const;
   std::optional<Region> pop_cache_used_region();
   void push_cache_free_region(Region &region);
   void swap_in(bool nt, GenericFarMemPtr *ptr);
-  void swap_out(GenericFarMemPtr *ptr, Object obj);
+  void swap_in_batch(bool nt, GenericFarMemPtr *const *ptrs,
+                     uint32_t num_ptrs);
+  void swap_in_all(bool nt, GenericFarMemPtr *const *ptrs, uint32_t num_ptrs);
+  void finish_swap_in(GenericFarMemPtr *ptr, uint64_t obj_addr, uint8_t ds_id,
+                      uint16_t obj_data_len, uint64_t obj_id);
+  bool swap_out(GenericFarMemPtr *ptr, Object obj,
+                SwapOutBatch *batch = nullptr);
+  void flush_swap_outs(SwapOutBatch *batch);
+  void finish_swap_out(GenericFarMemPtr *ptr, Object obj);
   void launch_gc_master();
   void gc_cache();
   void gc_far_mem();
@@ -130,8 +263,36 @@ private:
   std::optional<uint64_t> allocate_local_object_nb(bool nt,
                                                    uint16_t object_size);
   uint64_t allocate_remote_object(bool nt, uint16_t object_size);
+  void free_remote_object(uint64_t remote_object_addr, uint16_t object_size);
+  void free_remote_object(Object obj);
+  void free_local_object(Object obj);
+  bool free_swapped_out_ptr(GenericFarMemPtr *ptr);
+  void inc_ds_local_bytes(uint8_t ds_id, int64_t delta);
+  bool is_over_soft_quota(uint8_t ds_id) const;
+  bool is_over_hard_quota(uint8_t ds_id) const;
+  bool is_any_hard_quota_exceeded() const;
+  static uint8_t append_back_ref(uint8_t ds_id, uint8_t obj_id_len,
+                                 const uint8_t *obj_id, uint64_t ptr_addr,
+                                 uint8_t *buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf,
+                    uint64_t ptr_addr);
+  void record_moved_ptr(uint64_t obj_id, GenericFarMemPtr *ptr);
+  std::optional<uint64_t> erase_moved_ptr(uint64_t obj_id);
+  void flush_remote_frees(const uint8_t *entries, uint32_t num_entries);
+  void flush_remote_free_buffers();
+  uint32_t reclaim_far_mem_regions();
+  void compact_far_mem_regions();
+  bool compact_far_mem_region(uint32_t region_idx);
+  FarMemPtrMeta *locate_swapped_out_meta(uint64_t obj_id, uint16_t obj_size,
+                                         uint64_t ptr_addr);
+  std::optional<uint64_t> allocate_far_mem_gc_object(uint16_t object_size);
+  void move_far_mem_objects(std::vector<FarMemGCTask> *tasks);
+  bool run_gc_far_mem();
+  void launch_far_mem_gc();
   void mutator_wait_for_gc_far_mem();
   void pick_from_regions();
+  VictimRegionStats sample_region(const Region &region, uint64_t now_us);
   void mark_fm_ptrs(auto *preempt_guard);
   void wait_mutators_observation();
   void write_back_regions();
@@ -153,6 +314,12 @@ public:
   ~FarMemManager();
   FarMemDevice *get_device() const { return device_ptr_.get(); }
   double get_free_mem_ratio() const;
+  // Limits the local memory used by the DS. The limits are in bytes; a higher
+  // eviction weight makes the regions holding the DS objects evicted earlier.
+  void set_ds_quota(uint8_t ds_id, uint64_t soft_limit, uint64_t hard_limit,
+                    double eviction_weight = 1);
+  void clear_ds_quota(uint8_t ds_id);
+  uint64_t get_ds_local_bytes(uint8_t ds_id) const;
   bool allocate_generic_unique_ptr_nb(
       GenericUniquePtr *ptr, uint8_t ds_id, uint16_t item_size,
       std::optional<uint8_t> optional_id_len = {},
@@ -192,6 +359,8 @@ public:
                                      uint64_t remote_data_size);
   template <typename T> DataFrameVector<T> allocate_dataframe_vector();
   template <typename T> DataFrameVector<T> *allocate_dataframe_vector_heap();
+  template <typename K, typename V> BTree<K, V> allocate_btree();
+  template <typename K, typename V> BTree<K, V> *allocate_btree_heap();
   template <typename T>
   List<T> allocate_list(const DerefScope &scope, bool enable_merge = false);
   template <typename T> Queue<T> allocate_queue(const DerefScope &scope);
@@ -200,14 +369,19 @@ public:
   void register_copy_notifier(uint8_t ds_id, CopyNotifier notifier);
   void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                    uint16_t *data_len, uint8_t *data_buf);
+  void read_objects(uint32_t num_objs, const ObjectReadReq *reqs);
   bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
   void construct(uint8_t ds_type, uint8_t ds_id, uint32_t param_len,
                  uint8_t *params);
   void destruct(uint8_t ds_id);
-  bool call(uint8_t ds_id, const std::string &method,
-            const rpc::BufferPtr &args, rpc::BufferPtr &ret);
+  rpc::RpcErrorCode call(uint8_t ds_id, rpc::MethodID method_id,
+                         const rpc::BufferPtr &args, rpc::BufferPtr &ret);
+  rpc::RpcErrorCode call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                                const rpc::BufferPtr &args,
+                                const rpc::StreamReader::ChunkFn &chunk_fn);
   void mutator_wait_for_gc_cache();
   static void lock_object(uint8_t obj_id_len, const uint8_t *obj_id);
+  static bool try_lock_object(uint8_t obj_id_len, const uint8_t *obj_id);
   static void unlock_object(uint8_t obj_id_len, const uint8_t *obj_id);
 };
 
@@ -219,9 +393,12 @@ private:
   friend class FarMemManager;
 
 public:
+  // The manager owns the device and the victim policy. The policy defaults to
+  // CostBenefitVictimPolicy.
   static FarMemManager *build(uint64_t cache_size,
                               std::optional<uint32_t> optional_num_gc_threads,
-                              FarMemDevice *device);
+                              FarMemDevice *device,
+                              VictimRegionPolicy *victim_policy = nullptr);
   static FarMemManager *get();
 };
 
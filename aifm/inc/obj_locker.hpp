@@ -2,23 +2,59 @@
 
 #include "sync.h"
 
-#include <optional>
-#include <map>
+#include <cstdint>
 
 namespace far_memory {
 
+// A fixed-size open-addressed table of the locked object IDs. An object is
+// locked by claiming, with CAS, an entry within the probe window that its
+// hash selects, so locking never allocates and an uncontended lock/unlock only
+// touches the cachelines of the window. Each entry has its own wait queue, and
+// unlock() hands the lock over to the first waiter instead of waking them all.
 class ObjLocker {
 private:
-  constexpr static uint32_t kNumMaps = 1024;
+  enum State : uint32_t { Free = 0, Claiming, Locked, Contended };
+  enum class ClaimResult { Acquired, Held, Full };
 
-  std::map<uint64_t, bool> maps_[kNumMaps];
-  rt::Spin spins_[kNumMaps];
-  rt::CondVar cvs_[kNumMaps];
+  struct Entry {
+    uint64_t obj_id;
+    uint32_t state;
+    // Guarded by the spin of the wait queue.
+    uint32_t num_waiters;
+  };
+
+  struct WaitQueue {
+    rt::Spin spin;
+    rt::CondVar cv;
+  };
+
+  constexpr static uint32_t kNumBucketsShift = 12;
+  constexpr static uint32_t kNumEntriesPerBucket = 4;
+  constexpr static uint32_t kNumEntries = kNumEntriesPerBucket
+                                          << kNumBucketsShift;
+  // Each window is two adjacent cacheline-sized buckets.
+  constexpr static uint32_t kNumProbeEntries = 2 * kNumEntriesPerBucket;
+  static_assert(sizeof(Entry) * kNumEntriesPerBucket == 64);
+
+  alignas(64) Entry entries_[kNumEntries];
+  WaitQueue wait_queues_[kNumEntries];
+
+  static uint32_t hash_func(uint64_t obj_id);
+  Entry *probe(uint32_t start, uint32_t i);
+  // Claims a free entry for obj_id unless obj_id is held (*holder is set if it
+  // is locked rather than being claimed) or the window is full.
+  ClaimResult try_claim(uint64_t obj_id, Entry **holder);
+  // Waits on the holder until the lock is handed over. Returns false if the
+  // holder no longer holds obj_id.
+  bool wait(uint64_t obj_id, Entry *holder);
+  void handoff(Entry *entry);
 
 public:
   ObjLocker();
-  uint32_t hash_func(uint64_t obj_id);
-  bool try_insert(uint64_t obj_id);
-  void remove(uint64_t obj_id);
+  void lock(uint64_t obj_id);
+  bool try_lock(uint64_t obj_id);
+  void unlock(uint64_t obj_id);
 };
 }; // namespace far_memory
+
+#include "internal/obj_locker.ipp"
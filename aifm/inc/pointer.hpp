@@ -1,8 +1,12 @@
 #pragma once
 
+#include "thread.h"
+
 #include "deref_scope.hpp"
 #include "object.hpp"
 
+#include <functional>
+
 namespace far_memory {
 
 // Format:
@@ -88,6 +92,24 @@ public:
   static FarMemPtrMeta *from_object(const Object &object);
 };
 
+// The completion handle of an asynchronous swap-in, which is waited at the
+// latest when destructed. The pointers must stay valid until then.
+class SwapInFuture {
+private:
+  rt::Thread thread_;
+  bool pending_ = false;
+
+public:
+  SwapInFuture();
+  SwapInFuture(std::function<void()> &&swap_in_fn);
+  ~SwapInFuture();
+  SwapInFuture(SwapInFuture &&other);
+  SwapInFuture &operator=(SwapInFuture &&other);
+  NOT_COPYABLE(SwapInFuture);
+  bool is_pending() const;
+  void wait();
+};
+
 class GenericFarMemPtr {
 private:
   FarMemPtrMeta meta_;
@@ -113,6 +135,14 @@ public:
   void nullify();
   bool is_null() const;
   void swap_in(bool nt);
+  // Issues the swap-in in the background and returns immediately.
+  SwapInFuture swap_in_async(bool nt);
+  // Swaps in all the pointed objects in the background, with a single batched
+  // device request for those not being fetched by others already.
+  static SwapInFuture swap_in_async(bool nt, GenericFarMemPtr *const *ptrs,
+                                    uint32_t num_ptrs);
+  static void swap_in_all(bool nt, GenericFarMemPtr *const *ptrs,
+                          uint32_t num_ptrs);
   void flush();
   void move(GenericFarMemPtr &other, uint64_t reset_value);
   bool is_present() const;
@@ -129,6 +159,7 @@ protected:
 
   void init(uint64_t object_addr);
   void _free();
+  bool free_swapped_out();
   void evacuate();
 
 public:
@@ -142,6 +173,19 @@ public:
   template <bool Nt = false> const void *deref(const DerefScope &scope);
   template <bool Nt = false> void *deref_mut(const DerefScope &scope);
   void free(bool race = false);
+  // Swaps in the pointed objects with a single batched device request.
+  static void swap_in_batch(bool nt, GenericUniquePtr *const *ptrs,
+                            uint32_t num_ptrs);
+  // Derefs all the pointers, whose misses are swapped in together rather than
+  // one by one. Null pointers are derefed into nullptr.
+  template <bool Nt = false>
+  static void deref_many(const DerefScope &scope,
+                         GenericUniquePtr *const *ptrs, uint32_t num_ptrs,
+                         const void **raw_ptrs);
+  template <bool Nt = false>
+  static void deref_mut_many(const DerefScope &scope,
+                             GenericUniquePtr *const *ptrs, uint32_t num_ptrs,
+                             void **raw_ptrs);
 };
 
 template <typename T> class UniquePtr : public GenericUniquePtr {
@@ -159,6 +203,12 @@ public:
   NOT_COPYABLE(UniquePtr);
   template <bool Nt = false> const T *deref(const DerefScope &scope);
   template <bool Nt = false> T *deref_mut(const DerefScope &scope);
+  template <bool Nt = false>
+  static void deref_many(const DerefScope &scope, UniquePtr *const *ptrs,
+                         uint32_t num_ptrs, const T **raw_ptrs);
+  template <bool Nt = false>
+  static void deref_mut_many(const DerefScope &scope, UniquePtr *const *ptrs,
+                             uint32_t num_ptrs, T **raw_ptrs);
   template <bool Nt = false> T read();
   template <bool Nt = false, typename U> void write(U &&u);
   void free();
@@ -56,24 +56,28 @@ private:
     bool nt;
   };
 
-  struct SlaveStatus {
-    GenericUniquePtr *task;
-    bool is_exited;
-    rt::CondVar cv;
-  };
-
   constexpr static uint32_t kIdxTracesSize = 256;
   constexpr static uint32_t kHitTimesThresh = 8;
   constexpr static uint32_t kGenTasksBurstSize = 8;
   constexpr static uint32_t kMaxSlaveWaitUs = 5;
   constexpr static uint32_t kMaxNumPrefetchSlaveThreads = 16;
   constexpr static uint32_t kPrefetchNum = 1;
+  constexpr static uint32_t kMaxNumTasksPerBatch =
+      kGenTasksBurstSize * kPrefetchNum;
+
+  struct SlaveStatus {
+    // The tasks of a burst are swapped in as a single device batch.
+    GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
+    uint32_t num_tasks;
+    bool is_exited;
+    rt::CondVar cv;
+  };
 
   const uint32_t kPrefetchWinSize_; // In terms of number of objects.
   uint8_t *state_;
   Pattern_t pattern_;
   uint32_t object_data_size_;
-  Index_t last_idx_;
+  Index_t last_idx_{};
   uint64_t hit_times_ = 0;
   uint32_t num_objs_to_prefetch = 0;
   Index_t next_prefetch_idx_;
@@ -89,6 +93,7 @@ private:
   bool exit_ = false;
 
   void generate_prefetch_tasks();
+  void dispatch_prefetch_tasks(GenericUniquePtr **tasks, uint32_t num_tasks);
   void prefetch_master_fn();
   void prefetch_slave_fn(uint32_t tid);
 
@@ -60,12 +60,6 @@ class Prefetcher {
     bool nt;
   };
 
-  struct SlaveStatus {
-    GenericUniquePtr *task;
-    bool is_exited;
-    rt::CondVar cv;
-  };
-
   TrendPredictor<Pattern_t, 32> trend_predictor_;
   uint64_t predict_pos_ = 0;
 
@@ -75,6 +69,16 @@ class Prefetcher {
   constexpr static uint32_t kMaxSlaveWaitUs = 5;
   constexpr static uint32_t kMaxNumPrefetchSlaveThreads = 16;
   constexpr static uint32_t kPrefetchNum = 1;
+  constexpr static uint32_t kMaxNumTasksPerBatch =
+      kGenTasksBurstSize * kPrefetchNum;
+
+  struct SlaveStatus {
+    // The tasks of a burst are swapped in as a single device batch.
+    GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
+    uint32_t num_tasks;
+    bool is_exited;
+    rt::CondVar cv;
+  };
 
   const uint32_t kPrefetchWinSize_; // In terms of number of objects.
   uint8_t *state_;
@@ -96,6 +100,7 @@ class Prefetcher {
   bool exit_ = false;
 
   void generate_prefetch_tasks();
+  void dispatch_prefetch_tasks(GenericUniquePtr **tasks, uint32_t num_tasks);
   void prefetch_master_fn();
   void prefetch_slave_fn(uint32_t tid);
 
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "sync.h"
+#include "thread.h"
+
+#include "helpers.hpp"
+#include "pointer.hpp"
+
+#include <functional>
+#include <type_traits>
+
+namespace far_memory {
+
+class FarMemDevice;
+
+namespace stream {
+
+// Tracks up to kNumStreams concurrent strided streams of a data structure,
+// e.g., interleaved scans by several threads or the row and column walks over
+// a 2-D array. A stream is detected once an index extends an arithmetic
+// progression of two recent indices, and each stream has its own confidence
+// and prefetch window.
+template <typename InduceFn, typename InferFn, typename MappingFn>
+class Prefetcher {
+private:
+  using InduceFnTraits = helpers::FunctionTraits<InduceFn>;
+  using InferFnTraits = helpers::FunctionTraits<InferFn>;
+  using MappingFnTraits = helpers::FunctionTraits<MappingFn>;
+
+  using Index_t = typename InduceFnTraits::template Arg<0>::Type;
+  using Pattern_t = typename InduceFnTraits::ResultType;
+
+  // InduceFn: (Index_t, Index_t)->Pattern_t
+  static_assert(InduceFnTraits::Arity == 2);
+  static_assert(
+      std::is_same<Index_t,
+                   typename InduceFnTraits::template Arg<1>::Type>::value);
+
+  // InferFn: (Index_t, Pattern_t)->Index_t
+  static_assert(InferFnTraits::Arity == 2);
+  static_assert(std::is_same<
+                Index_t, typename InferFnTraits::template Arg<0>::Type>::value);
+  static_assert(
+      std::is_same<Pattern_t,
+                   typename InferFnTraits::template Arg<1>::Type>::value);
+  static_assert(
+      std::is_same<Index_t, typename InferFnTraits::ResultType>::value);
+
+  // MappingFn: (uint8_t *&, Index_t)->GenericUniquePtr *
+  static_assert(MappingFnTraits::Arity == 2);
+  static_assert(
+      std::is_same<uint8_t *&,
+                   typename MappingFnTraits::template Arg<0>::Type>::value);
+  static_assert(
+      std::is_same<Index_t,
+                   typename MappingFnTraits::template Arg<1>::Type>::value);
+  static_assert(std::is_same<GenericUniquePtr *,
+                             typename MappingFnTraits::ResultType>::value);
+
+  struct Trace {
+    uint64_t counter;
+    uint64_t idx;
+    bool nt;
+  };
+
+  struct Stream {
+    bool valid;
+    Index_t last_idx;
+    Pattern_t stride;
+    uint32_t confidence;
+    // When the stream was last hit, for the LRU replacement.
+    uint64_t last_hit;
+    Index_t next_prefetch_idx;
+    uint32_t num_objs_to_prefetch;
+  };
+
+  constexpr static uint32_t kIdxTracesSize = 256;
+  constexpr static uint32_t kNumStreams = 8;
+  // Recent indices searched for the progressions; it covers two accesses of
+  // every stream when the streams are interleaved.
+  constexpr static uint32_t kHistorySize = 2 * kNumStreams;
+  constexpr static uint32_t kConfidenceThresh = 3;
+  constexpr static uint32_t kMaxConfidence = 16;
+  constexpr static uint32_t kGenTasksBurstSize = 8;
+  constexpr static uint32_t kMaxSlaveWaitUs = 5;
+  constexpr static uint32_t kMaxNumPrefetchSlaveThreads = 16;
+  constexpr static uint32_t kMaxNumTasksPerBatch = kGenTasksBurstSize;
+
+  struct SlaveStatus {
+    // The tasks of a burst are swapped in as a single device batch.
+    GenericUniquePtr *tasks[kMaxNumTasksPerBatch];
+    uint32_t num_tasks;
+    bool is_exited;
+    rt::CondVar cv;
+  };
+
+  const uint32_t kPrefetchWinSize_; // In terms of number of objects.
+  uint8_t *state_;
+  uint32_t object_data_size_;
+  Stream streams_[kNumStreams] = {};
+  uint32_t next_stream_ = 0;
+  Index_t history_[kHistorySize] = {};
+  uint32_t history_size_ = 0;
+  uint32_t history_tail_ = 0;
+  uint64_t num_hits_ = 0;
+  bool nt_ = false;
+  Trace traces_[kIdxTracesSize];
+  uint32_t traces_head_ = 0;
+  uint32_t traces_tail_ = 0;
+  uint64_t traces_counter_ = 0;
+  std::vector<rt::Thread> prefetch_threads_;
+  CachelineAligned(SlaveStatus) slave_status_[kMaxNumPrefetchSlaveThreads];
+  rt::CondVar cv_prefetch_master_;
+  bool master_exited = false;
+  bool exit_ = false;
+
+  Stream *allocate_stream();
+  void hit_stream(Stream *stream, Index_t idx);
+  void detect_stream(Index_t idx);
+  void add_history(Index_t idx);
+  void process_trace(Index_t idx);
+  bool has_prefetch_tasks() const;
+  void generate_prefetch_tasks();
+  void dispatch_prefetch_tasks(GenericUniquePtr **tasks, uint32_t num_tasks);
+  void prefetch_master_fn();
+  void prefetch_slave_fn(uint32_t tid);
+
+public:
+  Prefetcher(FarMemDevice *device, uint8_t *state, uint32_t object_data_size);
+  ~Prefetcher();
+  NOT_COPYABLE(Prefetcher);
+  NOT_MOVEABLE(Prefetcher);
+  void add_trace(bool nt, Index_t idx);
+  void static_prefetch(Index_t start_idx, Pattern_t pattern, uint32_t num);
+  void update_state(uint8_t *state);
+};
+
+} // namespace stream
+
+} // namespace far_memory
+
+#include "internal/prefetcher_stream.ipp"
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "cost_estimator.hpp"
+#include "helpers.hpp"
+#include "rpc_buffer.hpp"
+#include "rpc_protocol.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace far_memory {
+
+// Tracks the dirty items of a data structure at the chunk granularity. The
+// dirty bytes are known without walking the items, and a flush only visits the
+// dirty chunks. It is not synchronized with the mutators of the flushed
+// chunks, ditto to the flush of the data structures. All the items start
+// dirty, since they only exist locally once allocated.
+class DirtyTracker {
+private:
+  constexpr static uint64_t kChunkSize = 64 << 10; // In bytes.
+  constexpr static uint32_t kNumBitsPerWord = 64;
+
+  uint64_t kNumItems_;
+  uint32_t kItemSize_;
+  uint64_t kNumItemsPerChunk_;
+  uint64_t kNumChunks_;
+  std::unique_ptr<uint64_t[]> bitmap_;
+  uint64_t num_dirty_chunks_ = 0;
+
+public:
+  DirtyTracker(uint64_t num_items, uint32_t item_size);
+  NOT_COPYABLE(DirtyTracker);
+  NOT_MOVEABLE(DirtyTracker);
+  void mark(uint64_t idx);
+  // An upper bound of the dirty data bytes.
+  uint64_t get_dirty_bytes() const;
+  // Clears the dirty chunks and calls flush_fn(begin_idx, end_idx) on each of
+  // them, by helpers::kNumCPUs threads.
+  template <typename F> void flush(F &&flush_fn);
+};
+
+// Runs a method of a data structure either in the local processor, or pushed
+// down to the far-mem server, whichever the estimator of the method predicts
+// to be faster. The time taken is fed back to the estimator. A method only
+// registered at one side always runs there; the other failures are returned
+// as is.
+class Pushdown {
+public:
+  // flush_fn() writes back the dirty items before a pushdown,
+  // local_fn(args, ret) and remote_fn(args, ret) return the rpc::RpcErrorCode
+  // of the method. A streamed return value is not left in ret; the caller
+  // counts its bytes into *streamed_bytes instead.
+  template <typename FlushFn, typename LocalFn, typename RemoteFn>
+  static rpc::RpcErrorCode call(CostEstimator *estimator, uint64_t flush_bytes,
+                   uint64_t load_bytes, FlushFn &&flush_fn, LocalFn &&local_fn,
+                   RemoteFn &&remote_fn, const rpc::BufferPtr &args,
+                   rpc::BufferPtr &ret,
+                   const uint64_t *streamed_bytes = nullptr);
+};
+
+} // namespace far_memory
+
+#include "internal/pushdown.ipp"
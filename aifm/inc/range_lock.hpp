@@ -0,0 +1,43 @@
+#pragma once
+
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace far_memory {
+
+// Reader-writer locks over the index ranges of an array. The items are grouped
+// into stripes of kStripeSize bytes, each guarded by a one-word reader-writer
+// spinlock, so the ranges that do not share a stripe never contend. A range
+// locks its stripes in the ascending order, hence overlapping ranges never
+// deadlock.
+class RangeLock {
+private:
+  constexpr static uint64_t kStripeSize = 64 << 10; // In bytes.
+  constexpr static int32_t kWriterLocked = -1;
+
+  uint64_t kNumItems_;
+  uint64_t kNumItemsPerStripe_;
+  // The number of readers holding the stripe, or kWriterLocked.
+  std::unique_ptr<int32_t[]> stripes_;
+
+  uint64_t begin_stripe_idx(uint64_t begin_idx) const;
+  uint64_t end_stripe_idx(uint64_t end_idx) const;
+
+public:
+  RangeLock(uint64_t num_items, uint32_t item_size);
+  NOT_COPYABLE(RangeLock);
+  NOT_MOVEABLE(RangeLock);
+  // All ranges are [begin_idx, end_idx).
+  void lock_reader(uint64_t begin_idx, uint64_t end_idx);
+  void unlock_reader(uint64_t begin_idx, uint64_t end_idx);
+  void lock_writer(uint64_t begin_idx, uint64_t end_idx);
+  void unlock_writer(uint64_t begin_idx, uint64_t end_idx);
+  // The ranges aligned to it are locked independently.
+  uint64_t get_num_items_per_stripe() const;
+};
+
+} // namespace far_memory
+
+#include "internal/range_lock.ipp"
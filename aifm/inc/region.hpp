@@ -48,6 +48,7 @@ public:
   std::optional<uint64_t> allocate_object(uint16_t object_size);
   bool is_invalid() const;
   void invalidate();
+  uint32_t get_idx() const;
   void reset();
   bool is_local() const;
   bool is_nt() const;
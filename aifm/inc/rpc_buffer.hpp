@@ -1,48 +1,162 @@
 #ifndef RPC_BUFFER_HPP_
 #define RPC_BUFFER_HPP_
 
+#include "sync.h"
+
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
-#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <new>
 #include <string>
 #include <string_view>
+#include <utility>
 
 namespace rpc {
 
+// 按2的幂分级的存储块池，每级的空闲块串成单链表，由rt::Spin保护，
+// 持锁期间关抢占，持有者不会被调度走而让其他线程空转。
+// 超过最大一级的块直接走operator new/delete
+class BufferPool {
+ public:
+  static constexpr size_t kMinShift = 6;  // 64B
+  static constexpr size_t kMaxShift = 16;  // 64KB，覆盖单次call的数据上限
+  static constexpr size_t kMaxNumFreeBlocks = 256;  // 每级缓存的空闲块上限
+
+  static size_t Capacity(size_t size) {
+    auto shift = Shift(size);
+    return shift > kMaxShift ? size : (size_t{1} << shift);
+  }
+
+  static void *Allocate(size_t size) {
+    auto shift = Shift(size);
+    if (shift > kMaxShift) return ::operator new(size);
+    auto &size_class = size_classes_[shift - kMinShift];
+    size_class.lock.Lock();
+    FreeNode *node = size_class.head;
+    if (node) {
+      size_class.head = node->next;
+      size_class.num_free_blocks--;
+    }
+    size_class.lock.Unlock();
+    return node ? node : ::operator new(size_t{1} << shift);
+  }
+
+  static void Free(void *ptr, size_t size) {
+    auto shift = Shift(size);
+    if (shift <= kMaxShift) {
+      auto &size_class = size_classes_[shift - kMinShift];
+      size_class.lock.Lock();
+      if (size_class.num_free_blocks < kMaxNumFreeBlocks) {
+        auto *node = static_cast<FreeNode *>(ptr);
+        node->next = size_class.head;
+        size_class.head = node;
+        size_class.num_free_blocks++;
+        size_class.lock.Unlock();
+        return;
+      }
+      size_class.lock.Unlock();
+    }
+    ::operator delete(ptr);
+  }
+
+ private:
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  struct alignas(64) SizeClass {
+    rt::Spin lock;
+    FreeNode *head = nullptr;
+    size_t num_free_blocks = 0;
+  };
+
+  static size_t Shift(size_t size) {
+    size = std::max(size, size_t{1} << kMinShift);
+    return 64 - __builtin_clzll(size - 1);
+  }
+
+  static SizeClass size_classes_[kMaxShift - kMinShift + 1];
+};
+
+inline BufferPool::SizeClass
+    BufferPool::size_classes_[kMaxShift - kMinShift + 1];
+
+// 从BufferPool分配的allocator，供allocate_shared把Buffer和控制块放进同一块池化内存
+template<typename T>
+struct PoolAllocator {
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template<typename U>
+  PoolAllocator(const PoolAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(BufferPool::Allocate(n * sizeof(T)));
+  }
+  void deallocate(T *ptr, size_t n) { BufferPool::Free(ptr, n * sizeof(T)); }
+
+  template<typename U>
+  bool operator==(const PoolAllocator<U> &) const { return true; }
+  template<typename U>
+  bool operator!=(const PoolAllocator<U> &) const { return false; }
+};
+
+class Buffer;
+using BufferPtr = std::shared_ptr<Buffer>;
+
+// 存储来自BufferPool且带引用计数，切片与原Buffer共享同一存储。
+// 共享中的存储是只读的，写入前会先复制出一份独占的存储。
+// 可读数据前预留kHeadroom字节，以便不复制地补上头部（如错误码）
 class Buffer {
  public:
   static constexpr size_t kInitSize = 1024;
+  static constexpr size_t kHeadroom = 16;
 
-  explicit Buffer(size_t sz = kInitSize)
-      : buffer_(sz),
-        write_pos_(0),
-        read_pos_(0) {}
-  Buffer(const char *ptr, size_t len)
-      : buffer_(ptr, ptr + len),
-        write_pos_(len),
-        read_pos_(0) {}
+  explicit Buffer(size_t sz = kInitSize) {
+    Allocate(kHeadroom + sz);
+    read_pos_ = write_pos_ = kHeadroom;
+  }
+  Buffer(const char *ptr, size_t len) : Buffer(len) { Append(ptr, len); }
   explicit Buffer(std::string_view s) : Buffer(s.data(), s.size()) {}
+  ~Buffer() { Release(); }
 
-  Buffer(Buffer &&other)
-      : buffer_(std::move(other.buffer_)),
-        write_pos_(other.write_pos_),
-        read_pos_(other.read_pos_) {
-    other.Reset();
+  // 借用[ptr, ptr + len)而不复制，调用者保证其生存期长于返回的Buffer
+  static Buffer View(const char *ptr, size_t len) {
+    Buffer view(Borrowed{});
+    view.data_ = const_cast<char *>(ptr);
+    view.capacity_ = view.write_pos_ = len;
+    return view;
   }
+
+  Buffer(Buffer &&other) : Buffer(Borrowed{}) { *this = std::move(other); }
   Buffer &operator=(Buffer &&other) {
-    buffer_ = std::move(other.buffer_);
-    write_pos_ = other.write_pos_;
-    read_pos_ = other.read_pos_;
-    other.Reset();
+    if (this != &other) {
+      Release();
+      block_ = std::exchange(other.block_, nullptr);
+      data_ = std::exchange(other.data_, nullptr);
+      capacity_ = std::exchange(other.capacity_, 0);
+      write_pos_ = std::exchange(other.write_pos_, 0);
+      read_pos_ = std::exchange(other.read_pos_, 0);
+    }
     return *this;
   }
 
+  // 独占存储时才可以原地写入，切片和View都是只读的
+  [[nodiscard]] bool IsWritable() const {
+    return block_ && block_->ref_cnt.load(std::memory_order_acquire) == 1;
+  }
+
   [[nodiscard]] size_t ReadableBytes() const { return write_pos_ - read_pos_; };
-  [[nodiscard]] size_t WritableBytes() const { return buffer_.size() - write_pos_; }
-  [[nodiscard]] const char *GetReadPtr() const { return buffer_.data() + read_pos_; }
-  [[nodiscard]] const char *GetWritePtr() const { return buffer_.data() + write_pos_; }
-  [[nodiscard]] char *GetWritePtr() { return buffer_.data() + write_pos_; }
+  [[nodiscard]] size_t WritableBytes() const {
+    return IsWritable() ? capacity_ - write_pos_ : 0;
+  }
+  [[nodiscard]] const char *GetReadPtr() const { return data_ + read_pos_; }
+  [[nodiscard]] const char *GetWritePtr() const { return data_ + write_pos_; }
+  [[nodiscard]] char *GetWritePtr() { return data_ + write_pos_; }
 
   void EnsureWritableBytes(size_t n) {
     if (WritableBytes() < n) {
@@ -53,17 +167,46 @@ class Buffer {
   void HasWritten(size_t n) { write_pos_ += n; }
   void HasRead(size_t n) {
     read_pos_ += n;
-    if (read_pos_ == write_pos_) {
+    if (read_pos_ == write_pos_ && IsWritable()) {
       Reset();
     }
   }
 
-  void Resize(size_t n) { buffer_.resize(n); }
+  // 保证容量至少为n，必要时换成一块独占的存储
+  void Resize(size_t n) {
+    if (IsWritable() && capacity_ >= n) return;
+    n = std::max(n, write_pos_);
+    auto readable_bytes = ReadableBytes();
+    auto new_capacity = std::max(n - read_pos_ + kHeadroom, 2 * capacity_);
+    Buffer tmp(Borrowed{});
+    tmp.Allocate(new_capacity);
+    tmp.read_pos_ = kHeadroom;
+    tmp.write_pos_ = kHeadroom + readable_bytes;
+    std::memcpy(tmp.data_ + kHeadroom, GetReadPtr(), readable_bytes);
+    *this = std::move(tmp);
+  }
   void Reset() {
-    write_pos_ = 0;
-    read_pos_ = 0;
+    write_pos_ = read_pos_ = std::min(kHeadroom, capacity_);
+  }
+
+  // 写到可读数据之前，headroom足够时不移动已有数据
+  void Prepend(const char *ptr, size_t len) {
+    if (!IsWritable() || read_pos_ < len) {
+      auto readable_bytes = ReadableBytes();
+      Buffer tmp(Borrowed{});
+      tmp.Allocate(kHeadroom + len + readable_bytes);
+      tmp.read_pos_ = kHeadroom + len;
+      tmp.write_pos_ = tmp.read_pos_ + readable_bytes;
+      std::memcpy(tmp.data_ + tmp.read_pos_, GetReadPtr(), readable_bytes);
+      *this = std::move(tmp);
+    }
+    read_pos_ -= len;
+    std::memcpy(data_ + read_pos_, ptr, len);
   }
 
+  // 取出len字节的可读数据，作为与本Buffer共享存储的切片，不复制
+  BufferPtr Slice(size_t len);
+
   /* 最好调用以下方法来操作Buffer */
   [[nodiscard]] const char *Find(char ch) const {
     // 使用std::find而不是memchr
@@ -107,12 +250,56 @@ class Buffer {
   }
 
  private:
-  std::vector<char> buffer_;
-  size_t write_pos_;
-  size_t read_pos_;
+  struct Borrowed {};
+
+  // 池化存储块的头部，数据紧随其后
+  struct Block {
+    std::atomic<uint32_t> ref_cnt;
+    size_t size;
+
+    char *Data() { return reinterpret_cast<char *>(this + 1); }
+  };
+
+  explicit Buffer(Borrowed) {}
+
+  void Allocate(size_t capacity) {
+    auto size = BufferPool::Capacity(sizeof(Block) + capacity);
+    block_ = static_cast<Block *>(BufferPool::Allocate(size));
+    new (&block_->ref_cnt) std::atomic<uint32_t>(1);
+    block_->size = size;
+    data_ = block_->Data();
+    capacity_ = size - sizeof(Block);
+  }
+
+  void Release() {
+    if (block_ && block_->ref_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      BufferPool::Free(block_, block_->size);
+    }
+    block_ = nullptr;
+  }
+
+  Block *block_ = nullptr;  // 借用外部内存时为空
+  char *data_ = nullptr;
+  size_t capacity_ = 0;
+  size_t write_pos_ = 0;
+  size_t read_pos_ = 0;
 };
 
-using BufferPtr = std::shared_ptr<Buffer>;
+template<typename ...Args>
+BufferPtr MakeBuffer(Args &&...args) {
+  return std::allocate_shared<Buffer>(PoolAllocator<Buffer>(),
+                                      std::forward<Args>(args)...);
+}
+
+inline BufferPtr Buffer::Slice(size_t len) {
+  auto slice = MakeBuffer(View(GetReadPtr(), len));
+  if (block_) {
+    block_->ref_cnt.fetch_add(1, std::memory_order_relaxed);
+    slice->block_ = block_;
+  }
+  HasRead(len);
+  return slice;
+}
 
 } // namespace rpc
 
@@ -4,10 +4,18 @@
 #include "rpc_serializer.hpp"
 
 #include <cstdint>
+#include <limits>
 #include <string>
 
 namespace rpc {
 
+// 方法ID即注册的顺序，对同一份注册代码是稳定的，请求中只携带ID
+using MethodID = uint16_t;
+constexpr MethodID kInvalidMethodID = std::numeric_limits<MethodID>::max();
+// 每个Router的0号方法返回按ID排列的方法名，客户端据此协商方法表
+constexpr MethodID kGetMethodsID = 0;
+constexpr char kGetMethodsName[] = "__GetMethods";
+
 // kRpcRequest的content部分
 struct RpcRequestBody {
   std::string method;
@@ -18,6 +26,7 @@ SERIALIZE2(RpcRequestBody, method, args)
 enum class RpcErrorCode {
   kSuccess,
   kMethodNotFound,
+  kInvalidReply,  // 回复缺失或被截断
 };
 
 // kRpcReply的content部分
@@ -30,7 +39,7 @@ SERIALIZE2(RpcReplyBody, error_code, ret)
 template<typename ...Args>
 BufferPtr SerializeArgsToBuffer(Args &&...args) {
   if constexpr(sizeof...(Args) == 0) {  // 针对无参数场景的优化
-    return std::make_shared<Buffer>(0);
+    return MakeBuffer(0);
   } else {
     Serializer serializer;
     (void) (serializer << ... << args);
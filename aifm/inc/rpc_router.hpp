@@ -4,21 +4,41 @@
 #include "rpc_traits.hpp"
 #include "rpc_serializer.hpp"
 #include "rpc_protocol.hpp"
+#include "rpc_stream.hpp"
 
+#include <cassert>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace rpc {
 
+namespace detail {
+
+template<typename Tuple>
+struct TupleTail;
+
+template<typename Head, typename ...Ts>
+struct TupleTail<std::tuple<Head, Ts...>> {
+  using type = std::tuple<Ts...>;
+};
+
+}
+
 class RpcRouter {
  public:
-  using WrappedFunction = std::function<void(const BufferPtr &args, BufferPtr &ret)>;
+  using WrappedFunction = std::function<void(const BufferPtr &args, StreamWriter &writer)>;
 
-  RpcRouter() = default;
+  RpcRouter() {
+    Register(kGetMethodsName, [this]() { return GetAllMethods(); });
+  }
+  // 0号方法捕获了this
+  RpcRouter(const RpcRouter &) = delete;
+  RpcRouter &operator=(const RpcRouter &) = delete;
 
   template<typename F>
-  void Register(std::string name, F func) {
-    name_to_function_.emplace(std::move(name), [func](const BufferPtr &args, BufferPtr &ret) {
+  MethodID Register(std::string name, F func) {
+    return Add(std::move(name), [func](const BufferPtr &args, StreamWriter &writer) {
       using ReturnType = typename FunctionTraits<F>::ReturnType;
       using TupleArgType = typename FunctionTraits<F>::TupleArgType;
       Serializer serializer(args);
@@ -26,41 +46,88 @@ class RpcRouter {
 
       if constexpr(std::is_void_v<ReturnType>) {
         std::apply(func, tuple_arg);
-        ret = std::make_shared<Buffer>(0);
       } else {
         ReturnType ret_value = std::apply(func, tuple_arg);
         Serializer out;
         out << ret_value;
-        ret = out.GetBuffer();
+        writer.WriteChunk(out.GetBuffer());
       }
     });
   }
 
-  [[nodiscard]] RpcReplyBody Call(const std::string &method, const BufferPtr &args) {
-    RpcReplyBody response;
-    if (name_to_function_.count(method) == 0) {
-      response.error_code = RpcErrorCode::kMethodNotFound;
-      response.ret = std::make_shared<Buffer>(0);
-      return response;
+  // 流式方法的第一个参数为StreamWriter &，返回值由它边产生边写出，
+  // 例如 void ReadRange(rpc::StreamWriter &writer, size_t begin, size_t end)
+  template<typename F>
+  MethodID RegisterStream(std::string name, F func) {
+    static_assert(std::is_void_v<typename FunctionTraits<F>::ReturnType>);
+    return Add(std::move(name), [func](const BufferPtr &args, StreamWriter &writer) {
+      using TupleArgType = typename detail::TupleTail<
+          typename FunctionTraits<F>::TupleArgType>::type;
+      Serializer serializer(args);
+      auto tuple_arg = Get<TupleArgType>(serializer);
+      std::apply([&](auto &...args) { func(writer, args...); }, tuple_arg);
+    });
+  }
+
+  // 找不到时返回kInvalidMethodID
+  MethodID GetMethodID(const std::string &method) const {
+    auto iter = name_to_id_.find(method);
+    return iter == name_to_id_.end() ? kInvalidMethodID : iter->second;
+  }
+
+  // 按ID分发，省去方法名的解析和哈希。writer先收到RpcErrorCode，
+  // 然后是返回值，最后被关闭
+  void Call(MethodID id, const BufferPtr &args, StreamWriter &writer) {
+    if (id >= functions_.size()) {
+      writer << RpcErrorCode::kMethodNotFound;
+      writer.Close();
+      return;
     }
-    WrappedFunction &func = name_to_function_[method];
-    func(args, response.ret);
-    response.error_code = RpcErrorCode::kSuccess;
+    writer << RpcErrorCode::kSuccess;
+    functions_[id](args, writer);
+    writer.Close();
+  }
+
+  // 把流式的返回值拼成一个Buffer
+  [[nodiscard]] RpcReplyBody Call(MethodID id, const BufferPtr &args) {
+    RpcReplyBody response;
+    StreamWriter writer([&response](const BufferPtr &chunk, bool last) {
+      if (!response.ret) {
+        response.ret = chunk;
+      } else {
+        response.ret->Append(chunk->GetReadPtr(), chunk->ReadableBytes());
+      }
+    });
+    Call(id, args, writer);
+    Serializer serializer(response.ret);
+    serializer >> response.error_code;
     return response;
   }
 
+  [[nodiscard]] RpcReplyBody Call(const std::string &method, const BufferPtr &args) {
+    return Call(GetMethodID(method), args);
+  }
+
   // 在服务器运行的时候Method是不变的，因此不考虑线程安全的问题
-  std::vector<std::string> GetAllMethods() {
-    std::vector<std::string> methods;
-    methods.reserve(name_to_function_.size());
-    for (const auto &[name, f] : name_to_function_) {
-      methods.emplace_back(name);
-    }
-    return methods;
+  // 下标即方法ID
+  std::vector<std::string> GetAllMethods() const {
+    return names_;
   }
 
  private:
-  std::unordered_map<std::string, WrappedFunction> name_to_function_;
+  MethodID Add(std::string name, WrappedFunction func) {
+    assert(functions_.size() < kInvalidMethodID);
+    assert(!name_to_id_.count(name));
+    MethodID id = functions_.size();
+    functions_.emplace_back(std::move(func));
+    name_to_id_.emplace(name, id);
+    names_.emplace_back(std::move(name));
+    return id;
+  }
+
+  std::vector<WrappedFunction> functions_;
+  std::vector<std::string> names_;
+  std::unordered_map<std::string, MethodID> name_to_id_;
 };
 
 }
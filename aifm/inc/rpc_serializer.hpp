@@ -17,7 +17,7 @@ namespace rpc {
 
 class Serializer {
  public:
-  Serializer() : buffer_(std::make_shared<rpc::Buffer>(64)) {}
+  Serializer() : buffer_(MakeBuffer(64)) {}
   explicit Serializer(BufferPtr buffer) : buffer_(std::move(buffer)) {}
 
   BufferPtr GetBuffer() const { return buffer_; }
@@ -64,6 +64,19 @@ class Serializer {
     WriteRaw(s.data(), s.size());
   }
 
+  // 写到已有的可读数据之前，用于补上头部
+  template<typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+  void Prepend(T data) {
+    char buf[sizeof(T)];
+    Encode(buf, data);
+    buffer_->Prepend(buf, sizeof(T));
+  }
+
+  template<typename T, std::enable_if_t<std::is_enum_v<T>, int> = 0>
+  void Prepend(T data) {
+    Prepend(static_cast<std::underlying_type_t<T>>(data));
+  }
+
   /* Read functions */
   size_t ReadableBytes() const { return buffer_->ReadableBytes(); }
 
@@ -98,6 +111,9 @@ class Serializer {
     std::memcpy(&data, &idata, sizeof(double));
   }
 
+  // 不复制，返回与当前Buffer共享存储的切片
+  BufferPtr ReadSlice(size_t len) { return buffer_->Slice(len); }
+
   void Read(std::string &s) {
     size_t len;
     Read(len);
@@ -140,10 +156,7 @@ inline Serializer &operator<<(Serializer &serializer, const BufferPtr &buffer) {
 inline Serializer &operator>>(Serializer &serializer, BufferPtr &buffer) {
   size_t len;
   serializer >> len;
-  BufferPtr buf = std::make_shared<Buffer>(len);
-  serializer.ReadRaw(buf->GetWritePtr(), len);
-  buf->HasWritten(len);
-  buffer = buf;
+  buffer = serializer.ReadSlice(len);
   return serializer;
 }
 
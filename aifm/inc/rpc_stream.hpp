@@ -0,0 +1,108 @@
+#ifndef RPC_STREAM_HPP_
+#define RPC_STREAM_HPP_
+
+#include "rpc_protocol.hpp"
+#include "rpc_serializer.hpp"
+
+#include <cassert>
+#include <functional>
+
+namespace rpc {
+
+// 流式返回值的写端。写入的值按序攒成分块，每攒够chunk_size字节就交给
+// chunk_fn发出，因此返回值可以边产生边发送，而不必先整体物化。
+// 一个值不会跨越两个分块，读端逐块反序列化即可。
+// 最后一个分块被推迟到Close()时带着last标志发出，普通调用只产生一个分块。
+class StreamWriter {
+ public:
+  static constexpr size_t kDefaultChunkSize = 64 << 10;
+
+  using ChunkFn = std::function<void(const BufferPtr &chunk, bool last)>;
+
+  explicit StreamWriter(ChunkFn chunk_fn, size_t chunk_size = kDefaultChunkSize)
+      : chunk_fn_(std::move(chunk_fn)), chunk_size_(chunk_size) {}
+  StreamWriter(const StreamWriter &) = delete;
+  StreamWriter &operator=(const StreamWriter &) = delete;
+
+  template<typename T>
+  StreamWriter &operator<<(const T &value) {
+    assert(!closed_);
+    if (!pending_) pending_ = MakeBuffer(64);
+    Serializer serializer(pending_);
+    serializer << value;
+    if (pending_->ReadableBytes() >= chunk_size_) Cut();
+    return *this;
+  }
+
+  // 把已序列化好的data原样作为一个分块写入，不复制，data可以是View。
+  // 攒着的少量数据（如错误码）补进可写的data的headroom，与data合为一个分块
+  void WriteChunk(BufferPtr data) {
+    assert(!closed_);
+    if (pending_ && (pending_->ReadableBytes() > Buffer::kHeadroom ||
+                     !data->IsWritable())) {
+      Cut();
+    }
+    if (pending_) {
+      data->Prepend(pending_->GetReadPtr(), pending_->ReadableBytes());
+    }
+    pending_ = std::move(data);
+    Cut();
+  }
+
+  // 结束这个流，之后不能再写入
+  void Close() {
+    assert(!closed_);
+    Cut();
+    chunk_fn_(ready_ ? ready_ : MakeBuffer(0), true);
+    ready_.reset();
+    closed_ = true;
+  }
+
+  bool IsClosed() const { return closed_; }
+
+ private:
+  void Cut() {
+    if (!pending_ || !pending_->ReadableBytes()) return;
+    if (ready_) chunk_fn_(ready_, false);
+    ready_ = std::move(pending_);
+    pending_.reset();
+  }
+
+  ChunkFn chunk_fn_;
+  size_t chunk_size_;
+  BufferPtr pending_;  // 正在攒的分块
+  BufferPtr ready_;    // 已攒好但还未发出的分块
+  bool closed_ = false;
+};
+
+// 流的读端。首个分块以RpcErrorCode开头，剥去后其余数据逐块交给chunk_fn。
+// 调用失败时不会调用chunk_fn
+class StreamReader {
+ public:
+  using ChunkFn = std::function<void(const BufferPtr &chunk)>;
+
+  explicit StreamReader(ChunkFn chunk_fn) : chunk_fn_(std::move(chunk_fn)) {}
+
+  void OnChunk(const BufferPtr &chunk) {
+    if (!started_) {
+      started_ = true;
+      if (chunk->ReadableBytes() < sizeof(RpcErrorCode)) return;
+      Serializer serializer(chunk);
+      error_code_ = Get<RpcErrorCode>(serializer);
+    }
+    if (Succeeded() && chunk->ReadableBytes()) chunk_fn_(chunk);
+  }
+
+  // 未收到完整错误码时为kInvalidReply
+  RpcErrorCode GetErrorCode() const { return error_code_; }
+  bool Succeeded() const { return error_code_ == RpcErrorCode::kSuccess; }
+
+ private:
+  ChunkFn chunk_fn_;
+  bool started_ = false;
+  RpcErrorCode error_code_ = RpcErrorCode::kInvalidReply;
+};
+
+}
+
+#endif
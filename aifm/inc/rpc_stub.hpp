@@ -0,0 +1,71 @@
+#ifndef RPC_STUB_HPP_
+#define RPC_STUB_HPP_
+
+#include "rpc_traits.hpp"
+#include "rpc_protocol.hpp"
+
+#include <functional>
+#include <optional>
+#include <type_traits>
+
+namespace rpc {
+
+namespace detail {
+
+template<typename T>
+constexpr bool kIsFixedSize = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+}
+
+// 按函数签名生成的客户端存根。参数直接按服务端注册的参数类型编码，
+// 不经过std::tuple，全部定长时一次分配好准确大小的Buffer
+template<typename F>
+class Stub;
+
+template<typename Ret, typename ...Args>
+class Stub<Ret(Args...)> {
+ public:
+  // 发送编码好的参数，返回调用是否成功
+  using Caller = std::function<bool(const BufferPtr &args, BufferPtr &ret)>;
+  using Traits = FunctionTraits<Ret(Args...)>;
+  using ReturnType = typename Traits::ReturnType;
+  // 无返回值的方法只返回是否成功
+  using Result = std::conditional_t<std::is_void_v<ReturnType>, bool,
+                                    std::optional<ReturnType>>;
+
+  Stub() = default;
+  explicit Stub(Caller caller) : caller_(std::move(caller)) {}
+
+  explicit operator bool() const { return static_cast<bool>(caller_); }
+
+  // 参数先转换为注册时的类型，避免与服务端的解码不一致
+  Result operator()(const std::remove_cv_t<std::remove_reference_t<Args>> &...args) const {
+    BufferPtr ret;
+    bool success = caller_(EncodeArgs(args...), ret);
+    if constexpr(std::is_void_v<ReturnType>) {
+      return success;
+    } else {
+      if (!success) return std::nullopt;
+      return GetReturnValueFromBuffer<ReturnType>(ret);
+    }
+  }
+
+  template<typename ...Ts>
+  static BufferPtr EncodeArgs(const Ts &...args) {
+    if constexpr(sizeof...(Ts) == 0) {
+      return MakeBuffer(0);
+    } else {
+      constexpr bool kFixedSize = (detail::kIsFixedSize<Ts> && ...);
+      Serializer serializer(MakeBuffer(kFixedSize ? (sizeof(Ts) + ...) : 64));
+      (void) (serializer << ... << args);
+      return serializer.GetBuffer();
+    }
+  }
+
+ private:
+  Caller caller_;
+};
+
+}
+
+#endif
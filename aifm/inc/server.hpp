@@ -24,12 +24,14 @@ public:
   void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
   bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  const uint8_t *peek_object(uint8_t ds_id, uint8_t obj_id_len,
+                             const uint8_t *obj_id, uint16_t *data_len);
   void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
                const uint8_t *input_buf, uint16_t *output_len,
                uint8_t *output_buf);
-  // ret还包括RpcErrorCode
-  void call(uint8_t ds_id, const std::string &method,
-            const rpc::BufferPtr &args, rpc::BufferPtr &ret);
+  // 返回值（以RpcErrorCode开头）边产生边写进writer
+  void call(uint8_t ds_id, rpc::MethodID method_id,
+            const rpc::BufferPtr &args, rpc::StreamWriter &writer);
 
   static ServerDS *get_server_ds(uint8_t ds_id);
 };
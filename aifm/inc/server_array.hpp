@@ -1,21 +1,28 @@
 #ifndef RPC_ARRAY_HPP_
 #define RPC_ARRAY_HPP_
 
+#include <algorithm>
 #include <vector>
 #include <thread>
 
+#include "thread.h"
+
+#include "helpers.hpp"
+#include "range_lock.hpp"
 #include "rpc_router.hpp"
-#include "reader_writer_lock.hpp"
 #include "server.hpp"
 
 namespace far_memory {
 
+// 对象读写与并发执行的方法之间由范围锁同步。不提供peek_object()，
+// 因为原地发送时无法持有锁
 class ServerArray : public ServerDS {
  public:
   explicit ServerArray(uint64_t num_items, uint32_t item_size)
       : num_items_(num_items),
         item_size_(item_size),
-        vec_(num_items * item_size){
+        vec_(num_items * item_size),
+        range_lock_(num_items, item_size) {
     RegisterRPCFuncs();
   }
   ~ServerArray() override = default;
@@ -27,9 +34,51 @@ class ServerArray : public ServerDS {
   bool remove_object(uint8_t obj_id_len, const uint8_t *obj_id);
   void compute(uint8_t opcode, uint16_t input_len, const uint8_t *input_buf,
                uint16_t *output_len, uint8_t *output_buf);
-  // ret包括ErrorCode和实际的函数返回值
-  void call(const std::string &method, const rpc::BufferPtr &args,
-            rpc::BufferPtr &ret);
+  void call(rpc::MethodID method_id, const rpc::BufferPtr &args,
+            rpc::StreamWriter &writer);
+
+  // 把[begin, end)按锁的粒度切分给helpers::kNumCPUs个线程，对每一段在持有
+  // 其范围锁（exclusive时为写锁）时执行fn(seg_begin, seg_end)。
+  // 供注册的方法使用，以利用服务器的所有核
+  template<typename F>
+  void ParallelFor(size_t begin, size_t end, bool exclusive, F &&fn) {
+    end = std::min(end, static_cast<size_t>(num_items_));
+    if (begin >= end) return;
+    auto num_items_per_stripe = range_lock_.get_num_items_per_stripe();
+    auto begin_stripe = begin / num_items_per_stripe;
+    auto num_stripes = (end - 1) / num_items_per_stripe + 1 - begin_stripe;
+    auto num_stripes_per_thread = (num_stripes - 1) / helpers::kNumCPUs + 1;
+    std::vector<rt::Thread> threads;
+    for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+      auto left = std::max(
+          begin, (begin_stripe + num_stripes_per_thread * tid) * num_items_per_stripe);
+      auto right = std::min(
+          end, (begin_stripe + num_stripes_per_thread * (tid + 1)) * num_items_per_stripe);
+      if (left >= right) break;
+      threads.emplace_back([&, left, right]() {
+        // 每次只锁一个stripe，以免长时间阻塞对象的读写
+        for (auto seg_begin = left; seg_begin < right;) {
+          auto seg_end = std::min(
+              (seg_begin / num_items_per_stripe + 1) * num_items_per_stripe, right);
+          if (exclusive) {
+            range_lock_.lock_writer(seg_begin, seg_end);
+          } else {
+            range_lock_.lock_reader(seg_begin, seg_end);
+          }
+          fn(seg_begin, seg_end);
+          if (exclusive) {
+            range_lock_.unlock_writer(seg_begin, seg_end);
+          } else {
+            range_lock_.unlock_reader(seg_begin, seg_end);
+          }
+          seg_begin = seg_end;
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.Join();
+    }
+  }
 
  private:
   uint8_t *ItemData(size_t index) {
@@ -40,6 +89,9 @@ class ServerArray : public ServerDS {
     router_.Register("Add", Add);
     router_.Register("Read", [this](size_t index) { return Read(index); });
     router_.Register("SnappyCompress", [this]() { SnappyCompress(); });
+    router_.RegisterStream("ReadRange", [this](rpc::StreamWriter &writer, size_t begin, size_t end) {
+      ReadRange(writer, begin, end);
+    });
     RegisterDecisionTestFuncs();
   }
 
@@ -56,19 +108,24 @@ class ServerArray : public ServerDS {
 
   static int Add(int a, int b) { return a + b; }
   std::vector<uint8_t> Read(size_t index) {
-    if (index >= vec_.size()) return {};
+    if (index >= num_items_) return {};
     std::vector<uint8_t> ret(item_size_);
+    range_lock_.lock_reader(index, index + 1);
     std::memcpy(ret.data(), ItemData(index), item_size_);
+    range_lock_.unlock_reader(index, index + 1);
     return ret;
   }
 
+  // 流式返回[begin, end)的item，不受单个分块大小的限制
+  void ReadRange(rpc::StreamWriter &writer, size_t begin, size_t end);
+  // 各线程分别压缩自己的分段
   void SnappyCompress();
 
   uint64_t num_items_;
   uint32_t item_size_;
   std::vector<uint8_t> vec_;
+  RangeLock range_lock_;
   rpc::RpcRouter router_;
-//  ReaderWriterLock lock_; // 暂时不使用锁
 };
 
 class ServerArrayFactory : public ServerDSFactory {
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "helpers.hpp"
+#include "reader_writer_lock.hpp"
+#include "server.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace far_memory {
+
+// Keeps the far-mem leaves of a BTree, indexed by their leaf IDs. The range
+// aggregations walk the leaf chain through the next_id of the leaf headers.
+class ServerBTree : public ServerDS {
+private:
+  uint8_t key_dt_id_;
+  uint8_t val_dt_id_;
+  std::vector<std::unique_ptr<uint8_t[]>> leaves_;
+  ReaderWriterLock lock_;
+  friend class ServerBTreeFactory;
+
+  const uint8_t *get_leaf(uint64_t leaf_id);
+  void compute_aggregate(uint8_t opcode, uint16_t input_len,
+                         const uint8_t *input_buf, uint16_t *output_len,
+                         uint8_t *output_buf);
+  template <typename K, typename V>
+  void _compute_aggregate(uint8_t opcode, uint16_t input_len,
+                          const uint8_t *input_buf, uint16_t *output_len,
+                          uint8_t *output_buf);
+
+public:
+  ServerBTree(uint8_t key_dt_id, uint8_t val_dt_id);
+  ~ServerBTree();
+  void read_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  bool remove_object(uint8_t obj_id_len, const uint8_t *obj_id);
+  void compute(uint8_t opcode, uint16_t input_len, const uint8_t *input_buf,
+               uint16_t *output_len, uint8_t *output_buf);
+};
+
+class ServerBTreeFactory : public ServerDSFactory {
+public:
+  ServerDS *build(uint32_t param_len, uint8_t *params);
+};
+
+}; // namespace far_memory
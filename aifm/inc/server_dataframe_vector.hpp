@@ -34,8 +34,12 @@ private:
   std::pair<uint64_t, uint64_t>
   _compute_aggregate(uint8_t opcode, uint8_t result_ds, uint8_t key_ds,
                      uint64_t size);
+  void compute_sorted_indices(uint16_t input_len, const uint8_t *input_buf,
+                              uint16_t *output_len, uint8_t *output_buf);
   template <typename U>
   void _compute_unique(uint64_t vec_size, std::vector<U> &unique_vec);
+  template <bool Ascending>
+  void _compute_sorted_indices(uint64_t size, unsigned long long *indices);
 
 public:
   std::vector<T> vec_;
@@ -12,11 +12,22 @@ public:
   virtual void write_object(uint8_t obj_id_len, const uint8_t *obj_id,
                             uint16_t data_len, const uint8_t *data_buf) = 0;
   virtual bool remove_object(uint8_t obj_id_len, const uint8_t *obj_id) = 0;
+  // Returns the object data kept in place by the DS so that it can be sent
+  // without copying, or nullptr if the DS has to go through read_object().
+  virtual const uint8_t *peek_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                                     uint16_t *data_len) {
+    return nullptr;
+  }
   virtual void compute(uint8_t opcode, uint16_t input_len,
                        const uint8_t *input_buf, uint16_t *output_len,
                        uint8_t *output_buf) = 0;
-  virtual void call(const std::string &method, const rpc::BufferPtr &args,
-                    rpc::BufferPtr &reply) {}
+  // Writes the RpcErrorCode and then the return value into the writer, and
+  // closes it.
+  virtual void call(rpc::MethodID method_id, const rpc::BufferPtr &args,
+                    rpc::StreamWriter &writer) {
+    writer << rpc::RpcErrorCode::kMethodNotFound;
+    writer.Close();
+  }
 };
 
 class ServerDSFactory {
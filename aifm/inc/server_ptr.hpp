@@ -2,15 +2,61 @@
 
 #include "server_ds.hpp"
 
+#include <limits>
 #include <memory>
 
 namespace far_memory {
 class ServerPtr : public ServerDS {
+public:
+  // The compute interface of the vanilla ptr DS is used by the far-mem GC.
+  enum OpCode {
+    FreeObjects = 0,
+    ListObjects,
+    MoveObjects,
+    ResetRegion,
+    ReadRegion,
+    WriteRegion
+  };
+
+  constexpr static uint32_t kMaxComputeDataLen =
+      std::numeric_limits<uint16_t>::max();
+  constexpr static uint32_t kFreeEntrySize =
+      sizeof(uint64_t) + sizeof(uint16_t);
+  constexpr static uint32_t kListEntrySize =
+      sizeof(uint64_t) + sizeof(uint16_t) + sizeof(uint64_t);
+  constexpr static uint32_t kMoveEntrySize =
+      sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint16_t) + sizeof(uint64_t);
+  // The raw region image is read and written in chunks of this size.
+  constexpr static uint32_t kRegionChunkSize = 1 << 15;
+  constexpr static uint32_t kRegionChunkHeaderSize =
+      sizeof(uint32_t) + sizeof(uint32_t);
+
 private:
-  std::unique_ptr<uint8_t> buf_;
+  uint64_t size_;
+  uint8_t *buf_;
   friend class ServerPtrFactory;
 
+  void compute_free_objects(uint16_t input_len, const uint8_t *input_buf,
+                            uint16_t *output_len, uint8_t *output_buf);
+  void compute_list_objects(uint16_t input_len, const uint8_t *input_buf,
+                            uint16_t *output_len, uint8_t *output_buf);
+  void compute_move_objects(uint16_t input_len, const uint8_t *input_buf,
+                            uint16_t *output_len, uint8_t *output_buf);
+  void compute_reset_region(uint16_t input_len, const uint8_t *input_buf,
+                            uint16_t *output_len, uint8_t *output_buf);
+  void compute_read_region(uint16_t input_len, const uint8_t *input_buf,
+                           uint16_t *output_len, uint8_t *output_buf);
+  void compute_write_region(uint16_t input_len, const uint8_t *input_buf,
+                            uint16_t *output_len, uint8_t *output_buf);
+
 public:
+  // Walks the region image at region_addr from offset cur and fills the
+  // output of the ListObjects compute. Shared with the devices that keep
+  // vanilla ptr objects outside of the server.
+  static void list_region_objects(uint64_t region_addr, uint64_t region_offset,
+                                  uint32_t cur, uint16_t *output_len,
+                                  uint8_t *output_buf);
+
   ServerPtr(uint32_t param_len, uint8_t *params);
   ~ServerPtr();
   void read_object(uint8_t obj_id_len, const uint8_t *obj_id,
@@ -18,6 +64,8 @@ public:
   void write_object(uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
   bool remove_object(uint8_t obj_id_len, const uint8_t *obj_id);
+  const uint8_t *peek_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                             uint16_t *data_len);
   void compute(uint8_t opcode, uint16_t input_len, const uint8_t *input_buf,
                uint16_t *output_len, uint8_t *output_buf);
 };
@@ -4,17 +4,66 @@ extern "C" {
 #include <runtime/runtime.h>
 }
 
+#include "thread.h"
+
 #include "helpers.hpp"
+#include "internal/ds_info.hpp"
+#include "latency_histogram.hpp"
 
 #include <cstdint>
+#include <ostream>
+#include <string>
 #include <vector>
 
+#ifdef MONITOR_DEREF_HITS
+#define MONITOR_DEREF_HITS 1
+#else
+#define MONITOR_DEREF_HITS 0
+#endif
+
 namespace far_memory {
 
 struct alignas(64) Cacheline {
   uint8_t data[64];
 };
 
+// Each core has a row of the per-DS counters. The rows are cacheline aligned so
+// that the cores never share the cachelines.
+constexpr static uint32_t kNumDSStatSlots = kMaxNumDSIDs + 1;
+static_assert(kNumDSStatSlots * sizeof(uint64_t) % sizeof(Cacheline) == 0);
+
+// A point-in-time sum of the always-on counters over all cores.
+struct StatsSnapshot {
+  struct DS {
+    uint64_t deref_hits;
+    uint64_t swap_ins;
+    uint64_t swap_in_bytes;
+    uint64_t swap_outs;
+    uint64_t swap_out_bytes;
+    uint64_t stored_bytes;
+  };
+
+  uint64_t timestamp_us;
+  DS ds[kNumDSStatSlots];
+  uint64_t gc_pick_us;
+  uint64_t gc_mark_us;
+  uint64_t gc_wait_us;
+  uint64_t gc_write_back_us;
+  uint64_t gc_free_us;
+  uint64_t gc_far_mem_us;
+  uint64_t mutator_stall_us;
+  LatencySummary read_object_latency;
+  LatencySummary write_object_latency;
+  LatencySummary compute_latency;
+  LatencySummary call_latency;
+  LatencySummary swap_in_latency;
+  LatencySummary gc_cache_wait_latency;
+
+  // Writes a line per active DS, a line of the GC times, and a line per
+  // non-empty latency histogram.
+  void dump(std::ostream &os) const;
+};
+
 class Stats {
 private:
   static bool enable_swap_;
@@ -37,6 +86,10 @@ private:
   static unsigned write_object_cycles_low_end_;
 #endif
 
+  static bool dump_exit_;
+  static bool dump_running_;
+  static rt::Thread dump_thread_;
+
   static void _add_free_mem_ratio_record();
 
 public:
@@ -70,6 +123,76 @@ public:                                                                        \
     return sum;                                                                \
   }
 
+#define ADD_PER_CORE_PER_DS_STAT(type, x, enable_flag)                         \
+private:                                                                       \
+  alignas(sizeof(Cacheline)) static type x##_[helpers::kNumCPUs]               \
+                                             [kNumDSStatSlots];                \
+                                                                               \
+public:                                                                        \
+  FORCE_INLINE static void inc_##x(uint8_t ds_id, type num) {                  \
+    if (enable_flag) {                                                         \
+      preempt_disable();                                                       \
+      ACCESS_ONCE(x##_[get_core_num()][ds_id]) += num;                         \
+      preempt_enable();                                                        \
+    }                                                                          \
+  }                                                                            \
+  FORCE_INLINE static type get_##x(uint8_t ds_id) {                            \
+    type sum = 0;                                                              \
+    FOR_ALL_SOCKET0_CORES(i) { sum += ACCESS_ONCE(x##_[i][ds_id]); }           \
+    return sum;                                                                \
+  }
+
+  // The telemetry counters below are always on, except for the deref hits of
+  // the far-mem pointers, which are on the deref fast path and so are only
+  // counted with MONITOR_DEREF_HITS. The hashtable lookups always count them.
+  ADD_PER_CORE_PER_DS_STAT(uint64_t, deref_hits, true)
+  // Objects read from the far memory, and their data bytes.
+  ADD_PER_CORE_PER_DS_STAT(uint64_t, swap_ins, true)
+  ADD_PER_CORE_PER_DS_STAT(uint64_t, swap_in_bytes, true)
+  // Objects evicted from the local cache, and the data bytes written back.
+  ADD_PER_CORE_PER_DS_STAT(uint64_t, swap_outs, true)
+  ADD_PER_CORE_PER_DS_STAT(uint64_t, swap_out_bytes, true)
+  // The bytes that CompressingDevice stores for the written objects.
+  ADD_PER_CORE_PER_DS_STAT(uint64_t, stored_bytes, true)
+  // The time spent in each phase of the cache GC, and in the far-mem GC.
+  ADD_PER_CORE_STAT(uint64_t, gc_pick_us, true)
+  ADD_PER_CORE_STAT(uint64_t, gc_mark_us, true)
+  ADD_PER_CORE_STAT(uint64_t, gc_wait_us, true)
+  ADD_PER_CORE_STAT(uint64_t, gc_write_back_us, true)
+  ADD_PER_CORE_STAT(uint64_t, gc_free_us, true)
+  ADD_PER_CORE_STAT(uint64_t, gc_far_mem_us, true)
+  // The time mutators are blocked waiting for a GC to free up space.
+  ADD_PER_CORE_STAT(uint64_t, mutator_stall_us, true)
+
+#define ADD_LATENCY_HIST(x)                                                    \
+private:                                                                       \
+  static LatencyHistogram x##_latency_;                                        \
+                                                                               \
+public:                                                                        \
+  FORCE_INLINE static void record_##x##_latency(uint64_t start_tsc) {          \
+    x##_latency_.record_since(start_tsc);                                      \
+  }                                                                            \
+  FORCE_INLINE static LatencyHistogram &get_##x##_latency() {                  \
+    return x##_latency_;                                                       \
+  }
+
+  // The latency histograms of the remote device operations, of the deref slow
+  // path (i.e., swapping in an object), and of the mutator waits for the cache
+  // GC. The starts are taken from rdtsc().
+  ADD_LATENCY_HIST(read_object)
+  ADD_LATENCY_HIST(write_object)
+  ADD_LATENCY_HIST(compute)
+  ADD_LATENCY_HIST(call)
+  ADD_LATENCY_HIST(swap_in)
+  ADD_LATENCY_HIST(gc_cache_wait)
+
+  static void snapshot(StatsSnapshot *snapshot);
+  static void reset_latencies();
+  // Appends a snapshot dump to the file (or FIFO) at path every interval_us,
+  // until stop_periodic_dump().
+  static void start_periodic_dump(const std::string &path,
+                                  uint64_t interval_us);
+  static void stop_periodic_dump();
   static void enable_swap();
   static void disable_swap();
   static void clear_free_mem_ratio_records();
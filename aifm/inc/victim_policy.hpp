@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace far_memory {
+
+// The estimated state of a used local region, sampled by the GC master.
+struct VictimRegionStats {
+  // Fractions of the sampled object bytes which are hot/dirty.
+  double hot_ratio;
+  double dirty_ratio;
+  // Time since the region became full.
+  uint64_t age_us;
+  // Fraction of the sampled object bytes whose DSes exceed their soft quotas.
+  double over_quota_ratio;
+  // Byte-weighted mean of the eviction weights of the sampled objects' DSes.
+  double eviction_weight;
+};
+
+// Decides which used local regions are evacuated by a GC round. The GC master
+// examines get_num_candidates() regions from the head of the used lists and
+// evacuates the ones with the highest scores; the rest stay in the lists.
+class VictimRegionPolicy {
+public:
+  virtual ~VictimRegionPolicy() {}
+  virtual uint32_t get_num_candidates(uint32_t num_victims) const = 0;
+  // Only called when there are more candidates than victims.
+  virtual double score(const VictimRegionStats &stats) const = 0;
+};
+
+// Evacuates the regions in the order they became full.
+class RoundRobinVictimPolicy : public VictimRegionPolicy {
+public:
+  uint32_t get_num_candidates(uint32_t num_victims) const;
+  double score(const VictimRegionStats &stats) const;
+};
+
+// A cost-benefit policy in the spirit of the LFS cleaner. Evacuating a region
+// frees its cold bytes (benefit, weighted by the region age), while its hot
+// bytes are copied to a new local region and its dirty bytes are written back
+// (cost).
+class CostBenefitVictimPolicy : public VictimRegionPolicy {
+private:
+  constexpr static uint32_t kNumCandidatesPerVictim = 4;
+  constexpr static double kDirtyCostWeight = 1;
+  constexpr static double kHotCostWeight = 2;
+  constexpr static double kOverQuotaBenefitWeight = 3;
+
+public:
+  uint32_t get_num_candidates(uint32_t num_victims) const;
+  double score(const VictimRegionStats &stats) const;
+};
+
+} // namespace far_memory
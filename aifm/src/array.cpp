@@ -3,11 +3,14 @@
 #include "manager.hpp"
 #include "pointer.hpp"
 
+#include <algorithm>
+
 namespace far_memory {
 
 GenericArray::GenericArray(FarMemManager *manager, uint32_t item_size,
                            uint64_t num_items)
     : kNumItems_(num_items), kItemSize_(item_size),
+      dirty_tracker_(num_items, item_size),
       prefetcher_(manager->get_device(), reinterpret_cast<uint8_t *>(&ptrs_),
                   item_size) {
   ds_id_ = manager->allocate_ds_id();
@@ -16,6 +19,7 @@ GenericArray::GenericArray(FarMemManager *manager, uint32_t item_size,
   __builtin_memcpy(&params[sizeof(num_items)], &item_size, sizeof(item_size));
   manager->construct(kArrayDSType, ds_id_,
                      sizeof(num_items) + sizeof(item_size), params);
+  negotiate_methods(manager);
 
   preempt_disable();
   ptrs_.reset(new GenericUniquePtr[num_items]);
@@ -33,54 +37,108 @@ GenericArray::~GenericArray() {
 }
 
 void GenericArray::flush() {
-  if (!dirty_) return;
-  dirty_ = false;
-  std::vector<rt::Thread> threads;
-  for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
-    threads.emplace_back([&, tid]() {
-      auto num_tasks_per_threads =
-          (kNumItems_ == 0)
-          ? 0
-          : (kNumItems_ - 1) / helpers::kNumCPUs + 1;
-      auto left = num_tasks_per_threads * tid;
-      auto right = std::min(left + num_tasks_per_threads, kNumItems_);
-      for (uint64_t i = left; i < right; i++) {
-        ptrs_[i].flush();
-      }
-    });
+  dirty_tracker_.flush([&](uint64_t begin_idx, uint64_t end_idx) {
+    for (uint64_t i = begin_idx; i < end_idx; i++) {
+      ptrs_[i].flush();
+    }
+  });
+}
+
+uint64_t GenericArray::get_non_present_bytes() const {
+  // The local bytes of the DS are maintained by the manager, which saves a
+  // walk over the items.
+  auto local_bytes = FarMemManagerFactory::get()->get_ds_local_bytes(ds_id_);
+  auto object_size = Object::kHeaderSize + kItemSize_ + sizeof(Index_t);
+  auto num_present_items = std::min(local_bytes / object_size, kNumItems_);
+  return (kNumItems_ - num_present_items) * kItemSize_;
+}
+
+void GenericArray::negotiate_methods(FarMemManager *manager) {
+  // Every server-side router serves its method names, indexed by the IDs.
+  rpc::BufferPtr ret;
+  if (manager->call(ds_id_, rpc::kGetMethodsID, rpc::MakeBuffer(0), ret) !=
+      rpc::RpcErrorCode::kSuccess) {
+    // E.g., the device has no server side.
+    return;
   }
-  for (auto &thread : threads) {
-    thread.Join();
+  auto methods = rpc::GetReturnValueFromBuffer<std::vector<std::string>>(ret);
+  BUG_ON(methods.size() > rpc::kInvalidMethodID);
+  for (rpc::MethodID id = 0; id < methods.size(); id++) {
+    remote_method_ids_.emplace(std::move(methods[id]), id);
   }
 }
 
-bool GenericArray::call(const std::string &method, const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
-  bool success = false;
-  auto estimator = cost_estimator_map_.Get(method);
-  uint64_t flush_bytes = 0, load_bytes = 0;
-  // 统计 flush_bytes 和 load_bytes
-  for (uint64_t i = 0; i < kNumItems_; ++i) {
-    if (!ptrs_[i].is_present()) {
-      load_bytes += kItemSize_;
-    } else if (ptrs_[i].is_dirty()){
-      flush_bytes += kItemSize_;
-    }
-  }
-//  if (estimator->SuggestPushdown(flush_bytes, load_bytes)) {
-//    estimator->StartBench();
-//    flush();
-//    estimator->FlushOver(flush_bytes);
-//    estimator->StartBench();
-//    success = FarMemManagerFactory::get()->call(ds_id_, method, args, ret);
-//    estimator->ComputeInMemoryOver(ret->ReadableBytes());
-//  } else {
-//    estimator->StartBench();
-    auto reply = rpc_router_.Call(method, args);
-    success = (reply.error_code == rpc::RpcErrorCode::kSuccess);
-    ret = reply.ret;
-//    estimator->ComputeInProcessorOver(load_bytes);
-//  }
-  return success;
+GenericArray::Method GenericArray::get_method(const std::string &name) {
+  auto iter = remote_method_ids_.find(name);
+  return Method{.local_id = rpc_router_.GetMethodID(name),
+                .remote_id = iter == remote_method_ids_.end() ? rpc::kInvalidMethodID
+                                                             : iter->second,
+                .estimator = cost_estimator_map_.Get(name)};
+}
+
+bool GenericArray::call(const Method &method, const rpc::BufferPtr &args,
+                        rpc::BufferPtr &ret) {
+  return Pushdown::call(
+             method.estimator.get(), dirty_tracker_.get_dirty_bytes(),
+             get_non_present_bytes(), [&]() { flush(); },
+             [&](const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
+               if (method.local_id == rpc::kInvalidMethodID) {
+                 return rpc::RpcErrorCode::kMethodNotFound;
+               }
+               auto reply = rpc_router_.Call(method.local_id, args);
+               ret = reply.ret;
+               return reply.error_code;
+             },
+             [&](const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
+               // Saves the round trip of a method unknown to the server.
+               if (method.remote_id == rpc::kInvalidMethodID) {
+                 return rpc::RpcErrorCode::kMethodNotFound;
+               }
+               return FarMemManagerFactory::get()->call(
+                   ds_id_, method.remote_id, args, ret);
+             },
+             args, ret) == rpc::RpcErrorCode::kSuccess;
+}
+
+bool GenericArray::call_stream(const Method &method,
+                               const rpc::BufferPtr &args,
+                               const rpc::StreamReader::ChunkFn &chunk_fn) {
+  // Both sides fail only if the method is not found, i.e., before any chunk
+  // of the return value, so the fallback never hands over a chunk twice.
+  rpc::BufferPtr ret;
+  uint64_t streamed_bytes = 0;
+  return Pushdown::call(
+             method.estimator.get(), dirty_tracker_.get_dirty_bytes(),
+             get_non_present_bytes(), [&]() { flush(); },
+             [&](const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
+               if (method.local_id == rpc::kInvalidMethodID) {
+                 return rpc::RpcErrorCode::kMethodNotFound;
+               }
+               rpc::StreamReader reader(chunk_fn);
+               rpc::StreamWriter writer(
+                   [&](const rpc::BufferPtr &chunk, bool last) {
+                     reader.OnChunk(chunk);
+                   });
+               rpc_router_.Call(method.local_id, args, writer);
+               return reader.GetErrorCode();
+             },
+             [&](const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
+               if (method.remote_id == rpc::kInvalidMethodID) {
+                 return rpc::RpcErrorCode::kMethodNotFound;
+               }
+               return FarMemManagerFactory::get()->call_stream(
+                   ds_id_, method.remote_id, args,
+                   [&](const rpc::BufferPtr &chunk) {
+                     streamed_bytes += chunk->ReadableBytes();
+                     chunk_fn(chunk);
+                   });
+             },
+             args, ret, &streamed_bytes) == rpc::RpcErrorCode::kSuccess;
+}
+
+bool GenericArray::call(const std::string &method, const rpc::BufferPtr &args,
+                        rpc::BufferPtr &ret) {
+  return call(get_method(method), args, ret);
 }
 
 void GenericArray::disable_prefetch() {
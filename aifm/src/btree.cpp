@@ -0,0 +1,111 @@
+#include "btree.hpp"
+#include "internal/ds_info.hpp"
+#include "manager.hpp"
+
+namespace far_memory {
+
+GenericBTree::GenericBTree(FarMemManager *manager, uint8_t key_dt_id,
+                           uint8_t val_dt_id, uint32_t key_size,
+                           uint32_t val_size)
+    : kLeafCapacity_(get_leaf_capacity(key_size, val_size)),
+      device_(manager->get_device()), ds_id_(manager->allocate_ds_id()),
+      prefetcher_(manager->get_device(), reinterpret_cast<uint8_t *>(this),
+                  kLeafSize) {
+  BUG_ON(kLeafCapacity_ < 2);
+  uint8_t params[] = {key_dt_id, val_dt_id};
+  manager->construct(kBTreeDSType, ds_id_, sizeof(params), params);
+}
+
+GenericBTree::~GenericBTree() {
+  // Free the leaves before their DS is destructed.
+  for (auto &leaf : leaves_) {
+    if (!leaf.ptr.is_null()) {
+      leaf.ptr.free();
+      leaf.ptr.nullify();
+    }
+  }
+  FarMemManagerFactory::get()->destruct(ds_id_);
+}
+
+GenericBTree::Leaf *GenericBTree::allocate_leaf(const DerefScope &scope,
+                                                Leaf *prev) {
+  Leaf *leaf;
+  if (free_leaves_.empty()) {
+    leaf = &leaves_.emplace_back();
+    leaf->id = leaves_.size() - 1;
+  } else {
+    leaf = free_leaves_.back();
+    free_leaves_.pop_back();
+  }
+  leaf->ptr = FarMemManagerFactory::get()->allocate_generic_unique_ptr(
+      ds_id_, kLeafSize, sizeof(leaf->id),
+      reinterpret_cast<const uint8_t *>(&leaf->id));
+  auto *next = prev ? prev->next : head_;
+  auto *header = deref_leaf_mut(scope, leaf);
+  header->next_id = next ? next->id : kInvalidLeafId;
+  header->cnt = 0;
+
+  leaf->prev = prev;
+  leaf->next = next;
+  if (next) {
+    next->prev = leaf;
+  }
+  if (prev) {
+    deref_leaf_mut(scope, prev)->next_id = leaf->id;
+    prev->next = leaf;
+  } else {
+    head_ = leaf;
+  }
+  return leaf;
+}
+
+void GenericBTree::free_leaf(const DerefScope &scope, Leaf *leaf) {
+  auto *prev = leaf->prev;
+  auto *next = leaf->next;
+  if (prev) {
+    deref_leaf_mut(scope, prev)->next_id = next ? next->id : kInvalidLeafId;
+    prev->next = next;
+  } else {
+    head_ = next;
+  }
+  if (next) {
+    next->prev = prev;
+  }
+  // Keep leaf->prev and leaf->next for the prefetcher that may be on it.
+  leaf->ptr.free();
+  leaf->ptr.nullify();
+  free_leaves_.push_back(leaf);
+}
+
+void GenericBTree::flush() {
+  if (!dirty_) {
+    return;
+  }
+  dirty_ = false;
+  std::vector<rt::Thread> threads;
+  for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+    threads.emplace_back([&, tid]() {
+      auto num_tasks_per_threads =
+          (leaves_.size() == 0) ? 0
+                                : (leaves_.size() - 1) / helpers::kNumCPUs + 1;
+      auto left = num_tasks_per_threads * tid;
+      auto right = std::min(left + num_tasks_per_threads, leaves_.size());
+      for (uint64_t i = left; i < right; i++) {
+        leaves_[i].ptr.flush();
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+}
+
+void GenericBTree::disable_prefetch() {
+  ACCESS_ONCE(dynamic_prefetch_enabled_) = false;
+}
+
+void GenericBTree::enable_prefetch() {
+  ACCESS_ONCE(dynamic_prefetch_enabled_) = true;
+}
+
+} // namespace far_memory
@@ -9,29 +9,31 @@ extern "C" {
 #include "helpers.hpp"
 #include "manager.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 namespace far_memory {
 
-GenericConcurrentHopscotch::GenericConcurrentHopscotch(
-    uint8_t ds_id, uint32_t local_num_entries_shift,
-    uint32_t remote_num_entries_shift, uint64_t remote_data_size)
-    : kHashMask_((1 << local_num_entries_shift) - 1),
-      kNumEntries_((1 << local_num_entries_shift) + kNeighborhood),
-      ds_id_(ds_id) {
+GenericConcurrentHopscotch::Table::Table(uint32_t num_entries_shift)
+    : kHashMask((1 << num_entries_shift) - 1),
+      kNumEntries((1 << num_entries_shift) + kNeighborhood), next(nullptr),
+      num_migrated(0) {
   // Check overflow.
-  BUG_ON(((kHashMask_ + 1) >> local_num_entries_shift) != 1);
+  BUG_ON(((kHashMask + 1) >> num_entries_shift) != 1);
 
   // Allocate memory for buckets.
-  auto size = kNumEntries_ * sizeof(BucketEntry);
+  auto size = kNumEntries * sizeof(BucketEntry);
   preempt_disable();
-  buckets_mem_.reset(static_cast<uint8_t *>(helpers::allocate_hugepage(size)));
-  buckets_ = new (buckets_mem_.get()) BucketEntry[kNumEntries_];
+  buckets_mem.reset(static_cast<uint8_t *>(helpers::allocate_hugepage(size)));
+  buckets = new (buckets_mem.get()) BucketEntry[kNumEntries];
   preempt_enable();
+}
 
-  // Allocate memory for far memory pointers.
-  size = kNumEntries_ * sizeof(GenericUniquePtr);
-
+GenericConcurrentHopscotch::GenericConcurrentHopscotch(
+    uint8_t ds_id, uint32_t local_num_entries_shift,
+    uint32_t remote_num_entries_shift, uint64_t remote_data_size)
+    : table_(new Table(local_num_entries_shift)), ds_id_(ds_id),
+      resizing_(false) {
   // Initialize the remote-side hashtable.
   uint8_t params[sizeof(remote_num_entries_shift) + sizeof(remote_data_size)];
   __builtin_memcpy(params, &remote_num_entries_shift,
@@ -49,17 +51,27 @@ GenericConcurrentHopscotch::GenericConcurrentHopscotch(
     return true;
   };
   FarMemManagerFactory::get()->register_eval_notifier(ds_id, evac_notifier_fn);
+
+  if constexpr (HASHTABLE_ADMISSION) {
+    admission_sketch_.reset(new FrequencySketch(
+        std::clamp(local_num_entries_shift, kMinAdmissionSketchShift,
+                   kMaxAdmissionSketchShift)));
+  }
 }
 
 GenericConcurrentHopscotch::~GenericConcurrentHopscotch() {
+  if (resizing_) {
+    resizer_.Join();
+  }
   // Free local data.
-  for (uint32_t i = 0; i < kNumEntries_; i++) {
-    auto &ptr = buckets_[i].ptr;
+  for (uint32_t i = 0; i < table_->kNumEntries; i++) {
+    auto &ptr = table_->buckets[i].ptr;
     DerefScope scope;
     if (ptr.deref(scope)) {
       ptr.free();
     }
   }
+  delete table_;
   // Free remote data.
   FarMemManagerFactory::get()->destruct(ds_id_);
 }
@@ -81,94 +93,138 @@ void GenericConcurrentHopscotch::do_evac_notifier(EvacNotifierMeta meta) {
   }
 }
 
-void GenericConcurrentHopscotch::forward_get(uint8_t key_len,
+bool GenericConcurrentHopscotch::admit(uint32_t hash) {
+  if constexpr (HASHTABLE_ADMISSION) {
+    // Every miss is recorded, but the frequency only matters once admitting
+    // the value would evict another one.
+    auto freq = admission_sketch_->record(hash);
+    auto *manager = FarMemManagerFactory::get();
+    if (!manager->is_free_cache_almost_empty() &&
+        !manager->is_over_soft_quota(ds_id_)) {
+      return true;
+    }
+    return freq >= kAdmissionThreshold;
+  } else {
+    return true;
+  }
+}
+
+void GenericConcurrentHopscotch::forward_get(uint32_t hash, uint8_t key_len,
                                              const uint8_t *key,
                                              uint16_t *val_len, uint8_t *val) {
   // Cannot find the key locally, so forward the request to the remote agent.
   FarMemManagerFactory::get()->read_object(ds_id_, key_len, key, val_len, val);
-  if (*val_len) {
-    _put(key_len, key, *val_len, val, /* swap_in = */ true);
+  if (*val_len && admit(hash)) {
+    Stats::inc_swap_ins(ds_id_, 1);
+    Stats::inc_swap_in_bytes(ds_id_, *val_len);
+    _put(hash, key_len, key, *val_len, val, /* swap_in = */ true);
   }
 }
 
-FORCE_INLINE void *deref(GenericUniquePtr &ptr, bool mut) {
-  if (mut) {
-    return ptr._deref<true, false>();
-  } else {
-    return ptr._deref<false, false>();
+void GenericConcurrentHopscotch::forward_get_batch(
+    uint32_t num_keys, const uint32_t *idxes, const uint32_t *hashes,
+    uint8_t key_len, const uint8_t *keys, uint16_t *val_lens,
+    uint8_t *const *vals) {
+  // Forward all the missing keys to the remote agent in one batch.
+  ObjectReadReq reqs[kMaxNumKeysPerBatch];
+  for (uint32_t i = 0; i < num_keys; i++) {
+    auto idx = idxes[i];
+    reqs[i] = ObjectReadReq{.ds_id = ds_id_,
+                            .obj_id_len = key_len,
+                            .obj_id = keys + idx * key_len,
+                            .data_len = &val_lens[idx],
+                            .data_buf = vals[idx]};
+  }
+  FarMemManagerFactory::get()->read_objects(num_keys, reqs);
+  for (uint32_t i = 0; i < num_keys; i++) {
+    auto idx = idxes[i];
+    if (val_lens[idx] && admit(hashes[idx])) {
+      Stats::inc_swap_ins(ds_id_, 1);
+      Stats::inc_swap_in_bytes(ds_id_, val_lens[idx]);
+      _put(hashes[idx], key_len, keys + idx * key_len, val_lens[idx], vals[idx],
+           /* swap_in = */ true);
+    }
   }
 }
 
-bool GenericConcurrentHopscotch::_put(uint8_t key_len, const uint8_t *key,
-                                      uint16_t val_len, const uint8_t *val,
-                                      bool swap_in) {
-  uint32_t hash = hash_32(static_cast<const void *>(key), key_len);
-  uint32_t bucket_idx = hash & kHashMask_;
-retry:
-  auto *bucket = &(buckets_[bucket_idx]);
-  auto orig_bucket_idx = bucket_idx;
-
-  while (unlikely(!bucket->spin.TryLockWp())) {
-    thread_yield();
+void GenericConcurrentHopscotch::hash_and_prefetch(uint32_t num_keys,
+                                                   uint8_t key_len,
+                                                   const uint8_t *keys,
+                                                   uint32_t *hashes) {
+  for (uint32_t i = 0; i < num_keys; i++) {
+    hashes[i] =
+        hash_32(static_cast<const void *>(keys + i * key_len), key_len);
   }
-  auto bucket_lock_guard = helpers::finally([&]() { bucket->spin.UnlockWp(); });
+  // Bring the anchor buckets into the cache before any of them is probed, so
+  // that their misses overlap.
+  rcu_lock_.reader_lock();
+  for (uint32_t i = 0; i < num_keys; i++) {
+    auto *table = locate(hashes[i]);
+    __builtin_prefetch(&(table->buckets[hashes[i] & table->kHashMask]));
+  }
+  rcu_lock_.reader_unlock();
+}
 
-  uint32_t bitmap = load_acquire(&(bucket->bitmap));
-  while (bitmap) {
-    auto offset = helpers::bsf_32(bitmap);
-    auto *bucket = &buckets_[bucket_idx];
-    auto *entry = bucket + offset;
-    auto &ptr = entry->ptr;
-#ifdef HASHTABLE_EXCLUSIVE
-    auto *obj_val_ptr = ptr._deref<true, false>();
-#else
-    auto *obj_val_ptr = deref(ptr, !swap_in);
-#endif
-    if (unlikely(!obj_val_ptr)) {
-      bucket_lock_guard.reset();
-      process_evac_notifier_stash();
-      thread_yield();
-      goto retry;
+void GenericConcurrentHopscotch::_get_batch(uint32_t num_keys, uint8_t key_len,
+                                            const uint8_t *keys,
+                                            uint16_t *val_lens,
+                                            uint8_t *const *vals) {
+  uint32_t hashes[kMaxNumKeysPerBatch];
+  uint32_t miss_idxes[kMaxNumKeysPerBatch];
+  for (uint32_t i = 0; i < num_keys; i += kMaxNumKeysPerBatch) {
+    auto num = std::min(num_keys - i, kMaxNumKeysPerBatch);
+    auto *cur_keys = keys + i * key_len;
+    hash_and_prefetch(num, key_len, cur_keys, hashes);
+    uint32_t num_misses = 0;
+    for (uint32_t j = 0; j < num; j++) {
+      if (very_unlikely(__get(hashes[j], key_len, cur_keys + j * key_len,
+                              &val_lens[i + j], vals[i + j]))) {
+        miss_idxes[num_misses++] = j;
+      }
     }
+    Stats::inc_deref_hits(ds_id_, num - num_misses);
+    if (num_misses) {
+      forward_get_batch(num_misses, miss_idxes, hashes, key_len, cur_keys,
+                        val_lens + i, vals + i);
+    }
+  }
+}
 
-    auto obj =
-        Object(reinterpret_cast<uint64_t>(obj_val_ptr) - Object::kHeaderSize);
-    if (obj.get_obj_id_len() == key_len) {
-      auto obj_data_len = obj.get_data_len();
-      if (strncmp(reinterpret_cast<const char *>(obj_val_ptr) + obj_data_len,
-                  reinterpret_cast<const char *>(key), key_len) == 0) {
-        if (unlikely(obj_data_len != val_len + sizeof(EvacNotifierMeta))) {
-          auto new_data_size = val_len + sizeof(EvacNotifierMeta);
-          if (!FarMemManagerFactory::get()->reallocate_generic_unique_ptr_nb(
-                  *static_cast<DerefScope *>(nullptr), &ptr, new_data_size,
-                  val)) {
-            bucket_lock_guard.reset();
-            FarMemManagerFactory::get()->mutator_wait_for_gc_cache();
-            goto retry;
-          }
-          auto new_obj_val_ptr = ptr._deref<true, false>();
-#ifndef HASHTABLE_EXCLUSIVE
-          if (swap_in) {
-            ptr.meta().clear_dirty();
-          }
-#endif
-          assert(new_obj_val_ptr);
-          auto new_meta = reinterpret_cast<EvacNotifierMeta *>(
-              reinterpret_cast<uint64_t>(new_obj_val_ptr) + val_len);
-          *new_meta = {.anchor_addr = reinterpret_cast<uint64_t>(bucket),
-                       .offset = static_cast<uint8_t>(offset)};
-        } else {
-          memcpy(obj_val_ptr, val, val_len);
-        }
-        return true;
-      }
+void GenericConcurrentHopscotch::_put_batch(uint32_t num_keys, uint8_t key_len,
+                                            const uint8_t *keys,
+                                            uint16_t val_len,
+                                            const uint8_t *vals,
+                                            bool *key_existed) {
+  uint32_t hashes[kMaxNumKeysPerBatch];
+  for (uint32_t i = 0; i < num_keys; i += kMaxNumKeysPerBatch) {
+    auto num = std::min(num_keys - i, kMaxNumKeysPerBatch);
+    auto *cur_keys = keys + i * key_len;
+    hash_and_prefetch(num, key_len, cur_keys, hashes);
+    for (uint32_t j = 0; j < num; j++) {
+      key_existed[i + j] =
+          _put(hashes[j], key_len, cur_keys + j * key_len, val_len,
+               vals + (i + j) * val_len, /* swap_in = */ false);
     }
-    bitmap ^= (1 << offset);
   }
+}
+
+FORCE_INLINE void *deref(GenericUniquePtr &ptr, bool mut) {
+  if (mut) {
+    return ptr._deref<true, false>();
+  } else {
+    return ptr._deref<false, false>();
+  }
+}
+
+GenericConcurrentHopscotch::ReserveStatus
+GenericConcurrentHopscotch::reserve_entry(Table *table, uint32_t anchor_idx,
+                                          uint32_t *entry_idx) {
+  auto *buckets = table->buckets;
+  auto bucket_idx = anchor_idx;
 
-  // The key does not exist. Use linear probing to find the first empty slot.
-  while (bucket_idx < kNumEntries_) {
-    auto *entry = &buckets_[bucket_idx];
+  // Use linear probing to find the first empty slot.
+  while (bucket_idx < table->kNumEntries) {
+    auto *entry = &buckets[bucket_idx];
     if (__sync_bool_compare_and_swap(reinterpret_cast<uint64_t *>(&entry->ptr),
                                      FarMemPtrMeta::kNull,
                                      BucketEntry::kBusyPtr)) {
@@ -177,21 +233,17 @@ retry:
     bucket_idx++;
   }
 
-  if (very_unlikely(bucket_idx == kNumEntries_)) {
-    // The bucket is full and we need to resize the hash table.
-    // For now, we just throw out an error.
-    BUG();
+  if (very_unlikely(bucket_idx == table->kNumEntries)) {
+    return Full;
   }
 
-  uint32_t distance_to_orig_bucket;
   // Now keep moving the empty slot until it becomes neighbors.
-  while ((distance_to_orig_bucket = bucket_idx - orig_bucket_idx) >=
-         kNeighborhood) {
+  while (bucket_idx - anchor_idx >= kNeighborhood) {
     // Try to see if we can move things backward.
     uint32_t distance;
     for (distance = kNeighborhood - 1; distance > 0; distance--) {
       auto idx = bucket_idx - distance;
-      auto *anchor_entry = &(buckets_[idx]);
+      auto *anchor_entry = &(buckets[idx]);
       if (!anchor_entry->bitmap) {
         continue;
       }
@@ -214,16 +266,13 @@ retry:
       }
 
       // Swap entry [closest_bucket + offset] and [bucket_idx]
-      auto *from_entry = &buckets_[idx + offset];
+      auto *from_entry = &buckets[idx + offset];
       auto &from_entry_ptr = from_entry->ptr;
       auto *from_obj_val_ptr = from_entry_ptr._deref<false, false>();
-      auto *to_entry = &buckets_[bucket_idx];
+      auto *to_entry = &buckets[bucket_idx];
       if (unlikely(!from_obj_val_ptr)) {
-        bucket_lock_guard.reset();
         to_entry->ptr.nullify();
-        process_evac_notifier_stash();
-        thread_yield();
-        goto retry;
+        return Evacuating;
       }
 
       auto from_obj = Object(reinterpret_cast<uint64_t>(from_obj_val_ptr) -
@@ -245,20 +294,117 @@ retry:
       break;
     }
 
-    // The bucket is full and we need to resize the hash table.
-    // For now, we just throw out an error.
     if (very_unlikely(!distance)) {
-      BUG();
+      buckets[bucket_idx].ptr.nullify();
+      return Full;
+    }
+  }
+
+  *entry_idx = bucket_idx;
+  return Reserved;
+}
+
+bool GenericConcurrentHopscotch::_put(uint32_t hash, uint8_t key_len,
+                                      const uint8_t *key, uint16_t val_len,
+                                      const uint8_t *val, bool swap_in) {
+  // The read side is left while waiting for the GC or the migration, which
+  // would otherwise hold back the freeing of the old tables.
+  rcu_lock_.reader_lock();
+  auto rcu_guard = helpers::finally([&]() { rcu_lock_.reader_unlock(); });
+
+retry:
+  BucketEntry *bucket;
+  auto *table = lock_anchor(hash, &bucket);
+  auto *buckets = table->buckets;
+  uint32_t bucket_idx = bucket - buckets;
+  auto bucket_lock_guard = helpers::finally([&]() { bucket->spin.UnlockWp(); });
+
+  uint32_t bitmap = load_acquire(&(bucket->bitmap));
+  while (bitmap) {
+    auto offset = helpers::bsf_32(bitmap);
+    auto *bucket = &buckets[bucket_idx];
+    auto *entry = bucket + offset;
+    auto &ptr = entry->ptr;
+#ifdef HASHTABLE_EXCLUSIVE
+    auto *obj_val_ptr = ptr._deref<true, false>();
+#else
+    auto *obj_val_ptr = deref(ptr, !swap_in);
+#endif
+    if (unlikely(!obj_val_ptr)) {
+      bucket_lock_guard.reset();
+      process_evac_notifier_stash();
+      thread_yield();
+      goto retry;
+    }
+
+    auto obj =
+        Object(reinterpret_cast<uint64_t>(obj_val_ptr) - Object::kHeaderSize);
+    if (obj.get_obj_id_len() == key_len) {
+      auto obj_data_len = obj.get_data_len();
+      if (strncmp(reinterpret_cast<const char *>(obj_val_ptr) + obj_data_len,
+                  reinterpret_cast<const char *>(key), key_len) == 0) {
+        if (unlikely(obj_data_len != val_len + sizeof(EvacNotifierMeta))) {
+          auto new_data_size = val_len + sizeof(EvacNotifierMeta);
+          if (!FarMemManagerFactory::get()->reallocate_generic_unique_ptr_nb(
+                  *static_cast<DerefScope *>(nullptr), &ptr, new_data_size,
+                  val)) {
+            bucket_lock_guard.reset();
+            rcu_lock_.reader_unlock();
+            FarMemManagerFactory::get()->mutator_wait_for_gc_cache();
+            rcu_lock_.reader_lock();
+            goto retry;
+          }
+          auto new_obj_val_ptr = ptr._deref<true, false>();
+#ifndef HASHTABLE_EXCLUSIVE
+          if (swap_in) {
+            ptr.meta().clear_dirty();
+          }
+#endif
+          assert(new_obj_val_ptr);
+          auto new_meta = reinterpret_cast<EvacNotifierMeta *>(
+              reinterpret_cast<uint64_t>(new_obj_val_ptr) + val_len);
+          *new_meta = {.anchor_addr = reinterpret_cast<uint64_t>(bucket),
+                       .offset = static_cast<uint8_t>(offset)};
+        } else {
+          memcpy(obj_val_ptr, val, val_len);
+        }
+        return true;
+      }
     }
+    bitmap ^= (1 << offset);
+  }
+
+  // The key does not exist. Reserve an empty slot within the neighborhood.
+  uint32_t final_bucket_idx;
+  switch (reserve_entry(table, bucket_idx, &final_bucket_idx)) {
+  case Reserved:
+    break;
+  case Evacuating:
+    bucket_lock_guard.reset();
+    process_evac_notifier_stash();
+    thread_yield();
+    goto retry;
+  case Full: {
+    // The neighborhood is full, so grow the hash table and retry.
+    auto hash_mask = table->kHashMask;
+    bucket_lock_guard.reset();
+    rcu_lock_.reader_unlock();
+    grow(hash_mask);
+    rcu_lock_.reader_lock();
+    goto retry;
+  }
   }
+  uint32_t distance_to_orig_bucket = final_bucket_idx - bucket_idx;
 
   // Allocate memory.
-  auto *final_entry = &buckets_[bucket_idx];
+  auto *final_entry = &buckets[final_bucket_idx];
   auto *ptr = &(final_entry->ptr);
   if (!FarMemManagerFactory::get()->allocate_generic_unique_ptr_nb(
           ptr, ds_id_, sizeof(EvacNotifierMeta) + val_len, key_len, key)) {
     bucket_lock_guard.reset();
+    rcu_lock_.reader_unlock();
     FarMemManagerFactory::get()->mutator_wait_for_gc_cache();
+    rcu_lock_.reader_lock();
     goto retry;
   }
   auto *val_ptr = ptr->_deref<true, false>();
@@ -282,6 +428,7 @@ retry:
   bucket->bitmap |= (1 << distance_to_orig_bucket);
 
   bucket_lock_guard.reset();
+  rcu_guard.reset();
 
   // Ensure there's no copy at remote. Ideally we can make this happen
   // asynchronously and check completion before returning to client.
@@ -293,20 +440,20 @@ retry:
 
 bool GenericConcurrentHopscotch::_remove(uint8_t key_len, const uint8_t *key) {
   uint32_t hash = hash_32(reinterpret_cast<const void *>(key), key_len);
-  uint32_t bucket_idx = hash & kHashMask_;
-  auto *bucket = &(buckets_[bucket_idx]);
   bool removed = false;
+  rcu_lock_.reader_lock();
+  auto rcu_guard = helpers::finally([&]() { rcu_lock_.reader_unlock(); });
 
 retry:
-  while (unlikely(!bucket->spin.TryLockWp())) {
-    thread_yield();
-  }
+  BucketEntry *bucket;
+  auto *table = lock_anchor(hash, &bucket);
+  uint32_t bucket_idx = bucket - table->buckets;
   auto spin_guard = helpers::finally([&]() { bucket->spin.UnlockWp(); });
 
   uint32_t bitmap = load_acquire(&(bucket->bitmap));
   while (bitmap) {
     auto offset = helpers::bsf_32(bitmap);
-    auto *entry = &buckets_[bucket_idx + offset];
+    auto *entry = &(table->buckets[bucket_idx + offset]);
     auto &ptr = entry->ptr;
     auto *obj_val_ptr = ptr._deref<false, false>();
     if (unlikely(!obj_val_ptr)) {
@@ -336,10 +483,176 @@ retry:
     bitmap ^= (1 << offset);
   }
   spin_guard.reset();
+  rcu_guard.reset();
 
   // Forward the request to the remote agent.
   return FarMemManagerFactory::get()->remove_object(ds_id_, key_len, key) ||
          removed;
 }
 
+void GenericConcurrentHopscotch::grow(uint32_t hash_mask) {
+  resize_mutex_.Lock();
+  auto guard = helpers::finally([&]() { resize_mutex_.Unlock(); });
+
+  // Wait for the ongoing migration, after which the caller may fit in.
+  if (resizing_) {
+    resizer_.Join();
+    resizing_ = false;
+  }
+  auto *table = table_;
+  if (table->kHashMask != hash_mask) {
+    return;
+  }
+
+  auto num_entries_shift = helpers::bsr_32(hash_mask + 1) + 1;
+  BUG_ON(num_entries_shift >= sizeof(hash_mask) * 8);
+  store_release(&table->next, new Table(num_entries_shift));
+  resizing_ = true;
+  resizer_ = rt::Thread([&, table]() { migrate(table); });
+}
+
+void GenericConcurrentHopscotch::migrate(Table *from) {
+  for (uint32_t i = 0; i <= from->kHashMask; i++) {
+    migrate_bucket(from, i);
+  }
+  auto *to = from->next;
+  while (to->next) {
+    to = to->next;
+  }
+  store_release(&table_, to);
+  // Free the old tables once no operation can be walking them. An entry that
+  // is being evacuated is never migrated before its notification clears it,
+  // so the stash only refers to the last table, and is drained before the
+  // others go away.
+  rcu_lock_.writer_sync();
+  process_evac_notifier_stash();
+  while (from != to) {
+    auto *next = from->next;
+    delete from;
+    from = next;
+  }
+}
+
+// Grows the table that the migration moves into, when it gets full, by
+// migrating it into the next one as a whole. The migration then carries on
+// with the last table of the chain.
+void GenericConcurrentHopscotch::extend(Table *table) {
+  auto num_entries_shift = helpers::bsr_32(table->kHashMask + 1) + 1;
+  BUG_ON(num_entries_shift >= sizeof(table->kHashMask) * 8);
+  store_release(&table->next, new Table(num_entries_shift));
+  for (uint32_t i = 0; i <= table->kHashMask; i++) {
+    migrate_bucket(table, i);
+  }
+}
+
+void GenericConcurrentHopscotch::migrate_bucket(Table *from,
+                                                uint32_t bucket_idx) {
+  auto *bucket = &(from->buckets[bucket_idx]);
+
+retry:
+  auto *to = from->next;
+  while (to->next) {
+    to = to->next;
+  }
+  ReserveStatus status;
+  {
+    DerefScope scope;
+    while (unlikely(!bucket->spin.TryLockWp())) {
+      thread_yield();
+    }
+    auto bucket_lock_guard =
+        helpers::finally([&]() { bucket->spin.UnlockWp(); });
+    bucket->timestamp++;
+    status = migrate_entries(bucket, to);
+    if (likely(status == Reserved)) {
+      store_release(&from->num_migrated, bucket_idx + 1);
+    }
+  }
+
+  switch (status) {
+  case Reserved:
+    break;
+  case Evacuating:
+    // Wait for the evac notifier to clear the entry.
+    process_evac_notifier_stash();
+    thread_yield();
+    goto retry;
+  case Full:
+    extend(to);
+    goto retry;
+  }
+}
+
+// Moves all the entries of the locked anchor bucket into the table, or none
+// of them: the slots are reserved first, so that a full neighborhood leaves
+// the bucket untouched and the operations on it are never misdirected.
+GenericConcurrentHopscotch::ReserveStatus
+GenericConcurrentHopscotch::migrate_entries(BucketEntry *bucket, Table *to) {
+  struct Move {
+    uint32_t offset;
+    Object obj;
+    BucketEntry *to_bucket;
+    BucketEntry *to_entry;
+  };
+  Move moves[kNeighborhood];
+  uint32_t num_moves = 0;
+
+  uint32_t bitmap = load_acquire(&(bucket->bitmap));
+  while (bitmap) {
+    auto offset = helpers::bsf_32(bitmap);
+    auto *obj_val_ptr = (bucket + offset)->ptr._deref<false, false>();
+    ReserveStatus status = Evacuating;
+    if (likely(obj_val_ptr)) {
+      auto obj =
+          Object(reinterpret_cast<uint64_t>(obj_val_ptr) - Object::kHeaderSize);
+      uint32_t hash = hash_32(static_cast<const void *>(obj.get_obj_id()),
+                              obj.get_obj_id_len());
+      uint32_t to_bucket_idx = hash & to->kHashMask;
+      auto *to_bucket = &(to->buckets[to_bucket_idx]);
+      while (unlikely(!to_bucket->spin.TryLockWp())) {
+        thread_yield();
+      }
+      uint32_t to_entry_idx;
+      status = reserve_entry(to, to_bucket_idx, &to_entry_idx);
+      to_bucket->spin.UnlockWp();
+      // A reserved slot is out of every bitmap, so it stays in place.
+      if (likely(status == Reserved)) {
+        moves[num_moves] = {.offset = offset,
+                            .obj = obj,
+                            .to_bucket = to_bucket,
+                            .to_entry = &(to->buckets[to_entry_idx])};
+      }
+    }
+    if (unlikely(status != Reserved)) {
+      for (uint32_t i = 0; i < num_moves; i++) {
+        moves[i].to_entry->ptr.nullify();
+      }
+      return status;
+    }
+    num_moves++;
+    bitmap ^= (1 << offset);
+  }
+
+  for (uint32_t i = 0; i < num_moves; i++) {
+    auto &move = moves[i];
+    auto *entry = bucket + move.offset;
+    while (unlikely(!move.to_bucket->spin.TryLockWp())) {
+      thread_yield();
+    }
+    // Repoint the evac notifier anchor to the next table before moving.
+    auto *meta = reinterpret_cast<EvacNotifierMeta *>(
+        const_cast<uint8_t *>(move.obj.get_obj_id()) -
+        sizeof(EvacNotifierMeta));
+    *meta = {.anchor_addr = reinterpret_cast<uint64_t>(move.to_bucket),
+             .offset = static_cast<uint8_t>(move.to_entry - move.to_bucket)};
+    move.to_entry->ptr.move(entry->ptr, FarMemPtrMeta::kNull);
+    wmb();
+    move.to_bucket->bitmap |= (1 << (move.to_entry - move.to_bucket));
+    move.to_bucket->spin.UnlockWp();
+    assert(bucket->bitmap & (1 << move.offset));
+    bucket->bitmap ^= (1 << move.offset);
+  }
+  return Reserved;
+}
+
 } // namespace far_memory
@@ -1,19 +1,47 @@
 extern "C" {
 #include <net/ip.h>
 #include <runtime/storage.h>
+#include <runtime/timer.h>
 }
 
 #include "device.hpp"
 #include "object.hpp"
+#include "region.hpp"
+#include "server_ptr.hpp"
 #include "stats.hpp"
 
+#include "snappy.h"
+
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/socket.h>
 
 namespace far_memory {
 
 FarMemDevice::FarMemDevice(uint64_t far_mem_size, uint32_t prefetch_win_size)
     : far_mem_size_(far_mem_size), prefetch_win_size_(prefetch_win_size) {}
 
+void FarMemDevice::read_objects(uint32_t num_objs, const ObjectReadReq *reqs) {
+  for (uint32_t i = 0; i < num_objs; i++) {
+    auto &req = reqs[i];
+    read_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                req.data_buf);
+  }
+}
+
+void FarMemDevice::write_objects(uint32_t num_objs,
+                                 const ObjectWriteReq *reqs) {
+  for (uint32_t i = 0; i < num_objs; i++) {
+    auto &req = reqs[i];
+    write_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                 req.data_buf);
+  }
+}
+
 FakeDevice::FakeDevice(uint64_t far_mem_size)
     : FarMemDevice(far_mem_size, kPrefetchWinSize), server_() {
   server_.construct(kVanillaPtrDSType, kVanillaPtrDSID, sizeof(far_mem_size),
@@ -52,14 +80,179 @@ void FakeDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
   server_.compute(ds_id, opcode, input_len, input_buf, output_len, output_buf);
 }
 
+TCPDevice::Connection::Connection(tcpconn_t *remote_slave)
+    : remote_slave_(remote_slave) {
+  free_req_ids_.reserve(kMaxNumInflightReqs);
+  for (uint32_t i = 0; i < kMaxNumInflightReqs; i++) {
+    free_req_ids_.push_back(kMaxNumInflightReqs - 1 - i);
+  }
+  memset(inflight_resps_, 0, sizeof(inflight_resps_));
+  receiver_ = rt::Thread([&]() { receiver_fn(); });
+}
+
+TCPDevice::Connection::~Connection() {
+  tcp_shutdown(remote_slave_, SHUT_RDWR);
+  receiver_.Join();
+  tcp_close(remote_slave_);
+}
+
+uint16_t TCPDevice::Connection::allocate_req_id(Response *resp) {
+  req_ids_spin_.Lock();
+  while (unlikely(free_req_ids_.empty())) {
+    req_ids_condvar_.Wait(&req_ids_spin_);
+  }
+  auto req_id = free_req_ids_.back();
+  free_req_ids_.pop_back();
+  inflight_resps_[req_id] = resp;
+  req_ids_spin_.Unlock();
+  return req_id;
+}
+
+void TCPDevice::Connection::free_req_id(uint16_t req_id) {
+  req_ids_spin_.Lock();
+  inflight_resps_[req_id] = nullptr;
+  free_req_ids_.push_back(req_id);
+  req_ids_condvar_.Signal();
+  req_ids_spin_.Unlock();
+}
+
+void TCPDevice::Connection::round_trip(iovec *req_iovecs, int num_req_iovecs,
+                                       Response *resp) {
+  assert(req_iovecs[0].iov_len >= kReqHeaderSize);
+  rt::WaitGroup completion(1);
+  resp->completion = &completion;
+  auto req_id = allocate_req_id(resp);
+  __builtin_memcpy(reinterpret_cast<uint8_t *>(req_iovecs[0].iov_base) +
+                       kOpcodeSize,
+                   &req_id, kReqIDSize);
+
+  write_mutex_.Lock();
+  helpers::tcp_writev_until(remote_slave_, req_iovecs, num_req_iovecs);
+  write_mutex_.Unlock();
+
+  completion.Wait();
+  free_req_id(req_id);
+}
+
+void TCPDevice::Connection::round_trip_stream(
+    iovec *req_iovecs, int num_req_iovecs,
+    const std::function<void(const rpc::BufferPtr &)> &chunk_fn) {
+  assert(req_iovecs[0].iov_len >= kReqHeaderSize);
+  Response resp;
+  auto chunk_queue = std::make_shared<ChunkQueue>();
+  resp.chunk_queue = chunk_queue;
+  auto req_id = allocate_req_id(&resp);
+  __builtin_memcpy(reinterpret_cast<uint8_t *>(req_iovecs[0].iov_base) +
+                       kOpcodeSize,
+                   &req_id, kReqIDSize);
+
+  write_mutex_.Lock();
+  helpers::tcp_writev_until(remote_slave_, req_iovecs, num_req_iovecs);
+  write_mutex_.Unlock();
+
+  // Consumes the chunks while the following ones are still on the wire.
+  bool done = false;
+  while (!done) {
+    chunk_queue->spin.Lock();
+    while (chunk_queue->chunks.empty()) {
+      chunk_queue->condvar.Wait(&chunk_queue->spin);
+    }
+    auto chunk = std::move(chunk_queue->chunks.front());
+    chunk_queue->chunks.pop_front();
+    done = chunk_queue->chunks.empty() && chunk_queue->done;
+    chunk_queue->space_condvar.Signal();
+    chunk_queue->spin.Unlock();
+    chunk_fn(chunk);
+  }
+  free_req_id(req_id);
+}
+
+// Frame: |chunk_len(4B)|chunk|, following the ReqID.
+void TCPDevice::Connection::receive_chunk(ChunkQueue *chunk_queue) {
+  chunk_queue->spin.Lock();
+  while (chunk_queue->chunks.size() >= kMaxNumQueuedChunks) {
+    chunk_queue->space_condvar.Wait(&chunk_queue->spin);
+  }
+  chunk_queue->spin.Unlock();
+
+  uint32_t chunk_len;
+  helpers::tcp_read_until(remote_slave_, &chunk_len, sizeof(chunk_len));
+  bool last = chunk_len & kLastChunkFlag;
+  chunk_len &= ~kLastChunkFlag;
+  auto chunk = rpc::MakeBuffer(chunk_len);
+  if (chunk_len) {
+    helpers::tcp_read_until(remote_slave_, chunk->GetWritePtr(), chunk_len);
+    chunk->HasWritten(chunk_len);
+  }
+  chunk_queue->spin.Lock();
+  chunk_queue->chunks.push_back(std::move(chunk));
+  chunk_queue->done = last;
+  chunk_queue->condvar.Signal();
+  chunk_queue->spin.Unlock();
+}
+
+void TCPDevice::Connection::receiver_fn() {
+  uint16_t req_id;
+  ssize_t ret;
+  while ((ret = tcp_read(remote_slave_, reinterpret_cast<uint8_t *>(&req_id),
+                         kReqIDSize)) > 0) {
+    if (unlikely(ret != kReqIDSize)) {
+      helpers::tcp_read_until(remote_slave_,
+                              reinterpret_cast<uint8_t *>(&req_id) + ret,
+                              kReqIDSize - ret);
+    }
+    BUG_ON(req_id >= kMaxNumInflightReqs);
+    req_ids_spin_.Lock();
+    auto *resp = inflight_resps_[req_id];
+    req_ids_spin_.Unlock();
+    BUG_ON(!resp);
+
+    if (resp->chunk_queue) {
+      // The requester is gone once the last chunk is queued, so only the
+      // shared queue is touched.
+      auto chunk_queue = resp->chunk_queue;
+      receive_chunk(chunk_queue.get());
+      continue;
+    }
+    if (resp->num_read_reqs) {
+      for (uint32_t i = 0; i < resp->num_read_reqs; i++) {
+        auto &req = resp->read_reqs[i];
+        helpers::tcp_read_until(remote_slave_, req.data_len,
+                                sizeof(*req.data_len));
+        if (*req.data_len) {
+          helpers::tcp_read_until(remote_slave_, req.data_buf, *req.data_len);
+        }
+      }
+    } else {
+      helpers::tcp_read_until(remote_slave_, resp->head, resp->head_len);
+    }
+    if (resp->has_body) {
+      auto body_len = *reinterpret_cast<uint16_t *>(resp->head);
+      if (resp->body_buffer) {
+        *resp->body_buffer = rpc::MakeBuffer(body_len);
+        if (body_len) {
+          helpers::tcp_read_until(remote_slave_,
+                                  (*resp->body_buffer)->GetWritePtr(),
+                                  body_len);
+          (*resp->body_buffer)->HasWritten(body_len);
+        }
+      } else if (body_len) {
+        helpers::tcp_read_until(remote_slave_, resp->body, body_len);
+      }
+    }
+    // The requester may return right after being woken up, so *resp must not
+    // be touched afterwards.
+    resp->completion->Done();
+  }
+}
+
 // Request:
 //     |OpCode = Init (1B)|Far Mem Size (8B)|
 // Response:
 //     |Ack (1B)|
 TCPDevice::TCPDevice(netaddr raddr, uint32_t num_connections,
                      uint64_t far_mem_size)
-    : FarMemDevice(far_mem_size, kPrefetchWinSize),
-      shared_pool_(num_connections) {
+    : FarMemDevice(far_mem_size, kPrefetchWinSize) {
   // Initialize the master connection.
   netaddr laddr = {.ip = MAKE_IP_ADDR(0, 0, 0, 0), .port = 0};
   BUG_ON(tcp_dial(laddr, raddr, &remote_master_) != 0);
@@ -74,7 +267,7 @@ TCPDevice::TCPDevice(netaddr raddr, uint32_t num_connections,
   tcpconn_t *remote_slave;
   for (uint32_t i = 0; i < num_connections; i++) {
     BUG_ON(tcp_dial(laddr, raddr, &remote_slave) != 0);
-    shared_pool_.push(remote_slave);
+    connections_.emplace_back(new Connection(remote_slave));
   }
 
   construct(kVanillaPtrDSType, kVanillaPtrDSID, sizeof(far_mem_size),
@@ -92,250 +285,386 @@ TCPDevice::~TCPDevice() {
   uint8_t ack;
   helpers::tcp_read_until(remote_master_, &ack, sizeof(ack));
   tcp_close(remote_master_);
-  shared_pool_.for_each([&](auto remote_slave) { tcp_close(remote_slave); });
+  connections_.clear();
+}
+
+TCPDevice::Connection *TCPDevice::pick_connection() {
+  auto idx = next_connection_idx_.fetch_add(1, std::memory_order_relaxed);
+  return connections_[idx % connections_.size()].get();
 }
 
 void TCPDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
                             const uint8_t *obj_id, uint16_t *data_len,
                             uint8_t *data_buf) {
-  auto remote_slave = shared_pool_.pop();
-  _read_object(remote_slave, ds_id, obj_id_len, obj_id, data_len, data_buf);
-  shared_pool_.push(remote_slave);
+  _read_object(pick_connection(), ds_id, obj_id_len, obj_id, data_len,
+               data_buf);
 }
 
 void TCPDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
                              const uint8_t *obj_id, uint16_t data_len,
                              const uint8_t *data_buf) {
-  auto remote_slave = shared_pool_.pop();
-  _write_object(remote_slave, ds_id, obj_id_len, obj_id, data_len, data_buf);
-  shared_pool_.push(remote_slave);
+  _write_object(pick_connection(), ds_id, obj_id_len, obj_id, data_len,
+                data_buf);
+}
+
+// Returns the number of leading requests that fit into a single batch.
+template <typename Req>
+static uint32_t get_batch_size(uint32_t num_objs, const Req *reqs,
+                               auto entry_len_fn) {
+  uint32_t num = 0;
+  uint32_t payload_len = 0;
+  while (num < num_objs && num < TCPDevice::kMaxNumObjsPerBatch) {
+    auto entry_len = entry_len_fn(reqs[num]);
+    if (num && payload_len + entry_len > TCPDevice::kMaxBatchPayloadLen) {
+      break;
+    }
+    payload_len += entry_len;
+    num++;
+  }
+  return num;
+}
+
+void TCPDevice::read_objects(uint32_t num_objs, const ObjectReadReq *reqs) {
+  while (num_objs) {
+    auto num = get_batch_size(num_objs, reqs, [](const ObjectReadReq &req) {
+      return Object::kDSIDSize + Object::kIDLenSize + req.obj_id_len;
+    });
+    _read_objects(pick_connection(), num, reqs);
+    reqs += num;
+    num_objs -= num;
+  }
+}
+
+void TCPDevice::write_objects(uint32_t num_objs, const ObjectWriteReq *reqs) {
+  while (num_objs) {
+    auto num = get_batch_size(num_objs, reqs, [](const ObjectWriteReq &req) {
+      return Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize +
+             req.obj_id_len + req.data_len;
+    });
+    _write_objects(pick_connection(), num, reqs);
+    reqs += num;
+    num_objs -= num;
+  }
 }
 
 bool TCPDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
                               const uint8_t *obj_id) {
-  auto remote_slave = shared_pool_.pop();
-  auto ret = _remove_object(remote_slave, ds_id, obj_id_len, obj_id);
-  shared_pool_.push(remote_slave);
-
-  return ret;
+  return _remove_object(pick_connection(), ds_id, obj_id_len, obj_id);
 }
 
 void TCPDevice::construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
                           uint8_t *params) {
-  auto remote_slave = shared_pool_.pop();
-  _construct(remote_slave, ds_type, ds_id, param_len, params);
-  shared_pool_.push(remote_slave);
+  _construct(pick_connection(), ds_type, ds_id, param_len, params);
 }
 
 void TCPDevice::destruct(uint8_t ds_id) {
-  auto remote_slave = shared_pool_.pop();
-  _destruct(remote_slave, ds_id);
-  shared_pool_.push(remote_slave);
+  _destruct(pick_connection(), ds_id);
 }
 
 void TCPDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
                         const uint8_t *input_buf, uint16_t *output_len,
                         uint8_t *output_buf) {
-  auto remote_slave = shared_pool_.pop();
-  _compute(remote_slave, ds_id, opcode, input_len, input_buf, output_len,
+  _compute(pick_connection(), ds_id, opcode, input_len, input_buf, output_len,
            output_buf);
-  shared_pool_.push(remote_slave);
 }
 
-bool TCPDevice::call(uint8_t ds_id, const std::string &method,
-                     const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
-  auto remote_slave = shared_pool_.pop();
-  bool success = _call(remote_slave, ds_id, method, args, ret);
-  shared_pool_.push(remote_slave);
-  return success;
+rpc::RpcErrorCode TCPDevice::call(uint8_t ds_id, rpc::MethodID method_id,
+                                  const rpc::BufferPtr &args,
+                                  rpc::BufferPtr &ret) {
+  // Most returns fit in a single chunk, which is taken without copying.
+  ret.reset();
+  auto error_code = _call_stream(pick_connection(), ds_id, method_id, args,
+                              [&](const rpc::BufferPtr &chunk) {
+                                if (!ret) {
+                                  ret = chunk;
+                                } else {
+                                  ret->Append(chunk->GetReadPtr(),
+                                              chunk->ReadableBytes());
+                                }
+                              });
+  if (error_code == rpc::RpcErrorCode::kSuccess && !ret) {
+    ret = rpc::MakeBuffer(0);
+  }
+  return error_code;
+}
+
+rpc::RpcErrorCode
+TCPDevice::call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                       const rpc::BufferPtr &args,
+                       const rpc::StreamReader::ChunkFn &chunk_fn) {
+  return _call_stream(pick_connection(), ds_id, method_id, args, chunk_fn);
 }
 
 // Request:
-// |Opcode = KOpReadObject(1B) | ds_id(1B) | obj_id_len(1B) | obj_id |
+// |Opcode = KOpReadObject(1B)|ReqID(2B)|ds_id(1B)|obj_id_len(1B)|obj_id|
 // Response:
-// |data_len(2B)|data_buf(data_len B)|
-void TCPDevice::_read_object(tcpconn_t *remote_slave, uint8_t ds_id,
+// |ReqID(2B)|data_len(2B)|data_buf(data_len B)|
+void TCPDevice::_read_object(Connection *remote_slave, uint8_t ds_id,
                              uint8_t obj_id_len, const uint8_t *obj_id,
                              uint16_t *data_len, uint8_t *data_buf) {
   Stats::start_measure_read_object_cycles();
-  
-  uint8_t req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+  auto start_tsc = rdtsc();
+
+  uint8_t req[kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize +
               Object::kMaxObjectIDSize];
 
   __builtin_memcpy(&req[0], &kOpReadObject, sizeof(kOpReadObject));
-  __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
-  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize], &obj_id_len,
+  __builtin_memcpy(&req[kReqHeaderSize], &ds_id, Object::kDSIDSize);
+  __builtin_memcpy(&req[kReqHeaderSize + Object::kDSIDSize], &obj_id_len,
                    Object::kIDLenSize);
-  memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize], obj_id,
+  memcpy(&req[kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize], obj_id,
          obj_id_len);
 
-  helpers::tcp_write_until(remote_slave, req,
-                           kOpcodeSize + Object::kDSIDSize +
-                               Object::kIDLenSize + obj_id_len);
-
-  helpers::tcp_read_until(remote_slave, data_len, sizeof(*data_len));
-  if (*data_len) {
-    helpers::tcp_read_until(remote_slave, data_buf, *data_len);
-  }
+  Response resp{.head = reinterpret_cast<uint8_t *>(data_len),
+                .head_len = sizeof(*data_len),
+                .has_body = true,
+                .body = data_buf};
+  iovec req_iovecs[] = {
+      {.iov_base = req,
+       .iov_len = kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize +
+                  obj_id_len}};
+  remote_slave->round_trip(req_iovecs, 1, &resp);
 
+  Stats::record_read_object_latency(start_tsc);
   Stats::finish_measure_read_object_cycles();
 }
 
 // Request:
-// |Opcode = KOpWriteObject (1B)|ds_id(1B)|obj_id_len(1B)|data_len(2B)|
-// |obj_id(obj_id_len B)|data_buf(data_len)|
+// |Opcode = KOpWriteObject (1B)|ReqID(2B)|ds_id(1B)|obj_id_len(1B)|
+// |data_len(2B)|obj_id(obj_id_len B)|data_buf(data_len)|
 // Response:
-// |Ack (1B)|
-void TCPDevice::_write_object(tcpconn_t *remote_slave, uint8_t ds_id,
+// |ReqID(2B)|Ack (1B)|
+void TCPDevice::_write_object(Connection *remote_slave, uint8_t ds_id,
                               uint8_t obj_id_len, const uint8_t *obj_id,
                               uint16_t data_len, const uint8_t *data_buf) {
   Stats::start_measure_write_object_cycles();
+  auto start_tsc = rdtsc();
 
-  uint8_t req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
-              Object::kDataLenSize + Object::kMaxObjectIDSize + kLargeDataSize];
+  uint8_t req[kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize +
+              Object::kDataLenSize + Object::kMaxObjectIDSize];
 
   __builtin_memcpy(&req[0], &kOpWriteObject, sizeof(kOpWriteObject));
-  __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
-  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize], &obj_id_len,
+  __builtin_memcpy(&req[kReqHeaderSize], &ds_id, Object::kDSIDSize);
+  __builtin_memcpy(&req[kReqHeaderSize + Object::kDSIDSize], &obj_id_len,
                    Object::kIDLenSize);
-  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize],
-                   &data_len, Object::kDataLenSize);
-  memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+  __builtin_memcpy(
+      &req[kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize], &data_len,
+      Object::kDataLenSize);
+  memcpy(&req[kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize +
               Object::kDataLenSize],
          obj_id, obj_id_len);
 
-  if (likely(data_len <= kLargeDataSize)) {
-    memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
-                Object::kDataLenSize + obj_id_len],
-           data_buf, data_len);
-    helpers::tcp_write_until(remote_slave, req,
-                             kOpcodeSize + Object::kDSIDSize +
-                                 Object::kIDLenSize + Object::kDataLenSize +
-                                 obj_id_len + data_len);
-  } else {
-    helpers::tcp_write2_until(remote_slave, req,
-                              kOpcodeSize + Object::kDSIDSize +
-                                  Object::kIDLenSize + Object::kDataLenSize +
-                                  obj_id_len,
-                              data_buf, data_len);
-  }
-
   uint8_t ack;
-  helpers::tcp_read_until(remote_slave, &ack, sizeof(ack));
+  Response resp{.head = &ack, .head_len = sizeof(ack)};
+  // The object data is sent straight from the local region without copying.
+  iovec req_iovecs[] = {
+      {.iov_base = req,
+       .iov_len = kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize +
+                  Object::kDataLenSize + obj_id_len},
+      {.iov_base = const_cast<uint8_t *>(data_buf), .iov_len = data_len}};
+  remote_slave->round_trip(req_iovecs, data_len ? 2 : 1, &resp);
 
+  Stats::record_write_object_latency(start_tsc);
   Stats::finish_measure_write_object_cycles();
 }
 
 // Request:
-// |Opcode = kOpRemoveObject (1B)|ds_id(1B)|obj_id_len(1B)|obj_id(obj_id_len B)|
+// |Opcode = kOpReadObjects(1B)|ReqID(2B)|num_objs(2B)|payload_len(4B)|
+// |payload = (|ds_id(1B)|obj_id_len(1B)|obj_id|) * num_objs|
 // Response:
-// |exists (1B)|
-bool TCPDevice::_remove_object(tcpconn_t *remote_slave, uint64_t ds_id,
+// |ReqID(2B)|(|data_len(2B)|data_buf(data_len B)|) * num_objs|
+void TCPDevice::_read_objects(Connection *remote_slave, uint32_t num_objs,
+                              const ObjectReadReq *reqs) {
+  uint16_t num = num_objs;
+  uint32_t payload_len = 0;
+  uint8_t req_header[kReqHeaderSize + sizeof(num) + sizeof(payload_len)];
+  std::vector<uint8_t> payload;
+  payload.reserve(num_objs * (Object::kDSIDSize + Object::kIDLenSize +
+                              sizeof(uint64_t)));
+  for (uint32_t i = 0; i < num_objs; i++) {
+    auto &req = reqs[i];
+    payload.push_back(req.ds_id);
+    payload.push_back(req.obj_id_len);
+    payload.insert(payload.end(), req.obj_id, req.obj_id + req.obj_id_len);
+  }
+  payload_len = payload.size();
+
+  __builtin_memcpy(&req_header[0], &kOpReadObjects, sizeof(kOpReadObjects));
+  __builtin_memcpy(&req_header[kReqHeaderSize], &num, sizeof(num));
+  __builtin_memcpy(&req_header[kReqHeaderSize + sizeof(num)], &payload_len,
+                   sizeof(payload_len));
+
+  Response resp{.read_reqs = reqs, .num_read_reqs = num_objs};
+  iovec req_iovecs[] = {
+      {.iov_base = req_header, .iov_len = sizeof(req_header)},
+      {.iov_base = payload.data(), .iov_len = payload_len}};
+  remote_slave->round_trip(req_iovecs, 2, &resp);
+}
+
+// Request:
+// |Opcode = kOpWriteObjects(1B)|ReqID(2B)|num_objs(2B)|payload_len(4B)|
+// |payload = (|ds_id(1B)|obj_id_len(1B)|data_len(2B)|obj_id|data_buf|)
+//            * num_objs|
+// Response:
+// |ReqID(2B)|Ack (1B)|
+void TCPDevice::_write_objects(Connection *remote_slave, uint32_t num_objs,
+                               const ObjectWriteReq *reqs) {
+  uint16_t num = num_objs;
+  uint32_t payload_len = 0;
+  uint32_t entry_headers_len = 0;
+  uint8_t req_header[kReqHeaderSize + sizeof(num) + sizeof(payload_len)];
+  for (uint32_t i = 0; i < num_objs; i++) {
+    entry_headers_len += Object::kDSIDSize + Object::kIDLenSize +
+                         Object::kDataLenSize + reqs[i].obj_id_len;
+    payload_len += reqs[i].data_len;
+  }
+  payload_len += entry_headers_len;
+
+  // Only the entry headers are copied; the object data is gathered straight
+  // from the local regions.
+  std::vector<uint8_t> entry_headers(entry_headers_len);
+  std::vector<iovec> req_iovecs;
+  req_iovecs.reserve(1 + 2 * num_objs);
+  req_iovecs.push_back({.iov_base = req_header, .iov_len = sizeof(req_header)});
+  auto *cur = entry_headers.data();
+  for (uint32_t i = 0; i < num_objs; i++) {
+    auto &req = reqs[i];
+    auto *entry_header = cur;
+    __builtin_memcpy(cur, &req.ds_id, Object::kDSIDSize);
+    cur += Object::kDSIDSize;
+    __builtin_memcpy(cur, &req.obj_id_len, Object::kIDLenSize);
+    cur += Object::kIDLenSize;
+    __builtin_memcpy(cur, &req.data_len, Object::kDataLenSize);
+    cur += Object::kDataLenSize;
+    memcpy(cur, req.obj_id, req.obj_id_len);
+    cur += req.obj_id_len;
+    req_iovecs.push_back({.iov_base = entry_header,
+                          .iov_len = static_cast<size_t>(cur - entry_header)});
+    if (req.data_len) {
+      req_iovecs.push_back({.iov_base = const_cast<uint8_t *>(req.data_buf),
+                            .iov_len = req.data_len});
+    }
+  }
+
+  __builtin_memcpy(&req_header[0], &kOpWriteObjects, sizeof(kOpWriteObjects));
+  __builtin_memcpy(&req_header[kReqHeaderSize], &num, sizeof(num));
+  __builtin_memcpy(&req_header[kReqHeaderSize + sizeof(num)], &payload_len,
+                   sizeof(payload_len));
+
+  uint8_t ack;
+  Response resp{.head = &ack, .head_len = sizeof(ack)};
+  remote_slave->round_trip(req_iovecs.data(), req_iovecs.size(), &resp);
+}
+
+// Request:
+// |Opcode = kOpRemoveObject (1B)|ReqID(2B)|ds_id(1B)|obj_id_len(1B)|
+// |obj_id(obj_id_len B)|
+// Response:
+// |ReqID(2B)|exists (1B)|
+bool TCPDevice::_remove_object(Connection *remote_slave, uint64_t ds_id,
                                uint8_t obj_id_len, const uint8_t *obj_id) {
 
-  uint8_t req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+  uint8_t req[kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize +
               Object::kMaxObjectIDSize];
 
   __builtin_memcpy(&req[0], &kOpRemoveObject, sizeof(kOpRemoveObject));
-  __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
-  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize], &obj_id_len,
+  __builtin_memcpy(&req[kReqHeaderSize], &ds_id, Object::kDSIDSize);
+  __builtin_memcpy(&req[kReqHeaderSize + Object::kDSIDSize], &obj_id_len,
                    Object::kIDLenSize);
-  memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize], obj_id,
+  memcpy(&req[kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize], obj_id,
          obj_id_len);
 
-  helpers::tcp_write_until(remote_slave, req,
-                           kOpcodeSize + Object::kDSIDSize +
-                               Object::kIDLenSize + obj_id_len);
-
   bool exists;
-  helpers::tcp_read_until(remote_slave, &exists, sizeof(exists));
+  Response resp{.head = reinterpret_cast<uint8_t *>(&exists),
+                .head_len = sizeof(exists)};
+  iovec req_iovecs[] = {
+      {.iov_base = req,
+       .iov_len = kReqHeaderSize + Object::kDSIDSize + Object::kIDLenSize +
+                  obj_id_len}};
+  remote_slave->round_trip(req_iovecs, 1, &resp);
 
   return exists;
 }
 
 // Request:
-// |Opcode = kOpConstruct (1B)|ds_type(1B)|ds_id(1B)|
+// |Opcode = kOpConstruct (1B)|ReqID(2B)|ds_type(1B)|ds_id(1B)|
 // |param_len(1B)|params(param_len B)|
 // Response:
-// |Ack (1B)|
-void TCPDevice::_construct(tcpconn_t *remote_slave, uint8_t ds_type,
+// |ReqID(2B)|Ack (1B)|
+void TCPDevice::_construct(Connection *remote_slave, uint8_t ds_type,
                            uint8_t ds_id, uint8_t param_len, uint8_t *params) {
-  uint8_t req[kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize +
+  uint8_t req[kReqHeaderSize + sizeof(ds_type) + Object::kDSIDSize +
               sizeof(param_len) +
               std::numeric_limits<decltype(param_len)>::max()];
 
   __builtin_memcpy(&req[0], &kOpConstruct, sizeof(kOpConstruct));
-  __builtin_memcpy(&req[kOpcodeSize], &ds_type, sizeof(ds_type));
-  __builtin_memcpy(&req[kOpcodeSize + sizeof(ds_type)], &ds_id,
+  __builtin_memcpy(&req[kReqHeaderSize], &ds_type, sizeof(ds_type));
+  __builtin_memcpy(&req[kReqHeaderSize + sizeof(ds_type)], &ds_id,
                    Object::kDSIDSize);
-  __builtin_memcpy(&req[kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize],
+  __builtin_memcpy(&req[kReqHeaderSize + sizeof(ds_type) + Object::kDSIDSize],
                    &param_len, sizeof(param_len));
 
-  memcpy(&req[kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize +
+  memcpy(&req[kReqHeaderSize + sizeof(ds_type) + Object::kDSIDSize +
               sizeof(param_len)],
          params, param_len);
-  helpers::tcp_write_until(remote_slave, req,
-                           kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize +
-                               sizeof(param_len) + param_len);
 
   uint8_t ack;
-  helpers::tcp_read_until(remote_slave, &ack, sizeof(ack));
+  Response resp{.head = &ack, .head_len = sizeof(ack)};
+  iovec req_iovecs[] = {
+      {.iov_base = req,
+       .iov_len = kReqHeaderSize + sizeof(ds_type) + Object::kDSIDSize +
+                  sizeof(param_len) + param_len}};
+  remote_slave->round_trip(req_iovecs, 1, &resp);
 }
 
 // Request:
-// |Opcode = kOpDeconstruct (1B)|ds_id(1B)|
+// |Opcode = kOpDeconstruct (1B)|ReqID(2B)|ds_id(1B)|
 // Response:
-// |Ack (1B)|
-void TCPDevice::_destruct(tcpconn_t *remote_slave, uint8_t ds_id) {
-  uint8_t req[kOpcodeSize + Object::kDSIDSize];
+// |ReqID(2B)|Ack (1B)|
+void TCPDevice::_destruct(Connection *remote_slave, uint8_t ds_id) {
+  uint8_t req[kReqHeaderSize + Object::kDSIDSize];
 
   __builtin_memcpy(&req[0], &kOpDeconstruct, sizeof(kOpDeconstruct));
-  __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
-
-  helpers::tcp_write_until(remote_slave, req, kOpcodeSize + Object::kDSIDSize);
+  __builtin_memcpy(&req[kReqHeaderSize], &ds_id, Object::kDSIDSize);
 
   uint8_t ack;
-  helpers::tcp_read_until(remote_slave, &ack, sizeof(ack));
+  Response resp{.head = &ack, .head_len = sizeof(ack)};
+  iovec req_iovecs[] = {
+      {.iov_base = req, .iov_len = kReqHeaderSize + Object::kDSIDSize}};
+  remote_slave->round_trip(req_iovecs, 1, &resp);
 }
 
 // Request:
-// |Opcode = kOpCompute(1B)|ds_id(1B)|opcode(1B)|input_len(2B)|
+// |Opcode = kOpCompute(1B)|ReqID(2B)|ds_id(1B)|opcode(1B)|input_len(2B)|
 // |input_buf(input_len)|
 // Response:
-// |output_len(2B)|output_buf(output_len B)|
-void TCPDevice::_compute(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t opcode,
-                         uint16_t input_len, const uint8_t *input_buf,
-                         uint16_t *output_len, uint8_t *output_buf) {
+// |ReqID(2B)|output_len(2B)|output_buf(output_len B)|
+void TCPDevice::_compute(Connection *remote_slave, uint8_t ds_id,
+                         uint8_t opcode, uint16_t input_len,
+                         const uint8_t *input_buf, uint16_t *output_len,
+                         uint8_t *output_buf) {
   assert(input_len <= kMaxComputeDataLen);
-  uint8_t req[kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
-              +sizeof(input_len) + kLargeDataSize];
+  auto start_tsc = rdtsc();
+  uint8_t req[kReqHeaderSize + Object::kDSIDSize + sizeof(opcode) +
+              sizeof(input_len)];
 
-  __builtin_memcpy(&req[0], &kOpCompute, sizeof(kOpWriteObject));
-  __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
-  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize], &opcode,
+  __builtin_memcpy(&req[0], &kOpCompute, sizeof(kOpCompute));
+  __builtin_memcpy(&req[kReqHeaderSize], &ds_id, Object::kDSIDSize);
+  __builtin_memcpy(&req[kReqHeaderSize + Object::kDSIDSize], &opcode,
                    sizeof(opcode));
-  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize + sizeof(opcode)],
+  __builtin_memcpy(&req[kReqHeaderSize + Object::kDSIDSize + sizeof(opcode)],
                    &input_len, sizeof(input_len));
 
-  if (likely(input_len <= kLargeDataSize)) {
-    memcpy(&req[kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
-                sizeof(input_len)],
-           input_buf, input_len);
-    helpers::tcp_write_until(remote_slave, req,
-                             kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
-                                 sizeof(input_len) + input_len);
-  } else {
-    helpers::tcp_write2_until(remote_slave, req,
-                              kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
-                                  sizeof(input_len),
-                              input_buf, input_len);
-  }
-
-  helpers::tcp_read_until(remote_slave, output_len, sizeof(*output_len));
-  if (*output_len) {
-    assert(*output_len <= kMaxComputeDataLen);
-    helpers::tcp_read_until(remote_slave, output_buf, *output_len);
-  }
+  Response resp{.head = reinterpret_cast<uint8_t *>(output_len),
+                .head_len = sizeof(*output_len),
+                .has_body = true,
+                .body = output_buf};
+  iovec req_iovecs[] = {
+      {.iov_base = req, .iov_len = sizeof(req)},
+      {.iov_base = const_cast<uint8_t *>(input_buf), .iov_len = input_len}};
+  remote_slave->round_trip(req_iovecs, input_len ? 2 : 1, &resp);
+  Stats::record_compute_latency(start_tsc);
+  assert(*output_len <= kMaxComputeDataLen);
 }
 
 #define RPC_LOG_ON 0
@@ -347,51 +676,1111 @@ void TCPDevice::_compute(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t opcode,
 #endif
 
 // Request:
-// |Opcode = kOpCall(1B)|ds_id(1B)|body_len(2B)|body(method+args)|
-// Response:
-// |ret_len(2B)|ret|
-bool TCPDevice::_call(tcpconn_t *remote_slave,
-                      uint8_t ds_id,
-                      const std::string &method,
-                      const rpc::BufferPtr &args,
-                      rpc::BufferPtr &ret) {
-  assert(serializer.ReadableBytes() <= kMaxCallDataLen);
-  rpc::Serializer serializer;
-  serializer << method;
-  serializer.WriteRaw(args->GetReadPtr(), args->ReadableBytes());
-  uint16_t body_len = serializer.ReadableBytes();
-  auto body_buffer = serializer.GetBuffer();
-  uint8_t req_header[kOpcodeSize + Object::kDSIDSize + sizeof(body_len)];
-
-  RPC_LOG("TCPDevice::_call(ds_id: %d, method: %s, body_len: %d)",
-          ds_id, method.c_str(), body_len);
+// |Opcode = kOpCall(1B)|ReqID(2B)|ds_id(1B)|body_len(4B)|method_id(2B)|args|
+// Response, streamed as one or more frames:
+// |ReqID(2B)|chunk_len(4B)|chunk|
+// where kLastChunkFlag is set in the chunk_len of the last frame, and the first
+// chunk starts with the RpcErrorCode.
+//
+// The method ID is negotiated with the server beforehand (see
+// GenericArray::GenericArray()), so the method name is never sent. The args are
+// gathered in place, without being serialized into a buffer first.
+rpc::RpcErrorCode
+TCPDevice::_call_stream(Connection *remote_slave, uint8_t ds_id,
+                        rpc::MethodID method_id, const rpc::BufferPtr &args,
+                        const rpc::StreamReader::ChunkFn &chunk_fn) {
+  auto start_tsc = rdtsc();
+  assert(args->ReadableBytes() <= kMaxCallDataLen);
+  uint32_t body_len = args->ReadableBytes();
+  uint8_t req_header[kReqHeaderSize + Object::kDSIDSize + sizeof(body_len) +
+                     sizeof(method_id)];
+
+  RPC_LOG("TCPDevice::_call_stream(ds_id: %d, method_id: %d, body_len: %d)",
+          ds_id, method_id, body_len);
 
   __builtin_memcpy(&req_header[0], &kOpCall, sizeof(kOpCall));
-  __builtin_memcpy(&req_header[kOpcodeSize], &ds_id, Object::kDSIDSize);
-  __builtin_memcpy(&req_header[kOpcodeSize + Object::kDSIDSize],
+  __builtin_memcpy(&req_header[kReqHeaderSize], &ds_id, Object::kDSIDSize);
+  __builtin_memcpy(&req_header[kReqHeaderSize + Object::kDSIDSize],
                    &body_len, sizeof(body_len));
+  __builtin_memcpy(
+      &req_header[kReqHeaderSize + Object::kDSIDSize + sizeof(body_len)],
+      &method_id, sizeof(method_id));
+
+  rpc::StreamReader reader(chunk_fn);
+  iovec req_iovecs[] = {
+      {.iov_base = req_header, .iov_len = sizeof(req_header)},
+      {.iov_base = const_cast<char *>(args->GetReadPtr()),
+       .iov_len = body_len}};
+  remote_slave->round_trip_stream(
+      req_iovecs, body_len ? 2 : 1,
+      [&](const rpc::BufferPtr &chunk) { reader.OnChunk(chunk); });
+  Stats::record_call_latency(start_tsc);
+
+  if (!reader.Succeeded()) {
+    RPC_LOG("TCPDevice::_call_stream RPC Failed");
+  }
+  return reader.GetErrorCode();
+}
+
+StorageDevice::StorageDevice(uint64_t far_mem_size)
+    : FarMemDevice(far_mem_size, kPrefetchWinSize) {
+  block_size_ = storage_block_size();
+  BUG_ON(!block_size_);
+  BUG_ON(far_mem_size > storage_num_blocks() * block_size_);
+  init();
+  // Unlike a fresh file, the namespace holds stale data, whereas the far-mem
+  // GC relies on never-written object headers being zero.
+  for (uint32_t region_idx = 0; region_idx < far_mem_size / Region::kSize;
+       region_idx++) {
+    compute_reset_region(sizeof(region_idx),
+                         reinterpret_cast<const uint8_t *>(&region_idx));
+  }
+}
+
+StorageDevice::StorageDevice(const std::string &file_path,
+                             uint64_t far_mem_size)
+    : FarMemDevice(far_mem_size, kPrefetchWinSize) {
+  block_size_ = kFileBlockSize;
+  fd_ = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  if (fd_ < 0 && errno == EINVAL) {
+    // The file system (e.g., tmpfs) does not support direct I/O.
+    fd_ = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  }
+  BUG_ON(fd_ < 0);
+  BUG_ON(ftruncate(fd_, far_mem_size) != 0);
+  init();
+}
+
+StorageDevice::~StorageDevice() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void StorageDevice::init() {
+  BUG_ON(Region::kSize % block_size_);
+  BUG_ON(far_mem_size_ % Region::kSize);
+  region_mutexes_.reset(new rt::Mutex[far_mem_size_ / Region::kSize]);
+}
+
+uint8_t *StorageDevice::allocate_block_buf(uint64_t len) {
+  void *buf = nullptr;
+  // O_DIRECT requires the buffers to be aligned to the logical block size.
+  BUG_ON(posix_memalign(&buf, kFileBlockSize,
+                        helpers::align_to(len, static_cast<uint64_t>(
+                                                   kFileBlockSize))));
+  return reinterpret_cast<uint8_t *>(buf);
+}
+
+void StorageDevice::read_blocks(uint64_t lba, uint64_t num_blocks,
+                                uint8_t *buf) {
+  auto len = num_blocks * block_size_;
+  if (fd_ < 0) {
+    BUG_ON(storage_read(buf, lba, num_blocks) != 0);
+    return;
+  }
+  BUG_ON(pread(fd_, buf, len, lba * block_size_) != static_cast<ssize_t>(len));
+}
+
+void StorageDevice::write_blocks(uint64_t lba, uint64_t num_blocks,
+                                 const uint8_t *buf) {
+  auto len = num_blocks * block_size_;
+  if (fd_ < 0) {
+    BUG_ON(storage_write(buf, lba, num_blocks) != 0);
+    return;
+  }
+  BUG_ON(pwrite(fd_, buf, len, lba * block_size_) !=
+         static_cast<ssize_t>(len));
+}
+
+void StorageDevice::read_range(uint64_t offset, uint32_t len, uint8_t *buf) {
+  auto first_lba = offset / block_size_;
+  auto end_lba = (offset + len - 1) / block_size_ + 1;
+  auto *blocks = allocate_block_buf((end_lba - first_lba) * block_size_);
+  auto guard = helpers::finally([&]() { free(blocks); });
+  read_blocks(first_lba, end_lba - first_lba, blocks);
+  memcpy(buf, blocks + offset - first_lba * block_size_, len);
+}
+
+void StorageDevice::write_range(uint64_t offset, uint32_t len,
+                                const uint8_t *buf) {
+  auto first_lba = offset / block_size_;
+  auto end_lba = (offset + len - 1) / block_size_ + 1;
+  auto num_blocks = end_lba - first_lba;
+  auto *blocks = allocate_block_buf(num_blocks * block_size_);
+  auto guard = helpers::finally([&]() { free(blocks); });
+  if (offset % block_size_ || (offset + len) % block_size_) {
+    read_blocks(first_lba, num_blocks, blocks);
+  }
+  memcpy(blocks + offset - first_lba * block_size_, buf, len);
+  write_blocks(first_lba, num_blocks, blocks);
+}
+
+rt::Mutex &StorageDevice::region_mutex(uint64_t offset) {
+  return region_mutexes_[offset / Region::kSize];
+}
+
+bool StorageDevice::has_back_ref(uint8_t obj_id_len) {
+  return obj_id_len == kVanillaPtrObjectIDSize + kVanillaPtrBackRefSize;
+}
+
+uint64_t StorageDevice::get_offset(const uint8_t *obj_id) {
+  return *reinterpret_cast<const uint64_t *>(obj_id);
+}
+
+// Writes the object image as ServerPtr::write_object() does and returns its
+// length. Without a back ref, the ptr_addr field is left out of the image
+// (which then starts at the data_len field) so that the stored one is kept.
+uint32_t StorageDevice::encode_object(uint8_t obj_id_len,
+                                      const uint8_t *obj_id, uint16_t data_len,
+                                      const uint8_t *data_buf,
+                                      uint8_t *image) {
+  uint64_t ptr_addr = 0;
+  if (has_back_ref(obj_id_len)) {
+    memcpy(&ptr_addr, obj_id + kVanillaPtrObjectIDSize, kVanillaPtrBackRefSize);
+  }
+  Object object(reinterpret_cast<uint64_t>(image));
+  object.set_ptr_addr(ptr_addr);
+  object.set_data_len(data_len);
+  object.set_ds_id(kVanillaPtrDSID);
+  object.set_obj_id_len(kVanillaPtrObjectIDSize);
+  memcpy(image + Object::kHeaderSize, data_buf, data_len);
+  return Object::kHeaderSize + data_len;
+}
+
+void StorageDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                const uint8_t *obj_id, uint16_t *data_len,
+                                uint8_t *data_buf) {
+  ObjectReadReq req{.ds_id = ds_id,
+                    .obj_id_len = obj_id_len,
+                    .obj_id = obj_id,
+                    .data_len = data_len,
+                    .data_buf = data_buf};
+  read_objects(1, &req);
+}
+
+void StorageDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                 const uint8_t *obj_id, uint16_t data_len,
+                                 const uint8_t *data_buf) {
+  BUG_ON(ds_id != kVanillaPtrDSID);
+  auto offset = get_offset(obj_id);
+  std::unique_ptr<uint8_t[]> image(
+      new uint8_t[Object::kHeaderSize + data_len]);
+  auto image_len =
+      encode_object(obj_id_len, obj_id, data_len, data_buf, image.get());
+  uint32_t skip_len = has_back_ref(obj_id_len) ? 0 : kVanillaPtrBackRefSize;
+  auto &mutex = region_mutex(offset);
+  mutex.Lock();
+  auto guard = helpers::finally([&]() { mutex.Unlock(); });
+  write_range(offset + skip_len, image_len - skip_len, image.get() + skip_len);
+}
+
+// The requests whose headers fall into contiguous blocks are served by one
+// read; the objects that extend beyond it have their data read separately.
+void StorageDevice::read_objects(uint32_t num_objs,
+                                 const ObjectReadReq *reqs) {
+  std::vector<const ObjectReadReq *> sorted_reqs(num_objs);
+  for (uint32_t i = 0; i < num_objs; i++) {
+    BUG_ON(reqs[i].ds_id != kVanillaPtrDSID);
+    sorted_reqs[i] = &reqs[i];
+  }
+  std::sort(sorted_reqs.begin(), sorted_reqs.end(),
+            [](const ObjectReadReq *x, const ObjectReadReq *y) {
+              return get_offset(x->obj_id) < get_offset(y->obj_id);
+            });
+
+  for (uint32_t start = 0, end; start < num_objs; start = end) {
+    auto first_lba = get_offset(sorted_reqs[start]->obj_id) / block_size_;
+    auto end_lba = first_lba;
+    for (end = start; end < num_objs; end++) {
+      auto offset = get_offset(sorted_reqs[end]->obj_id);
+      auto header_end_lba =
+          (offset + Object::kHeaderSize - 1) / block_size_ + 1;
+      if (end > start &&
+          (offset / block_size_ > end_lba ||
+           (header_end_lba - first_lba) * block_size_ > kMaxBatchIOLen)) {
+        break;
+      }
+      end_lba = std::max(end_lba, header_end_lba);
+    }
+    auto *blocks = allocate_block_buf((end_lba - first_lba) * block_size_);
+    auto guard = helpers::finally([&]() { free(blocks); });
+    read_blocks(first_lba, end_lba - first_lba, blocks);
+
+    auto blocks_end_offset = end_lba * block_size_;
+    for (uint32_t i = start; i < end; i++) {
+      auto &req = *sorted_reqs[i];
+      auto offset = get_offset(req.obj_id);
+      Object object(reinterpret_cast<uint64_t>(blocks) + offset -
+                    first_lba * block_size_);
+      *req.data_len = object.get_data_len();
+      auto data_offset = offset + Object::kHeaderSize;
+      if (data_offset + *req.data_len <= blocks_end_offset) {
+        memcpy(req.data_buf, reinterpret_cast<uint8_t *>(object.get_data_addr()),
+               *req.data_len);
+      } else if (*req.data_len) {
+        read_range(data_offset, *req.data_len, req.data_buf);
+      }
+    }
+  }
+}
+
+// The requests carrying back refs (i.e., the full headers) are merged into
+// runs of contiguous blocks within a region, each written by one
+// read-modify-write.
+void StorageDevice::write_objects(uint32_t num_objs,
+                                  const ObjectWriteReq *reqs) {
+  std::vector<const ObjectWriteReq *> sorted_reqs;
+  sorted_reqs.reserve(num_objs);
+  for (uint32_t i = 0; i < num_objs; i++) {
+    auto &req = reqs[i];
+    if (has_back_ref(req.obj_id_len)) {
+      BUG_ON(req.ds_id != kVanillaPtrDSID);
+      sorted_reqs.push_back(&req);
+    } else {
+      write_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                   req.data_buf);
+    }
+  }
+  std::sort(sorted_reqs.begin(), sorted_reqs.end(),
+            [](const ObjectWriteReq *x, const ObjectWriteReq *y) {
+              return get_offset(x->obj_id) < get_offset(y->obj_id);
+            });
+
+  uint32_t num_sorted_reqs = sorted_reqs.size();
+  for (uint32_t start = 0, end; start < num_sorted_reqs; start = end) {
+    auto start_offset = get_offset(sorted_reqs[start]->obj_id);
+    auto first_lba = start_offset / block_size_;
+    auto end_lba = first_lba;
+    for (end = start; end < num_sorted_reqs; end++) {
+      auto &req = *sorted_reqs[end];
+      auto offset = get_offset(req.obj_id);
+      auto obj_end_lba =
+          (offset + Object::kHeaderSize + req.data_len - 1) / block_size_ + 1;
+      if (end > start &&
+          (offset / Region::kSize != start_offset / Region::kSize ||
+           offset / block_size_ > end_lba ||
+           (obj_end_lba - first_lba) * block_size_ > kMaxBatchIOLen)) {
+        break;
+      }
+      end_lba = std::max(end_lba, obj_end_lba);
+    }
+
+    auto num_blocks = end_lba - first_lba;
+    auto *blocks = allocate_block_buf(num_blocks * block_size_);
+    auto &mutex = region_mutex(start_offset);
+    mutex.Lock();
+    auto guard = helpers::finally([&]() {
+      mutex.Unlock();
+      free(blocks);
+    });
+    read_blocks(first_lba, num_blocks, blocks);
+    for (uint32_t i = start; i < end; i++) {
+      auto &req = *sorted_reqs[i];
+      encode_object(req.obj_id_len, req.obj_id, req.data_len, req.data_buf,
+                    blocks + get_offset(req.obj_id) - first_lba * block_size_);
+    }
+    write_blocks(first_lba, num_blocks, blocks);
+  }
+}
+
+bool StorageDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                  const uint8_t *obj_id) {
+  BUG();
+}
+
+void StorageDevice::construct(uint8_t ds_type, uint8_t ds_id,
+                              uint8_t param_len, uint8_t *params) {
+  BUG();
+}
+
+void StorageDevice::destruct(uint8_t ds_id) { BUG(); }
+
+void StorageDevice::compute_free_objects(uint16_t input_len,
+                                         const uint8_t *input_buf) {
+  assert(input_len % ServerPtr::kFreeEntrySize == 0);
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += ServerPtr::kFreeEntrySize) {
+    auto offset = *reinterpret_cast<const uint64_t *>(cur);
+    auto obj_size = *reinterpret_cast<const uint16_t *>(cur + sizeof(uint64_t));
+    uint8_t header[Object::kHeaderSize];
+    auto &mutex = region_mutex(offset);
+    mutex.Lock();
+    auto guard = helpers::finally([&]() { mutex.Unlock(); });
+    read_range(offset, sizeof(header), header);
+    Object object(reinterpret_cast<uint64_t>(header));
+    object.set_data_len(obj_size - Object::kHeaderSize);
+    object.set_obj_id_len(0);
+    object.free();
+    write_range(offset, sizeof(header), header);
+  }
+}
+
+void StorageDevice::compute_list_objects(uint16_t input_len,
+                                         const uint8_t *input_buf,
+                                         uint16_t *output_len,
+                                         uint8_t *output_buf) {
+  uint32_t region_idx, cur;
+  assert(input_len == sizeof(region_idx) + sizeof(cur));
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  cur = *reinterpret_cast<const uint32_t *>(input_buf + sizeof(region_idx));
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > far_mem_size_);
+  auto *region = allocate_block_buf(Region::kSize);
+  auto guard = helpers::finally([&]() { free(region); });
+  read_blocks(region_offset / block_size_, Region::kSize / block_size_, region);
+  ServerPtr::list_region_objects(reinterpret_cast<uint64_t>(region),
+                                 region_offset, cur, output_len, output_buf);
+}
+
+void StorageDevice::compute_move_objects(uint16_t input_len,
+                                         const uint8_t *input_buf) {
+  assert(input_len % ServerPtr::kMoveEntrySize == 0);
+  std::unique_ptr<uint8_t[]> image(new uint8_t[Object::kMaxObjectSize]);
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += ServerPtr::kMoveEntrySize) {
+    auto old_offset = *reinterpret_cast<const uint64_t *>(cur);
+    auto new_offset =
+        *reinterpret_cast<const uint64_t *>(cur + sizeof(uint64_t));
+    auto obj_size =
+        *reinterpret_cast<const uint16_t *>(cur + 2 * sizeof(uint64_t));
+    auto ptr_addr = *reinterpret_cast<const uint64_t *>(
+        cur + 2 * sizeof(uint64_t) + sizeof(uint16_t));
+    Object object(reinterpret_cast<uint64_t>(image.get()));
+
+    auto &old_mutex = region_mutex(old_offset);
+    old_mutex.Lock();
+    read_range(old_offset, obj_size, image.get());
+    old_mutex.Unlock();
 
-  helpers::tcp_write2_until(remote_slave, req_header,
-                            kOpcodeSize + Object::kDSIDSize + sizeof(body_len),
-                            body_buffer->GetReadPtr(), body_len);
-
-  RPC_LOG("TCPDevice::_call write success");
-
-  uint16_t ret_len;
-  helpers::tcp_read_until(remote_slave, &ret_len, sizeof(ret_len));
-  RPC_LOG("TCPDevice::_call read header success(ret_len: %d)", ret_len);
-  if (ret_len) {
-    assert(ret_len <= kMaxCallDataLen);
-    ret = std::make_shared<rpc::Buffer>(ret_len);
-    helpers::tcp_read_until(remote_slave, ret->GetWritePtr(), ret_len);
-    ret->HasWritten(ret_len);
-    RPC_LOG("TCPDevice::_call read body success");
-    rpc::Serializer ret_serializer(ret);
-    auto error_code = rpc::Get<rpc::RpcErrorCode>(ret_serializer);
-    if (error_code == rpc::RpcErrorCode::kSuccess) return true;
-    RPC_LOG("TCPDevice::_call RPC Failed");
+    auto &new_mutex = region_mutex(new_offset);
+    new_mutex.Lock();
+    object.set_ptr_addr(ptr_addr);
+    write_range(new_offset, obj_size, image.get());
+    new_mutex.Unlock();
+
+    old_mutex.Lock();
+    read_range(old_offset, Object::kHeaderSize, image.get());
+    object.free();
+    write_range(old_offset, Object::kHeaderSize, image.get());
+    old_mutex.Unlock();
+  }
+}
+
+void StorageDevice::compute_reset_region(uint16_t input_len,
+                                         const uint8_t *input_buf) {
+  uint32_t region_idx;
+  assert(input_len == sizeof(region_idx));
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > far_mem_size_);
+  auto *region = allocate_block_buf(Region::kSize);
+  auto &mutex = region_mutex(region_offset);
+  mutex.Lock();
+  auto guard = helpers::finally([&]() {
+    mutex.Unlock();
+    free(region);
+  });
+  memset(region, 0, Region::kSize);
+  write_blocks(region_offset / block_size_, Region::kSize / block_size_,
+               region);
+}
+
+void StorageDevice::compute_read_region(uint16_t input_len,
+                                        const uint8_t *input_buf,
+                                        uint16_t *output_len,
+                                        uint8_t *output_buf) {
+  uint32_t region_idx, offset;
+  assert(input_len == ServerPtr::kRegionChunkHeaderSize);
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  offset = *reinterpret_cast<const uint32_t *>(input_buf + sizeof(region_idx));
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > far_mem_size_);
+  BUG_ON(offset + ServerPtr::kRegionChunkSize > Region::kSize);
+  auto &mutex = region_mutex(region_offset);
+  mutex.Lock();
+  auto guard = helpers::finally([&]() { mutex.Unlock(); });
+  read_range(region_offset + offset, ServerPtr::kRegionChunkSize, output_buf);
+  *output_len = ServerPtr::kRegionChunkSize;
+}
+
+void StorageDevice::compute_write_region(uint16_t input_len,
+                                         const uint8_t *input_buf) {
+  uint32_t region_idx, offset;
+  assert(input_len > ServerPtr::kRegionChunkHeaderSize);
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  offset = *reinterpret_cast<const uint32_t *>(input_buf + sizeof(region_idx));
+  auto data_len = input_len - ServerPtr::kRegionChunkHeaderSize;
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > far_mem_size_);
+  BUG_ON(offset + data_len > Region::kSize);
+  auto &mutex = region_mutex(region_offset);
+  mutex.Lock();
+  auto guard = helpers::finally([&]() { mutex.Unlock(); });
+  write_range(region_offset + offset, data_len,
+              input_buf + ServerPtr::kRegionChunkHeaderSize);
+}
+
+void StorageDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+                            const uint8_t *input_buf, uint16_t *output_len,
+                            uint8_t *output_buf) {
+  BUG_ON(ds_id != kVanillaPtrDSID);
+  *output_len = 0;
+  switch (opcode) {
+  case ServerPtr::OpCode::FreeObjects:
+    compute_free_objects(input_len, input_buf);
+    break;
+  case ServerPtr::OpCode::ListObjects:
+    compute_list_objects(input_len, input_buf, output_len, output_buf);
+    break;
+  case ServerPtr::OpCode::MoveObjects:
+    compute_move_objects(input_len, input_buf);
+    break;
+  case ServerPtr::OpCode::ResetRegion:
+    compute_reset_region(input_len, input_buf);
+    break;
+  case ServerPtr::OpCode::ReadRegion:
+    compute_read_region(input_len, input_buf, output_len, output_buf);
+    break;
+  case ServerPtr::OpCode::WriteRegion:
+    compute_write_region(input_len, input_buf);
+    break;
+  default:
+    BUG();
+  }
+}
+
+TieredDevice::TieredDevice(FarMemDevice *fast_device,
+                           FarMemDevice *slow_device)
+    : FarMemDevice(fast_device->get_far_mem_size(),
+                   fast_device->get_prefetch_win_size()),
+      fast_device_(fast_device), slow_device_(slow_device) {
+  BUG_ON(fast_device->get_far_mem_size() != slow_device->get_far_mem_size());
+  num_regions_ = far_mem_size_ / Region::kSize;
+  region_states_.reset(new RegionState[num_regions_]);
+  tiering_thread_ = rt::Thread([&]() { tiering_fn(); });
+}
+
+TieredDevice::~TieredDevice() {
+  store_release(&exit_, true);
+  tiering_thread_.Join();
+}
+
+FarMemDevice *TieredDevice::get_device(uint8_t tier) {
+  return tier == kFastTier ? fast_device_.get() : slow_device_.get();
+}
+
+uint32_t TieredDevice::get_region_idx(uint64_t offset) {
+  return offset / Region::kSize;
+}
+
+uint32_t TieredDevice::get_region_idx(const uint8_t *obj_id) {
+  return get_region_idx(*reinterpret_cast<const uint64_t *>(obj_id));
+}
+
+uint8_t TieredDevice::enter_region(uint32_t region_idx) {
+  auto &state = region_states_[region_idx];
+  while (true) {
+    state.num_inflights++;
+    if (likely(!state.migrating)) {
+      return ACCESS_ONCE(state.tier);
+    }
+    state.num_inflights--;
+    while (state.migrating) {
+      thread_yield();
+    }
+  }
+}
+
+void TieredDevice::exit_region(uint32_t region_idx) {
+  region_states_[region_idx].num_inflights--;
+}
+
+// The regions are entered in ascending order. Since a locker holds a single
+// region, this rules out deadlocks between the batches and the lockers.
+void TieredDevice::enter_regions(std::vector<uint32_t> *region_idxes,
+                                 std::vector<uint8_t> *tiers) {
+  std::sort(region_idxes->begin(), region_idxes->end());
+  region_idxes->erase(std::unique(region_idxes->begin(), region_idxes->end()),
+                      region_idxes->end());
+  tiers->resize(region_idxes->size());
+  for (uint32_t i = 0; i < region_idxes->size(); i++) {
+    (*tiers)[i] = enter_region((*region_idxes)[i]);
+  }
+}
+
+void TieredDevice::exit_regions(const std::vector<uint32_t> &region_idxes) {
+  for (auto region_idx : region_idxes) {
+    exit_region(region_idx);
+  }
+}
+
+uint8_t TieredDevice::get_tier(const std::vector<uint32_t> &region_idxes,
+                               const std::vector<uint8_t> &tiers,
+                               uint32_t region_idx) {
+  auto iter =
+      std::lower_bound(region_idxes.begin(), region_idxes.end(), region_idx);
+  return tiers[iter - region_idxes.begin()];
+}
+
+void TieredDevice::lock_region(uint32_t region_idx) {
+  auto &state = region_states_[region_idx];
+  bool expected = false;
+  while (!state.migrating.compare_exchange_weak(expected, true)) {
+    expected = false;
+    thread_yield();
+  }
+  while (state.num_inflights) {
+    thread_yield();
+  }
+}
+
+void TieredDevice::unlock_region(uint32_t region_idx) {
+  region_states_[region_idx].migrating = false;
+}
+
+void TieredDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                               const uint8_t *obj_id, uint16_t *data_len,
+                               uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    fast_device_->read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  auto region_idx = get_region_idx(obj_id);
+  auto tier = enter_region(region_idx);
+  auto guard = helpers::finally([&]() { exit_region(region_idx); });
+  region_states_[region_idx].num_reads.fetch_add(1, std::memory_order_relaxed);
+  get_device(tier)->read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+}
+
+void TieredDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                const uint8_t *obj_id, uint16_t data_len,
+                                const uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    fast_device_->write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  auto region_idx = get_region_idx(obj_id);
+  auto tier = enter_region(region_idx);
+  auto guard = helpers::finally([&]() { exit_region(region_idx); });
+  ACCESS_ONCE(region_states_[region_idx].written) = true;
+  get_device(tier)->write_object(ds_id, obj_id_len, obj_id, data_len,
+                                 data_buf);
+}
+
+void TieredDevice::read_objects(uint32_t num_objs, const ObjectReadReq *reqs) {
+  std::vector<uint32_t> region_idxes;
+  for (uint32_t i = 0; i < num_objs; i++) {
+    if (reqs[i].ds_id == kVanillaPtrDSID) {
+      region_idxes.push_back(get_region_idx(reqs[i].obj_id));
+    }
+  }
+  std::vector<uint8_t> tiers;
+  enter_regions(&region_idxes, &tiers);
+  auto guard = helpers::finally([&]() { exit_regions(region_idxes); });
+
+  std::vector<ObjectReadReq> tier_reqs[2];
+  for (uint32_t i = 0; i < num_objs; i++) {
+    auto &req = reqs[i];
+    if (req.ds_id != kVanillaPtrDSID) {
+      tier_reqs[kFastTier].push_back(req);
+      continue;
+    }
+    auto region_idx = get_region_idx(req.obj_id);
+    region_states_[region_idx].num_reads.fetch_add(1,
+                                                   std::memory_order_relaxed);
+    tier_reqs[get_tier(region_idxes, tiers, region_idx)].push_back(req);
+  }
+  for (uint8_t tier : {kFastTier, kSlowTier}) {
+    if (!tier_reqs[tier].empty()) {
+      get_device(tier)->read_objects(tier_reqs[tier].size(),
+                                     tier_reqs[tier].data());
+    }
+  }
+}
+
+void TieredDevice::write_objects(uint32_t num_objs,
+                                 const ObjectWriteReq *reqs) {
+  std::vector<uint32_t> region_idxes;
+  for (uint32_t i = 0; i < num_objs; i++) {
+    if (reqs[i].ds_id == kVanillaPtrDSID) {
+      region_idxes.push_back(get_region_idx(reqs[i].obj_id));
+    }
+  }
+  std::vector<uint8_t> tiers;
+  enter_regions(&region_idxes, &tiers);
+  auto guard = helpers::finally([&]() { exit_regions(region_idxes); });
+
+  std::vector<ObjectWriteReq> tier_reqs[2];
+  for (uint32_t i = 0; i < num_objs; i++) {
+    auto &req = reqs[i];
+    if (req.ds_id != kVanillaPtrDSID) {
+      tier_reqs[kFastTier].push_back(req);
+      continue;
+    }
+    auto region_idx = get_region_idx(req.obj_id);
+    ACCESS_ONCE(region_states_[region_idx].written) = true;
+    tier_reqs[get_tier(region_idxes, tiers, region_idx)].push_back(req);
+  }
+  for (uint8_t tier : {kFastTier, kSlowTier}) {
+    if (!tier_reqs[tier].empty()) {
+      get_device(tier)->write_objects(tier_reqs[tier].size(),
+                                      tier_reqs[tier].data());
+    }
+  }
+}
+
+bool TieredDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                 const uint8_t *obj_id) {
+  return fast_device_->remove_object(ds_id, obj_id_len, obj_id);
+}
+
+void TieredDevice::construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                             uint8_t *params) {
+  fast_device_->construct(ds_type, ds_id, param_len, params);
+}
+
+void TieredDevice::destruct(uint8_t ds_id) { fast_device_->destruct(ds_id); }
+
+rpc::RpcErrorCode TieredDevice::call(uint8_t ds_id, rpc::MethodID method_id,
+                                     const rpc::BufferPtr &args,
+                                     rpc::BufferPtr &ret) {
+  return fast_device_->call(ds_id, method_id, args, ret);
+}
+
+rpc::RpcErrorCode
+TieredDevice::call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                const rpc::BufferPtr &args,
+                const rpc::StreamReader::ChunkFn &chunk_fn) {
+  return fast_device_->call_stream(ds_id, method_id, args, chunk_fn);
+}
+
+void TieredDevice::compute_free_objects(uint16_t input_len,
+                                        const uint8_t *input_buf) {
+  assert(input_len % ServerPtr::kFreeEntrySize == 0);
+  std::vector<uint32_t> region_idxes;
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += ServerPtr::kFreeEntrySize) {
+    region_idxes.push_back(get_region_idx(cur));
+  }
+  std::vector<uint8_t> tiers;
+  enter_regions(&region_idxes, &tiers);
+  auto guard = helpers::finally([&]() { exit_regions(region_idxes); });
+
+  std::vector<uint8_t> tier_inputs[2];
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += ServerPtr::kFreeEntrySize) {
+    auto tier = get_tier(region_idxes, tiers, get_region_idx(cur));
+    tier_inputs[tier].insert(tier_inputs[tier].end(), cur,
+                             cur + ServerPtr::kFreeEntrySize);
+  }
+  for (uint8_t tier : {kFastTier, kSlowTier}) {
+    if (!tier_inputs[tier].empty()) {
+      uint16_t output_len;
+      get_device(tier)->compute(kVanillaPtrDSID, ServerPtr::OpCode::FreeObjects,
+                                tier_inputs[tier].size(),
+                                tier_inputs[tier].data(), &output_len,
+                                nullptr);
+    }
+  }
+}
+
+// The objects moved within a tier are batched into its device. The ones
+// moved across tiers are copied through the client, which is rare since the
+// destination regions are the freshly written (i.e., fast) ones.
+void TieredDevice::compute_move_objects(uint16_t input_len,
+                                        const uint8_t *input_buf) {
+  assert(input_len % ServerPtr::kMoveEntrySize == 0);
+  std::vector<uint32_t> region_idxes;
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += ServerPtr::kMoveEntrySize) {
+    region_idxes.push_back(get_region_idx(cur));
+    region_idxes.push_back(get_region_idx(cur + sizeof(uint64_t)));
+  }
+  std::vector<uint8_t> tiers;
+  enter_regions(&region_idxes, &tiers);
+  auto guard = helpers::finally([&]() { exit_regions(region_idxes); });
+
+  std::vector<uint8_t> tier_inputs[2];
+  std::unique_ptr<uint8_t[]> data_buf;
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += ServerPtr::kMoveEntrySize) {
+    auto old_tier = get_tier(region_idxes, tiers, get_region_idx(cur));
+    auto new_region_idx = get_region_idx(cur + sizeof(uint64_t));
+    auto new_tier = get_tier(region_idxes, tiers, new_region_idx);
+    ACCESS_ONCE(region_states_[new_region_idx].written) = true;
+    if (old_tier == new_tier) {
+      tier_inputs[old_tier].insert(tier_inputs[old_tier].end(), cur,
+                                   cur + ServerPtr::kMoveEntrySize);
+      continue;
+    }
+
+    auto obj_size =
+        *reinterpret_cast<const uint16_t *>(cur + 2 * sizeof(uint64_t));
+    auto ptr_addr = *reinterpret_cast<const uint64_t *>(
+        cur + 2 * sizeof(uint64_t) + sizeof(uint16_t));
+    if (!data_buf) {
+      data_buf.reset(new uint8_t[Object::kMaxObjectSize]);
+    }
+    uint16_t data_len;
+    get_device(old_tier)->read_object(kVanillaPtrDSID, kVanillaPtrObjectIDSize,
+                                      cur, &data_len, data_buf.get());
+    uint8_t obj_id[kVanillaPtrObjectIDSize + kVanillaPtrBackRefSize];
+    memcpy(obj_id, cur + sizeof(uint64_t), kVanillaPtrObjectIDSize);
+    memcpy(obj_id + kVanillaPtrObjectIDSize, &ptr_addr, kVanillaPtrBackRefSize);
+    get_device(new_tier)->write_object(kVanillaPtrDSID, sizeof(obj_id), obj_id,
+                                       data_len, data_buf.get());
+    uint8_t free_entry[ServerPtr::kFreeEntrySize];
+    memcpy(free_entry, cur, sizeof(uint64_t));
+    memcpy(free_entry + sizeof(uint64_t), &obj_size, sizeof(obj_size));
+    uint16_t output_len;
+    get_device(old_tier)->compute(kVanillaPtrDSID,
+                                  ServerPtr::OpCode::FreeObjects,
+                                  sizeof(free_entry), free_entry, &output_len,
+                                  nullptr);
+  }
+  for (uint8_t tier : {kFastTier, kSlowTier}) {
+    if (!tier_inputs[tier].empty()) {
+      uint16_t output_len;
+      get_device(tier)->compute(kVanillaPtrDSID, ServerPtr::OpCode::MoveObjects,
+                                tier_inputs[tier].size(),
+                                tier_inputs[tier].data(), &output_len,
+                                nullptr);
+    }
+  }
+}
+
+// A reset region is empty, so it is brought back to the fast tier for free.
+void TieredDevice::compute_reset_region(uint16_t input_len,
+                                        const uint8_t *input_buf) {
+  uint32_t region_idx;
+  assert(input_len == sizeof(region_idx));
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  lock_region(region_idx);
+  auto guard = helpers::finally([&]() { unlock_region(region_idx); });
+  auto &state = region_states_[region_idx];
+  uint16_t output_len;
+  get_device(state.tier)
+      ->compute(kVanillaPtrDSID, ServerPtr::OpCode::ResetRegion, input_len,
+                input_buf, &output_len, nullptr);
+  state.tier = kFastTier;
+  state.written = false;
+  state.num_cold_epochs = 0;
+  state.num_reads = 0;
+}
+
+void TieredDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+                           const uint8_t *input_buf, uint16_t *output_len,
+                           uint8_t *output_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    fast_device_->compute(ds_id, opcode, input_len, input_buf, output_len,
+                          output_buf);
+    return;
+  }
+  *output_len = 0;
+  switch (opcode) {
+  case ServerPtr::OpCode::FreeObjects:
+    compute_free_objects(input_len, input_buf);
+    break;
+  case ServerPtr::OpCode::ListObjects:
+  case ServerPtr::OpCode::ReadRegion:
+  case ServerPtr::OpCode::WriteRegion: {
+    auto region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+    auto tier = enter_region(region_idx);
+    auto guard = helpers::finally([&]() { exit_region(region_idx); });
+    get_device(tier)->compute(ds_id, opcode, input_len, input_buf, output_len,
+                              output_buf);
+    break;
+  }
+  case ServerPtr::OpCode::MoveObjects:
+    compute_move_objects(input_len, input_buf);
+    break;
+  case ServerPtr::OpCode::ResetRegion:
+    compute_reset_region(input_len, input_buf);
+    break;
+  default:
+    BUG();
+  }
+}
+
+// The raw region image is copied instead of its listed objects: the region
+// walker stops at the never-written objects and skips the ones without a
+// back-ref, both of which still have to be carried over. The all-zero chunks
+// are skipped since the destination region has just been reset.
+void TieredDevice::migrate_region(uint32_t region_idx, uint8_t to_tier) {
+  lock_region(region_idx);
+  auto guard = helpers::finally([&]() { unlock_region(region_idx); });
+  auto &state = region_states_[region_idx];
+  if (state.tier == to_tier) {
+    return;
+  }
+  auto *from_device = get_device(state.tier);
+  auto *to_device = get_device(to_tier);
+  uint16_t output_len;
+  to_device->compute(kVanillaPtrDSID, ServerPtr::OpCode::ResetRegion,
+                     sizeof(region_idx),
+                     reinterpret_cast<uint8_t *>(&region_idx), &output_len,
+                     nullptr);
+
+  constexpr uint32_t kHeaderSize = ServerPtr::kRegionChunkHeaderSize;
+  constexpr uint32_t kChunkSize = ServerPtr::kRegionChunkSize;
+  static_assert(Region::kSize % kChunkSize == 0);
+  std::unique_ptr<uint64_t[]> buf(
+      new uint64_t[(kHeaderSize + kChunkSize) / sizeof(uint64_t)]);
+  auto *input = reinterpret_cast<uint8_t *>(buf.get());
+  auto *chunk = buf.get() + kHeaderSize / sizeof(uint64_t);
+  memcpy(input, &region_idx, sizeof(region_idx));
+  for (uint32_t offset = 0; offset < Region::kSize; offset += kChunkSize) {
+    memcpy(input + sizeof(region_idx), &offset, sizeof(offset));
+    from_device->compute(kVanillaPtrDSID, ServerPtr::OpCode::ReadRegion,
+                         kHeaderSize, input, &output_len,
+                         reinterpret_cast<uint8_t *>(chunk));
+    BUG_ON(output_len != kChunkSize);
+    if (std::all_of(chunk, chunk + kChunkSize / sizeof(uint64_t),
+                    [](uint64_t word) { return !word; })) {
+      continue;
+    }
+    to_device->compute(kVanillaPtrDSID, ServerPtr::OpCode::WriteRegion,
+                       kHeaderSize + kChunkSize, input, &output_len, nullptr);
+  }
+
+  from_device->compute(kVanillaPtrDSID, ServerPtr::OpCode::ResetRegion,
+                       sizeof(region_idx),
+                       reinterpret_cast<uint8_t *>(&region_idx), &output_len,
+                       nullptr);
+  state.tier = to_tier;
+  state.num_reads = 0;
+  state.num_cold_epochs = 0;
+}
+
+void TieredDevice::tiering_fn() {
+  uint32_t num_intervals = 0;
+  while (!load_acquire(&exit_)) {
+    timer_sleep(kTieringIntervalUs);
+    bool new_epoch = (++num_intervals % kNumIntervalsPerEpoch == 0);
+    uint32_t num_demotions = 0;
+    for (uint32_t i = 0; i < num_regions_; i++) {
+      auto &state = region_states_[i];
+      auto num_reads = state.num_reads.load(std::memory_order_relaxed);
+      if (ACCESS_ONCE(state.tier) == kSlowTier) {
+        if (num_reads >= kNumReadsToPromote) {
+          migrate_region(i, kFastTier);
+        }
+      } else if (new_epoch && ACCESS_ONCE(state.written)) {
+        state.num_cold_epochs = num_reads ? 0 : state.num_cold_epochs + 1;
+        if (state.num_cold_epochs >= kNumColdEpochsToDemote &&
+            num_demotions < kMaxNumDemotionsPerEpoch) {
+          migrate_region(i, kSlowTier);
+          num_demotions++;
+        }
+      }
+      if (new_epoch) {
+        state.num_reads.store(num_reads / 2, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+uint32_t TieredDevice::get_num_slow_regions() {
+  uint32_t num_slow_regions = 0;
+  for (uint32_t i = 0; i < num_regions_; i++) {
+    num_slow_regions += (ACCESS_ONCE(region_states_[i].tier) == kSlowTier);
+  }
+  return num_slow_regions;
+}
+
+CompressingDevice::CompressingDevice(FarMemDevice *device)
+    : FarMemDevice(device->get_far_mem_size(),
+                   device->get_prefetch_win_size()),
+      device_(device) {
+  memset(compressed_ds_ids_, 0, sizeof(compressed_ds_ids_));
+  memset(num_misses_, 0, sizeof(num_misses_));
+}
+
+CompressingDevice::~CompressingDevice() {}
+
+bool CompressingDevice::is_compressible_ds_type(uint8_t ds_type) {
+  return ds_type == kHashTableDSType;
+}
+
+bool CompressingDevice::should_try_compress(uint8_t ds_id,
+                                            uint16_t data_len) {
+  if (data_len < kMinCompressDataLen) {
+    return false;
+  }
+  auto num_misses = ACCESS_ONCE(num_misses_[ds_id]);
+  if (num_misses < kMaxNumMisses) {
+    return true;
+  }
+  // Skip the object but keep counting so that the DS is probed periodically.
+  ACCESS_ONCE(num_misses_[ds_id]) = num_misses + 1;
+  return num_misses % kProbeInterval == 0;
+}
+
+uint16_t CompressingDevice::encode(uint8_t ds_id, uint16_t data_len,
+                                   const uint8_t *data_buf,
+                                   uint8_t *stored_buf) {
+  BUG_ON(data_len + kCodecSize > kMaxStoredDataLen);
+  if (should_try_compress(ds_id, data_len)) {
+    size_t compressed_len;
+    snappy::RawCompress(reinterpret_cast<const char *>(data_buf), data_len,
+                        reinterpret_cast<char *>(stored_buf + kCodecSize),
+                        &compressed_len);
+    if (compressed_len <= data_len - data_len / kMinSavingDenom) {
+      ACCESS_ONCE(num_misses_[ds_id]) = 0;
+      stored_buf[0] = kCodecSnappy;
+      Stats::inc_stored_bytes(ds_id, kCodecSize + compressed_len);
+      return kCodecSize + compressed_len;
+    }
+    auto num_misses = ACCESS_ONCE(num_misses_[ds_id]);
+    if (num_misses < kMaxNumMisses) {
+      ACCESS_ONCE(num_misses_[ds_id]) = num_misses + 1;
+    }
+  }
+  stored_buf[0] = kCodecRaw;
+  memcpy(stored_buf + kCodecSize, data_buf, data_len);
+  Stats::inc_stored_bytes(ds_id, kCodecSize + data_len);
+  return kCodecSize + data_len;
+}
+
+void CompressingDevice::decode(uint16_t stored_len, const uint8_t *stored_buf,
+                               uint16_t *data_len, uint8_t *data_buf) {
+  // A missing object is reported as empty.
+  if (!stored_len) {
+    *data_len = 0;
+    return;
+  }
+  auto *payload = stored_buf + kCodecSize;
+  auto payload_len = stored_len - kCodecSize;
+  switch (stored_buf[0]) {
+  case kCodecRaw:
+    memcpy(data_buf, payload, payload_len);
+    *data_len = payload_len;
+    break;
+  case kCodecSnappy: {
+    size_t uncompressed_len;
+    BUG_ON(!snappy::GetUncompressedLength(
+        reinterpret_cast<const char *>(payload), payload_len,
+        &uncompressed_len));
+    BUG_ON(!snappy::RawUncompress(reinterpret_cast<const char *>(payload),
+                                  payload_len,
+                                  reinterpret_cast<char *>(data_buf)));
+    *data_len = uncompressed_len;
+    break;
+  }
+  default:
+    BUG();
+  }
+}
+
+bool CompressingDevice::any_compressed(uint32_t num_objs,
+                                       const ObjectReadReq *reqs) const {
+  for (uint32_t i = 0; i < num_objs; i++) {
+    if (compressed_ds_ids_[reqs[i].ds_id]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CompressingDevice::any_compressed(uint32_t num_objs,
+                                       const ObjectWriteReq *reqs) const {
+  for (uint32_t i = 0; i < num_objs; i++) {
+    if (compressed_ds_ids_[reqs[i].ds_id]) {
+      return true;
+    }
   }
   return false;
 }
 
+void CompressingDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                    const uint8_t *obj_id, uint16_t *data_len,
+                                    uint8_t *data_buf) {
+  if (!compressed_ds_ids_[ds_id]) {
+    device_->read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  // The raw codec makes the stored object one byte larger than the caller's
+  // buffer, so it cannot be read in place. The staging buffer is pooled.
+  auto *stored_buf =
+      static_cast<uint8_t *>(rpc::BufferPool::Allocate(kMaxStoredDataLen));
+  auto guard = helpers::finally(
+      [&]() { rpc::BufferPool::Free(stored_buf, kMaxStoredDataLen); });
+  uint16_t stored_len = 0;
+  device_->read_object(ds_id, obj_id_len, obj_id, &stored_len, stored_buf);
+  decode(stored_len, stored_buf, data_len, data_buf);
+}
+
+void CompressingDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                     const uint8_t *obj_id, uint16_t data_len,
+                                     const uint8_t *data_buf) {
+  if (!compressed_ds_ids_[ds_id]) {
+    device_->write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  auto stored_buf_size = kCodecSize + snappy::MaxCompressedLength(data_len);
+  auto *stored_buf =
+      static_cast<uint8_t *>(rpc::BufferPool::Allocate(stored_buf_size));
+  auto guard = helpers::finally(
+      [&]() { rpc::BufferPool::Free(stored_buf, stored_buf_size); });
+  auto stored_len = encode(ds_id, data_len, data_buf, stored_buf);
+  device_->write_object(ds_id, obj_id_len, obj_id, stored_len, stored_buf);
+}
+
+void CompressingDevice::read_objects(uint32_t num_objs,
+                                     const ObjectReadReq *reqs) {
+  if (!any_compressed(num_objs, reqs)) {
+    device_->read_objects(num_objs, reqs);
+    return;
+  }
+  FarMemDevice::read_objects(num_objs, reqs);
+}
+
+void CompressingDevice::write_objects(uint32_t num_objs,
+                                      const ObjectWriteReq *reqs) {
+  if (!any_compressed(num_objs, reqs)) {
+    device_->write_objects(num_objs, reqs);
+    return;
+  }
+  FarMemDevice::write_objects(num_objs, reqs);
+}
+
+bool CompressingDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                      const uint8_t *obj_id) {
+  return device_->remove_object(ds_id, obj_id_len, obj_id);
+}
+
+void CompressingDevice::construct(uint8_t ds_type, uint8_t ds_id,
+                                  uint8_t param_len, uint8_t *params) {
+  device_->construct(ds_type, ds_id, param_len, params);
+  num_misses_[ds_id] = 0;
+  compressed_ds_ids_[ds_id] = is_compressible_ds_type(ds_type);
+}
+
+void CompressingDevice::destruct(uint8_t ds_id) {
+  compressed_ds_ids_[ds_id] = false;
+  device_->destruct(ds_id);
+}
+
+void CompressingDevice::compute(uint8_t ds_id, uint8_t opcode,
+                                uint16_t input_len, const uint8_t *input_buf,
+                                uint16_t *output_len, uint8_t *output_buf) {
+  device_->compute(ds_id, opcode, input_len, input_buf, output_len,
+                   output_buf);
+}
+
+rpc::RpcErrorCode CompressingDevice::call(uint8_t ds_id,
+                                          rpc::MethodID method_id,
+                                          const rpc::BufferPtr &args,
+                                          rpc::BufferPtr &ret) {
+  return device_->call(ds_id, method_id, args, ret);
+}
+
+rpc::RpcErrorCode
+CompressingDevice::call_stream(uint8_t ds_id, rpc::MethodID method_id,
+                const rpc::BufferPtr &args,
+                const rpc::StreamReader::ChunkFn &chunk_fn) {
+  return device_->call_stream(ds_id, method_id, args, chunk_fn);
+}
+
 } // namespace far_memory
@@ -0,0 +1,56 @@
+#include "frequency_sketch.hpp"
+
+#include <algorithm>
+
+namespace far_memory {
+
+FrequencySketch::FrequencySketch(uint32_t num_counters_shift)
+    : kIdxMask_((1U << num_counters_shift) - 1),
+      kDoorkeeperMask_((1U << (num_counters_shift + kSampleFactorShift)) - 1),
+      kSampleSize_(1ULL << (num_counters_shift + kSampleFactorShift)),
+      kNumCounterWords_(
+          (static_cast<uint64_t>(kNumRows) << num_counters_shift) /
+          kCountersPerWord),
+      kNumDoorkeeperWords_((static_cast<uint64_t>(kDoorkeeperMask_) + 1) / 64),
+      num_samples_(0), aging_(false), next_aging_word_(0),
+      num_aged_words_(0) {
+  BUG_ON(num_counters_shift < 6 ||
+         num_counters_shift + kSampleFactorShift > 31);
+  counters_.reset(new uint64_t[kNumCounterWords_]());
+  doorkeeper_.reset(new uint64_t[kNumDoorkeeperWords_]());
+}
+
+void FrequencySketch::start_aging() {
+  // Only the access that fills the window gets here, and the previous pass
+  // has finished by then, since it took half of the samples away.
+  ACCESS_ONCE(num_aged_words_) = 0;
+  ACCESS_ONCE(next_aging_word_) = 0;
+  store_release(&aging_, true);
+}
+
+void FrequencySketch::age_slice() {
+  auto num_words = kNumCounterWords_ + kNumDoorkeeperWords_;
+  auto begin = __atomic_fetch_add(&next_aging_word_, kAgingSliceWords,
+                                  __ATOMIC_RELAXED);
+  if (begin >= num_words) {
+    return;
+  }
+  auto end = std::min(begin + kAgingSliceWords, num_words);
+  constexpr uint64_t kHalfMask = 0x7777777777777777ULL;
+  for (auto i = begin; i < end; i++) {
+    if (i < kNumCounterWords_) {
+      ACCESS_ONCE(counters_[i]) = (ACCESS_ONCE(counters_[i]) >> 1) & kHalfMask;
+    } else {
+      ACCESS_ONCE(doorkeeper_[i - kNumCounterWords_]) = 0;
+    }
+  }
+  if (__atomic_add_fetch(&num_aged_words_, end - begin, __ATOMIC_ACQ_REL) ==
+      num_words) {
+    // Keep half of the samples, as the counters do, along with the ones
+    // recorded during the pass.
+    store_release(&aging_, false);
+    __atomic_fetch_sub(&num_samples_, kSampleSize_ / 2, __ATOMIC_RELAXED);
+  }
+}
+
+} // namespace far_memory
@@ -0,0 +1,78 @@
+#include "latency_histogram.hpp"
+
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+namespace far_memory {
+
+LatencyHistogram::LatencyHistogram() { reset(); }
+
+uint64_t LatencyHistogram::bucket_max_ns(uint32_t idx) {
+  if (idx < (1 << kSubBucketBits)) {
+    return idx;
+  }
+  idx -= (1 << kSubBucketBits);
+  uint32_t shift = idx / kNumSubBuckets + 1;
+  uint64_t sub_bucket = idx % kNumSubBuckets + kNumSubBuckets;
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::reset() {
+  FOR_ALL_SOCKET0_CORES(core_id) {
+    memset(counts_[core_id], 0, sizeof(counts_[core_id]));
+  }
+}
+
+void LatencyHistogram::merge(uint64_t *counts) const {
+  memset(counts, 0, kNumBuckets * sizeof(uint64_t));
+  FOR_ALL_SOCKET0_CORES(core_id) {
+    for (uint32_t i = 0; i < kNumBuckets; i++) {
+      counts[i] += ACCESS_ONCE(counts_[core_id][i]);
+    }
+  }
+}
+
+LatencySummary LatencyHistogram::summary() const {
+  auto counts = std::make_unique<uint64_t[]>(kNumBuckets);
+  merge(counts.get());
+  LatencySummary summary{};
+  for (uint32_t i = 0; i < kNumBuckets; i++) {
+    summary.count += counts[i];
+  }
+  if (!summary.count) {
+    return summary;
+  }
+
+  // The rank of the p-th percentile, rounded up.
+  auto rank = [&](uint64_t parts_per_thousand) {
+    return (summary.count * parts_per_thousand + 999) / 1000;
+  };
+  std::pair<uint64_t, uint64_t *> targets[] = {{rank(500), &summary.p50_ns},
+                                               {rank(990), &summary.p99_ns},
+                                               {rank(999), &summary.p999_ns}};
+  uint64_t seen = 0;
+  uint32_t target_idx = 0;
+  for (uint32_t i = 0; i < kNumBuckets && target_idx < std::size(targets);
+       i++) {
+    seen += counts[i];
+    while (target_idx < std::size(targets) &&
+           seen >= targets[target_idx].first) {
+      *targets[target_idx++].second = bucket_max_ns(i);
+    }
+  }
+  return summary;
+}
+
+void LatencyHistogram::dump(std::ostream &os) const {
+  auto counts = std::make_unique<uint64_t[]>(kNumBuckets);
+  merge(counts.get());
+  for (uint32_t i = 0; i < kNumBuckets; i++) {
+    if (counts[i]) {
+      os << bucket_max_ns(i) << " " << counts[i] << std::endl;
+    }
+  }
+}
+
+} // namespace far_memory
@@ -6,24 +6,34 @@
 
 namespace far_memory {
 
-LocalGenericConcurrentHopscotch::LocalGenericConcurrentHopscotch(
-    uint32_t num_entries_shift, uint64_t data_size)
-    : kHashMask_((1 << num_entries_shift) - 1),
-      kNumEntries_((1 << num_entries_shift) + kNeighborhood),
-      slab_base_addr_(
-          reinterpret_cast<uint64_t>(helpers::allocate_hugepage(data_size))),
-      slab_(reinterpret_cast<uint8_t *>(slab_base_addr_), data_size) {
+LocalGenericConcurrentHopscotch::Table::Table(uint32_t num_entries_shift)
+    : kHashMask((1 << num_entries_shift) - 1),
+      kNumEntries((1 << num_entries_shift) + kNeighborhood), next(nullptr),
+      num_migrated(0) {
   // Check overflow.
-  BUG_ON(((kHashMask_ + 1) >> num_entries_shift) != 1);
+  BUG_ON(((kHashMask + 1) >> num_entries_shift) != 1);
 
   // Allocate memory for buckets.
-  auto size = kNumEntries_ * sizeof(BucketEntry);
-  buckets_mem_.reset(
+  auto size = kNumEntries * sizeof(BucketEntry);
+  buckets_mem.reset(
       reinterpret_cast<uint8_t *>(helpers::allocate_hugepage(size)));
-  buckets_ = new (buckets_mem_.get()) BucketEntry[kNumEntries_];
+  buckets = new (buckets_mem.get()) BucketEntry[kNumEntries];
 }
 
-LocalGenericConcurrentHopscotch::~LocalGenericConcurrentHopscotch() {}
+LocalGenericConcurrentHopscotch::LocalGenericConcurrentHopscotch(
+    uint32_t num_entries_shift, uint64_t data_size)
+    : table_(new Table(num_entries_shift)),
+      slab_base_addr_(
+          reinterpret_cast<uint64_t>(helpers::allocate_hugepage(data_size))),
+      slab_(reinterpret_cast<uint8_t *>(slab_base_addr_), data_size),
+      resizing_(false) {}
+
+LocalGenericConcurrentHopscotch::~LocalGenericConcurrentHopscotch() {
+  if (resizing_) {
+    resizer_.Join();
+  }
+  delete table_;
+}
 
 void LocalGenericConcurrentHopscotch::do_remove(BucketEntry *bucket,
                                                 BucketEntry *entry) {
@@ -40,11 +50,17 @@ void LocalGenericConcurrentHopscotch::get(uint8_t key_len, const uint8_t *key,
                                           uint16_t *val_len, uint8_t *val,
                                           bool remove) {
   uint32_t hash = hash_32(static_cast<const void *>(key), key_len);
-  uint32_t bucket_idx = hash & kHashMask_;
-  auto *bucket = buckets_ + bucket_idx;
+  rcu_lock_.reader_lock();
+  auto rcu_guard = helpers::finally([&]() { rcu_lock_.reader_unlock(); });
+
+relocate:
+  auto *table = locate(hash);
+  uint32_t bucket_idx = hash & table->kHashMask;
+  auto *bucket = table->buckets + bucket_idx;
   decltype(bucket) entry;
   uint64_t timestamp;
   uint32_t retry_counter = 0;
+  bool migrated = false;
 
   auto get_once = [&]<bool Lock>() -> bool {
     if constexpr (Lock) {
@@ -57,11 +73,17 @@ void LocalGenericConcurrentHopscotch::get(uint8_t key_len, const uint8_t *key,
         bucket->spin.UnlockWp();
       }
     });
+    if constexpr (Lock) {
+      if (unlikely(bucket_idx < load_acquire(&table->num_migrated))) {
+        migrated = true;
+        return false;
+      }
+    }
     timestamp = load_acquire(&(bucket->timestamp));
     uint32_t bitmap = bucket->bitmap;
     while (bitmap) {
       auto offset = helpers::bsf_32(bitmap);
-      entry = &buckets_[bucket_idx + offset];
+      entry = &(table->buckets[bucket_idx + offset]);
       auto *header = entry->ptr;
       auto *slab_val_ptr =
           reinterpret_cast<const char *>(header) + sizeof(KVDataHeader);
@@ -92,14 +114,19 @@ void LocalGenericConcurrentHopscotch::get(uint8_t key_len, const uint8_t *key,
   } while (timestamp != ACCESS_ONCE(bucket->timestamp) &&
            retry_counter++ < kMaxRetries);
 
-  // Slow path.
-  if (timestamp != ACCESS_ONCE(bucket->timestamp)) {
+  // Slow path. While the table is being migrated, a miss is only trusted
+  // with the bucket lock held, since the key may be moving to the next table.
+  if (timestamp != ACCESS_ONCE(bucket->timestamp) ||
+      unlikely(load_acquire(&table->next))) {
     if (get_once.template operator()<true>()) {
       if (remove) {
         goto remove;
       }
       return;
     }
+    if (unlikely(migrated)) {
+      goto relocate;
+    }
   }
   *val_len = 0;
   return;
@@ -107,65 +134,27 @@ void LocalGenericConcurrentHopscotch::get(uint8_t key_len, const uint8_t *key,
 remove:
   bucket->spin.Lock();
   auto spin_guard = helpers::finally([&]() { bucket->spin.Unlock(); });
-  if (likely(entry->ptr)) {
-    if (likely(timestamp == ACCESS_ONCE(bucket->timestamp))) {
-      // Fast path.
+  if (likely(timestamp == ACCESS_ONCE(bucket->timestamp))) {
+    // Fast path.
+    if (likely(entry->ptr)) {
       do_remove(bucket, entry);
-    } else {
-      // Slow path.
-      spin_guard.reset();
-      this->remove(key_len, key);
     }
+  } else {
+    // Slow path. The entry may also have been migrated.
+    spin_guard.reset();
+    rcu_guard.reset();
+    this->remove(key_len, key);
   }
 }
 
-bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
-                                          uint16_t val_len,
-                                          const uint8_t *val) {
-  uint32_t hash = hash_32(static_cast<const void *>(key), key_len);
-  uint32_t bucket_idx = hash & kHashMask_;
-  auto *bucket = &(buckets_[bucket_idx]);
-  auto orig_bucket_idx = bucket_idx;
-
-  while (unlikely(!bucket->spin.TryLockWp())) {
-    thread_yield();
-  }
-  auto bucket_lock_guard = helpers::finally([&]() { bucket->spin.UnlockWp(); });
-
-  uint32_t bitmap = load_acquire(&(bucket->bitmap));
-  while (bitmap) {
-    auto offset = helpers::bsf_32(bitmap);
-    auto *bucket = &buckets_[bucket_idx];
-    auto *entry = bucket + offset;
-    auto *header = entry->ptr;
-    if (header->key_len == key_len) {
-      auto *slab_val_ptr =
-          reinterpret_cast<char *>(header) + sizeof(KVDataHeader);
-      if (strncmp(slab_val_ptr + header->val_len,
-                  reinterpret_cast<const char *>(key), key_len) == 0) {
-        if (unlikely(header->val_len != val_len)) {
-          auto old_data_size = sizeof(KVDataHeader) + key_len + header->val_len;
-          slab_.free(reinterpret_cast<uint8_t *>(header), old_data_size);
-          auto new_data_size = sizeof(KVDataHeader) + key_len + val_len;
-          auto *new_header =
-              reinterpret_cast<KVDataHeader *>(slab_.allocate(new_data_size));
-          BUG_ON(!new_header);
-          entry->ptr = new_header;
-          *new_header = {.key_len = key_len, .val_len = val_len};
-          slab_val_ptr =
-              reinterpret_cast<char *>(new_header) + sizeof(KVDataHeader);
-          memcpy(slab_val_ptr + val_len, key, key_len);
-        }
-        memcpy(slab_val_ptr, val, val_len);
-        return true;
-      }
-    }
-    bitmap ^= (1 << offset);
-  }
+uint32_t LocalGenericConcurrentHopscotch::reserve_entry(Table *table,
+                                                       uint32_t anchor_idx) {
+  auto *buckets = table->buckets;
+  auto bucket_idx = anchor_idx;
 
-  // The key does not exist. Use linear probing to find the first empty slot.
-  while (bucket_idx < kNumEntries_) {
-    auto *entry = &buckets_[bucket_idx];
+  // Use linear probing to find the first empty slot.
+  while (bucket_idx < table->kNumEntries) {
+    auto *entry = &buckets[bucket_idx];
     if (__sync_bool_compare_and_swap(reinterpret_cast<uint64_t *>(&entry->ptr),
                                      0, BucketEntry::kBusyPtr)) {
       break;
@@ -173,21 +162,17 @@ bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
     bucket_idx++;
   }
 
-  if (very_unlikely(bucket_idx == kNumEntries_)) {
-    // The bucket is full and we need to resize the hash table.
-    // For now, we just throw out an error.
-    BUG();
+  if (very_unlikely(bucket_idx == table->kNumEntries)) {
+    return table->kNumEntries;
   }
 
-  uint32_t distance_to_orig_bucket;
   // Now keep moving the empty slot until it becomes neighbors.
-  while ((distance_to_orig_bucket = bucket_idx - orig_bucket_idx) >=
-         kNeighborhood) {
+  while (bucket_idx - anchor_idx >= kNeighborhood) {
     // Try to see if we can move things backward.
     uint32_t distance;
     for (distance = kNeighborhood - 1; distance > 0; distance--) {
       auto idx = bucket_idx - distance;
-      auto *anchor_entry = &(buckets_[idx]);
+      auto *anchor_entry = &(buckets[idx]);
       if (!anchor_entry->bitmap) {
         continue;
       }
@@ -210,8 +195,8 @@ bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
       }
 
       // Swap entry [closest_bucket + offset] and [bucket_idx]
-      auto *from_entry = &buckets_[idx + offset];
-      auto *to_entry = &buckets_[bucket_idx];
+      auto *from_entry = &buckets[idx + offset];
+      auto *to_entry = &buckets[bucket_idx];
 
       to_entry->ptr = from_entry->ptr;
       assert((anchor_entry->bitmap & (1 << distance)) == 0);
@@ -229,15 +214,76 @@ bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
       break;
     }
 
-    // The bucket is full and we need to resize the hash table.
-    // For now, we just throw out an error.
     if (very_unlikely(!distance)) {
-      BUG();
+      buckets[bucket_idx].ptr = nullptr;
+      return table->kNumEntries;
     }
   }
 
+  return bucket_idx;
+}
+
+bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
+                                          uint16_t val_len,
+                                          const uint8_t *val) {
+  uint32_t hash = hash_32(static_cast<const void *>(key), key_len);
+  rcu_lock_.reader_lock();
+  auto rcu_guard = helpers::finally([&]() { rcu_lock_.reader_unlock(); });
+
+retry:
+  BucketEntry *bucket;
+  auto *table = lock_anchor(hash, &bucket);
+  auto *buckets = table->buckets;
+  uint32_t bucket_idx = bucket - buckets;
+  auto bucket_lock_guard = helpers::finally([&]() { bucket->spin.UnlockWp(); });
+
+  uint32_t bitmap = load_acquire(&(bucket->bitmap));
+  while (bitmap) {
+    auto offset = helpers::bsf_32(bitmap);
+    auto *bucket = &buckets[bucket_idx];
+    auto *entry = bucket + offset;
+    auto *header = entry->ptr;
+    if (header->key_len == key_len) {
+      auto *slab_val_ptr =
+          reinterpret_cast<char *>(header) + sizeof(KVDataHeader);
+      if (strncmp(slab_val_ptr + header->val_len,
+                  reinterpret_cast<const char *>(key), key_len) == 0) {
+        if (unlikely(header->val_len != val_len)) {
+          auto old_data_size = sizeof(KVDataHeader) + key_len + header->val_len;
+          slab_.free(reinterpret_cast<uint8_t *>(header), old_data_size);
+          auto new_data_size = sizeof(KVDataHeader) + key_len + val_len;
+          auto *new_header =
+              reinterpret_cast<KVDataHeader *>(slab_.allocate(new_data_size));
+          BUG_ON(!new_header);
+          entry->ptr = new_header;
+          *new_header = {.key_len = key_len, .val_len = val_len};
+          slab_val_ptr =
+              reinterpret_cast<char *>(new_header) + sizeof(KVDataHeader);
+          memcpy(slab_val_ptr + val_len, key, key_len);
+        }
+        memcpy(slab_val_ptr, val, val_len);
+        return true;
+      }
+    }
+    bitmap ^= (1 << offset);
+  }
+
+  // The key does not exist. Reserve an empty slot within the neighborhood.
+  auto final_bucket_idx = reserve_entry(table, bucket_idx);
+  if (very_unlikely(final_bucket_idx == table->kNumEntries)) {
+    // The neighborhood is full, so grow the hash table and retry. The
+    // migration waits for the RCU readers, so leave the read side meanwhile.
+    auto hash_mask = table->kHashMask;
+    bucket_lock_guard.reset();
+    rcu_lock_.reader_unlock();
+    grow(hash_mask);
+    rcu_lock_.reader_lock();
+    goto retry;
+  }
+  uint32_t distance_to_orig_bucket = final_bucket_idx - bucket_idx;
+
   // Allocate memory.
-  auto *final_entry = &buckets_[bucket_idx];
+  auto *final_entry = &buckets[final_bucket_idx];
   auto *header = reinterpret_cast<KVDataHeader *>(
       slab_.allocate(sizeof(KVDataHeader) + key_len + val_len));
   BUG_ON(!header);
@@ -259,18 +305,18 @@ bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
 bool LocalGenericConcurrentHopscotch::remove(uint8_t key_len,
                                              const uint8_t *key) {
   uint32_t hash = hash_32(static_cast<const void *>(key), key_len);
-  uint32_t bucket_idx = hash & kHashMask_;
-  auto *bucket = &(buckets_[bucket_idx]);
+  rcu_lock_.reader_lock();
+  auto rcu_guard = helpers::finally([&]() { rcu_lock_.reader_unlock(); });
 
-  while (unlikely(!bucket->spin.TryLockWp())) {
-    thread_yield();
-  }
+  BucketEntry *bucket;
+  auto *table = lock_anchor(hash, &bucket);
+  uint32_t bucket_idx = bucket - table->buckets;
   auto spin_guard = helpers::finally([&]() { bucket->spin.UnlockWp(); });
 
   uint32_t bitmap = load_acquire(&(bucket->bitmap));
   while (bitmap) {
     auto offset = helpers::bsf_32(bitmap);
-    auto *entry = &buckets_[bucket_idx + offset];
+    auto *entry = &(table->buckets[bucket_idx + offset]);
     auto *header = entry->ptr;
     if (header->key_len == key_len) {
       auto *slab_val_ptr =
@@ -286,4 +332,138 @@ bool LocalGenericConcurrentHopscotch::remove(uint8_t key_len,
   return false;
 }
 
+void LocalGenericConcurrentHopscotch::grow(uint32_t hash_mask) {
+  resize_mutex_.Lock();
+  auto guard = helpers::finally([&]() { resize_mutex_.Unlock(); });
+
+  // Wait for the ongoing migration, after which the caller may fit in.
+  if (resizing_) {
+    resizer_.Join();
+    resizing_ = false;
+  }
+  auto *table = table_;
+  if (table->kHashMask != hash_mask) {
+    return;
+  }
+
+  auto num_entries_shift = helpers::bsr_32(hash_mask + 1) + 1;
+  BUG_ON(num_entries_shift >= sizeof(hash_mask) * 8);
+  store_release(&table->next, new Table(num_entries_shift));
+  resizing_ = true;
+  resizer_ = rt::Thread([&, table]() { migrate(table); });
+}
+
+void LocalGenericConcurrentHopscotch::migrate(Table *from) {
+  for (uint32_t i = 0; i <= from->kHashMask; i++) {
+    migrate_bucket(from, i);
+  }
+  auto *to = from->next;
+  while (to->next) {
+    to = to->next;
+  }
+  store_release(&table_, to);
+  // Free the old tables once no operation can be walking them.
+  rcu_lock_.writer_sync();
+  while (from != to) {
+    auto *next = from->next;
+    delete from;
+    from = next;
+  }
+}
+
+void LocalGenericConcurrentHopscotch::extend(Table *table) {
+  auto num_entries_shift = helpers::bsr_32(table->kHashMask + 1) + 1;
+  BUG_ON(num_entries_shift >= sizeof(table->kHashMask) * 8);
+  store_release(&table->next, new Table(num_entries_shift));
+  for (uint32_t i = 0; i <= table->kHashMask; i++) {
+    migrate_bucket(table, i);
+  }
+}
+
+void LocalGenericConcurrentHopscotch::migrate_bucket(Table *from,
+                                                     uint32_t bucket_idx) {
+  auto *bucket = &(from->buckets[bucket_idx]);
+
+retry:
+  auto *to = from->next;
+  while (to->next) {
+    to = to->next;
+  }
+  bool migrated;
+  {
+    while (unlikely(!bucket->spin.TryLockWp())) {
+      thread_yield();
+    }
+    auto bucket_lock_guard =
+        helpers::finally([&]() { bucket->spin.UnlockWp(); });
+    bucket->timestamp++;
+    migrated = migrate_entries(bucket, to);
+    if (likely(migrated)) {
+      store_release(&from->num_migrated, bucket_idx + 1);
+    }
+  }
+  if (unlikely(!migrated)) {
+    extend(to);
+    goto retry;
+  }
+}
+
+// Same as GenericConcurrentHopscotch::migrate_entries(), all the entries of
+// the locked anchor bucket are moved or none of them is.
+bool LocalGenericConcurrentHopscotch::migrate_entries(BucketEntry *bucket,
+                                                      Table *to) {
+  struct Move {
+    uint32_t offset;
+    BucketEntry *to_bucket;
+    BucketEntry *to_entry;
+  };
+  Move moves[kNeighborhood];
+  uint32_t num_moves = 0;
+
+  uint32_t bitmap = load_acquire(&(bucket->bitmap));
+  while (bitmap) {
+    auto offset = helpers::bsf_32(bitmap);
+    auto *header = (bucket + offset)->ptr;
+    auto *slab_val_ptr =
+        reinterpret_cast<const char *>(header) + sizeof(KVDataHeader);
+    uint32_t hash =
+        hash_32(static_cast<const void *>(slab_val_ptr + header->val_len),
+                header->key_len);
+    uint32_t to_bucket_idx = hash & to->kHashMask;
+    auto *to_bucket = &(to->buckets[to_bucket_idx]);
+    while (unlikely(!to_bucket->spin.TryLockWp())) {
+      thread_yield();
+    }
+    auto to_entry_idx = reserve_entry(to, to_bucket_idx);
+    to_bucket->spin.UnlockWp();
+    if (unlikely(to_entry_idx == to->kNumEntries)) {
+      for (uint32_t i = 0; i < num_moves; i++) {
+        moves[i].to_entry->ptr = nullptr;
+      }
+      return false;
+    }
+    // A reserved slot is out of every bitmap, so it stays in place.
+    moves[num_moves++] = {.offset = offset,
+                          .to_bucket = to_bucket,
+                          .to_entry = &(to->buckets[to_entry_idx])};
+    bitmap ^= (1 << offset);
+  }
+
+  for (uint32_t i = 0; i < num_moves; i++) {
+    auto &move = moves[i];
+    auto *entry = bucket + move.offset;
+    while (unlikely(!move.to_bucket->spin.TryLockWp())) {
+      thread_yield();
+    }
+    move.to_entry->ptr = entry->ptr;
+    wmb();
+    move.to_bucket->bitmap |= (1 << (move.to_entry - move.to_bucket));
+    move.to_bucket->spin.UnlockWp();
+    entry->ptr = nullptr;
+    assert(bucket->bitmap & (1 << move.offset));
+    bucket->bitmap ^= (1 << move.offset);
+  }
+  return true;
+}
+
 } // namespace far_memory
@@ -49,14 +49,15 @@ void GCParallelizer::master_fn() {
 }
 
 FarMemManager::FarMemManager(uint64_t cache_size, uint64_t far_mem_size,
-                             uint32_t num_gc_threads, FarMemDevice *device)
+                             uint32_t num_gc_threads, FarMemDevice *device,
+                             VictimRegionPolicy *victim_policy)
     : cache_region_manager_(cache_size, true),
       far_mem_region_manager_(far_mem_size, false), device_ptr_(device),
       parallel_marker_(num_gc_threads, kGCSlaveThreadTaskQueueDepth,
                        &from_regions_),
       parallel_write_backer_(num_gc_threads, kGCSlaveThreadTaskQueueDepth,
                              &from_regions_),
-      num_gc_threads_(num_gc_threads) {
+      victim_policy_(victim_policy), num_gc_threads_(num_gc_threads) {
 
   BUG_ON(far_mem_size >= (1ULL << FarMemPtrMeta::kObjectIDBitSize));
 
@@ -65,6 +66,15 @@ FarMemManager::FarMemManager(uint64_t cache_size, uint64_t far_mem_size,
     LOG_PRINTF("%s\n", "Warn: fail to open /dev/ksched.");
   }
   memset(evac_notifiers_, 0, sizeof(evac_notifiers_));
+  for (uint32_t ds_id = 0; ds_id < kMaxNumDSIDs; ds_id++) {
+    ds_quotas_[ds_id] = DSQuota{
+        .soft_limit = std::numeric_limits<uint64_t>::max(),
+        .hard_limit = std::numeric_limits<uint64_t>::max(),
+        .eviction_weight = 1};
+    ds_local_bytes_[ds_id].data = 0;
+  }
+  // Reserve the region for the objects relocated by the far-mem GC.
+  BUG_ON(!far_mem_region_manager_.pop_free_region(&far_mem_gc_region_));
 
   for (uint8_t ds_id =
            std::numeric_limits<decltype(available_ds_ids_)::value_type>::min();
@@ -92,11 +102,12 @@ bool FarMemManager::allocate_generic_unique_ptr_nb(
       Object::kHeaderSize + item_size +
       (optional_id_len ? *optional_id_len : kVanillaPtrObjectIDSize);
   auto optional_local_object_addr =
-      allocate_local_object_nb(false, object_size);
+      allocate_local_object_nb(is_over_soft_quota(ds_id), object_size);
   if (!optional_local_object_addr) {
     return false;
   }
   auto local_object_addr = *optional_local_object_addr;
+  inc_ds_local_bytes(ds_id, object_size);
   ptr->init(local_object_addr);
   if (!optional_id_len) {
     auto remote_object_addr = allocate_remote_object(false, object_size);
@@ -118,7 +129,9 @@ GenericUniquePtr FarMemManager::allocate_generic_unique_ptr(
   auto object_size =
       Object::kHeaderSize + item_size +
       (optional_id_len ? *optional_id_len : kVanillaPtrObjectIDSize);
-  auto local_object_addr = allocate_local_object(false, object_size);
+  auto local_object_addr =
+      allocate_local_object(is_over_soft_quota(ds_id), object_size);
+  inc_ds_local_bytes(ds_id, object_size);
   auto ptr = GenericUniquePtr(local_object_addr);
   if (!optional_id_len) {
     auto remote_object_addr = allocate_remote_object(false, object_size);
@@ -136,10 +149,49 @@ GenericUniquePtr FarMemManager::allocate_generic_unique_ptr(
 void FarMemManager::RegionManager::push_free_region(Region &region) {
   region_spin_.Lock();
   region.reset();
-  BUG_ON(!free_regions_.push_back(region));
+  // A region always goes back to the pool of its home node.
+  BUG_ON(!free_regions_[get_region_node(region.get_idx())].push_back(region));
+  region_spin_.Unlock();
+}
+
+bool FarMemManager::RegionManager::pop_free_region_locked(uint32_t node,
+                                                          Region *region) {
+  for (uint32_t i = 0; i < num_nodes_; i++) {
+    if (free_regions_[(node + i) % num_nodes_].pop_front(region)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool FarMemManager::RegionManager::pop_free_region(Region *region) {
+  region_spin_.Lock();
+  auto success = pop_free_region_locked(get_core_node(), region);
+  region_spin_.Unlock();
+  return success;
+}
+
+void FarMemManager::RegionManager::reclaim_region(uint32_t region_idx) {
+  assert(!local_cache_ptr_);
+  region_spin_.Lock();
+  __atomic_store_n(&live_bytes_[region_idx], 0, __ATOMIC_RELEASE);
+  BUG_ON(!free_regions_[get_region_node(region_idx)].push_back(
+      Region(region_idx, /* is_local = */ false, /* nt = */ false, nullptr)));
+  region_spin_.Unlock();
+}
+
+void FarMemManager::RegionManager::push_front_used_region(Region &region) {
+  region_spin_.Lock();
+  BUG_ON(!(region.is_nt() ? nt_used_regions_.push_front(region)
+                          : used_regions_.push_front(region)));
   region_spin_.Unlock();
 }
 
+uint64_t
+FarMemManager::RegionManager::get_used_since_us(const Region &region) const {
+  return ACCESS_ONCE(used_since_us_[region.get_idx()]);
+}
+
 std::optional<Region> FarMemManager::RegionManager::pop_used_region() {
   Region region;
   region_spin_.Lock();
@@ -179,7 +231,13 @@ bool FarMemManager::RegionManager::try_refill_core_local_free_region(
 
   bool success = true;
   if (full_region) {
-    if (!full_region->is_invalid()) {
+    if (!full_region->is_invalid() && !full_region->is_local()) {
+      // Remote regions are tracked by their live bytes instead of the used
+      // list; the far-mem GC picks them up once they are sealed.
+      seal_region(*full_region);
+      full_region->invalidate();
+    } else if (!full_region->is_invalid()) {
+      used_since_us_[full_region->get_idx()] = microtime();
       success =
           (full_region->is_local() &&
            full_region
@@ -192,7 +250,7 @@ bool FarMemManager::RegionManager::try_refill_core_local_free_region(
   }
   auto &core_local_region = core_local_free_region(nt);
   if (core_local_region.is_invalid()) {
-    success = free_regions_.pop_front(&core_local_region);
+    success = pop_free_region_locked(get_core_node(), &core_local_region);
     if (nt) {
       core_local_region.set_nt();
     }
@@ -204,7 +262,8 @@ bool FarMemManager::RegionManager::try_refill_core_local_free_region(
 FarMemManager *
 FarMemManagerFactory::build(uint64_t cache_size,
                             std::optional<uint32_t> optional_num_gc_threads,
-                            FarMemDevice *device) {
+                            FarMemDevice *device,
+                            VictimRegionPolicy *victim_policy) {
   if (unlikely(ptr_)) {
     return nullptr;
   }
@@ -214,8 +273,11 @@ FarMemManagerFactory::build(uint64_t cache_size,
   if (unlikely(!num_gc_threads)) {
     return nullptr;
   }
+  if (!victim_policy) {
+    victim_policy = new CostBenefitVictimPolicy();
+  }
   ptr_ = new FarMemManager(cache_size, device->get_far_mem_size(),
-                           num_gc_threads, device);
+                           num_gc_threads, device, victim_policy);
   return ptr_;
 }
 
@@ -225,30 +287,84 @@ FarMemManager::RegionManager::RegionManager(uint64_t size, bool is_local) {
     LOG_PRINTF("%s\n", "Error: two few available regions.");
     exit(-ENOSPC);
   }
-  free_regions_ = std::move(CircularBuffer<Region, false>(free_regions_count));
-  used_regions_ = std::move(CircularBuffer<Region, false>(free_regions_count));
-  nt_used_regions_ =
-      std::move(CircularBuffer<Region, false>(free_regions_count));
+  num_regions_ = free_regions_count;
+  // get_core_num() returns the CPU a kthread runs on, so every configured CPU
+  // is mapped.
+  num_cpus_ = std::max(helpers::get_num_configured_cpus(),
+                       static_cast<uint32_t>(helpers::kNumCPUs));
+  core_nodes_.reset(new uint8_t[num_cpus_]());
+  if (is_local) {
+    num_nodes_ = 0;
+    for (uint32_t core_id = 0; core_id < num_cpus_; core_id++) {
+      auto node_id = helpers::get_numa_node_of_core(core_id);
+      uint32_t node = 0;
+      while (node < num_nodes_ && node_ids_[node] != node_id) {
+        node++;
+      }
+      if (node == num_nodes_) {
+        if (core_id < helpers::kNumCPUs &&
+            num_nodes_ < helpers::kMaxNumNUMANodes) {
+          node_ids_[num_nodes_++] = node_id;
+        } else {
+          // Folds the extra nodes into the existing slices.
+          node = node_id % num_nodes_;
+        }
+      }
+      core_nodes_[core_id] = node;
+    }
+  }
+  // Every slice but the last one is hugepage-aligned so that it can be bound.
+  constexpr uint32_t kNumRegionsPerHugepage =
+      helpers::kHugepageSize / Region::kSize;
+  num_regions_per_node_ = num_regions_ / num_nodes_ / kNumRegionsPerHugepage *
+                          kNumRegionsPerHugepage;
+  if (unlikely(!num_regions_per_node_)) {
+    num_nodes_ = 1;
+    memset(core_nodes_.get(), 0, num_cpus_);
+    num_regions_per_node_ = num_regions_;
+  }
+  for (uint32_t node = 0; node < num_nodes_; node++) {
+    free_regions_[node] =
+        std::move(CircularBuffer<Region, false>(num_regions_));
+  }
+  used_regions_ = std::move(CircularBuffer<Region, false>(num_regions_));
+  nt_used_regions_ = std::move(CircularBuffer<Region, false>(num_regions_));
   if (is_local) {
     local_cache_ptr_.reset(reinterpret_cast<uint8_t *>(
-        helpers::allocate_hugepage(free_regions_count * Region::kSize)));
+        helpers::allocate_hugepage(num_regions_ * Region::kSize)));
+    if (num_nodes_ > 1) {
+      for (uint32_t node = 0; node < num_nodes_; node++) {
+        auto first_idx = node * num_regions_per_node_;
+        auto num_node_regions = (node == num_nodes_ - 1)
+                                    ? num_regions_ - first_idx
+                                    : num_regions_per_node_;
+        helpers::bind_to_numa_node(
+            local_cache_ptr_.get() + first_idx * Region::kSize,
+            helpers::round_to_hugepage_size(num_node_regions * Region::kSize),
+            node_ids_[node]);
+      }
+    }
+    used_since_us_.reset(new uint64_t[num_regions_]());
+  } else {
+    live_bytes_.reset(new uint32_t[num_regions_]());
   }
-  free_regions_count -= 2 * helpers::kNumSocket1CPUs;
 
-  uint32_t idx = 0;
-  auto new_region_fn = [&](bool nt) {
+  for (uint32_t idx = 0; idx < num_regions_; idx++) {
     auto buf_ptr =
         is_local ? (local_cache_ptr_.get() + idx * Region::kSize) : nullptr;
-    return Region(idx++, is_local, nt, buf_ptr);
-  };
-
-  FOR_ALL_SOCKET0_CORES(core_id) {
-    core_local_free_regions_[core_id] = new_region_fn(false);
-    core_local_free_nt_regions_[core_id] = new_region_fn(true);
+    BUG_ON(!free_regions_[get_region_node(idx)].push_back(
+        Region(idx, is_local, /* nt = */ false, buf_ptr)));
   }
 
-  for (uint64_t i = 0; i < free_regions_count; i++) {
-    BUG_ON(!free_regions_.push_back(new_region_fn(false)));
+  // The core-local regions come from the nodes of the cores.
+  FOR_ALL_SOCKET0_CORES(core_id) {
+    BUG_ON(!pop_free_region_locked(core_nodes_[core_id],
+                                   &core_local_free_regions_[core_id]));
+    BUG_ON(!pop_free_region_locked(core_nodes_[core_id],
+                                   &core_local_free_nt_regions_[core_id]));
+    if (is_local) {
+      core_local_free_nt_regions_[core_id].set_nt();
+    }
   }
 }
 
@@ -260,44 +376,139 @@ void FarMemManager::swap_in(bool nt, GenericFarMemPtr *ptr) {
     return;
   }
 
+  auto start_tsc = rdtsc();
   auto obj_id = meta_snapshot.get_object_id();
   FarMemManager::lock_object(sizeof(obj_id),
                              reinterpret_cast<const uint8_t *>(&obj_id));
   auto guard = helpers::finally([&]() {
     FarMemManager::unlock_object(sizeof(obj_id),
                                  reinterpret_cast<const uint8_t *>(&obj_id));
+    Stats::record_swap_in_latency(start_tsc);
   });
 
   auto &meta = ptr->meta();
   if (likely(!meta.is_present())) {
-    auto obj_addr = allocate_local_object(nt, meta.get_object_size());
-    auto obj = Object(obj_addr);
     auto ds_id = meta.get_ds_id();
+    auto obj_addr = allocate_local_object(nt || is_over_soft_quota(ds_id),
+                                          meta.get_object_size());
     uint16_t obj_data_len;
-    auto obj_data_addr = reinterpret_cast<uint8_t *>(obj.get_data_addr());
+    auto obj_data_addr =
+        reinterpret_cast<uint8_t *>(Object(obj_addr).get_data_addr());
     device_ptr_->read_object(ds_id, sizeof(obj_id),
                              reinterpret_cast<uint8_t *>(&obj_id),
                              &obj_data_len, obj_data_addr);
-    wmb();
-    obj.init(ds_id, obj_data_len, sizeof(obj_id),
-             reinterpret_cast<uint8_t *>(&obj_id));
-    if (!meta.is_shared()) {
-      meta.set_present(obj_addr);
-    } else {
-      reinterpret_cast<GenericSharedPtr *>(ptr)->traverse(
-          [=](GenericFarMemPtr *ptr) { ptr->meta().set_present(obj_addr); });
+    finish_swap_in(ptr, obj_addr, ds_id, obj_data_len, obj_id);
+  }
+}
+
+void FarMemManager::swap_in_batch(bool nt, GenericFarMemPtr *const *ptrs,
+                                  uint32_t num_ptrs) {
+  assert(preempt_enabled());
+  assert(num_ptrs <= kMaxNumSwapInsPerBatch);
+
+  struct PendingSwapIn {
+    GenericFarMemPtr *ptr;
+    uint64_t obj_id;
+    uint64_t obj_addr;
+    uint8_t ds_id;
+    uint16_t obj_data_len;
+  };
+  PendingSwapIn pendings[kMaxNumSwapInsPerBatch];
+  ObjectReadReq reqs[kMaxNumSwapInsPerBatch];
+  uint32_t num_pendings = 0;
+
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    auto *ptr = ptrs[i];
+    auto meta_snapshot = ptr->meta();
+    if (meta_snapshot.is_present() || meta_snapshot.is_null()) {
+      continue;
+    }
+    auto &pending = pendings[num_pendings];
+    pending.obj_id = meta_snapshot.get_object_id();
+    auto *obj_id = reinterpret_cast<const uint8_t *>(&pending.obj_id);
+    // Never block here since we are holding the locks of the previous objects.
+    if (!try_lock_object(sizeof(pending.obj_id), obj_id)) {
+      continue;
+    }
+    if (unlikely(ptr->meta() != meta_snapshot)) {
+      unlock_object(sizeof(pending.obj_id), obj_id);
+      continue;
+    }
+    pending.ptr = ptr;
+    pending.ds_id = meta_snapshot.get_ds_id();
+    pending.obj_addr =
+        allocate_local_object(nt || is_over_soft_quota(pending.ds_id),
+                              meta_snapshot.get_object_size());
+    reqs[num_pendings] = ObjectReadReq{
+        .ds_id = pending.ds_id,
+        .obj_id_len = sizeof(pending.obj_id),
+        .obj_id = obj_id,
+        .data_len = &pending.obj_data_len,
+        .data_buf =
+            reinterpret_cast<uint8_t *>(Object(pending.obj_addr).get_data_addr())};
+    num_pendings++;
+  }
+
+  if (num_pendings) {
+    device_ptr_->read_objects(num_pendings, reqs);
+  }
+  for (uint32_t i = 0; i < num_pendings; i++) {
+    auto &pending = pendings[i];
+    finish_swap_in(pending.ptr, pending.obj_addr, pending.ds_id,
+                   pending.obj_data_len, pending.obj_id);
+    unlock_object(sizeof(pending.obj_id),
+                  reinterpret_cast<const uint8_t *>(&pending.obj_id));
+  }
+}
+
+// Unlike swap_in_batch(), the objects being swapped in by others are waited
+// for, so that all the objects have been present once it returns.
+void FarMemManager::swap_in_all(bool nt, GenericFarMemPtr *const *ptrs,
+                                uint32_t num_ptrs) {
+  for (uint32_t i = 0; i < num_ptrs; i += kMaxNumSwapInsPerBatch) {
+    swap_in_batch(nt, ptrs + i,
+                  std::min(num_ptrs - i, kMaxNumSwapInsPerBatch));
+  }
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    if (!ptrs[i]->meta().is_null()) {
+      swap_in(nt, ptrs[i]);
+    }
+  }
+}
+
+void FarMemManager::finish_swap_in(GenericFarMemPtr *ptr, uint64_t obj_addr,
+                                   uint8_t ds_id, uint16_t obj_data_len,
+                                   uint64_t obj_id) {
+  auto &meta = ptr->meta();
+  wmb();
+  Object(obj_addr).init(ds_id, obj_data_len, sizeof(obj_id),
+                        reinterpret_cast<uint8_t *>(&obj_id));
+  inc_ds_local_bytes(ds_id, Object(obj_addr).size());
+  Stats::inc_swap_ins(ds_id, 1);
+  Stats::inc_swap_in_bytes(ds_id, obj_data_len);
+  if (!meta.is_shared()) {
+    // The back reference kept at the far-mem side is stale if the pointer
+    // has been moved, refresh it at the next write back.
+    bool moved = (ds_id == kVanillaPtrDSID) && erase_moved_ptr(obj_id);
+    meta.set_present(obj_addr);
+    if (moved) {
+      meta.set_dirty();
     }
-    Region::atomic_inc_ref_cnt(obj_addr, -1);
+  } else {
+    reinterpret_cast<GenericSharedPtr *>(ptr)->traverse(
+        [=](GenericFarMemPtr *ptr) { ptr->meta().set_present(obj_addr); });
   }
+  Region::atomic_inc_ref_cnt(obj_addr, -1);
 }
 
-void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
+bool FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj,
+                             SwapOutBatch *batch) {
   assert(preempt_enabled());
 
   auto &meta = ptr->meta();
 #ifndef STW_GC
   if (unlikely(!meta.is_evacuation())) {
-    return;
+    return false;
   }
 #endif
 
@@ -317,7 +528,8 @@ void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
         });
   }
 
-  if (hot && !nt && !ACCESS_ONCE(almost_empty)) {
+  if (hot && !nt && !ACCESS_ONCE(almost_empty) &&
+      !is_over_hard_quota(obj.get_ds_id())) {
     auto obj_size = obj.size();
     auto optional_local_object_addr = allocate_local_object_nb(false, obj_size);
     if (likely(optional_local_object_addr)) {
@@ -341,30 +553,83 @@ void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
             });
       }
       Region::atomic_inc_ref_cnt(new_local_object_addr, -1);
-      return;
+      return false;
     }
   }
 
   auto obj_id = obj.get_obj_id();
   auto obj_id_len = obj.get_obj_id_len();
-  auto obj_size = obj.size();
   auto ds_id = obj.get_ds_id();
   auto data_ptr = reinterpret_cast<const uint8_t *>(obj.get_data_addr());
 
   auto write_object_fn = [&](uint32_t data_len) {
     if (dirty) {
-      device_ptr_->write_object(ds_id, obj_id_len, obj_id, data_len, data_ptr);
+      write_object(ds_id, obj_id_len, obj_id, data_len, data_ptr,
+                   reinterpret_cast<uint64_t>(ptr));
+      Stats::inc_swap_out_bytes(ds_id, data_len);
     }
   };
 
   if (auto evac_notifier = evac_notifiers_[ds_id]) {
     if (evac_notifier(obj, write_object_fn)) { // Ptr removed.
-      return;
+      inc_ds_local_bytes(ds_id, -static_cast<int64_t>(obj.size()));
+      Stats::inc_swap_outs(ds_id, 1);
+      return false;
     }
+  } else if (dirty && batch) {
+    // Defer both the write back and the pointer update to flush_swap_outs().
+    auto &pending = batch->pendings.emplace_back();
+    pending.ptr = ptr;
+    pending.obj = obj;
+    pending.obj_id_len =
+        append_back_ref(ds_id, obj_id_len, obj_id,
+                        reinterpret_cast<uint64_t>(ptr), pending.obj_id);
+    batch->data_len += obj.get_data_len();
+    return true;
   } else {
     write_object_fn(obj.get_data_len());
   }
 
+  finish_swap_out(ptr, obj);
+  return false;
+}
+
+void FarMemManager::flush_swap_outs(SwapOutBatch *batch) {
+  auto num_pendings = batch->pendings.size();
+  if (!num_pendings) {
+    return;
+  }
+  BUG_ON(num_pendings > kMaxNumSwapOutsPerBatch);
+  ObjectWriteReq reqs[kMaxNumSwapOutsPerBatch];
+  for (uint32_t i = 0; i < num_pendings; i++) {
+    auto &pending = batch->pendings[i];
+    reqs[i] = ObjectWriteReq{
+        .ds_id = pending.obj.get_ds_id(),
+        .obj_id_len = pending.obj_id_len,
+        .obj_id = pending.obj_id,
+        .data_len = pending.obj.get_data_len(),
+        .data_buf = reinterpret_cast<const uint8_t *>(
+            pending.obj.get_data_addr())};
+  }
+  device_ptr_->write_objects(num_pendings, reqs);
+  for (uint32_t i = 0; i < num_pendings; i++) {
+    Stats::inc_swap_out_bytes(reqs[i].ds_id, reqs[i].data_len);
+  }
+  for (auto &pending : batch->pendings) {
+    finish_swap_out(pending.ptr, pending.obj);
+    unlock_object(pending.obj.get_obj_id_len(), pending.obj.get_obj_id());
+  }
+  batch->pendings.clear();
+  batch->data_len = 0;
+}
+
+void FarMemManager::finish_swap_out(GenericFarMemPtr *ptr, Object obj) {
+  auto &meta = ptr->meta();
+  auto obj_id = obj.get_obj_id();
+  auto obj_size = obj.size();
+  auto ds_id = obj.get_ds_id();
+  inc_ds_local_bytes(ds_id, -static_cast<int64_t>(obj_size));
+  Stats::inc_swap_outs(ds_id, 1);
   if (!meta.is_shared()) {
     meta.gc_wb(ds_id, obj_size, *reinterpret_cast<const uint64_t *>(obj_id));
   } else {
@@ -377,7 +642,8 @@ void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
 }
 
 /*
-  A naive from-region picker according to the simple round-robin order.
+  Examines the used regions from the oldest and picks the ones favored by the
+  victim policy. The regions that are not picked are put back in order.
  */
 void FarMemManager::pick_from_regions() {
   from_regions_.clear();
@@ -390,15 +656,122 @@ void FarMemManager::pick_from_regions() {
       std::min(kMaxNumRegionsPerGCRound,
                static_cast<uint32_t>(ratio_per_gc_round *
                                      cache_region_manager_.get_num_regions()));
+  auto num_candidates =
+      victim_policy_->get_num_candidates(num_regions_per_gc_round);
+  if (num_candidates <= num_regions_per_gc_round) {
+    do {
+      auto optional_region = pop_cache_used_region();
+      if (unlikely(!optional_region)) {
+        break;
+      }
+      preempt_disable();
+      from_regions_.push_back(std::move(*optional_region));
+      preempt_enable();
+    } while (from_regions_.size() < num_regions_per_gc_round);
+    return;
+  }
+
+  candidate_regions_.clear();
   do {
     auto optional_region = pop_cache_used_region();
     if (unlikely(!optional_region)) {
       break;
     }
     preempt_disable();
-    from_regions_.push_back(std::move(*optional_region));
+    candidate_regions_.push_back(std::move(*optional_region));
     preempt_enable();
-  } while (from_regions_.size() < num_regions_per_gc_round);
+  } while (candidate_regions_.size() < num_candidates);
+
+  auto now_us = microtime();
+  std::vector<std::pair<double, uint32_t>> scores;
+  scores.reserve(candidate_regions_.size());
+  for (uint32_t i = 0; i < candidate_regions_.size(); i++) {
+    auto stats = sample_region(candidate_regions_[i], now_us);
+    scores.emplace_back(victim_policy_->score(stats), i);
+  }
+  auto num_victims = std::min(static_cast<uint32_t>(scores.size()),
+                              num_regions_per_gc_round);
+  std::partial_sort(
+      scores.begin(), scores.begin() + num_victims, scores.end(),
+      [](const auto &a, const auto &b) { return a.first > b.first; });
+  std::vector<bool> is_victim(candidate_regions_.size());
+  for (uint32_t i = 0; i < num_victims; i++) {
+    is_victim[scores[i].second] = true;
+  }
+  for (uint32_t i = 0; i < candidate_regions_.size(); i++) {
+    if (is_victim[i]) {
+      preempt_disable();
+      from_regions_.push_back(std::move(candidate_regions_[i]));
+      preempt_enable();
+    }
+  }
+  for (int64_t i = candidate_regions_.size() - 1; i >= 0; i--) {
+    if (!is_victim[i]) {
+      cache_region_manager_.push_front_used_region(candidate_regions_[i]);
+    }
+  }
+}
+
+// Estimates the hotness and dirtiness of the region from its leading objects.
+// The pointer of an object is only read under the object lock, as a mutator
+// may free the object and its pointer meanwhile. The objects whose locks are
+// busy are skipped rather than waited on, which is fine for an estimation.
+VictimRegionStats FarMemManager::sample_region(const Region &region,
+                                               uint64_t now_us) {
+  VictimRegionStats stats{.hot_ratio = 0,
+                          .dirty_ratio = 0,
+                          .age_us = 0,
+                          .over_quota_ratio = 0,
+                          .eviction_weight = 1};
+  auto used_since_us = cache_region_manager_.get_used_since_us(region);
+  if (likely(now_us > used_since_us)) {
+    stats.age_us = now_us - used_since_us;
+  }
+  auto num_boundaries = region.get_num_boundaries();
+  if (unlikely(!num_boundaries)) {
+    return stats;
+  }
+  auto cur = region.get_boundary(0).first;
+  auto right = region.get_boundary(num_boundaries - 1).second;
+  uint64_t total_bytes = 0, hot_bytes = 0, dirty_bytes = 0;
+  uint64_t over_quota_bytes = 0;
+  double weighted_bytes = 0;
+  for (uint32_t i = 0;
+       i < kMaxNumSampledObjectsPerRegion && cur + Object::kHeaderSize < right;
+       i++) {
+    auto obj = Object(cur);
+    auto obj_size = obj.size();
+    cur += helpers::align_to(obj_size, sizeof(FarMemPtrMeta));
+    if (obj.is_freed()) {
+      continue;
+    }
+    auto obj_id_len = obj.get_obj_id_len();
+    auto *obj_id = obj.get_obj_id();
+    if (!try_lock_object(obj_id_len, obj_id)) {
+      continue;
+    }
+    auto guard =
+        helpers::finally([&]() { unlock_object(obj_id_len, obj_id); });
+    if (likely(!obj.is_freed())) {
+      auto *ptr = reinterpret_cast<GenericFarMemPtr *>(obj.get_ptr_addr());
+      auto meta = ptr->meta();
+      total_bytes += obj_size;
+      hot_bytes += meta.is_hot() ? obj_size : 0;
+      dirty_bytes += meta.is_dirty() ? obj_size : 0;
+      auto ds_id = obj.get_ds_id();
+      over_quota_bytes += is_over_soft_quota(ds_id) ? obj_size : 0;
+      weighted_bytes +=
+          ACCESS_ONCE(ds_quotas_[ds_id].eviction_weight) * obj_size;
+    }
+  }
+  if (total_bytes) {
+    stats.hot_ratio = static_cast<double>(hot_bytes) / total_bytes;
+    stats.dirty_ratio = static_cast<double>(dirty_bytes) / total_bytes;
+    stats.over_quota_ratio =
+        static_cast<double>(over_quota_bytes) / total_bytes;
+    stats.eviction_weight = weighted_bytes / total_bytes;
+  }
+  return stats;
 }
 
 GCParallelizer::GCParallelizer(uint32_t num_slaves, uint32_t task_queues_depth,
@@ -489,22 +862,38 @@ void GCParallelWriteBacker::slave_fn(uint32_t tid) {
       auto [left, right] = task;
       auto cur = left;
       auto *manager = FarMemManagerFactory::get();
+      FarMemManager::SwapOutBatch batch;
       while (cur + Object::kHeaderSize < right) {
         auto obj = Object(cur);
         if (!obj.is_freed()) {
           auto obj_id_len = obj.get_obj_id_len();
           auto *obj_id = obj.get_obj_id();
-          FarMemManager::lock_object(obj_id_len, obj_id);
-          auto guard = helpers::finally(
-              [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
+          // The batched objects stay locked, and the lock keys (the ID
+          // fragments) may collide across the DSes, so never block with a
+          // non-empty batch: the holder may be the batch itself, or another
+          // slave blocking on this batch.
+          if (batch.pendings.empty() ||
+              !FarMemManager::try_lock_object(obj_id_len, obj_id)) {
+            manager->flush_swap_outs(&batch);
+            FarMemManager::lock_object(obj_id_len, obj_id);
+          }
+          bool deferred = false;
           if (likely(!obj.is_freed())) {
             auto *ptr =
                 reinterpret_cast<GenericFarMemPtr *>(obj.get_ptr_addr());
-            manager->swap_out(ptr, obj);
+            // The object stays locked until its batch is flushed.
+            deferred = manager->swap_out(ptr, obj, &batch);
+          }
+          if (!deferred) {
+            FarMemManager::unlock_object(obj_id_len, obj_id);
           }
         }
         cur += helpers::align_to(obj.size(), sizeof(FarMemPtrMeta));
+        if (batch.is_full()) {
+          manager->flush_swap_outs(&batch);
+        }
       }
+      manager->flush_swap_outs(&batch);
     }
   }
 }
@@ -553,7 +942,7 @@ void FarMemManager::gc_cache() {
 #endif
   start_gc_us[get_core_num()].c = microtime();
 
-  if (unlikely(!is_free_cache_low())) {
+  if (unlikely(!is_free_cache_low() && !is_any_hard_quota_exceeded())) {
     return;
   }
 
@@ -567,12 +956,23 @@ void FarMemManager::gc_cache() {
              cache_region_manager_.get_free_region_ratio());
 #endif
 
-  while (!is_free_cache_high()) {
+  // A DS exceeding its hard quota is worth at most one extra round per launch,
+  // since the GC may not be able to evict its objects.
+  bool quota_round = true;
+  uint64_t phase_start_us = 0;
+  auto phase_us = [&]() {
+    auto now_us = microtime();
+    return now_us - std::exchange(phase_start_us, now_us);
+  };
+  while (!is_free_cache_high() ||
+         (std::exchange(quota_round, false) && is_any_hard_quota_exceeded())) {
     // Phase 1. Pick regions to be GCed.
 #ifdef GC_LOG
     ts[0] = std::chrono::steady_clock::now();
 #endif
+    phase_start_us = microtime();
     pick_from_regions();
+    Stats::inc_gc_pick_us(phase_us());
     if (unlikely(!from_regions_.size())) {
       LOG_PRINTF("%s\n", "Warn: GC cannot find any from_regions.");
       thread_yield();
@@ -586,18 +986,21 @@ void FarMemManager::gc_cache() {
 #ifndef STW_GC
     mark_fm_ptrs(&preempt_guard);
 #endif
+    Stats::inc_gc_mark_us(phase_us());
 
     // Phase 3. Wait all mutator threads to observe the marking.
 #ifdef GC_LOG
     ts[2] = std::chrono::steady_clock::now();
 #endif
     wait_mutators_observation();
+    Stats::inc_gc_wait_us(phase_us());
 
     // Phase 4. Write back the regions to far memory.
 #ifdef GC_LOG
     ts[3] = std::chrono::steady_clock::now();
 #endif
     write_back_regions();
+    Stats::inc_gc_write_back_us(phase_us());
 
     // Phase 5. Add regions to the free list.
 #ifdef GC_LOG
@@ -614,6 +1017,7 @@ void FarMemManager::gc_cache() {
 #endif
     }
     gc_lock_.Unlock();
+    Stats::inc_gc_free_us(phase_us());
 
 #ifdef GC_LOG
     ts[5] = std::chrono::steady_clock::now();
@@ -706,7 +1110,17 @@ retry_allocate_local:
 
 uint64_t FarMemManager::allocate_remote_object(bool nt, uint16_t object_size) {
   preempt_disable();
-  auto guard = helpers::finally([&]() { preempt_enable(); });
+  bool per_core_remote_region_refilled = false;
+  auto guard = helpers::finally([&]() {
+    bool far_mem_low = per_core_remote_region_refilled &&
+                       far_mem_region_manager_.get_free_region_ratio() <=
+                           kFreeFarMemLowThresh;
+    preempt_enable();
+    // Spawning may block, so it must be done with preemption enabled.
+    if (unlikely(far_mem_low)) {
+      launch_far_mem_gc();
+    }
+  });
   std::optional<uint64_t> optional_remote_addr;
 retry_allocate_far_mem:
   auto &free_remote_region = far_mem_region_manager_.core_local_free_region(nt);
@@ -714,6 +1128,7 @@ retry_allocate_far_mem:
   if (unlikely(!optional_remote_addr)) {
     bool success = far_mem_region_manager_.try_refill_core_local_free_region(
         nt, &free_remote_region);
+    per_core_remote_region_refilled = true;
     if (unlikely(!success)) {
       preempt_enable();
       mutator_wait_for_gc_far_mem();
@@ -721,9 +1136,378 @@ retry_allocate_far_mem:
     }
     goto retry_allocate_far_mem;
   }
+  // Must be accounted before the region gets sealed, i.e., with preemption
+  // disabled.
+  far_mem_region_manager_.inc_live_bytes(
+      *optional_remote_addr,
+      helpers::align_to(object_size, sizeof(FarMemPtrMeta)));
   return *optional_remote_addr;
 }
 
+void FarMemManager::free_remote_object(uint64_t remote_object_addr,
+                                       uint16_t object_size) {
+  uint8_t entries[kRemoteFreeBufferSize * ServerPtr::kFreeEntrySize];
+  uint32_t num_entries = 0;
+
+  preempt_disable();
+  auto &buffer = remote_free_buffers_[get_core_num()];
+  buffer.spin.Lock();
+  auto *entry = buffer.entries + buffer.num_entries * ServerPtr::kFreeEntrySize;
+  __builtin_memcpy(entry, &remote_object_addr, sizeof(remote_object_addr));
+  __builtin_memcpy(entry + sizeof(remote_object_addr), &object_size,
+                   sizeof(object_size));
+  // Checked under the buffer lock, so that a free missed by the compaction
+  // has been flushed before it started listing objects.
+  if (unlikely(load_acquire(&far_mem_compacting_))) {
+    compaction_freed_spin_.Lock();
+    compaction_freed_obj_ids_.insert(remote_object_addr);
+    compaction_freed_spin_.Unlock();
+  }
+  if (++buffer.num_entries == kRemoteFreeBufferSize) {
+    num_entries = buffer.num_entries;
+    memcpy(entries, buffer.entries, num_entries * ServerPtr::kFreeEntrySize);
+    buffer.num_entries = 0;
+  }
+  buffer.spin.Unlock();
+  preempt_enable();
+
+  if (num_entries) {
+    flush_remote_frees(entries, num_entries);
+  }
+}
+
+void FarMemManager::flush_remote_frees(const uint8_t *entries,
+                                       uint32_t num_entries) {
+  uint16_t output_len;
+  device_ptr_->compute(kVanillaPtrDSID, ServerPtr::OpCode::FreeObjects,
+                       num_entries * ServerPtr::kFreeEntrySize, entries,
+                       &output_len, nullptr);
+  // Only account the freed space after the far-mem side has observed the
+  // frees, otherwise a late notification could corrupt a reclaimed region.
+  for (auto *entry = entries;
+       entry < entries + num_entries * ServerPtr::kFreeEntrySize;
+       entry += ServerPtr::kFreeEntrySize) {
+    auto remote_object_addr = *reinterpret_cast<const uint64_t *>(entry);
+    auto object_size =
+        *reinterpret_cast<const uint16_t *>(entry + sizeof(uint64_t));
+    far_mem_region_manager_.inc_live_bytes(
+        remote_object_addr,
+        -static_cast<int32_t>(
+            helpers::align_to(object_size, sizeof(FarMemPtrMeta))));
+  }
+}
+
+void FarMemManager::flush_remote_free_buffers() {
+  uint8_t entries[kRemoteFreeBufferSize * ServerPtr::kFreeEntrySize];
+  FOR_ALL_SOCKET0_CORES(core_id) {
+    auto &buffer = remote_free_buffers_[core_id];
+    buffer.spin.Lock();
+    auto num_entries = buffer.num_entries;
+    memcpy(entries, buffer.entries, num_entries * ServerPtr::kFreeEntrySize);
+    buffer.num_entries = 0;
+    buffer.spin.Unlock();
+    if (num_entries) {
+      flush_remote_frees(entries, num_entries);
+    }
+  }
+}
+
+bool FarMemManager::free_swapped_out_ptr(GenericFarMemPtr *ptr) {
+retry:
+  auto meta_snapshot = ptr->meta();
+  if (meta_snapshot.is_present()) {
+    return false;
+  }
+  if (meta_snapshot.is_null() ||
+      meta_snapshot.get_ds_id() != kVanillaPtrDSID) {
+    return true;
+  }
+  auto obj_id = meta_snapshot.get_object_id();
+  lock_object(sizeof(obj_id), reinterpret_cast<const uint8_t *>(&obj_id));
+  auto guard = helpers::finally([&]() {
+    unlock_object(sizeof(obj_id), reinterpret_cast<const uint8_t *>(&obj_id));
+  });
+  if (unlikely(ptr->meta() != meta_snapshot)) {
+    // Swapped in or relocated by the far-mem GC.
+    guard.reset();
+    goto retry;
+  }
+  erase_moved_ptr(obj_id);
+  free_remote_object(obj_id, meta_snapshot.get_object_size());
+  ptr->meta().nullify();
+  return true;
+}
+
+void FarMemManager::record_moved_ptr(uint64_t obj_id, GenericFarMemPtr *ptr) {
+  moved_ptrs_spin_.Lock();
+  auto [iter, inserted] =
+      moved_ptrs_.insert_or_assign(obj_id, reinterpret_cast<uint64_t>(ptr));
+  if (inserted) {
+    num_moved_ptrs_++;
+  }
+  moved_ptrs_spin_.Unlock();
+}
+
+uint32_t FarMemManager::reclaim_far_mem_regions() {
+  uint32_t num_reclaimed = 0;
+  for (uint32_t idx = 0; idx < far_mem_region_manager_.get_num_regions();
+       idx++) {
+    auto optional_live_bytes = far_mem_region_manager_.get_sealed_live_bytes(idx);
+    if (optional_live_bytes && !*optional_live_bytes) {
+      uint16_t output_len;
+      device_ptr_->compute(kVanillaPtrDSID, ServerPtr::OpCode::ResetRegion,
+                           sizeof(idx), reinterpret_cast<const uint8_t *>(&idx),
+                           &output_len, nullptr);
+      far_mem_region_manager_.reclaim_region(idx);
+      num_reclaimed++;
+    }
+  }
+  return num_reclaimed;
+}
+
+FarMemPtrMeta *FarMemManager::locate_swapped_out_meta(uint64_t obj_id,
+                                                      uint16_t obj_size,
+                                                      uint64_t ptr_addr) {
+  if (auto optional_moved_ptr_addr = erase_moved_ptr(obj_id)) {
+    // The entry is dropped either way: the back reference is refreshed when
+    // the object gets moved, and it is stale if the validation below fails.
+    ptr_addr = *optional_moved_ptr_addr;
+  }
+  // The object lock is held, so the object cannot be freed concurrently. If
+  // it has been freed already, its pointer may be gone.
+  compaction_freed_spin_.Lock();
+  bool freed = compaction_freed_obj_ids_.count(obj_id);
+  compaction_freed_spin_.Unlock();
+  if (freed) {
+    return nullptr;
+  }
+  // Pointers embedded in the local cache are not stable, skip them.
+  if (!ptr_addr || ptr_addr % sizeof(FarMemPtrMeta) ||
+      cache_region_manager_.contains(ptr_addr)) {
+    return nullptr;
+  }
+  auto *meta = reinterpret_cast<FarMemPtrMeta *>(ptr_addr);
+  auto meta_snapshot = *meta;
+  if (meta_snapshot.is_present() || meta_snapshot.is_null() ||
+      meta_snapshot.is_shared() ||
+      meta_snapshot.get_ds_id() != kVanillaPtrDSID ||
+      meta_snapshot.get_object_id() != obj_id ||
+      meta_snapshot.get_object_size() != obj_size) {
+    return nullptr;
+  }
+  return meta;
+}
+
+std::optional<uint64_t>
+FarMemManager::allocate_far_mem_gc_object(uint16_t object_size) {
+  while (true) {
+    auto optional_remote_addr = far_mem_gc_region_.allocate_object(object_size);
+    if (likely(optional_remote_addr)) {
+      far_mem_region_manager_.inc_live_bytes(
+          *optional_remote_addr,
+          helpers::align_to(object_size, sizeof(FarMemPtrMeta)));
+      return optional_remote_addr;
+    }
+    if (!far_mem_gc_region_.is_invalid()) {
+      far_mem_region_manager_.seal_region(far_mem_gc_region_);
+      far_mem_gc_region_.invalidate();
+    }
+    if (!far_mem_region_manager_.pop_free_region(&far_mem_gc_region_)) {
+      return std::nullopt;
+    }
+  }
+}
+
+void FarMemManager::move_far_mem_objects(std::vector<FarMemGCTask> *tasks) {
+  if (tasks->empty()) {
+    return;
+  }
+  assert(tasks->size() <= kMaxNumFarMemGCTasksPerMove);
+  std::unique_ptr<uint8_t[]> input(
+      new uint8_t[tasks->size() * ServerPtr::kMoveEntrySize]);
+  auto *entry = input.get();
+  for (auto &task : *tasks) {
+    auto ptr_addr = reinterpret_cast<uint64_t>(task.meta);
+    __builtin_memcpy(entry, &task.old_obj_id, sizeof(task.old_obj_id));
+    __builtin_memcpy(entry + sizeof(task.old_obj_id), &task.new_obj_id,
+                     sizeof(task.new_obj_id));
+    __builtin_memcpy(entry + 2 * sizeof(uint64_t), &task.obj_size,
+                     sizeof(task.obj_size));
+    __builtin_memcpy(entry + 2 * sizeof(uint64_t) + sizeof(task.obj_size),
+                     &ptr_addr, sizeof(ptr_addr));
+    entry += ServerPtr::kMoveEntrySize;
+  }
+  uint16_t output_len;
+  device_ptr_->compute(kVanillaPtrDSID, ServerPtr::OpCode::MoveObjects,
+                       entry - input.get(), input.get(), &output_len, nullptr);
+  for (auto &task : *tasks) {
+    task.meta->gc_wb(kVanillaPtrDSID, task.obj_size, task.new_obj_id);
+    far_mem_region_manager_.inc_live_bytes(
+        task.old_obj_id,
+        -static_cast<int32_t>(
+            helpers::align_to(task.obj_size, sizeof(FarMemPtrMeta))));
+    unlock_object(sizeof(task.old_obj_id),
+                  reinterpret_cast<const uint8_t *>(&task.old_obj_id));
+  }
+  tasks->clear();
+}
+
+bool FarMemManager::compact_far_mem_region(uint32_t region_idx) {
+  std::unique_ptr<uint8_t[]> output_buf(
+      new uint8_t[ServerPtr::kMaxComputeDataLen]);
+  auto *output = output_buf.get();
+  std::vector<FarMemGCTask> tasks;
+  bool out_of_space = false;
+  uint32_t start = Region::kObjectPos;
+
+  while (!out_of_space && start < Region::kSize) {
+    uint8_t input[sizeof(region_idx) + sizeof(start)];
+    __builtin_memcpy(input, &region_idx, sizeof(region_idx));
+    __builtin_memcpy(input + sizeof(region_idx), &start, sizeof(start));
+    uint16_t output_len;
+    device_ptr_->compute(kVanillaPtrDSID, ServerPtr::OpCode::ListObjects,
+                         sizeof(input), input, &output_len, output);
+    auto next = *reinterpret_cast<uint32_t *>(output);
+
+    for (auto *entry = output + sizeof(next); entry < output + output_len;
+         entry += ServerPtr::kListEntrySize) {
+      auto obj_id = *reinterpret_cast<uint64_t *>(entry);
+      auto obj_size = *reinterpret_cast<uint16_t *>(entry + sizeof(obj_id));
+      auto ptr_addr = *reinterpret_cast<uint64_t *>(entry + sizeof(obj_id) +
+                                                    sizeof(obj_size));
+      // Skip the objects being accessed by mutators; they get a chance at the
+      // next round.
+      if (!try_lock_object(sizeof(obj_id),
+                           reinterpret_cast<const uint8_t *>(&obj_id))) {
+        continue;
+      }
+      auto *meta = locate_swapped_out_meta(obj_id, obj_size, ptr_addr);
+      std::optional<uint64_t> optional_new_obj_id;
+      if (meta) {
+        optional_new_obj_id = allocate_far_mem_gc_object(obj_size);
+        out_of_space = !optional_new_obj_id;
+      }
+      if (!optional_new_obj_id) {
+        unlock_object(sizeof(obj_id),
+                      reinterpret_cast<const uint8_t *>(&obj_id));
+        if (out_of_space) {
+          break;
+        }
+        continue;
+      }
+      tasks.push_back(FarMemGCTask{.old_obj_id = obj_id,
+                                   .new_obj_id = *optional_new_obj_id,
+                                   .obj_size = obj_size,
+                                   .meta = meta});
+      if (tasks.size() == kMaxNumFarMemGCTasksPerMove) {
+        move_far_mem_objects(&tasks);
+      }
+    }
+    move_far_mem_objects(&tasks);
+
+    if (next <= start) {
+      break;
+    }
+    start = next;
+  }
+  return !out_of_space;
+}
+
+void FarMemManager::compact_far_mem_regions() {
+  // The frees buffered before the flag is set get flushed below, so the
+  // far-mem side never lists them; the later ones are recorded.
+  compaction_freed_spin_.Lock();
+  compaction_freed_obj_ids_.clear();
+  compaction_freed_spin_.Unlock();
+  store_release(&far_mem_compacting_, true);
+  auto guard = helpers::finally(
+      [&]() { store_release(&far_mem_compacting_, false); });
+  flush_remote_free_buffers();
+
+  std::vector<std::pair<uint32_t, uint32_t>> candidates;
+  for (uint32_t idx = 0; idx < far_mem_region_manager_.get_num_regions();
+       idx++) {
+    auto optional_live_bytes = far_mem_region_manager_.get_sealed_live_bytes(idx);
+    if (optional_live_bytes &&
+        *optional_live_bytes < kFarMemCompactThresh * Region::kSize) {
+      candidates.emplace_back(*optional_live_bytes, idx);
+    }
+  }
+  // Compact the sparsest regions first, since they are the cheapest ones.
+  auto num_candidates = std::min(
+      static_cast<uint32_t>(candidates.size()), kMaxNumRegionsPerFarMemGCRound);
+  std::partial_sort(candidates.begin(), candidates.begin() + num_candidates,
+                    candidates.end());
+  for (uint32_t i = 0; i < num_candidates; i++) {
+    if (!compact_far_mem_region(candidates[i].second)) {
+      break;
+    }
+  }
+}
+
+void FarMemManager::gc_far_mem() {
+  assert(preempt_enabled());
+#ifdef GC_LOG
+  LOG_PRINTF("%s%lf\n", "Info: start far mem GC, free far mem ratio = ",
+             far_mem_region_manager_.get_free_region_ratio());
+#endif
+
+  // Phase 1. Let the far-mem side observe all pending frees.
+  flush_remote_free_buffers();
+
+  // Phase 2. Reclaim the sealed regions without any live objects.
+  [[maybe_unused]] auto num_reclaimed = reclaim_far_mem_regions();
+
+  // Phase 3. Compact the sparse regions if that is not enough.
+  if (far_mem_region_manager_.get_free_region_ratio() <=
+      kFreeFarMemLowThresh) {
+    compact_far_mem_regions();
+    num_reclaimed += reclaim_far_mem_regions();
+  }
+
+#ifdef GC_LOG
+  LOG_PRINTF("%s%u%s%lf\n", "Info: finish far mem GC, reclaims ",
+             num_reclaimed, " regions, free far mem ratio = ",
+             far_mem_region_manager_.get_free_region_ratio());
+#endif
+}
+
+bool FarMemManager::run_gc_far_mem() {
+  far_mem_gc_lock_.Lock();
+  if (far_mem_gc_active_) {
+    // Someone else is collecting, wait for its completion.
+    mutator_far_mem_condvar_.Wait(&far_mem_gc_lock_);
+    far_mem_gc_lock_.Unlock();
+    return false;
+  }
+  far_mem_gc_active_ = true;
+  far_mem_gc_lock_.Unlock();
+
+  auto start_us = microtime();
+  gc_far_mem();
+  Stats::inc_gc_far_mem_us(microtime() - start_us);
+
+  far_mem_gc_lock_.Lock();
+  far_mem_gc_active_ = false;
+  mutator_far_mem_condvar_.SignalAll();
+  far_mem_gc_lock_.Unlock();
+  return true;
+}
+
+void FarMemManager::launch_far_mem_gc() {
+  // Prevent too many spawned threads.
+  bool spawned = false;
+  if (!load_acquire(&far_mem_gc_active_) &&
+      far_mem_gc_spawned_.compare_exchange_strong(spawned, true)) {
+    pending_gcs_++;
+    rt::Spawn([&]() {
+      run_gc_far_mem();
+      far_mem_gc_spawned_.store(false);
+      pending_gcs_--;
+    });
+  }
+}
+
 void FarMemManager::mutator_wait_for_gc_cache() {
   assert(preempt_enabled());
   gc_lock_.Lock();
@@ -739,17 +1523,29 @@ void FarMemManager::mutator_wait_for_gc_cache() {
 #ifdef STW_GC
   launch_gc_master();
 #endif
+  auto start_us = microtime();
+  auto start_tsc = rdtsc();
   do {
     mutator_cache_condvar_.Wait(&gc_lock_);
   } while (ACCESS_ONCE(almost_empty));
   guard.reset();
+  Stats::record_gc_cache_wait_latency(start_tsc);
+  Stats::inc_mutator_stall_us(microtime() - start_us);
 #ifdef DEBUG
   LOG_PRINTF("%s\n", "Warn: mutator paused due to insufficient memory.");
 #endif
 }
 
 void FarMemManager::mutator_wait_for_gc_far_mem() {
-  LOG_PRINTF("%s\n", "Warn: GCing far mem has not been implemented yet.");
+  assert(preempt_enabled());
+  auto start_us = microtime();
+  auto gc_done = run_gc_far_mem();
+  Stats::inc_mutator_stall_us(microtime() - start_us);
+  if (gc_done &&
+      unlikely(!far_mem_region_manager_.get_free_region_ratio())) {
+    LOG_PRINTF("%s\n", "Error: runs out of far memory space.");
+    exit(-ENOSPC);
+  }
 }
 
 void FarMemManager::launch_gc_master() {
@@ -776,7 +1572,47 @@ uint8_t FarMemManager::allocate_ds_id() {
   return ds_id;
 }
 
-void FarMemManager::free_ds_id(uint8_t ds_id) { available_ds_ids_.push(ds_id); }
+void FarMemManager::free_ds_id(uint8_t ds_id) {
+  clear_ds_quota(ds_id);
+  available_ds_ids_.push(ds_id);
+}
+
+void FarMemManager::set_ds_quota(uint8_t ds_id, uint64_t soft_limit,
+                                 uint64_t hard_limit, double eviction_weight) {
+  BUG_ON(soft_limit > hard_limit);
+  BUG_ON(eviction_weight <= 0);
+  ds_quotas_spin_.Lock();
+  auto guard = helpers::finally([&]() { ds_quotas_spin_.Unlock(); });
+  auto &quota = ds_quotas_[ds_id];
+  ACCESS_ONCE(quota.soft_limit) = soft_limit;
+  ACCESS_ONCE(quota.hard_limit) = hard_limit;
+  ACCESS_ONCE(quota.eviction_weight) = eviction_weight;
+  for (uint32_t i = 0; i < num_quota_ds_ids_; i++) {
+    if (quota_ds_ids_[i] == ds_id) {
+      return;
+    }
+  }
+  quota_ds_ids_[num_quota_ds_ids_] = ds_id;
+  store_release(&num_quota_ds_ids_, num_quota_ds_ids_ + 1);
+}
+
+void FarMemManager::clear_ds_quota(uint8_t ds_id) {
+  ds_quotas_spin_.Lock();
+  auto guard = helpers::finally([&]() { ds_quotas_spin_.Unlock(); });
+  auto &quota = ds_quotas_[ds_id];
+  ACCESS_ONCE(quota.soft_limit) = std::numeric_limits<uint64_t>::max();
+  ACCESS_ONCE(quota.hard_limit) = std::numeric_limits<uint64_t>::max();
+  ACCESS_ONCE(quota.eviction_weight) = 1;
+  for (uint32_t i = 0; i < num_quota_ds_ids_; i++) {
+    if (quota_ds_ids_[i] == ds_id) {
+      // The lock-free readers may still see the moved ID twice, which is
+      // harmless.
+      ACCESS_ONCE(quota_ds_ids_[i]) = quota_ds_ids_[num_quota_ds_ids_ - 1];
+      store_release(&num_quota_ds_ids_, num_quota_ds_ids_ - 1);
+      return;
+    }
+  }
+}
 
 bool FarMemManager::reallocate_generic_unique_ptr_nb(const DerefScope &scope,
                                                      GenericUniquePtr *ptr,
@@ -789,10 +1625,11 @@ bool FarMemManager::reallocate_generic_unique_ptr_nb(const DerefScope &scope,
   auto old_obj_ds_id = old_obj.get_ds_id();
   auto new_obj_size = Object::kHeaderSize + new_item_size + old_obj_id_len;
   auto optional_local_object_addr =
-      allocate_local_object_nb(false, new_obj_size);
+      allocate_local_object_nb(is_over_soft_quota(old_obj_ds_id), new_obj_size);
   if (!optional_local_object_addr) {
     return false;
   }
+  inc_ds_local_bytes(old_obj_ds_id, new_obj_size);
   auto local_object_addr = *optional_local_object_addr;
   memcpy(reinterpret_cast<char *>(local_object_addr) + Object::kHeaderSize,
          data_buf, new_item_size);
@@ -811,7 +1648,8 @@ bool FarMemManager::reallocate_generic_unique_ptr_nb(const DerefScope &scope,
   }
   wmb();
   // Free old object and update the pointer.
-  old_obj.free();
+  free_remote_object(old_obj);
+  free_local_object(old_obj);
   Region::atomic_inc_ref_cnt(local_object_addr, -1);
   return true;
 }
@@ -2,51 +2,51 @@
 
 #include "helpers.hpp"
 #include "obj_locker.hpp"
-#include "pointer.hpp"
 
 namespace far_memory {
 
 ObjLocker::ObjLocker() {}
 
-uint32_t ObjLocker::hash_func(uint64_t x) {
-#ifdef USE_UNIFORM_HASH
-  constexpr uint32_t a = 17;
-  constexpr uint32_t b = 47;
-  constexpr uint32_t c = 211;
-
-  auto low = (uint32_t)x;
-  auto high = (uint32_t)(x >> 32);
-  auto val = a * low + b * high + c;
-
-  return val & (kNumMaps - 1);
-#else
-  return x & (kNumMaps - 1);
-#endif
+bool ObjLocker::wait(uint64_t obj_id, Entry *holder) {
+  auto &queue = wait_queues_[holder - entries_];
+  queue.spin.Lock();
+  auto guard = helpers::finally([&] { queue.spin.Unlock(); });
+
+  // Once the entry is contended, it is only released under the spin, so its
+  // obj_id can be checked reliably afterwards.
+  auto state = ACCESS_ONCE(holder->state);
+  if (state == Locked) {
+    if (!__sync_bool_compare_and_swap(&holder->state, Locked, Contended)) {
+      return false;
+    }
+  } else if (state != Contended) {
+    return false;
+  }
+  if (ACCESS_ONCE(holder->obj_id) != obj_id) {
+    // Another object has taken over the entry. The unlock of its holder deals
+    // with the spurious contended state.
+    return false;
+  }
+  holder->num_waiters++;
+  // There are no spurious wakeups; being woken up means the lock is ours.
+  queue.cv.Wait(&queue.spin);
+  return true;
 }
 
-bool ObjLocker::try_insert(uint64_t obj_id) {
-  bool success = true;
-  auto idx = hash_func(obj_id);
-  spins_[idx].Lock();
-  auto guard = helpers::finally([&] { spins_[idx].Unlock(); });
+void ObjLocker::handoff(Entry *entry) {
+  auto &queue = wait_queues_[entry - entries_];
+  queue.spin.Lock();
+  auto guard = helpers::finally([&] { queue.spin.Unlock(); });
 
-  std::map<uint64_t, bool>::iterator iter;
-  if ((iter = maps_[idx].find(obj_id)) == maps_[idx].end()) {
-    maps_[idx].try_emplace(obj_id);
-  } else {
-    success = false;
-    cvs_[idx].Wait(&spins_[idx]);
+  assert(ACCESS_ONCE(entry->state) == Contended);
+  if (!entry->num_waiters) {
+    store_release(&entry->state, Free);
+    return;
   }
-  return success;
-}
-
-void ObjLocker::remove(uint64_t obj_id) {
-  auto idx = hash_func(obj_id);
-  spins_[idx].Lock();
-  auto iter = maps_[idx].find(obj_id);
-  assert(iter != maps_[idx].end());
-  cvs_[idx].SignalAll();
-  maps_[idx].erase(iter);
-  spins_[idx].Unlock();
+  if (--entry->num_waiters == 0) {
+    ACCESS_ONCE(entry->state) = Locked;
+  }
+  // Wakes up the first waiter only, which now holds the lock.
+  queue.cv.Signal();
 }
 } // namespace far_memory
@@ -4,6 +4,7 @@
 #include "manager.hpp"
 
 #include <cstdint>
+#include <vector>
 
 namespace far_memory {
 
@@ -58,6 +59,41 @@ void GenericFarMemPtr::swap_in(bool nt) {
   FarMemManagerFactory::get()->swap_in(nt, this);
 }
 
+SwapInFuture GenericFarMemPtr::swap_in_async(bool nt) {
+  if (meta().is_present() || meta().is_null()) {
+    return SwapInFuture();
+  }
+  return SwapInFuture([this, nt]() { swap_in(nt); });
+}
+
+SwapInFuture GenericFarMemPtr::swap_in_async(bool nt,
+                                             GenericFarMemPtr *const *ptrs,
+                                             uint32_t num_ptrs) {
+  std::vector<GenericFarMemPtr *> misses;
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    if (!ptrs[i]->meta().is_present() && !ptrs[i]->meta().is_null()) {
+      misses.push_back(ptrs[i]);
+    }
+  }
+  if (misses.empty()) {
+    return SwapInFuture();
+  }
+  return SwapInFuture([nt, misses = std::move(misses)]() {
+    swap_in_all(nt, misses.data(), misses.size());
+  });
+}
+
+void GenericFarMemPtr::swap_in_all(bool nt, GenericFarMemPtr *const *ptrs,
+                                   uint32_t num_ptrs) {
+  FarMemManagerFactory::get()->swap_in_all(nt, ptrs, num_ptrs);
+}
+
+void GenericUniquePtr::swap_in_batch(bool nt, GenericUniquePtr *const *ptrs,
+                                     uint32_t num_ptrs) {
+  FarMemManagerFactory::get()->swap_in_batch(
+      nt, reinterpret_cast<GenericFarMemPtr *const *>(ptrs), num_ptrs);
+}
+
 bool GenericFarMemPtr::mutator_migrate_object() {
   auto *manager = FarMemManagerFactory::get();
 
@@ -131,9 +167,10 @@ restart:
       }
     }
 
-    FarMemManagerFactory::get()->get_device()->write_object(
+    FarMemManagerFactory::get()->write_object(
         obj.get_ds_id(), obj_id_len, obj_id_ptr, obj.get_data_len(),
-        reinterpret_cast<const uint8_t *>(obj.get_data_addr()));
+        reinterpret_cast<const uint8_t *>(obj.get_data_addr()),
+        reinterpret_cast<uint64_t>(this));
     if (!meta_snapshot.is_shared()) {
       meta().clear_dirty();
     } else {
@@ -180,6 +217,13 @@ retry:
       cur->set_next_ptr(reinterpret_cast<GenericSharedPtr *>(next));
     }
     other_object.set_ptr_addr(reinterpret_cast<uint64_t>(this));
+    if (other_object.get_ds_id() == kVanillaPtrDSID) {
+      // Refresh the back reference kept at the far-mem side.
+      meta().set_dirty();
+    }
+  } else if (!meta().is_null() && !meta().is_shared() &&
+             meta().get_ds_id() == kVanillaPtrDSID) {
+    FarMemManagerFactory::get()->record_moved_ptr(other_obj_id, this);
   }
   __builtin_memcpy(reinterpret_cast<uint64_t *>(&other.meta()), &reset_value,
                    sizeof(reset_value));
@@ -208,12 +252,18 @@ void GenericUniquePtr::_free() {
   auto guard = helpers::finally(
       [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
 
-  object().free();
+  auto *manager = FarMemManagerFactory::get();
+  manager->free_remote_object(obj);
+  manager->free_local_object(obj);
   meta().nullify();
 }
 
+bool GenericUniquePtr::free_swapped_out() {
+  return FarMemManagerFactory::get()->free_swapped_out_ptr(this);
+}
+
 void GenericUniquePtr::free(bool race) {
-  if (!meta().is_present() && !race) {
+  if (!meta().is_present() && !race && free_swapped_out()) {
     return;
   }
   auto pin_guard = pin</* Shared */ false>();
@@ -239,7 +289,7 @@ restart:
     auto ds_id = obj.get_ds_id();
     auto obj_size = obj.size();
     meta().gc_wb(ds_id, obj_size, *reinterpret_cast<const uint64_t *>(obj_id));
-    obj.free();
+    FarMemManagerFactory::get()->free_local_object(obj);
   }
 }
 
@@ -254,7 +304,9 @@ void GenericSharedPtr::_free() {
   auto guard = helpers::finally(
       [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
   if (next_ptr_ == this) {
-    object().free();
+    auto *manager = FarMemManagerFactory::get();
+    manager->free_remote_object(obj);
+    manager->free_local_object(obj);
   } else {
     auto *ptr = next_ptr_;
     while (ptr->next_ptr_ != this) {
@@ -0,0 +1,26 @@
+#include "pushdown.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace far_memory {
+
+DirtyTracker::DirtyTracker(uint64_t num_items, uint32_t item_size)
+    : kNumItems_(num_items), kItemSize_(item_size) {
+  kNumItemsPerChunk_ = std::max(kChunkSize / item_size, 1UL);
+  kNumChunks_ = num_items ? (num_items - 1) / kNumItemsPerChunk_ + 1 : 1;
+  auto num_words = (kNumChunks_ - 1) / kNumBitsPerWord + 1;
+  bitmap_.reset(new uint64_t[num_words]);
+  memset(bitmap_.get(), 0, num_words * sizeof(uint64_t));
+  if (!num_items) {
+    return;
+  }
+  // Set the bits of all the chunks, but none beyond.
+  memset(bitmap_.get(), 0xFF, kNumChunks_ / kNumBitsPerWord * sizeof(uint64_t));
+  if (kNumChunks_ % kNumBitsPerWord) {
+    bitmap_[num_words - 1] = (1ULL << (kNumChunks_ % kNumBitsPerWord)) - 1;
+  }
+  num_dirty_chunks_ = kNumChunks_;
+}
+
+} // namespace far_memory
@@ -0,0 +1,16 @@
+#include "range_lock.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace far_memory {
+
+RangeLock::RangeLock(uint64_t num_items, uint32_t item_size)
+    : kNumItems_(num_items) {
+  kNumItemsPerStripe_ = std::max(kStripeSize / item_size, 1UL);
+  auto num_stripes = std::max(end_stripe_idx(num_items), 1UL);
+  stripes_.reset(new int32_t[num_stripes]);
+  memset(stripes_.get(), 0, num_stripes * sizeof(int32_t));
+}
+
+} // namespace far_memory
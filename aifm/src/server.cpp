@@ -6,6 +6,7 @@ extern "C" {
 }
 
 #include "server.hpp"
+#include "server_btree.hpp"
 #include "server_dataframe_vector.hpp"
 #include "server_hashtable.hpp"
 #include "server_ptr.hpp"
@@ -20,6 +21,7 @@ Server::Server() {
   register_ds(kHashTableDSType, new ServerHashTableFactory());
   register_ds(kDataFrameVectorDSType, new ServerDataFrameVectorFactory());
   register_ds(kArrayDSType, new ServerArrayFactory());
+  register_ds(kBTreeDSType, new ServerBTreeFactory());
 }
 
 void Server::register_ds(uint8_t ds_type, ServerDSFactory *factory) {
@@ -58,6 +60,15 @@ void Server::write_object(uint8_t ds_id, uint8_t obj_id_len,
   ds_ptr->write_object(obj_id_len, obj_id, data_len, data_buf);
 }
 
+const uint8_t *Server::peek_object(uint8_t ds_id, uint8_t obj_id_len,
+                                  const uint8_t *obj_id, uint16_t *data_len) {
+  auto ds_ptr = server_ds_ptrs_[ds_id].get();
+  if (!ds_ptr) {
+    ds_ptr = server_ds_ptrs_[kVanillaPtrDSID].get();
+  }
+  return ds_ptr->peek_object(obj_id_len, obj_id, data_len);
+}
+
 bool Server::remove_object(uint64_t ds_id, uint8_t obj_id_len,
                            const uint8_t *obj_id) {
   auto ds_ptr = server_ds_ptrs_[ds_id].get();
@@ -74,10 +85,10 @@ void Server::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
   return ds_ptr->compute(opcode, input_len, input_buf, output_len, output_buf);
 }
 
-void Server::call(uint8_t ds_id, const std::string &method,
-                  const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
+void Server::call(uint8_t ds_id, rpc::MethodID method_id,
+                  const rpc::BufferPtr &args, rpc::StreamWriter &writer) {
   auto ds_ptr = server_ds_ptrs_[ds_id].get();
-  ds_ptr->call(method, args, ret);
+  ds_ptr->call(method_id, args, writer);
 }
 
 ServerDS *Server::get_server_ds(uint8_t ds_id) {
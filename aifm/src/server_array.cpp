@@ -2,26 +2,30 @@
 
 #include "snappy.h"
 
+#include <algorithm>
+
 namespace far_memory {
 
 void ServerArray::read_object(uint8_t obj_id_len, const uint8_t *obj_id, uint16_t *data_len, uint8_t *data_buf) {
-//  auto reader_lock = lock_.get_reader_lock();
   uint64_t index;
   assert(obj_id_len == sizeof(index));
   index = *reinterpret_cast<const uint64_t *>(obj_id);
 
   *data_len = item_size_; // 注意：这里由uint32_t缩小为uint16_t
+  range_lock_.lock_reader(index, index + 1);
   __builtin_memcpy(data_buf, ItemData(index), item_size_);
+  range_lock_.unlock_reader(index, index + 1);
 }
 
 void ServerArray::write_object(uint8_t obj_id_len, const uint8_t *obj_id, uint16_t data_len, const uint8_t *data_buf) {
-//  auto reader_lock = lock_.get_reader_lock();
   uint64_t index;
   assert(obj_id_len == sizeof(index));
   index = *reinterpret_cast<const uint64_t *>(obj_id);
 
   assert(data_len == item_size_);
+  range_lock_.lock_writer(index, index + 1);
   __builtin_memcpy(ItemData(index), data_buf, data_len);
+  range_lock_.unlock_writer(index, index + 1);
 }
 
 bool ServerArray::remove_object(uint8_t obj_id_len, const uint8_t *obj_id) {
@@ -36,18 +40,35 @@ void ServerArray::compute(uint8_t opcode,
   BUG();
 }
 
-void ServerArray::call(const std::string &method, const rpc::BufferPtr &args,
-                       rpc::BufferPtr &ret) {
-  auto reply = router_.Call(method, args);
-  ret = std::make_shared<rpc::Buffer>(sizeof(rpc::RpcErrorCode) + reply.ret->ReadableBytes());
-  rpc::Serializer ret_serializer(ret);
-  ret_serializer << reply.error_code;
-  ret_serializer.WriteRaw(reply.ret->GetReadPtr(), reply.ret->ReadableBytes());
+void ServerArray::call(rpc::MethodID method_id, const rpc::BufferPtr &args,
+                       rpc::StreamWriter &writer) {
+  router_.Call(method_id, args, writer);
+}
+
+void ServerArray::ReadRange(rpc::StreamWriter &writer, size_t begin,
+                            size_t end) {
+  end = std::min(end, static_cast<size_t>(num_items_));
+  // 每个分块是若干个完整的item，在持有其范围锁时复制出来
+  auto num_items_per_chunk = std::max(
+      rpc::StreamWriter::kDefaultChunkSize / item_size_, static_cast<size_t>(1));
+  for (auto i = begin; i < end; i += num_items_per_chunk) {
+    auto num_items = std::min(num_items_per_chunk, end - i);
+    auto chunk = rpc::MakeBuffer(num_items * item_size_);
+    range_lock_.lock_reader(i, i + num_items);
+    chunk->Append(reinterpret_cast<const char *>(ItemData(i)),
+                  num_items * item_size_);
+    range_lock_.unlock_reader(i, i + num_items);
+    writer.WriteChunk(std::move(chunk));
+  }
 }
 
 void ServerArray::SnappyCompress() {
-  std::string out_str;
-  snappy::Compress(reinterpret_cast<char *>(vec_.data()), vec_.size(), &out_str);
+  ParallelFor(0, num_items_, /* exclusive = */ false,
+              [&](size_t begin, size_t end) {
+                std::string out_str;
+                snappy::Compress(reinterpret_cast<char *>(ItemData(begin)),
+                                 (end - begin) * item_size_, &out_str);
+              });
 }
 
 ServerDS *ServerArrayFactory::build(uint32_t param_len, uint8_t *params) {
@@ -0,0 +1,188 @@
+extern "C" {
+#include <base/assert.h>
+#include <base/compiler.h>
+#include <base/stddef.h>
+}
+
+#include "../DataFrame/AIFM/include/simple_time.hpp"
+#include "btree.hpp"
+#include "internal/dataframe_types.hpp"
+#include "server_btree.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace far_memory {
+
+namespace {
+
+template <typename T> struct TypeTag {
+  using type = T;
+};
+
+// Invokes f with the TypeTag of the basic dataframe type dt_id.
+template <typename F> void dispatch_dataframe_type(uint8_t dt_id, F &&f) {
+  switch (dt_id) {
+  case DataFrameTypeID::Char:
+    return f(TypeTag<char>());
+  case DataFrameTypeID::Short:
+    return f(TypeTag<short>());
+  case DataFrameTypeID::Int:
+    return f(TypeTag<int>());
+  case DataFrameTypeID::UnsignedInt:
+    return f(TypeTag<unsigned int>());
+  case DataFrameTypeID::Long:
+    return f(TypeTag<long>());
+  case DataFrameTypeID::UnsignedLong:
+    return f(TypeTag<unsigned long>());
+  case DataFrameTypeID::LongLong:
+    return f(TypeTag<long long>());
+  case DataFrameTypeID::UnsignedLongLong:
+    return f(TypeTag<unsigned long long>());
+  case DataFrameTypeID::Float:
+    return f(TypeTag<float>());
+  case DataFrameTypeID::Double:
+    return f(TypeTag<double>());
+  case DataFrameTypeID::Time:
+    return f(TypeTag<SimpleTime>());
+  default:
+    BUG();
+  }
+}
+
+} // namespace
+
+ServerBTree::ServerBTree(uint8_t key_dt_id, uint8_t val_dt_id)
+    : key_dt_id_(key_dt_id), val_dt_id_(val_dt_id) {}
+
+ServerBTree::~ServerBTree() {}
+
+const uint8_t *ServerBTree::get_leaf(uint64_t leaf_id) {
+  BUG_ON(leaf_id >= leaves_.size() || !leaves_[leaf_id]);
+  return leaves_[leaf_id].get();
+}
+
+void ServerBTree::read_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                              uint16_t *data_len, uint8_t *data_buf) {
+  auto reader_lock = lock_.get_reader_lock();
+  uint64_t leaf_id;
+  assert(obj_id_len == sizeof(leaf_id));
+  leaf_id = *reinterpret_cast<const uint64_t *>(obj_id);
+  *data_len = GenericBTree::kLeafSize;
+  __builtin_memcpy(data_buf, get_leaf(leaf_id), GenericBTree::kLeafSize);
+}
+
+void ServerBTree::write_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                               uint16_t data_len, const uint8_t *data_buf) {
+  uint64_t leaf_id;
+  assert(obj_id_len == sizeof(leaf_id));
+  leaf_id = *reinterpret_cast<const uint64_t *>(obj_id);
+  assert(data_len == GenericBTree::kLeafSize);
+  {
+    auto reader_lock = lock_.get_reader_lock();
+    if (likely(leaf_id < leaves_.size() && leaves_[leaf_id])) {
+      __builtin_memcpy(leaves_[leaf_id].get(), data_buf, data_len);
+      return;
+    }
+  }
+  // The leaf is written for the first time.
+  auto writer_lock = lock_.get_writer_lock();
+  if (leaf_id >= leaves_.size()) {
+    leaves_.resize(std::max(leaf_id + 1, leaves_.size() * 2));
+  }
+  if (!leaves_[leaf_id]) {
+    leaves_[leaf_id].reset(new uint8_t[GenericBTree::kLeafSize]);
+  }
+  __builtin_memcpy(leaves_[leaf_id].get(), data_buf, data_len);
+}
+
+bool ServerBTree::remove_object(uint8_t obj_id_len, const uint8_t *obj_id) {
+  // The leaves are recycled by their IDs, so this should never be called.
+  BUG();
+}
+
+// Input:
+//     |start_leaf_id(8B)|lo(sizeof(K))|hi(sizeof(K))|
+// Output:
+//     |cnt(8B)|ret(sizeof(V))|
+template <typename K, typename V>
+void ServerBTree::_compute_aggregate(uint8_t opcode, uint16_t input_len,
+                                     const uint8_t *input_buf,
+                                     uint16_t *output_len,
+                                     uint8_t *output_buf) {
+  uint64_t leaf_id;
+  K lo, hi;
+  assert(input_len == sizeof(leaf_id) + sizeof(K) + sizeof(K));
+  __builtin_memcpy(&leaf_id, input_buf, sizeof(leaf_id));
+  __builtin_memcpy(&lo, input_buf + sizeof(leaf_id), sizeof(K));
+  __builtin_memcpy(&hi, input_buf + sizeof(leaf_id) + sizeof(K), sizeof(K));
+
+  auto capacity = GenericBTree::get_leaf_capacity(sizeof(K), sizeof(V));
+  uint64_t cnt = 0;
+  V ret{};
+  bool first_leaf = true;
+  auto reader_lock = lock_.get_reader_lock();
+  while (leaf_id != GenericBTree::kInvalidLeafId) {
+    auto *leaf = get_leaf(leaf_id);
+    auto *header = reinterpret_cast<const GenericBTree::LeafHeader *>(leaf);
+    auto *keys =
+        reinterpret_cast<const K *>(leaf + GenericBTree::kLeafHeaderSize);
+    auto *vals = reinterpret_cast<const V *>(keys + capacity);
+    uint16_t pos = 0;
+    if (first_leaf) {
+      pos = std::lower_bound(keys, keys + header->cnt, lo) - keys;
+      first_leaf = false;
+    }
+    for (; pos < header->cnt; pos++) {
+      if (!(keys[pos] < hi)) {
+        goto done;
+      }
+      GenericBTree::aggregate_value(opcode, &cnt, &ret, vals[pos]);
+    }
+    leaf_id = header->next_id;
+  }
+
+done:
+  __builtin_memcpy(output_buf, &cnt, sizeof(cnt));
+  __builtin_memcpy(output_buf + sizeof(cnt), &ret, sizeof(V));
+  *output_len = sizeof(cnt) + sizeof(V);
+}
+
+void ServerBTree::compute_aggregate(uint8_t opcode, uint16_t input_len,
+                                    const uint8_t *input_buf,
+                                    uint16_t *output_len,
+                                    uint8_t *output_buf) {
+  dispatch_dataframe_type(key_dt_id_, [&](auto key_tag) {
+    dispatch_dataframe_type(val_dt_id_, [&](auto val_tag) {
+      using K = typename decltype(key_tag)::type;
+      using V = typename decltype(val_tag)::type;
+      _compute_aggregate<K, V>(opcode, input_len, input_buf, output_len,
+                               output_buf);
+    });
+  });
+}
+
+void ServerBTree::compute(uint8_t opcode, uint16_t input_len,
+                          const uint8_t *input_buf, uint16_t *output_len,
+                          uint8_t *output_buf) {
+  switch (opcode) {
+  case GenericBTree::OpCode::Count:
+  case GenericBTree::OpCode::Sum:
+  case GenericBTree::OpCode::Min:
+  case GenericBTree::OpCode::Max:
+    compute_aggregate(opcode, input_len, input_buf, output_len, output_buf);
+    break;
+  default:
+    BUG();
+  }
+}
+
+ServerDS *ServerBTreeFactory::build(uint32_t param_len, uint8_t *params) {
+  uint8_t key_dt_id, val_dt_id;
+  BUG_ON(param_len != sizeof(key_dt_id) + sizeof(val_dt_id));
+  key_dt_id = params[0];
+  val_dt_id = params[1];
+  return new ServerBTree(key_dt_id, val_dt_id);
+}
+
+} // namespace far_memory
@@ -9,8 +9,10 @@ extern "C" {
 #include "dataframe_vector.hpp"
 #include "internal/dataframe_types.hpp"
 #include "server_dataframe_vector.hpp"
+#include "thread.h"
 
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <unordered_set>
 
@@ -281,6 +283,146 @@ ServerDataFrameVector<T>::_compute_aggregate(uint8_t opcode, uint8_t result_ds,
   return std::make_pair(result_vec.size(), result_vec.capacity());
 }
 
+template <typename T>
+void ServerDataFrameVector<T>::compute_sorted_indices(uint16_t input_len,
+                                                      const uint8_t *input_buf,
+                                                      uint16_t *output_len,
+                                                      uint8_t *output_buf) {
+  uint8_t indices_ds_id = input_buf[0];
+  uint64_t size =
+      *reinterpret_cast<const uint64_t *>(input_buf + sizeof(indices_ds_id));
+  bool ascending = input_buf[sizeof(indices_ds_id) + sizeof(size)];
+  auto &indices = reinterpret_cast<ServerDataFrameVector<unsigned long long> *>(
+                      Server::get_server_ds(indices_ds_id))
+                      ->vec_;
+  preempt_disable();
+  indices.resize(size);
+  indices.resize(indices.capacity());
+  preempt_enable();
+  if (ascending) {
+    _compute_sorted_indices</* Ascending = */ true>(size, indices.data());
+  } else {
+    _compute_sorted_indices</* Ascending = */ false>(size, indices.data());
+  }
+  *output_len = sizeof(uint64_t);
+  *reinterpret_cast<uint64_t *>(output_buf) = indices.capacity();
+}
+
+// The same LSD radix sort as DataFrameVector::_get_sorted_indices_radix_sort(),
+// but over the local vector. Writes the rank of every element into indices.
+template <typename T>
+template <bool Ascending>
+void ServerDataFrameVector<T>::_compute_sorted_indices(
+    uint64_t size, unsigned long long *indices) {
+  using Key_t = RadixKey_t<T>;
+  using Histogram_t = std::array<uint64_t, kRadixNumBuckets>;
+  constexpr uint32_t kNumDigits = get_radix_num_digits<T>();
+  constexpr Key_t kDigitMask = kRadixNumBuckets - 1;
+  if (unlikely(!size)) {
+    return;
+  }
+
+  auto num_entries_per_thread = (size - 1) / helpers::kNumCPUs + 1;
+  auto parallel_for = [&](auto &&fn) {
+    std::vector<rt::Thread> threads;
+    for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+      threads.emplace_back([&, tid]() {
+        auto left = std::min(num_entries_per_thread * tid, size);
+        auto right = std::min(left + num_entries_per_thread, size);
+        if (left < right) {
+          fn(tid, left, right);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.Join();
+    }
+  };
+
+  preempt_disable();
+  std::vector<Key_t> keys[2] = {std::vector<Key_t>(size),
+                                std::vector<Key_t>(size)};
+  std::vector<uint64_t> srcs[2] = {std::vector<uint64_t>(size),
+                                   std::vector<uint64_t>(size)};
+  auto hists = std::make_unique<Histogram_t[]>(helpers::kNumCPUs * kNumDigits);
+  preempt_enable();
+
+  // The first scan extracts the keys and builds the per-thread histograms of
+  // all digits at once.
+  parallel_for([&](uint32_t tid, uint64_t left, uint64_t right) {
+    auto *hist = &hists[tid * kNumDigits];
+    for (uint64_t i = left; i < right; i++) {
+      auto key = get_radix_key(vec_[i]);
+      keys[0][i] = key;
+      srcs[0][i] = i;
+      for (uint32_t d = 0; d < kNumDigits; d++) {
+        hist[d][(key >> (d * kRadixBits)) & kDigitMask]++;
+      }
+    }
+  });
+
+  // Skip the digits that are the same across all keys.
+  std::vector<uint32_t> digits;
+  for (uint32_t d = 0; d < kNumDigits; d++) {
+    for (uint32_t b = 0; b < kRadixNumBuckets; b++) {
+      uint64_t cnt = 0;
+      for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+        cnt += hists[tid * kNumDigits + d][b];
+      }
+      if (cnt) {
+        if (cnt != size) {
+          digits.push_back(d);
+        }
+        break;
+      }
+    }
+  }
+  if (digits.empty()) {
+    digits.push_back(0);
+  }
+
+  for (uint32_t pass = 0; pass < digits.size(); pass++) {
+    auto digit = digits[pass];
+    auto shift = digit * kRadixBits;
+    bool last_pass = (pass == digits.size() - 1);
+    auto &from_keys = keys[pass % 2];
+    auto &from_srcs = srcs[pass % 2];
+    auto &to_keys = keys[(pass + 1) % 2];
+    auto &to_srcs = srcs[(pass + 1) % 2];
+    if (pass != 0) {
+      parallel_for([&](uint32_t tid, uint64_t left, uint64_t right) {
+        auto &hist = hists[tid * kNumDigits + digit];
+        hist.fill(0);
+        for (uint64_t i = left; i < right; i++) {
+          hist[(from_keys[i] >> shift) & kDigitMask]++;
+        }
+      });
+    }
+    uint64_t offset = 0;
+    for (uint32_t b = 0; b < kRadixNumBuckets; b++) {
+      for (uint32_t tid = 0; tid < helpers::kNumCPUs; tid++) {
+        auto &cnt = hists[tid * kNumDigits + digit][b];
+        auto next_offset = offset + cnt;
+        cnt = offset;
+        offset = next_offset;
+      }
+    }
+    parallel_for([&](uint32_t tid, uint64_t left, uint64_t right) {
+      auto &hist = hists[tid * kNumDigits + digit];
+      for (uint64_t i = left; i < right; i++) {
+        auto key = from_keys[i];
+        auto pos = hist[(key >> shift) & kDigitMask]++;
+        if (last_pass) {
+          indices[from_srcs[i]] = Ascending ? pos : size - pos - 1;
+        } else {
+          to_keys[pos] = key;
+          to_srcs[pos] = from_srcs[i];
+        }
+      }
+    });
+  }
+}
+
 template <typename T>
 void ServerDataFrameVector<T>::compute(uint8_t opcode, uint16_t input_len,
                                        const uint8_t *input_buf,
@@ -307,6 +449,9 @@ void ServerDataFrameVector<T>::compute(uint8_t opcode, uint16_t input_len,
   case GenericDataFrameVector::OpCode::AggregateMedian:
     compute_aggregate(opcode, input_len, input_buf, output_len, output_buf);
     break;
+  case GenericDataFrameVector::OpCode::SortedIndices:
+    compute_sorted_indices(input_len, input_buf, output_len, output_buf);
+    break;
   default:
     BUG();
   }
@@ -5,51 +5,262 @@ extern "C" {
 #include <base/stddef.h>
 }
 
+#include "helpers.hpp"
+#include "internal/ds_info.hpp"
 #include "object.hpp"
+#include "region.hpp"
 #include "server_ptr.hpp"
 
+#include <cstring>
+#include <sys/mman.h>
+
 namespace far_memory {
 
 ServerPtr::ServerPtr(uint32_t param_len, uint8_t *params) {
-  uint64_t size;
-  BUG_ON(param_len != sizeof(decltype(size)));
-  size = *(reinterpret_cast<decltype(size) *>(params));
-  buf_.reset(reinterpret_cast<uint8_t *>(malloc(size)));
+  BUG_ON(param_len != sizeof(decltype(size_)));
+  size_ = *(reinterpret_cast<decltype(size_) *>(params));
+  // The far-mem GC relies on never-written object headers being zero, which
+  // the anonymous mapping provides lazily.
+  buf_ = reinterpret_cast<uint8_t *>(
+      mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+  BUG_ON(buf_ == MAP_FAILED);
 }
 
-ServerPtr::~ServerPtr() {}
+ServerPtr::~ServerPtr() { munmap(buf_, size_); }
 
 void ServerPtr::read_object(uint8_t obj_id_len, const uint8_t *obj_id,
                             uint16_t *data_len, uint8_t *data_buf) {
+  memcpy(data_buf, peek_object(obj_id_len, obj_id, data_len), *data_len);
+}
+
+const uint8_t *ServerPtr::peek_object(uint8_t obj_id_len, const uint8_t *obj_id,
+                                      uint16_t *data_len) {
   const uint64_t &object_id = *(reinterpret_cast<const uint64_t *>(obj_id));
   assert(obj_id_len == sizeof(decltype(object_id)));
-  auto remote_object_addr = reinterpret_cast<uint64_t>(buf_.get()) + object_id;
+  auto remote_object_addr = reinterpret_cast<uint64_t>(buf_) + object_id;
   Object remote_object(remote_object_addr);
   *data_len = remote_object.get_data_len();
-  memcpy(data_buf, reinterpret_cast<uint8_t *>(remote_object.get_data_addr()),
-         *data_len);
+  return reinterpret_cast<const uint8_t *>(remote_object.get_data_addr());
 }
 
 void ServerPtr::write_object(uint8_t obj_id_len, const uint8_t *obj_id,
                              uint16_t data_len, const uint8_t *data_buf) {
   const uint64_t &object_id = *(reinterpret_cast<const uint64_t *>(obj_id));
-  assert(obj_id_len == sizeof(decltype(object_id)));
-  auto remote_object_addr = reinterpret_cast<uint64_t>(buf_.get()) + object_id;
+  assert(obj_id_len == sizeof(decltype(object_id)) ||
+         obj_id_len == sizeof(decltype(object_id)) + kVanillaPtrBackRefSize);
+  auto remote_object_addr = reinterpret_cast<uint64_t>(buf_) + object_id;
   Object remote_object(remote_object_addr);
   memcpy(reinterpret_cast<uint8_t *>(remote_object.get_data_addr()), data_buf,
          data_len);
   remote_object.set_data_len(data_len);
-  remote_object.set_obj_id_len(obj_id_len);
+  remote_object.set_obj_id_len(sizeof(decltype(object_id)));
+  if (obj_id_len > sizeof(decltype(object_id))) {
+    // The far-mem pointer addr is piggybacked after the object ID. Keep it in
+    // the ptr_addr field so that the far-mem GC can jump back to the pointer.
+    uint64_t ptr_addr = 0;
+    memcpy(&ptr_addr, obj_id + sizeof(decltype(object_id)),
+           kVanillaPtrBackRefSize);
+    remote_object.set_ptr_addr(ptr_addr);
+  }
 }
 
 bool ServerPtr::remove_object(uint8_t obj_id_len, const uint8_t *obj_id) {
   BUG();
 }
 
+// Input:
+//     |obj_id(8B)|obj_size(2B)| * N
+// Output:
+//     None.
+void ServerPtr::compute_free_objects(uint16_t input_len,
+                                     const uint8_t *input_buf,
+                                     uint16_t *output_len,
+                                     uint8_t *output_buf) {
+  assert(input_len % kFreeEntrySize == 0);
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += kFreeEntrySize) {
+    auto object_id = *reinterpret_cast<const uint64_t *>(cur);
+    auto obj_size = *reinterpret_cast<const uint16_t *>(cur + sizeof(uint64_t));
+    assert(object_id + obj_size <= size_);
+    Object remote_object(reinterpret_cast<uint64_t>(buf_) + object_id);
+    // The object may have never been written, so its size has to be
+    // rebuilt for the region walker.
+    remote_object.set_data_len(obj_size - Object::kHeaderSize);
+    remote_object.set_obj_id_len(0);
+    remote_object.free();
+  }
+  *output_len = 0;
+}
+
+// Input:
+//     |region_idx(4B)|start_offset(4B)|
+// Output:
+//     |next_offset(4B)|obj_id(8B)|obj_size(2B)|ptr_addr(8B)| * N
+//
+// Walks the region from start_offset and returns the live objects that carry
+// a far-mem pointer addr. The walk stops once the output is full or at a
+// never-written object (whose size is unknown to the server).
+void ServerPtr::compute_list_objects(uint16_t input_len,
+                                     const uint8_t *input_buf,
+                                     uint16_t *output_len,
+                                     uint8_t *output_buf) {
+  uint32_t region_idx, cur;
+  assert(input_len == sizeof(region_idx) + sizeof(cur));
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  cur = *reinterpret_cast<const uint32_t *>(input_buf + sizeof(region_idx));
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > size_);
+  auto region_addr = reinterpret_cast<uint64_t>(buf_) + region_offset;
+  list_region_objects(region_addr, region_offset, cur, output_len, output_buf);
+}
+
+void ServerPtr::list_region_objects(uint64_t region_addr,
+                                    uint64_t region_offset, uint32_t cur,
+                                    uint16_t *output_len,
+                                    uint8_t *output_buf) {
+  auto *entry = output_buf + sizeof(cur);
+  auto *entry_end = output_buf + kMaxComputeDataLen - kListEntrySize;
+  while (cur + Object::kHeaderSize <= Region::kSize && entry <= entry_end) {
+    Object remote_object(region_addr + cur);
+    auto obj_size = remote_object.size();
+    if (unlikely(obj_size == Object::kHeaderSize)) {
+      break;
+    }
+    if (!remote_object.is_freed()) {
+      auto ptr_addr = remote_object.get_ptr_addr();
+      if (ptr_addr) {
+        uint64_t object_id = region_offset + cur;
+        __builtin_memcpy(entry, &object_id, sizeof(object_id));
+        __builtin_memcpy(entry + sizeof(object_id), &obj_size,
+                         sizeof(obj_size));
+        __builtin_memcpy(entry + sizeof(object_id) + sizeof(obj_size),
+                         &ptr_addr, sizeof(ptr_addr));
+        entry += kListEntrySize;
+      }
+    }
+    cur += helpers::align_to(static_cast<uint32_t>(obj_size),
+                             static_cast<uint32_t>(sizeof(uint64_t)));
+  }
+  __builtin_memcpy(output_buf, &cur, sizeof(cur));
+  *output_len = entry - output_buf;
+}
+
+// Input:
+//     |old_obj_id(8B)|new_obj_id(8B)|obj_size(2B)|ptr_addr(8B)| * N
+// Output:
+//     None.
+void ServerPtr::compute_move_objects(uint16_t input_len,
+                                     const uint8_t *input_buf,
+                                     uint16_t *output_len,
+                                     uint8_t *output_buf) {
+  assert(input_len % kMoveEntrySize == 0);
+  for (auto *cur = input_buf; cur < input_buf + input_len;
+       cur += kMoveEntrySize) {
+    auto old_object_id = *reinterpret_cast<const uint64_t *>(cur);
+    auto new_object_id =
+        *reinterpret_cast<const uint64_t *>(cur + sizeof(uint64_t));
+    auto obj_size =
+        *reinterpret_cast<const uint16_t *>(cur + 2 * sizeof(uint64_t));
+    auto ptr_addr = *reinterpret_cast<const uint64_t *>(
+        cur + 2 * sizeof(uint64_t) + sizeof(uint16_t));
+    assert(old_object_id + obj_size <= size_);
+    assert(new_object_id + obj_size <= size_);
+    memcpy(buf_ + new_object_id, buf_ + old_object_id, obj_size);
+    Object(reinterpret_cast<uint64_t>(buf_) + new_object_id)
+        .set_ptr_addr(ptr_addr);
+    Object(reinterpret_cast<uint64_t>(buf_) + old_object_id).free();
+  }
+  *output_len = 0;
+}
+
+// Input:
+//     |region_idx(4B)|
+// Output:
+//     None.
+void ServerPtr::compute_reset_region(uint16_t input_len,
+                                     const uint8_t *input_buf,
+                                     uint16_t *output_len,
+                                     uint8_t *output_buf) {
+  uint32_t region_idx;
+  assert(input_len == sizeof(region_idx));
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > size_);
+  // Zero the region by dropping its pages, so that the memory of the reset
+  // regions (e.g., the ones demoted by TieredDevice) is given back.
+  BUG_ON(madvise(buf_ + region_offset, Region::kSize, MADV_DONTNEED) != 0);
+  *output_len = 0;
+}
+
+// Input:
+//     |region_idx(4B)|offset(4B)|
+// Output:
+//     |data(kRegionChunkSize)|
+//
+// Copies out a chunk of the raw region image. Unlike ListObjects, it does not
+// interpret the objects, so it also carries the never-written ones.
+void ServerPtr::compute_read_region(uint16_t input_len,
+                                    const uint8_t *input_buf,
+                                    uint16_t *output_len,
+                                    uint8_t *output_buf) {
+  uint32_t region_idx, offset;
+  assert(input_len == kRegionChunkHeaderSize);
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  offset = *reinterpret_cast<const uint32_t *>(input_buf + sizeof(region_idx));
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > size_);
+  BUG_ON(offset + kRegionChunkSize > Region::kSize);
+  memcpy(output_buf, buf_ + region_offset + offset, kRegionChunkSize);
+  *output_len = kRegionChunkSize;
+}
+
+// Input:
+//     |region_idx(4B)|offset(4B)|data|
+// Output:
+//     None.
+void ServerPtr::compute_write_region(uint16_t input_len,
+                                     const uint8_t *input_buf,
+                                     uint16_t *output_len,
+                                     uint8_t *output_buf) {
+  uint32_t region_idx, offset;
+  assert(input_len >= kRegionChunkHeaderSize);
+  region_idx = *reinterpret_cast<const uint32_t *>(input_buf);
+  offset = *reinterpret_cast<const uint32_t *>(input_buf + sizeof(region_idx));
+  auto data_len = input_len - kRegionChunkHeaderSize;
+  auto region_offset = static_cast<uint64_t>(region_idx) * Region::kSize;
+  BUG_ON(region_offset + Region::kSize > size_);
+  BUG_ON(offset + data_len > Region::kSize);
+  memcpy(buf_ + region_offset + offset, input_buf + kRegionChunkHeaderSize,
+         data_len);
+  *output_len = 0;
+}
+
 void ServerPtr::compute(uint8_t opcode, uint16_t input_len,
                         const uint8_t *input_buf, uint16_t *output_len,
                         uint8_t *output_buf) {
-  BUG();
+  switch (opcode) {
+  case OpCode::FreeObjects:
+    compute_free_objects(input_len, input_buf, output_len, output_buf);
+    break;
+  case OpCode::ListObjects:
+    compute_list_objects(input_len, input_buf, output_len, output_buf);
+    break;
+  case OpCode::MoveObjects:
+    compute_move_objects(input_len, input_buf, output_len, output_buf);
+    break;
+  case OpCode::ResetRegion:
+    compute_reset_region(input_len, input_buf, output_len, output_buf);
+    break;
+  case OpCode::ReadRegion:
+    compute_read_region(input_len, input_buf, output_len, output_buf);
+    break;
+  case OpCode::WriteRegion:
+    compute_write_region(input_len, input_buf, output_len, output_buf);
+    break;
+  default:
+    BUG();
+  }
 }
 
 ServerDS *ServerPtrFactory::build(uint32_t param_len, uint8_t *params) {
@@ -2,10 +2,46 @@
 #include "helpers.hpp"
 #include "manager.hpp"
 
+extern "C" {
+#include <runtime/timer.h>
+}
+
 #include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <utility>
 
 namespace far_memory {
 bool Stats::enable_swap_;
+bool Stats::dump_exit_;
+bool Stats::dump_running_;
+rt::Thread Stats::dump_thread_;
+
+#define DEFINE_PER_CORE_STAT(x) Cacheline Stats::x##_[helpers::kNumCPUs];
+#define DEFINE_PER_CORE_PER_DS_STAT(type, x)                                   \
+  alignas(sizeof(Cacheline)) type Stats::x##_[helpers::kNumCPUs]               \
+                                             [kNumDSStatSlots];
+
+DEFINE_PER_CORE_PER_DS_STAT(uint64_t, deref_hits)
+DEFINE_PER_CORE_PER_DS_STAT(uint64_t, swap_ins)
+DEFINE_PER_CORE_PER_DS_STAT(uint64_t, swap_in_bytes)
+DEFINE_PER_CORE_PER_DS_STAT(uint64_t, swap_outs)
+DEFINE_PER_CORE_PER_DS_STAT(uint64_t, swap_out_bytes)
+DEFINE_PER_CORE_PER_DS_STAT(uint64_t, stored_bytes)
+DEFINE_PER_CORE_STAT(gc_pick_us)
+DEFINE_PER_CORE_STAT(gc_mark_us)
+DEFINE_PER_CORE_STAT(gc_wait_us)
+DEFINE_PER_CORE_STAT(gc_write_back_us)
+DEFINE_PER_CORE_STAT(gc_free_us)
+DEFINE_PER_CORE_STAT(gc_far_mem_us)
+DEFINE_PER_CORE_STAT(mutator_stall_us)
+LatencyHistogram Stats::read_object_latency_;
+LatencyHistogram Stats::write_object_latency_;
+LatencyHistogram Stats::compute_latency_;
+LatencyHistogram Stats::call_latency_;
+LatencyHistogram Stats::swap_in_latency_;
+LatencyHistogram Stats::gc_cache_wait_latency_;
 #ifdef MONITOR_FREE_MEM_RATIO
 std::vector<std::pair<uint64_t, double>>
     Stats::free_mem_ratio_records_[helpers::kNumCPUs];
@@ -52,6 +88,106 @@ void Stats::print_free_mem_ratio_records() {
 #endif
 }
 
+void Stats::snapshot(StatsSnapshot *snapshot) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  snapshot->timestamp_us = microtime();
+  FOR_ALL_SOCKET0_CORES(core_id) {
+    for (uint32_t ds_id = 0; ds_id < kNumDSStatSlots; ds_id++) {
+      auto &ds = snapshot->ds[ds_id];
+      ds.deref_hits += ACCESS_ONCE(deref_hits_[core_id][ds_id]);
+      ds.swap_ins += ACCESS_ONCE(swap_ins_[core_id][ds_id]);
+      ds.swap_in_bytes += ACCESS_ONCE(swap_in_bytes_[core_id][ds_id]);
+      ds.swap_outs += ACCESS_ONCE(swap_outs_[core_id][ds_id]);
+      ds.swap_out_bytes += ACCESS_ONCE(swap_out_bytes_[core_id][ds_id]);
+      ds.stored_bytes += ACCESS_ONCE(stored_bytes_[core_id][ds_id]);
+    }
+  }
+  snapshot->gc_pick_us = get_gc_pick_us();
+  snapshot->gc_mark_us = get_gc_mark_us();
+  snapshot->gc_wait_us = get_gc_wait_us();
+  snapshot->gc_write_back_us = get_gc_write_back_us();
+  snapshot->gc_free_us = get_gc_free_us();
+  snapshot->gc_far_mem_us = get_gc_far_mem_us();
+  snapshot->mutator_stall_us = get_mutator_stall_us();
+  snapshot->read_object_latency = read_object_latency_.summary();
+  snapshot->write_object_latency = write_object_latency_.summary();
+  snapshot->compute_latency = compute_latency_.summary();
+  snapshot->call_latency = call_latency_.summary();
+  snapshot->swap_in_latency = swap_in_latency_.summary();
+  snapshot->gc_cache_wait_latency = gc_cache_wait_latency_.summary();
+}
+
+void Stats::reset_latencies() {
+  read_object_latency_.reset();
+  write_object_latency_.reset();
+  compute_latency_.reset();
+  call_latency_.reset();
+  swap_in_latency_.reset();
+  gc_cache_wait_latency_.reset();
+}
+
+void StatsSnapshot::dump(std::ostream &os) const {
+  for (uint32_t ds_id = 0; ds_id < kNumDSStatSlots; ds_id++) {
+    auto &d = ds[ds_id];
+    if (!d.deref_hits && !d.swap_ins && !d.swap_outs) {
+      continue;
+    }
+    os << "ts_us=" << timestamp_us << " ds_id=" << ds_id
+       << " deref_hits=" << d.deref_hits << " swap_ins=" << d.swap_ins
+       << " swap_in_bytes=" << d.swap_in_bytes << " swap_outs=" << d.swap_outs
+       << " swap_out_bytes=" << d.swap_out_bytes
+       << " stored_bytes=" << d.stored_bytes << std::endl;
+  }
+  os << "ts_us=" << timestamp_us << " gc_pick_us=" << gc_pick_us
+     << " gc_mark_us=" << gc_mark_us << " gc_wait_us=" << gc_wait_us
+     << " gc_write_back_us=" << gc_write_back_us
+     << " gc_free_us=" << gc_free_us << " gc_far_mem_us=" << gc_far_mem_us
+     << " mutator_stall_us=" << mutator_stall_us << std::endl;
+  std::pair<const char *, const LatencySummary *> latencies[] = {
+      {"read_object", &read_object_latency},
+      {"write_object", &write_object_latency},
+      {"compute", &compute_latency},
+      {"call", &call_latency},
+      {"swap_in", &swap_in_latency},
+      {"gc_cache_wait", &gc_cache_wait_latency}};
+  for (auto [op, latency] : latencies) {
+    if (!latency->count) {
+      continue;
+    }
+    os << "ts_us=" << timestamp_us << " op=" << op
+       << " count=" << latency->count << " p50_ns=" << latency->p50_ns
+       << " p99_ns=" << latency->p99_ns << " p999_ns=" << latency->p999_ns
+       << std::endl;
+  }
+}
+
+void Stats::start_periodic_dump(const std::string &path,
+                                uint64_t interval_us) {
+  stop_periodic_dump();
+  store_release(&dump_exit_, false);
+  dump_running_ = true;
+  dump_thread_ = rt::Thread([path, interval_us]() {
+    std::ofstream ofs(path, std::ios::app);
+    BUG_ON(!ofs.is_open());
+    // The snapshot is too large for the thread stack.
+    auto snapshot = std::make_unique<StatsSnapshot>();
+    while (!load_acquire(&dump_exit_)) {
+      timer_sleep(interval_us);
+      Stats::snapshot(snapshot.get());
+      snapshot->dump(ofs);
+    }
+  });
+}
+
+void Stats::stop_periodic_dump() {
+  if (!dump_running_) {
+    return;
+  }
+  store_release(&dump_exit_, true);
+  dump_thread_.Join();
+  dump_running_ = false;
+}
+
 void Stats::clear_free_mem_ratio_records() {
 #ifdef MONITOR_FREE_MEM_RATIO
   FOR_ALL_SOCKET0_CORES(core_id) { free_mem_ratio_records_[core_id].clear(); }
@@ -69,14 +69,51 @@ void process_shutdown(tcpconn_t *c) {
   slave_threads.clear();
 }
 
+// The state of a slave connection. Multiple requests can be in flight on it;
+// the responses are tagged by the request IDs and may be written back out of
+// order by the spawned handlers.
+struct SlaveConnection {
+  tcpconn_t *c;
+  rt::Mutex write_mutex;
+  rt::WaitGroup inflight_handlers;
+};
+
+void write_response(SlaveConnection *slave, const void *buf, size_t len) {
+  slave->write_mutex.Lock();
+  helpers::tcp_write_until(slave->c, buf, len);
+  slave->write_mutex.Unlock();
+}
+
+void write2_response(SlaveConnection *slave, const void *buf_0,
+                     size_t len_0, const void *buf_1, size_t len_1) {
+  slave->write_mutex.Lock();
+  helpers::tcp_write2_until(slave->c, buf_0, len_0, buf_1, len_1);
+  slave->write_mutex.Unlock();
+}
+
+void writev_response(SlaveConnection *slave, iovec *iovecs, int num_iovecs) {
+  slave->write_mutex.Lock();
+  helpers::tcp_writev_until(slave->c, iovecs, num_iovecs);
+  slave->write_mutex.Unlock();
+}
+
+void write_ack(SlaveConnection *slave, uint16_t req_id, uint8_t ack) {
+  uint8_t resp[TCPDevice::kReqIDSize + sizeof(ack)];
+  __builtin_memcpy(&resp[0], &req_id, TCPDevice::kReqIDSize);
+  __builtin_memcpy(&resp[TCPDevice::kReqIDSize], &ack, sizeof(ack));
+  write_response(slave, resp, sizeof(resp));
+}
+
 // Request:
-// |Opcode = KOpReadObject(1B) | ds_id(1B) | obj_id_len(1B) | obj_id |
+// |Opcode = KOpReadObject(1B)|ReqID(2B)|ds_id(1B)|obj_id_len(1B)|obj_id|
 // Response:
-// |data_len(2B)|data_buf(data_len B)|
-void process_read_object(tcpconn_t *c) {
+// |ReqID(2B)|data_len(2B)|data_buf(data_len B)|
+void process_read_object(SlaveConnection *slave, uint16_t req_id) {
+  auto *c = slave->c;
   uint8_t
       req[Object::kDSIDSize + Object::kIDLenSize + Object::kMaxObjectIDSize];
-  uint8_t resp[Object::kDataLenSize + Object::kMaxObjectDataSize];
+  uint16_t data_len;
+  uint8_t resp_header[TCPDevice::kReqIDSize + sizeof(data_len)];
 
   helpers::tcp_read_until(c, req, Object::kDSIDSize + Object::kIDLenSize);
   auto ds_id = *const_cast<uint8_t *>(&req[0]);
@@ -84,19 +121,28 @@ void process_read_object(tcpconn_t *c) {
   auto *object_id = &req[Object::kDSIDSize + Object::kIDLenSize];
   helpers::tcp_read_until(c, object_id, object_id_len);
 
-  auto *data_len = reinterpret_cast<uint16_t *>(&resp);
-  auto *data_buf = &resp[Object::kDataLenSize];
-  server.read_object(ds_id, object_id_len, object_id, data_len, data_buf);
+  // Send the object data in place if the DS allows, otherwise read it out.
+  uint8_t data_copy[Object::kMaxObjectDataSize];
+  auto *data_buf = server.peek_object(ds_id, object_id_len, object_id,
+                                      &data_len);
+  if (!data_buf) {
+    server.read_object(ds_id, object_id_len, object_id, &data_len, data_copy);
+    data_buf = data_copy;
+  }
 
-  helpers::tcp_write_until(c, resp, Object::kDataLenSize + *data_len);
+  __builtin_memcpy(&resp_header[0], &req_id, TCPDevice::kReqIDSize);
+  __builtin_memcpy(&resp_header[TCPDevice::kReqIDSize], &data_len,
+                   sizeof(data_len));
+  write2_response(slave, resp_header, sizeof(resp_header), data_buf, data_len);
 }
 
 // Request:
-// |Opcode = KOpWriteObject (1B)|ds_id(1B)|obj_id_len(1B)|data_len(2B)|
-// |obj_id(obj_id_len B)|data_buf(data_len)|
+// |Opcode = KOpWriteObject (1B)|ReqID(2B)|ds_id(1B)|obj_id_len(1B)|
+// |data_len(2B)|obj_id(obj_id_len B)|data_buf(data_len)|
 // Response:
-// |Ack (1B)|
-void process_write_object(tcpconn_t *c) {
+// |ReqID(2B)|Ack (1B)|
+void process_write_object(SlaveConnection *slave, uint16_t req_id) {
+  auto *c = slave->c;
   uint8_t req[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize +
               Object::kMaxObjectIDSize + Object::kMaxObjectDataSize];
 
@@ -120,15 +166,110 @@ void process_write_object(tcpconn_t *c) {
 
   server.write_object(ds_id, object_id_len, object_id, data_len, data_buf);
 
-  uint8_t ack;
-  helpers::tcp_write_until(c, &ack, sizeof(ack));
+  write_ack(slave, req_id, /* ack = */ 0);
+}
+
+void read_batch_request(tcpconn_t *c, uint16_t *num_objs,
+                        std::vector<uint8_t> *payload) {
+  uint32_t payload_len;
+  uint8_t req_header[sizeof(*num_objs) + sizeof(payload_len)];
+  helpers::tcp_read_until(c, req_header, sizeof(req_header));
+  *num_objs = *reinterpret_cast<uint16_t *>(&req_header[0]);
+  payload_len = *reinterpret_cast<uint32_t *>(&req_header[sizeof(*num_objs)]);
+  assert(payload_len <= TCPDevice::kMaxBatchPayloadLen);
+  payload->resize(payload_len);
+  if (payload_len) {
+    helpers::tcp_read_until(c, payload->data(), payload_len);
+  }
+}
+
+// Request:
+// |Opcode = kOpReadObjects(1B)|ReqID(2B)|num_objs(2B)|payload_len(4B)|
+// |payload = (|ds_id(1B)|obj_id_len(1B)|obj_id|) * num_objs|
+// Response:
+// |ReqID(2B)|(|data_len(2B)|data_buf(data_len B)|) * num_objs|
+void process_read_objects(SlaveConnection *slave, uint16_t req_id) {
+  uint16_t num_objs;
+  std::vector<uint8_t> req;
+  read_batch_request(slave->c, &num_objs, &req);
+
+  // The response is gathered from |data_len| headers and the object data,
+  // which is sent in place whenever the DS allows.
+  std::vector<uint16_t> data_lens(num_objs);
+  std::vector<uint8_t> data_copies;
+  // (iovec idx, offset in data_copies), patched once data_copies stops growing.
+  std::vector<std::pair<uint32_t, uint32_t>> copied_iovecs;
+  std::vector<iovec> resp_iovecs;
+  resp_iovecs.reserve(1 + 2 * num_objs);
+  resp_iovecs.push_back(
+      {.iov_base = &req_id, .iov_len = TCPDevice::kReqIDSize});
+  auto *cur = req.data();
+  for (uint16_t i = 0; i < num_objs; i++) {
+    auto ds_id = cur[0];
+    auto object_id_len = cur[Object::kDSIDSize];
+    auto *object_id = &cur[Object::kDSIDSize + Object::kIDLenSize];
+    cur += Object::kDSIDSize + Object::kIDLenSize + object_id_len;
+
+    auto *data_len = &data_lens[i];
+    resp_iovecs.push_back({.iov_base = data_len, .iov_len = sizeof(*data_len)});
+    auto *data_buf =
+        server.peek_object(ds_id, object_id_len, object_id, data_len);
+    if (!data_buf) {
+      auto offset = data_copies.size();
+      data_copies.resize(offset + Object::kMaxObjectDataSize);
+      server.read_object(ds_id, object_id_len, object_id, data_len,
+                         &data_copies[offset]);
+      data_copies.resize(offset + *data_len);
+      if (*data_len) {
+        copied_iovecs.emplace_back(resp_iovecs.size(), offset);
+      }
+    }
+    if (*data_len) {
+      resp_iovecs.push_back({.iov_base = const_cast<uint8_t *>(data_buf),
+                             .iov_len = *data_len});
+    }
+  }
+  for (auto [iovec_idx, offset] : copied_iovecs) {
+    resp_iovecs[iovec_idx].iov_base = &data_copies[offset];
+  }
+
+  writev_response(slave, resp_iovecs.data(), resp_iovecs.size());
+}
+
+// Request:
+// |Opcode = kOpWriteObjects(1B)|ReqID(2B)|num_objs(2B)|payload_len(4B)|
+// |payload = (|ds_id(1B)|obj_id_len(1B)|data_len(2B)|obj_id|data_buf|)
+//            * num_objs|
+// Response:
+// |ReqID(2B)|Ack (1B)|
+void process_write_objects(SlaveConnection *slave, uint16_t req_id) {
+  uint16_t num_objs;
+  std::vector<uint8_t> req;
+  read_batch_request(slave->c, &num_objs, &req);
+
+  auto *cur = req.data();
+  for (uint16_t i = 0; i < num_objs; i++) {
+    auto ds_id = cur[0];
+    auto object_id_len = cur[Object::kDSIDSize];
+    auto data_len = *reinterpret_cast<uint16_t *>(
+        &cur[Object::kDSIDSize + Object::kIDLenSize]);
+    auto *object_id =
+        &cur[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize];
+    auto *data_buf = object_id + object_id_len;
+    server.write_object(ds_id, object_id_len, object_id, data_len, data_buf);
+    cur = data_buf + data_len;
+  }
+
+  write_ack(slave, req_id, /* ack = */ 0);
 }
 
 // Request:
-// |Opcode = kOpRemoveObject (1B)|ds_id(1B)|obj_id_len(1B)|obj_id(obj_id_len B)|
+// |Opcode = kOpRemoveObject (1B)|ReqID(2B)|ds_id(1B)|obj_id_len(1B)|
+// |obj_id(obj_id_len B)|
 // Response:
-// |exists (1B)|
-void process_remove_object(tcpconn_t *c) {
+// |ReqID(2B)|exists (1B)|
+void process_remove_object(SlaveConnection *slave, uint16_t req_id) {
+  auto *c = slave->c;
   uint8_t
       req[Object::kDSIDSize + Object::kIDLenSize + Object::kMaxObjectIDSize];
 
@@ -143,15 +284,16 @@ void process_remove_object(tcpconn_t *c) {
       const_cast<uint8_t *>(&req[Object::kDSIDSize + Object::kIDLenSize]);
   bool exists = server.remove_object(ds_id, obj_id_len, obj_id);
 
-  helpers::tcp_write_until(c, &exists, sizeof(exists));
+  write_ack(slave, req_id, exists);
 }
 
 // Request:
-// |Opcode = kOpConstruct (1B)|ds_type(1B)|ds_id(1B)|
+// |Opcode = kOpConstruct (1B)|ReqID(2B)|ds_type(1B)|ds_id(1B)|
 // |param_len(1B)|params(param_len B)|
 // Response:
-// |Ack (1B)|
-void process_construct(tcpconn_t *c) {
+// |ReqID(2B)|Ack (1B)|
+void process_construct(SlaveConnection *slave, uint16_t req_id) {
+  auto *c = slave->c;
   uint8_t ds_type;
   uint8_t ds_id;
   uint8_t param_len;
@@ -172,140 +314,169 @@ void process_construct(tcpconn_t *c) {
 
   server.construct(ds_type, ds_id, param_len, params);
 
-  uint8_t ack;
-  helpers::tcp_write_until(c, &ack, sizeof(ack));
+  write_ack(slave, req_id, /* ack = */ 0);
 }
 
 // Request:
-// |Opcode = kOpDeconstruct (1B)|ds_id(1B)|
+// |Opcode = kOpDeconstruct (1B)|ReqID(2B)|ds_id(1B)|
 // Response:
-// |Ack (1B)|
-void process_destruct(tcpconn_t *c) {
+// |ReqID(2B)|Ack (1B)|
+void process_destruct(SlaveConnection *slave, uint16_t req_id) {
   uint8_t ds_id;
 
-  helpers::tcp_read_until(c, &ds_id, Object::kDSIDSize);
+  helpers::tcp_read_until(slave->c, &ds_id, Object::kDSIDSize);
 
   server.destruct(ds_id);
 
-  uint8_t ack;
-  helpers::tcp_write_until(c, &ack, sizeof(ack));
+  write_ack(slave, req_id, /* ack = */ 0);
 }
 
 // Request:
-// |Opcode = kOpCompute(1B)|ds_id(1B)|opcode(1B)|input_len(2B)|
+// |Opcode = kOpCompute(1B)|ReqID(2B)|ds_id(1B)|opcode(1B)|input_len(2B)|
 // |input_buf(input_len)|
 // Response:
-// |output_len(2B)|output_buf(output_len B)|
-void process_compute(tcpconn_t *c) {
+// |ReqID(2B)|output_len(2B)|output_buf(output_len B)|
+//
+// The computation is offloaded to a spawned thread so that it does not block
+// the following requests on the connection.
+void process_compute(SlaveConnection *slave, uint16_t req_id) {
+  auto *c = slave->c;
   uint8_t opcode;
   uint16_t input_len;
-  uint8_t req[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len) +
-              TCPDevice::kMaxComputeDataLen];
+  uint8_t req_header[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len)];
 
-  helpers::tcp_read_until(
-      c, req, Object::kDSIDSize + sizeof(opcode) + sizeof(input_len));
+  helpers::tcp_read_until(c, req_header, sizeof(req_header));
 
-  auto ds_id = *reinterpret_cast<uint8_t *>(&req[0]);
-  opcode = *reinterpret_cast<uint8_t *>(&req[Object::kDSIDSize]);
-  input_len =
-      *reinterpret_cast<uint16_t *>(&req[Object::kDSIDSize + sizeof(opcode)]);
+  auto ds_id = *reinterpret_cast<uint8_t *>(&req_header[0]);
+  opcode = *reinterpret_cast<uint8_t *>(&req_header[Object::kDSIDSize]);
+  input_len = *reinterpret_cast<uint16_t *>(
+      &req_header[Object::kDSIDSize + sizeof(opcode)]);
   assert(input_len <= TCPDevice::kMaxComputeDataLen);
 
+  std::vector<uint8_t> input(input_len);
   if (input_len) {
-    helpers::tcp_read_until(
-        c, &req[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len)],
-        input_len);
+    helpers::tcp_read_until(c, input.data(), input_len);
   }
 
-  auto *input_buf = const_cast<uint8_t *>(
-      &req[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len)]);
-
-  uint16_t *output_len;
-  uint8_t resp[sizeof(*output_len) + TCPDevice::kMaxComputeDataLen];
-  output_len = reinterpret_cast<uint16_t *>(&resp[0]);
-  uint8_t *output_buf = &resp[sizeof(*output_len)];
-  server.compute(ds_id, opcode, input_len, input_buf, output_len, output_buf);
-
-  helpers::tcp_write_until(c, resp, sizeof(*output_len) + *output_len);
+  slave->inflight_handlers.Add(1);
+  rt::Spawn([slave, req_id, ds_id, opcode, input = std::move(input)]() {
+    uint16_t *output_len;
+    std::vector<uint8_t> resp(TCPDevice::kReqIDSize + sizeof(*output_len) +
+                              TCPDevice::kMaxComputeDataLen);
+    __builtin_memcpy(&resp[0], &req_id, TCPDevice::kReqIDSize);
+    output_len =
+        reinterpret_cast<uint16_t *>(&resp[TCPDevice::kReqIDSize]);
+    uint8_t *output_buf = &resp[TCPDevice::kReqIDSize + sizeof(*output_len)];
+    server.compute(ds_id, opcode, input.size(), input.data(), output_len,
+                   output_buf);
+
+    write_response(slave, resp.data(),
+                   TCPDevice::kReqIDSize + sizeof(*output_len) + *output_len);
+    slave->inflight_handlers.Done();
+  });
 }
 
 // Request:
-// |Opcode = kOpCall(1B)|ds_id(1B)|body_len(2B)|body(method+args)|
-// Response:
-// |ret_len(2B)|ret|
-void process_call(tcpconn_t *c) {
+// |Opcode = kOpCall(1B)|ReqID(2B)|ds_id(1B)|body_len(4B)|method_id(2B)|args|
+// Response, streamed as one or more frames:
+// |ReqID(2B)|chunk_len(4B)|chunk|
+//
+// Ditto, the call is offloaded to a spawned thread. Each chunk is written back
+// as soon as the method produces it, so the frames of a long return value
+// interleave with the responses of the other requests.
+void process_call(SlaveConnection *slave, uint16_t req_id) {
+  auto *c = slave->c;
 //  FLOG("Start process call");
-  uint16_t body_len;
-  uint8_t req_header[Object::kDSIDSize + sizeof(body_len)];
+  uint32_t body_len;
+  rpc::MethodID method_id;
+  uint8_t req_header[Object::kDSIDSize + sizeof(body_len) + sizeof(method_id)];
 
-  helpers::tcp_read_until(
-      c, req_header, Object::kDSIDSize + sizeof(body_len));
+  helpers::tcp_read_until(c, req_header, sizeof(req_header));
 
   auto ds_id = *reinterpret_cast<uint8_t *>(&req_header[0]);
-  body_len = *reinterpret_cast<uint16_t *>(&req_header[Object::kDSIDSize]);
-  assert(body_len <= TCPDevice::kMaxCallDataLen);
+  body_len = *reinterpret_cast<uint32_t *>(&req_header[Object::kDSIDSize]);
+  method_id = *reinterpret_cast<rpc::MethodID *>(
+      &req_header[Object::kDSIDSize + sizeof(body_len)]);
 //  FLOG("Read Header Success(ds_id: %d, body_len: %d)", ds_id, body_len);
 
-  auto body_buffer = std::make_shared<rpc::Buffer>(body_len);
+  auto body_buffer = rpc::MakeBuffer(body_len);
 
   if (body_len) {
     helpers::tcp_read_until( c, body_buffer->GetWritePtr(), body_len);
     body_buffer->HasWritten(body_len);
   }
 
-  rpc::Serializer body_serializer(body_buffer);
-  auto method = rpc::Get<std::string>(body_serializer);
-//  FLOG("Read Body Success(method: %s)", method.c_str());
-//  FLOG("Start Call method: %s", method.c_str());
-  auto start = std::chrono::steady_clock::now();
-
-  rpc::BufferPtr ret_buffer;
-  server.call(ds_id, method, body_buffer, ret_buffer);
-  auto end = std::chrono::steady_clock::now();
-  FLOG("Call method %s cost %ld us", method.c_str(),
-       std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
-
-  uint16_t ret_len = ret_buffer->ReadableBytes(); // 没有处理大端小端
-//  FLOG("Write Response(ret_len: %d)", ret_len);
-
-  helpers::tcp_write2_until(c, &ret_len, sizeof(ret_len),
-                            ret_buffer->GetReadPtr(), ret_len);
-  // 理论上来说还应该加一步：ret_buffer.HasRead(ret_len),但不是必要的
+  slave->inflight_handlers.Add(1);
+  rt::Spawn([slave, req_id, ds_id, method_id, body_buffer]() {
+//    FLOG("Start Call method: %d", method_id);
+    auto start = std::chrono::steady_clock::now();
+
+    rpc::StreamWriter writer([&](const rpc::BufferPtr &chunk, bool last) {
+      BUG_ON(chunk->ReadableBytes() > TCPDevice::kMaxCallChunkLen);
+      uint32_t chunk_len = chunk->ReadableBytes(); // 没有处理大端小端
+      uint8_t resp_header[TCPDevice::kReqIDSize + sizeof(chunk_len)];
+      __builtin_memcpy(&resp_header[0], &req_id, TCPDevice::kReqIDSize);
+      chunk_len |= last ? TCPDevice::kLastChunkFlag : 0;
+      __builtin_memcpy(&resp_header[TCPDevice::kReqIDSize], &chunk_len,
+                       sizeof(chunk_len));
+      write2_response(slave, resp_header, sizeof(resp_header),
+                      chunk->GetReadPtr(), chunk->ReadableBytes());
+    });
+    server.call(ds_id, method_id, body_buffer, writer);
+    BUG_ON(!writer.IsClosed());
+    auto end = std::chrono::steady_clock::now();
+    FLOG("Call method %d cost %ld us", method_id,
+         std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+             .count());
+    slave->inflight_handlers.Done();
+  });
 }
 
 void slave_fn(tcpconn_t *c) {
+  SlaveConnection slave;
+  slave.c = c;
+
   // Run event loop.
   uint8_t opcode;
+  uint16_t req_id;
   int ret;
   while ((ret = tcp_read(c, &opcode, TCPDevice::kOpcodeSize)) > 0) {
     BUG_ON(ret != TCPDevice::kOpcodeSize);
+    helpers::tcp_read_until(c, &req_id, TCPDevice::kReqIDSize);
 //    FLOG("opcode: %d", opcode);
     switch (opcode) {
     case TCPDevice::kOpReadObject:
-      process_read_object(c);
+      process_read_object(&slave, req_id);
       break;
     case TCPDevice::kOpWriteObject:
-      process_write_object(c);
+      process_write_object(&slave, req_id);
       break;
     case TCPDevice::kOpRemoveObject:
-      process_remove_object(c);
+      process_remove_object(&slave, req_id);
       break;
     case TCPDevice::kOpConstruct:
-      process_construct(c);
+      process_construct(&slave, req_id);
       break;
     case TCPDevice::kOpDeconstruct:
-      process_destruct(c);
+      process_destruct(&slave, req_id);
       break;
     case TCPDevice::kOpCompute:
-      process_compute(c);
+      process_compute(&slave, req_id);
       break;
     case TCPDevice::kOpCall:
-      process_call(c);
+      process_call(&slave, req_id);
+      break;
+    case TCPDevice::kOpReadObjects:
+      process_read_objects(&slave, req_id);
+      break;
+    case TCPDevice::kOpWriteObjects:
+      process_write_objects(&slave, req_id);
       break;
     default:
       BUG();
     }
   }
+  slave.inflight_handlers.Wait();
   tcp_close(c);
 }
 
@@ -0,0 +1,28 @@
+#include "victim_policy.hpp"
+
+namespace far_memory {
+
+uint32_t
+RoundRobinVictimPolicy::get_num_candidates(uint32_t num_victims) const {
+  return num_victims;
+}
+
+double RoundRobinVictimPolicy::score(const VictimRegionStats &stats) const {
+  return 0;
+}
+
+uint32_t
+CostBenefitVictimPolicy::get_num_candidates(uint32_t num_victims) const {
+  return num_victims * kNumCandidatesPerVictim;
+}
+
+double CostBenefitVictimPolicy::score(const VictimRegionStats &stats) const {
+  auto benefit = (1 - stats.hot_ratio) * (stats.age_us + 1) *
+                 stats.eviction_weight *
+                 (1 + kOverQuotaBenefitWeight * stats.over_quota_ratio);
+  auto cost = 1 + kDirtyCostWeight * stats.dirty_ratio +
+              kHotCostWeight * stats.hot_ratio;
+  return benefit / cost;
+}
+
+} // namespace far_memory
@@ -0,0 +1,182 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "btree.hpp"
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+
+using namespace far_memory;
+using namespace std;
+
+// The leaves (about half full after the splits) do not fit in the cache, so
+// that they are swapped in and out.
+constexpr static uint64_t kCacheSize = (16ULL << 20);
+constexpr static uint64_t kFarMemSize = (1ULL << 30);
+constexpr static uint32_t kNumGCThreads = 12;
+constexpr static uint32_t kNumKVPairs = 1 << 20;
+constexpr static uint32_t kMaxKey = 1 << 24;
+constexpr static uint32_t kNumRanges = 64;
+
+map<long, double> kvs;
+
+void check_ranges(BTree<long, double> *btree) {
+  for (uint32_t i = 0; i < kNumRanges; i++) {
+    long lo = rand() % kMaxKey;
+    long hi = lo + rand() % (kMaxKey / 8);
+    uint64_t cnt = 0;
+    double sum = 0, min_val = 0, max_val = 0;
+    for (auto it = kvs.lower_bound(lo); it != kvs.end() && it->first < hi;
+         it++) {
+      auto val = it->second;
+      sum += val;
+      min_val = cnt ? std::min(min_val, val) : val;
+      max_val = cnt ? std::max(max_val, val) : val;
+      cnt++;
+    }
+    TEST_ASSERT(btree->count_range(lo, hi) == cnt);
+    TEST_ASSERT(btree->sum_range(lo, hi) == sum);
+    auto optional_min = btree->min_range(lo, hi);
+    auto optional_max = btree->max_range(lo, hi);
+    TEST_ASSERT(static_cast<bool>(optional_min) == (cnt != 0));
+    TEST_ASSERT(static_cast<bool>(optional_max) == (cnt != 0));
+    if (cnt) {
+      TEST_ASSERT(*optional_min == min_val);
+      TEST_ASSERT(*optional_max == max_val);
+    }
+  }
+}
+
+void check_scan(BTree<long, double> *btree) {
+  DerefScope scope;
+  uint64_t i = 0;
+  auto ref_it = kvs.begin();
+  for (auto it = btree->begin(scope); it != btree->end(); it.inc(scope), i++) {
+    if (unlikely(i % 1024 == 0)) {
+      scope.renew();
+    }
+    TEST_ASSERT(ref_it != kvs.end());
+    TEST_ASSERT(it.key(scope) == ref_it->first);
+    TEST_ASSERT(it.value(scope) == ref_it->second);
+    ref_it++;
+  }
+  TEST_ASSERT(ref_it == kvs.end());
+  TEST_ASSERT(btree->size() == kvs.size());
+}
+
+void check_lower_bound(BTree<long, double> *btree) {
+  for (uint32_t i = 0; i < kNumRanges; i++) {
+    DerefScope scope;
+    long key = rand() % kMaxKey;
+    auto it = btree->lower_bound(scope, key);
+    auto ref_it = kvs.lower_bound(key);
+    for (uint32_t j = 0; j < 1024 && ref_it != kvs.end();
+         j++, it.inc(scope), ref_it++) {
+      TEST_ASSERT(it != btree->end());
+      TEST_ASSERT(it.key(scope) == ref_it->first);
+      TEST_ASSERT(it.value(scope) == ref_it->second);
+    }
+    if (ref_it == kvs.end()) {
+      TEST_ASSERT(it == btree->end());
+    }
+  }
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  auto btree = manager->allocate_btree<long, double>();
+  TEST_ASSERT(btree.empty());
+
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    DerefScope scope;
+    long key = rand() % kMaxKey;
+    double value = rand() % 1024;
+    btree.insert(scope, key, value);
+    kvs[key] = value;
+  }
+  check_scan(&btree);
+  check_lower_bound(&btree);
+  check_ranges(&btree);
+
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    DerefScope scope;
+    long key = rand() % kMaxKey;
+    auto optional_value = btree.find(scope, key);
+    auto ref_it = kvs.find(key);
+    TEST_ASSERT(static_cast<bool>(optional_value) == (ref_it != kvs.end()));
+    if (optional_value) {
+      TEST_ASSERT(*optional_value == ref_it->second);
+    }
+  }
+
+  // Erase a dense key range so that whole leaves are emptied and removed.
+  for (long key = kMaxKey / 4; key < kMaxKey / 2; key++) {
+    DerefScope scope;
+    TEST_ASSERT(btree.erase(scope, key) == (kvs.erase(key) == 1));
+  }
+  for (uint32_t i = 0; i < kNumKVPairs / 4; i++) {
+    DerefScope scope;
+    long key = rand() % kMaxKey;
+    TEST_ASSERT(btree.erase(scope, key) == (kvs.erase(key) == 1));
+  }
+  check_scan(&btree);
+  check_lower_bound(&btree);
+  check_ranges(&btree);
+
+  // Refill the erased range, which reuses the removed leaves.
+  for (uint32_t i = 0; i < kNumKVPairs / 4; i++) {
+    DerefScope scope;
+    long key = kMaxKey / 4 + rand() % (kMaxKey / 4);
+    double value = rand() % 1024;
+    btree.insert(scope, key, value);
+    kvs[key] = value;
+  }
+  check_scan(&btree);
+  check_ranges(&btree);
+
+  for (auto &[key, value] : kvs) {
+    DerefScope scope;
+    TEST_ASSERT(btree.erase(scope, key));
+  }
+  TEST_ASSERT(btree.empty());
+  {
+    DerefScope scope;
+    TEST_ASSERT(btree.begin(scope) == btree.end());
+  }
+  TEST_ASSERT(btree.count_range(0, kMaxKey) == 0);
+  TEST_ASSERT(!btree.min_range(0, kMaxKey));
+
+  cout << "Passed" << endl;
+}
+
+void _main(void *args) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char **argv) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -26,6 +26,57 @@ constexpr uint64_t kNumElementsPerScope = 1024;
 namespace far_memory {
 class FarMemTest {
 private:
+  template <typename T, bool Ascending>
+  void
+  check_sorted_indices(const std::vector<T> &data,
+                       DataFrameVector<unsigned long long> &sorted_indices) {
+    TEST_ASSERT(sorted_indices.size() == data.size());
+    std::vector<T> sorted_data(data.size());
+    std::vector<bool> ranked(data.size());
+    for (uint64_t i = 0; i < data.size(); i++) {
+      DerefScope scope;
+      auto rank = sorted_indices.at(scope, i);
+      TEST_ASSERT(rank < data.size() && !ranked[rank]);
+      ranked[rank] = true;
+      sorted_data[rank] = data[i];
+    }
+    for (uint64_t i = 1; i < data.size(); i++) {
+      if (Ascending) {
+        TEST_ASSERT(!(sorted_data[i] < sorted_data[i - 1]));
+      } else {
+        TEST_ASSERT(!(sorted_data[i - 1] < sorted_data[i]));
+      }
+    }
+  }
+
+  template <typename T, bool Ascending>
+  void check_sorted_indices(FarMemManager *manager, const std::vector<T> &data) {
+    auto data_vec = manager->allocate_dataframe_vector<T>();
+    for (uint64_t i = 0; i < data.size(); i++) {
+      DerefScope scope;
+      data_vec.push_back(scope, data[i]);
+    }
+    auto sorted_indices =
+        data_vec.template get_sorted_indices<Ascending>(manager, false);
+    check_sorted_indices<T, Ascending>(data, sorted_indices);
+    // The radix sort is only taken when the offloading is disabled, so it is
+    // also run directly.
+    auto radix_sorted_indices = DataFrameVector<unsigned long long>(manager);
+    data_vec.template _get_sorted_indices_radix_sort<Ascending>(
+        manager, &radix_sorted_indices);
+    check_sorted_indices<T, Ascending>(data, radix_sorted_indices);
+  }
+
+  template <typename T, typename F>
+  void check_sorted_indices(FarMemManager *manager, uint64_t num, F &&gen) {
+    std::vector<T> data;
+    for (uint64_t i = 0; i < num; i++) {
+      data.push_back(gen());
+    }
+    check_sorted_indices<T, /* Ascending = */ true>(manager, data);
+    check_sorted_indices<T, /* Ascending = */ false>(manager, data);
+  }
+
 public:
   void do_work(FarMemManager *manager) {
     auto dataframe_vector = manager->allocate_dataframe_vector<long long>();
@@ -235,6 +286,31 @@ public:
       }
     }
 
+    {
+      // Radix sort on 4- and 8-byte keys, spanning many chunks.
+      constexpr uint64_t kNumSortEntries = 1 << 20;
+      check_sorted_indices<int>(manager, kNumSortEntries, []() {
+        return static_cast<int>(rand() - RAND_MAX / 2);
+      });
+      check_sorted_indices<unsigned int>(manager, kNumSortEntries, []() {
+        return static_cast<unsigned int>(rand()) << 1;
+      });
+      check_sorted_indices<long long>(manager, kNumSortEntries, []() {
+        return (static_cast<long long>(rand()) << 32 | rand()) - RAND_MAX;
+      });
+      check_sorted_indices<double>(manager, kNumSortEntries, []() {
+        return (rand() - RAND_MAX / 2) / static_cast<double>(rand() + 1);
+      });
+      check_sorted_indices<SimpleTime>(manager, kNumSortEntries, []() {
+        return SimpleTime(2000 + rand() % 20, 1 + rand() % 12, 1 + rand() % 28,
+                          rand() % 24, rand() % 60, rand() % 60);
+      });
+      // Few distinct keys, so that most digits are skipped.
+      check_sorted_indices<long>(manager, kNumSortEntries,
+                                 []() { return static_cast<long>(rand() % 4); });
+      check_sorted_indices<float>(manager, 1, []() { return 1.0f; });
+    }
+
     cout << "Passed" << endl;
   }
 };
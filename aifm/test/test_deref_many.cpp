@@ -0,0 +1,140 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 64 * Region::kSize;
+constexpr uint64_t kFarMemSize = 512 * Region::kSize;
+constexpr uint64_t kWorkSetSize = 256 * Region::kSize;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint32_t kNumPtrsPerDeref = 100;
+
+struct Data4096 {
+  char data[4096];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+bool check(const Data_t *raw_ptr, char value) {
+  for (uint32_t j = 0; j < sizeof(Data_t); j++) {
+    if (raw_ptr->data[j] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    {
+      DerefScope scope;
+      auto raw_mut_ptr = far_mem_ptr.deref_mut(scope);
+      memset(raw_mut_ptr->data, static_cast<char>(i), sizeof(Data_t));
+    }
+    vec.emplace_back(std::move(far_mem_ptr));
+  }
+
+  // Mutate through deref_mut_many(), then verify through deref_many().
+  for (uint64_t i = 0; i < kNumEntries; i += kNumPtrsPerDeref) {
+    uint32_t num_ptrs = std::min(kNumEntries - i, uint64_t(kNumPtrsPerDeref));
+    UniquePtr<Data_t> *ptrs[kNumPtrsPerDeref];
+    Data_t *raw_mut_ptrs[kNumPtrsPerDeref];
+    for (uint32_t j = 0; j < num_ptrs; j++) {
+      ptrs[j] = &vec[i + j];
+    }
+    DerefScope scope;
+    UniquePtr<Data_t>::deref_mut_many(scope, ptrs, num_ptrs, raw_mut_ptrs);
+    for (uint32_t j = 0; j < num_ptrs; j++) {
+      memset(raw_mut_ptrs[j]->data, static_cast<char>(i + j + 1),
+             sizeof(Data_t));
+    }
+  }
+  for (uint64_t i = 0; i < kNumEntries; i += kNumPtrsPerDeref) {
+    uint32_t num_ptrs = std::min(kNumEntries - i, uint64_t(kNumPtrsPerDeref));
+    UniquePtr<Data_t> *ptrs[kNumPtrsPerDeref];
+    const Data_t *raw_ptrs[kNumPtrsPerDeref];
+    for (uint32_t j = 0; j < num_ptrs; j++) {
+      ptrs[j] = &vec[i + j];
+    }
+    DerefScope scope;
+    UniquePtr<Data_t>::deref_many(scope, ptrs, num_ptrs, raw_ptrs);
+    for (uint32_t j = 0; j < num_ptrs; j++) {
+      if (!check(raw_ptrs[j], static_cast<char>(i + j + 1))) {
+        goto fail;
+      }
+    }
+  }
+
+  // Overlap the swap-ins of the next group with the checks of this one.
+  {
+    std::vector<GenericFarMemPtr *> ptrs;
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      ptrs.push_back(&vec[i]);
+    }
+    auto future = GenericFarMemPtr::swap_in_async(false, ptrs.data(),
+                                                  kNumPtrsPerDeref);
+    for (uint64_t i = 0; i < kNumEntries; i += kNumPtrsPerDeref) {
+      future.wait();
+      auto next = i + kNumPtrsPerDeref;
+      if (next < kNumEntries) {
+        future = GenericFarMemPtr::swap_in_async(
+            false, ptrs.data() + next,
+            std::min(kNumEntries - next, uint64_t(kNumPtrsPerDeref)));
+      }
+      for (uint64_t j = i; j < std::min(next, kNumEntries); j++) {
+        DerefScope scope;
+        if (!check(vec[j].deref(scope), static_cast<char>(j + 1))) {
+          goto fail;
+        }
+      }
+    }
+  }
+
+  cout << "Passed" << endl;
+  return;
+
+fail:
+  cout << "Failed" << endl;
+  return;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,125 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 256 * Region::kSize;
+constexpr uint64_t kFarMemSize = 512 * Region::kSize;
+constexpr uint64_t kWorkSetSize = 64 * Region::kSize;
+constexpr uint64_t kSoftLimit = 8 * Region::kSize;
+constexpr uint64_t kHardLimit = 16 * Region::kSize;
+constexpr uint64_t kNumGCThreads = 12;
+
+struct Data4096 {
+  char data[4096];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+void write(UniquePtr<Data_t> *ptr, char value) {
+  DerefScope scope;
+  auto raw_mut_ptr = ptr->deref_mut(scope);
+  memset(raw_mut_ptr->data, value, sizeof(Data_t));
+}
+
+bool check(UniquePtr<Data_t> *ptr, char value) {
+  DerefScope scope;
+  const auto raw_const_ptr = ptr->deref(scope);
+  for (uint32_t j = 0; j < sizeof(Data_t); j++) {
+    if (raw_const_ptr->data[j] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool fill_and_check(FarMemManager *manager,
+                    std::vector<UniquePtr<Data_t>> *vec) {
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    write(&far_mem_ptr, static_cast<char>(i));
+    vec->emplace_back(std::move(far_mem_ptr));
+  }
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    if (!check(&(*vec)[i], static_cast<char>(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  // Without a quota the whole working set fits into the local cache.
+  if (!fill_and_check(manager, &vec)) {
+    goto fail;
+  }
+  if (manager->get_ds_local_bytes(kVanillaPtrDSID) <
+      kNumEntries * sizeof(Data_t)) {
+    goto fail;
+  }
+  vec.clear();
+  if (manager->get_ds_local_bytes(kVanillaPtrDSID) != 0) {
+    goto fail;
+  }
+
+  // With a quota the DS is pushed out to far memory while staying correct.
+  manager->set_ds_quota(kVanillaPtrDSID, kSoftLimit, kHardLimit);
+  if (!fill_and_check(manager, &vec)) {
+    goto fail;
+  }
+  if (manager->get_ds_local_bytes(kVanillaPtrDSID) > kHardLimit) {
+    goto fail;
+  }
+  vec.clear();
+  manager->clear_ds_quota(kVanillaPtrDSID);
+  if (manager->get_ds_local_bytes(kVanillaPtrDSID) != 0) {
+    goto fail;
+  }
+
+  cout << "Passed" << endl;
+  return;
+
+fail:
+  cout << "Failed" << endl;
+  return;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 64 * Region::kSize;
+constexpr uint64_t kFarMemSize = 128 * Region::kSize;
+constexpr uint64_t kWorkSetSize = 64 * Region::kSize;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumRounds = 16;
+// Every kLongLivedStride-th entry is never reallocated, so that the far-mem
+// GC has to compact the sparse regions instead of only reclaiming empty ones.
+constexpr uint64_t kLongLivedStride = 4;
+
+struct Data4096 {
+  char data[4096];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+char get_value(uint64_t round, uint64_t idx) {
+  if (idx % kLongLivedStride == 0) {
+    round = 0;
+  }
+  return static_cast<char>(round * kNumEntries + idx);
+}
+
+void write(UniquePtr<Data_t> *ptr, char value) {
+  DerefScope scope;
+  auto raw_mut_ptr = ptr->deref_mut(scope);
+  memset(raw_mut_ptr->data, value, sizeof(Data_t));
+}
+
+bool check(UniquePtr<Data_t> *ptr, char value) {
+  DerefScope scope;
+  const auto raw_const_ptr = ptr->deref(scope);
+  for (uint32_t j = 0; j < sizeof(Data_t); j++) {
+    if (raw_const_ptr->data[j] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    write(&far_mem_ptr, get_value(0, i));
+    vec.emplace_back(std::move(far_mem_ptr));
+  }
+
+  // The total allocated far memory is far beyond kFarMemSize.
+  for (uint64_t round = 1; round < kNumRounds; round++) {
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      if (i % kLongLivedStride == 0) {
+        continue;
+      }
+      if (!check(&vec[i], get_value(round - 1, i))) {
+        goto fail;
+      }
+      vec[i].free();
+      auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+      write(&far_mem_ptr, get_value(round, i));
+      vec[i] = std::move(far_mem_ptr);
+    }
+  }
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    if (!check(&vec[i], get_value(kNumRounds - 1, i))) {
+      goto fail;
+    }
+  }
+
+  cout << "Passed" << endl;
+  return;
+
+fail:
+  cout << "Failed" << endl;
+  return;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,81 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "frequency_sketch.hpp"
+#include "hash.hpp"
+#include "helpers.hpp"
+
+#include <iostream>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr static uint32_t kNumCountersShift = 16;
+constexpr static uint32_t kNumHotKeys = 64;
+constexpr static uint32_t kNumHotAccesses = 8;
+constexpr static uint32_t kNumColdKeys = 1 << 14;
+
+uint32_t hash_of(uint64_t key) { return hash_32(&key, sizeof(key)); }
+
+void do_work() {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  FrequencySketch sketch(kNumCountersShift);
+
+  // A key is admitted into the sketch counters from its second access on.
+  TEST_ASSERT(sketch.estimate(hash_of(0)) == 0);
+  TEST_ASSERT(sketch.record(hash_of(0)) == 1);
+  TEST_ASSERT(sketch.record(hash_of(0)) == 2);
+
+  for (uint32_t i = 0; i < kNumHotAccesses; i++) {
+    for (uint64_t key = 1; key <= kNumHotKeys; key++) {
+      sketch.record(hash_of(key));
+    }
+  }
+  // Barring the doorkeeper false positives, the one-hit keys are estimated
+  // once.
+  uint32_t num_overestimated = 0;
+  for (uint64_t key = kNumHotKeys + 1; key <= kNumHotKeys + kNumColdKeys;
+       key++) {
+    num_overestimated += (sketch.record(hash_of(key)) > 1);
+  }
+  TEST_ASSERT(num_overestimated < kNumColdKeys / 100);
+  // Count-Min never underestimates before aging.
+  for (uint64_t key = 1; key <= kNumHotKeys; key++) {
+    TEST_ASSERT(sketch.estimate(hash_of(key)) >= kNumHotAccesses);
+  }
+
+  // Keep recording the cold keys until the sketch ages once (the window is 16
+  // accesses per counter), after which the hot keys are mostly forgotten.
+  for (uint64_t key = kNumHotKeys + kNumColdKeys + 1;
+       key <= (16ULL << kNumCountersShift); key++) {
+    sketch.record(hash_of(key));
+  }
+  uint32_t num_remembered = 0;
+  for (uint64_t key = 1; key <= kNumHotKeys; key++) {
+    num_remembered += (sketch.estimate(hash_of(key)) >= kNumHotAccesses);
+  }
+  TEST_ASSERT(num_remembered < kNumHotKeys / 4);
+
+  cout << "Passed" << endl;
+}
+
+void _main(void *args) { do_work(); }
+
+int main(int argc, char **argv) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
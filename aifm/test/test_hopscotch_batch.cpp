@@ -0,0 +1,141 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "concurrent_hopscotch.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr static uint32_t kKeyLen = 200;
+constexpr static uint32_t kValueLen = 700;
+constexpr static uint32_t kHashTableNumEntriesShift = 19;
+constexpr static uint32_t kHashTableRemoteDataSize =
+    (Object::kHeaderSize + kKeyLen + kValueLen) *
+    (1 << kHashTableNumEntriesShift);
+constexpr static double kLoadFactor = 0.80;
+constexpr static uint32_t kNumKVPairs =
+    kLoadFactor * (1 << kHashTableNumEntriesShift);
+// Larger than the internal batch size, so that the batches are split.
+constexpr static uint32_t kBatchSize = 100;
+
+// Far smaller than the data, so that most finds are forwarded to the remote.
+constexpr static uint64_t kCacheSize = (128ULL << 20);
+constexpr static uint64_t kFarMemSize = (1ULL << 30);
+constexpr static uint32_t kNumGCThreads = 12;
+
+struct Key {
+  char data[kKeyLen];
+};
+
+struct Value {
+  char data[kValueLen];
+};
+
+vector<Key> keys;
+vector<Value> values;
+
+void random_string(char *data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    data[i] = rand() % ('z' - 'a' + 1) + 'a';
+  }
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  auto hopscotch = manager->allocate_concurrent_hopscotch<Key, Value>(
+      kHashTableNumEntriesShift, kHashTableNumEntriesShift,
+      kHashTableRemoteDataSize);
+
+  keys.resize(kNumKVPairs);
+  values.resize(kNumKVPairs);
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    random_string(keys[i].data, kKeyLen);
+    random_string(values[i].data, kValueLen);
+  }
+
+  for (uint32_t i = 0; i < kNumKVPairs; i += kBatchSize) {
+    auto num = std::min(kNumKVPairs - i, kBatchSize);
+    hopscotch.insert_batch_tp(num, &keys[i], &values[i]);
+  }
+  TEST_ASSERT(hopscotch.size() == kNumKVPairs);
+
+  // Overwrite half of the values; the size stays the same.
+  for (uint32_t i = 0; i < kNumKVPairs / 2; i += kBatchSize) {
+    auto num = std::min(kNumKVPairs / 2 - i, kBatchSize);
+    for (uint32_t j = i; j < i + num; j++) {
+      random_string(values[j].data, kValueLen);
+    }
+    hopscotch.insert_batch_tp(num, &keys[i], &values[i]);
+  }
+  TEST_ASSERT(hopscotch.size() == kNumKVPairs);
+
+  // Each batch has random existing keys and some missing ones.
+  vector<Key> batch_keys(kBatchSize);
+  vector<int64_t> batch_idxes(kBatchSize);
+  vector<optional<Value>> batch_values(kBatchSize);
+  for (uint32_t i = 0; i < kNumKVPairs; i += kBatchSize) {
+    for (uint32_t j = 0; j < kBatchSize; j++) {
+      if (rand() % 8 == 0) {
+        batch_idxes[j] = -1;
+        random_string(batch_keys[j].data, kKeyLen);
+      } else {
+        batch_idxes[j] = rand() % kNumKVPairs;
+        batch_keys[j] = keys[batch_idxes[j]];
+      }
+    }
+    hopscotch.find_batch_tp(kBatchSize, batch_keys.data(),
+                            batch_values.data());
+    for (uint32_t j = 0; j < kBatchSize; j++) {
+      if (batch_idxes[j] == -1) {
+        TEST_ASSERT(!batch_values[j]);
+      } else {
+        TEST_ASSERT(batch_values[j]);
+        TEST_ASSERT(strncmp(batch_values[j]->data,
+                            values[batch_idxes[j]].data, kValueLen) == 0);
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    TEST_ASSERT(hopscotch.erase_tp(keys[i]));
+  }
+  TEST_ASSERT(hopscotch.empty());
+
+  std::cout << "Passed" << std::endl;
+}
+
+void _main(void *args) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char **argv) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,139 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "concurrent_hopscotch.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "local_concurrent_hopscotch.hpp"
+#include "manager.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr static uint32_t kKeyLen = 200;
+constexpr static uint32_t kValueLen = 700;
+// The index starts far smaller than the number of keys, so that it has to
+// grow several times.
+constexpr static uint32_t kLocalNumEntriesShift = 10;
+constexpr static uint32_t kRemoteNumEntriesShift = 16;
+constexpr static uint32_t kHashTableRemoteDataSize =
+    (Object::kHeaderSize + kKeyLen + kValueLen) *
+    (1 << kRemoteNumEntriesShift);
+constexpr static uint32_t kNumKVPairs = 16 * (1 << kLocalNumEntriesShift);
+constexpr static uint64_t kLocalSlabMemSize = (1 << 30);
+
+constexpr static uint64_t kCacheSize = (1ULL << 30);
+constexpr static uint64_t kFarMemSize = (1ULL << 30);
+constexpr static uint32_t kNumGCThreads = 12;
+
+struct Key {
+  char data[kKeyLen];
+  bool operator<(const Key &other) const {
+    return strncmp(data, other.data, kKeyLen) < 0;
+  }
+};
+
+struct Value {
+  char data[kValueLen];
+};
+
+std::map<Key, Value> kvs;
+
+void random_string(char *data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    data[i] = rand() % ('z' - 'a' + 1) + 'a';
+  }
+}
+
+void test_far_mem_hopscotch(FarMemManager *manager) {
+  auto hopscotch = manager->allocate_concurrent_hopscotch<Key, Value>(
+      kLocalNumEntriesShift, kRemoteNumEntriesShift, kHashTableRemoteDataSize);
+
+  for (auto &[key, value] : kvs) {
+    hopscotch.insert_tp(key, value);
+  }
+  TEST_ASSERT(hopscotch.size() == kvs.size());
+
+  for (auto &[key, value] : kvs) {
+    auto optional_value = hopscotch.find_tp(key);
+    TEST_ASSERT(optional_value);
+    TEST_ASSERT(strncmp(optional_value->data, value.data, kValueLen) == 0);
+  }
+
+  for (auto &[key, value] : kvs) {
+    TEST_ASSERT(hopscotch.erase_tp(key));
+  }
+  TEST_ASSERT(hopscotch.empty());
+}
+
+void test_local_hopscotch() {
+  auto hopscotch = LocalGenericConcurrentHopscotch(kLocalNumEntriesShift,
+                                                   kLocalSlabMemSize);
+
+  for (auto &[key, value] : kvs) {
+    hopscotch.put(kKeyLen, reinterpret_cast<const uint8_t *>(key.data),
+                  kValueLen, reinterpret_cast<const uint8_t *>(value.data));
+  }
+
+  for (auto &[key, value] : kvs) {
+    uint16_t val_len;
+    char val[kValueLen];
+    hopscotch.get(kKeyLen, reinterpret_cast<const uint8_t *>(key.data),
+                  &val_len, reinterpret_cast<uint8_t *>(val));
+    TEST_ASSERT(val_len == kValueLen);
+    TEST_ASSERT(strncmp(val, value.data, kValueLen) == 0);
+  }
+
+  for (auto &[key, value] : kvs) {
+    TEST_ASSERT(
+        hopscotch.remove(kKeyLen, reinterpret_cast<const uint8_t *>(key.data)));
+  }
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    Key key;
+    Value value;
+    random_string(key.data, kKeyLen);
+    random_string(value.data, kValueLen);
+    kvs[key] = value;
+  }
+
+  test_far_mem_hopscotch(manager);
+  test_local_hopscotch();
+
+  std::cout << "Passed" << std::endl;
+}
+
+void _main(void *args) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char **argv) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+#include "thread.h"
+
+#include "helpers.hpp"
+#include "latency_histogram.hpp"
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr static uint32_t kNumThreads = 10;
+constexpr static uint64_t kNumRecordsPerThread = 100000;
+
+// The exact percentile of the latencies 1, 2, ..., kNumThreads *
+// kNumRecordsPerThread.
+uint64_t exact_ns(uint64_t parts_per_thousand) {
+  return (kNumThreads * kNumRecordsPerThread * parts_per_thousand + 999) / 1000;
+}
+
+bool within_precision(uint64_t reported_ns, uint64_t exact_ns) {
+  return reported_ns >= exact_ns && reported_ns <= exact_ns + exact_ns / 32;
+}
+
+void do_work() {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  auto histogram = std::make_unique<LatencyHistogram>();
+  TEST_ASSERT(histogram->summary().count == 0);
+
+  std::vector<rt::Thread> threads;
+  for (uint32_t tid = 0; tid < kNumThreads; tid++) {
+    threads.emplace_back([&, tid]() {
+      for (uint64_t i = 0; i < kNumRecordsPerThread; i++) {
+        histogram->record(i * kNumThreads + tid + 1);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+
+  auto summary = histogram->summary();
+  TEST_ASSERT(summary.count == kNumThreads * kNumRecordsPerThread);
+  TEST_ASSERT(within_precision(summary.p50_ns, exact_ns(500)));
+  TEST_ASSERT(within_precision(summary.p99_ns, exact_ns(990)));
+  TEST_ASSERT(within_precision(summary.p999_ns, exact_ns(999)));
+
+  // The small latencies are exact.
+  histogram->reset();
+  for (uint64_t i = 0; i < 10; i++) {
+    histogram->record(7);
+  }
+  histogram->record(1ULL << 50);
+  summary = histogram->summary();
+  TEST_ASSERT(summary.count == 11);
+  TEST_ASSERT(summary.p50_ns == 7);
+  TEST_ASSERT(summary.p999_ns >= (1ULL << 39));
+
+  ostringstream oss;
+  histogram->dump(oss);
+  TEST_ASSERT(oss.str().find("7 10\n") == 0);
+
+  cout << "Passed" << endl;
+}
+
+void _main(void *arg) { do_work(); }
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,85 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+#include "thread.h"
+
+#include "helpers.hpp"
+#include "obj_locker.hpp"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr static uint32_t kNumThreads = 40;
+constexpr static uint32_t kNumObjs = 16;
+constexpr static uint32_t kNumItersPerThread = 20000;
+constexpr static uint32_t kObjSize = 4096;
+
+uint64_t counters[kNumObjs];
+
+void do_work() {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  auto locker = std::make_unique<ObjLocker>();
+
+  TEST_ASSERT(locker->try_lock(0));
+  TEST_ASSERT(!locker->try_lock(0));
+  TEST_ASSERT(locker->try_lock(kObjSize));
+  locker->unlock(0);
+  TEST_ASSERT(locker->try_lock(0));
+  locker->unlock(0);
+  locker->unlock(kObjSize);
+
+  // The threads contend on a few objects, and occasionally sleep while holding
+  // the lock so that the others queue up on it.
+  std::vector<rt::Thread> threads;
+  for (uint32_t tid = 0; tid < kNumThreads; tid++) {
+    threads.emplace_back([&, tid]() {
+      for (uint32_t i = 0; i < kNumItersPerThread; i++) {
+        auto obj_idx = (tid + i) % kNumObjs;
+        locker->lock(obj_idx * kObjSize);
+        auto cnt = ACCESS_ONCE(counters[obj_idx]);
+        if (i % 1024 == 0) {
+          timer_sleep(10);
+        }
+        ACCESS_ONCE(counters[obj_idx]) = cnt + 1;
+        locker->unlock(obj_idx * kObjSize);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < kNumObjs; i++) {
+    sum += counters[i];
+    TEST_ASSERT(locker->try_lock(i * kObjSize));
+    locker->unlock(i * kObjSize);
+  }
+  TEST_ASSERT(sum == static_cast<uint64_t>(kNumThreads) * kNumItersPerThread);
+
+  cout << "Passed" << endl;
+}
+
+void _main(void *arg) { do_work(); }
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+
+#include "thread.h"
+
+#include "array.hpp"
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "prefetcher_stream.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+using namespace far_memory;
+using namespace std;
+
+struct Data_t {
+  uint8_t buf[4096];
+};
+
+constexpr uint64_t kCacheSize = 256ULL << 20;
+constexpr uint64_t kFarMemSize = 4ULL << 30;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumRows = 512;
+constexpr uint64_t kNumCols = 512;
+constexpr uint64_t kNumEntries = kNumRows * kNumCols;
+constexpr uint64_t kNumStreamAccesses = kNumRows / 2;
+constexpr double kMinHitRatio = 0.6;
+
+namespace far_memory {
+class FarMemTest {
+public:
+  using Array_t = Array<Data_t, kNumEntries>;
+
+  bool run(FarMemManager *manager) {
+    // The working set (1 GiB) is 4x the cache.
+    auto array = std::unique_ptr<Array_t>(
+        manager->allocate_array_heap<Data_t, kNumEntries>());
+    array->disable_prefetch();
+    auto *state = reinterpret_cast<uint8_t *>(&array->ptrs_);
+    stream::Prefetcher<decltype(Array_t::kInduceFn),
+                       decltype(Array_t::kInferFn),
+                       decltype(Array_t::kMappingFn)>
+        prefetcher(manager->get_device(), state, sizeof(Data_t));
+
+    // Evicts the head of the array out of the cache.
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      DerefScope scope;
+      array->at_mut<false>(scope, i);
+    }
+
+    // Interleaves a walk along a row, a walk along the first column and a
+    // backward walk along the middle row, which a single-stride prefetcher
+    // never locks on.
+    const uint64_t starts[] = {kNumCols, 2 * kNumCols,
+                               kNumEntries / 2 + kNumCols - 1};
+    const int64_t strides[] = {1, static_cast<int64_t>(kNumCols), -1};
+    uint64_t num_present = 0;
+    uint64_t num_accesses = 0;
+    for (uint64_t i = 0; i < kNumStreamAccesses; i++) {
+      for (uint32_t j = 0; j < std::size(starts); j++) {
+        uint64_t idx = starts[j] + strides[j] * static_cast<int64_t>(i);
+        auto *ptr = array->GenericArray::at(false, idx);
+        prefetcher.add_trace(false, idx);
+        // The first accesses of each stream train the prefetcher.
+        if (i >= 8) {
+          num_present += ptr->meta().is_present();
+          num_accesses++;
+        }
+        DerefScope scope;
+        array->at<false>(scope, idx);
+      }
+      // Leaves the prefetcher some time to run ahead, as the computation of
+      // a real workload would.
+      timer_sleep(20);
+    }
+
+    auto hit_ratio = static_cast<double>(num_present) / num_accesses;
+    std::cout << "hit_ratio = " << hit_ratio << std::endl;
+    return hit_ratio >= kMinHitRatio;
+  }
+};
+} // namespace far_memory
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+  FarMemTest test;
+  if (test.run(manager)) {
+    cout << "Passed" << endl;
+  } else {
+    cout << "Failed" << endl;
+  }
+}
+
+void _main(void *arg) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
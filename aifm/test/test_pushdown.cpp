@@ -0,0 +1,108 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "thread.h"
+
+#include "array.hpp"
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+#include "rpc_protocol.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 256ULL << 20;
+constexpr uint64_t kFarMemSize = 1ULL << 30;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumEntries = 1 << 20;
+constexpr uint64_t kNumDirtyEntries = 1000;
+
+namespace far_memory {
+class FarMemTest {
+public:
+  using Array_t = Array<uint64_t, kNumEntries>;
+
+  void run(FarMemManager *manager) {
+    auto array = std::unique_ptr<Array_t>(
+        manager->allocate_array_heap<uint64_t, kNumEntries>());
+    // The items are dirty once allocated, so flush them all.
+    TEST_ASSERT(array->dirty_tracker_.get_dirty_bytes() ==
+                kNumEntries * sizeof(uint64_t));
+    array->flush();
+    TEST_ASSERT(array->dirty_tracker_.get_dirty_bytes() == 0);
+
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < kNumDirtyEntries; i++) {
+      auto idx = i * (kNumEntries / kNumDirtyEntries);
+      array->write(idx, idx);
+      sum += idx;
+    }
+    auto dirty_bytes = array->dirty_tracker_.get_dirty_bytes();
+    TEST_ASSERT(dirty_bytes >= kNumDirtyEntries * sizeof(uint64_t));
+    TEST_ASSERT(dirty_bytes < kNumEntries * sizeof(uint64_t));
+    TEST_ASSERT(array->get_non_present_bytes() == 0);
+
+    // The fake device has no server side, so the call falls back to the local
+    // processor after the flush of the first pushdown attempt.
+    array->register_local("Sum", [&]() {
+      uint64_t local_sum = 0;
+      for (uint64_t i = 0; i < kNumEntries; i++) {
+        local_sum += array->read(i);
+      }
+      return local_sum;
+    });
+    for (uint32_t i = 0; i < 2; i++) {
+      rpc::BufferPtr ret;
+      TEST_ASSERT(array->call("Sum", rpc::SerializeArgsToBuffer(), ret));
+      TEST_ASSERT(rpc::GetReturnValueFromBuffer<uint64_t>(ret) == sum);
+      TEST_ASSERT(array->dirty_tracker_.get_dirty_bytes() == 0);
+    }
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      auto *ptr = array->GenericArray::at(false, i);
+      TEST_ASSERT(!ptr->is_present() || !ptr->is_dirty());
+    }
+
+    rpc::BufferPtr ret;
+    TEST_ASSERT(!array->call("NotFound", rpc::SerializeArgsToBuffer(), ret));
+
+    cout << "Passed" << endl;
+  }
+};
+} // namespace far_memory
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+  FarMemTest test;
+  test.run(manager);
+}
+
+void _main(void *arg) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
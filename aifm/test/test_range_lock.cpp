@@ -0,0 +1,165 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+#include "thread.h"
+
+#include "helpers.hpp"
+#include "range_lock.hpp"
+#include "server_array.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kNumItems = 1 << 20;
+constexpr uint32_t kNumThreads = 40;
+constexpr uint32_t kNumOpsPerThread = 2000;
+constexpr uint64_t kMaxRangeLen = 1 << 16;
+constexpr uint32_t kNumRounds = 8;
+
+void test_range_lock() {
+  RangeLock lock(kNumItems, sizeof(uint64_t));
+  std::unique_ptr<uint64_t[]> counters(new uint64_t[kNumItems]());
+  std::vector<uint64_t> num_increments(kNumThreads);
+
+  // Writers increment overlapping ranges non-atomically, and readers check
+  // that their ranges stay unchanged while being held.
+  std::vector<rt::Thread> threads;
+  for (uint32_t tid = 0; tid < kNumThreads; tid++) {
+    threads.emplace_back([&, tid]() {
+      std::mt19937_64 rng(tid);
+      for (uint32_t i = 0; i < kNumOpsPerThread; i++) {
+        auto begin = rng() % kNumItems;
+        auto end = std::min(begin + 1 + rng() % kMaxRangeLen, kNumItems);
+        if (tid % 2) {
+          lock.lock_writer(begin, end);
+          for (auto j = begin; j < end; j++) {
+            counters[j]++;
+          }
+          lock.unlock_writer(begin, end);
+          num_increments[tid] += end - begin;
+        } else {
+          lock.lock_reader(begin, end);
+          auto first = ACCESS_ONCE(counters[begin]);
+          auto last = ACCESS_ONCE(counters[end - 1]);
+          thread_yield();
+          TEST_ASSERT(ACCESS_ONCE(counters[begin]) == first);
+          TEST_ASSERT(ACCESS_ONCE(counters[end - 1]) == last);
+          lock.unlock_reader(begin, end);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+
+  uint64_t sum = 0, expected_sum = 0;
+  for (uint64_t i = 0; i < kNumItems; i++) {
+    sum += counters[i];
+  }
+  for (auto num : num_increments) {
+    expected_sum += num;
+  }
+  TEST_ASSERT(sum == expected_sum);
+}
+
+rpc::RpcReplyBody call(ServerArray *array, rpc::MethodID method_id,
+                       const rpc::BufferPtr &args) {
+  rpc::RpcReplyBody reply;
+  rpc::StreamWriter writer([&](const rpc::BufferPtr &chunk, bool last) {
+    if (!reply.ret) {
+      reply.ret = chunk;
+    } else {
+      reply.ret->Append(chunk->GetReadPtr(), chunk->ReadableBytes());
+    }
+  });
+  array->call(method_id, args, writer);
+  rpc::Serializer serializer(reply.ret);
+  serializer >> reply.error_code;
+  return reply;
+}
+
+void test_server_array() {
+  ServerArray array(kNumItems, sizeof(uint64_t));
+  for (uint64_t i = 0; i < kNumItems; i++) {
+    array.write_object(sizeof(i), reinterpret_cast<uint8_t *>(&i), sizeof(i),
+                       reinterpret_cast<uint8_t *>(&i));
+  }
+  auto reply = call(&array, rpc::kGetMethodsID, rpc::MakeBuffer(0));
+  auto methods =
+      rpc::GetReturnValueFromBuffer<std::vector<std::string>>(reply.ret);
+  auto compress_id = static_cast<rpc::MethodID>(
+      std::find(methods.begin(), methods.end(), "SnappyCompress") -
+      methods.begin());
+  TEST_ASSERT(compress_id < methods.size());
+
+  // Parallel scans, pushed-down compressions and object IO run concurrently.
+  std::vector<rt::Thread> threads;
+  for (uint32_t tid = 0; tid < kNumThreads; tid++) {
+    threads.emplace_back([&, tid]() {
+      for (uint32_t round = 0; round < kNumRounds; round++) {
+        if (tid == 0) {
+          std::atomic<uint64_t> num_scanned{0};
+          array.ParallelFor(0, kNumItems, /* exclusive = */ false,
+                            [&](size_t begin, size_t end) {
+                              num_scanned += end - begin;
+                            });
+          TEST_ASSERT(num_scanned == kNumItems);
+        } else if (tid == 1) {
+          auto reply = call(&array, compress_id, rpc::MakeBuffer(0));
+          TEST_ASSERT(reply.error_code == rpc::RpcErrorCode::kSuccess);
+        } else {
+          // Each thread owns the items congruent to tid.
+          for (uint64_t i = tid; i < kNumItems; i += kNumThreads * 64) {
+            uint64_t val = i + round, read_val;
+            uint16_t data_len;
+            array.write_object(sizeof(i), reinterpret_cast<uint8_t *>(&i),
+                               sizeof(val), reinterpret_cast<uint8_t *>(&val));
+            array.read_object(sizeof(i), reinterpret_cast<uint8_t *>(&i),
+                              &data_len,
+                              reinterpret_cast<uint8_t *>(&read_val));
+            TEST_ASSERT(data_len == sizeof(val) && read_val == val);
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+}
+
+void do_work() {
+  cout << "Running " << __FILE__ "..." << endl;
+  test_range_lock();
+  test_server_array();
+  cout << "Passed" << endl;
+}
+
+void _main(void *arg) { do_work(); }
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
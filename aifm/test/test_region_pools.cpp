@@ -0,0 +1,163 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 256ULL << 20;
+constexpr uint64_t kFarMemSize = 1ULL << 30;
+constexpr uint64_t kNumGCThreads = 12;
+
+namespace far_memory {
+class FarMemTest {
+private:
+  uint32_t count_free_regions(FarMemManager::RegionManager *region_manager) {
+    uint32_t num_free_regions = 0;
+    for (uint32_t node = 0; node < region_manager->get_num_nodes(); node++) {
+      num_free_regions += region_manager->get_num_free_regions(node);
+    }
+    return num_free_regions;
+  }
+
+public:
+  bool run(FarMemManager *manager) {
+    auto *region_manager = &manager->cache_region_manager_;
+    auto num_nodes = region_manager->get_num_nodes();
+    TEST_ASSERT(num_nodes >= 1 && num_nodes <= helpers::kMaxNumNUMANodes);
+
+    // Every slice is bound to a distinct node that owns some runtime cores.
+    for (uint32_t i = 0; i < num_nodes; i++) {
+      for (uint32_t j = i + 1; j < num_nodes; j++) {
+        TEST_ASSERT(region_manager->node_ids_[i] !=
+                    region_manager->node_ids_[j]);
+      }
+    }
+    std::vector<bool> is_node_used(num_nodes);
+    FOR_ALL_SOCKET0_CORES(core_id) {
+      auto node = region_manager->core_nodes_[core_id];
+      TEST_ASSERT(node < num_nodes);
+      is_node_used[node] = true;
+      if (num_nodes > 1 && helpers::get_numa_node_of_core(core_id) !=
+                               region_manager->node_ids_[node]) {
+        // Only the nodes beyond kMaxNumNUMANodes are folded.
+        TEST_ASSERT(num_nodes == helpers::kMaxNumNUMANodes);
+      }
+    }
+    for (uint32_t node = 0; node < num_nodes; node++) {
+      TEST_ASSERT(is_node_used[node]);
+    }
+
+    // Every configured CPU is mapped, including the ones beyond the runtime
+    // cores, which share the slice of their node if it has one.
+    auto num_cpus = region_manager->num_cpus_;
+    TEST_ASSERT(num_cpus >= helpers::kNumCPUs);
+    TEST_ASSERT(num_cpus >= helpers::get_num_configured_cpus());
+    for (uint32_t core_id = helpers::kNumCPUs; core_id < num_cpus; core_id++) {
+      auto node = region_manager->core_nodes_[core_id];
+      TEST_ASSERT(node < num_nodes);
+      auto node_id = helpers::get_numa_node_of_core(core_id);
+      for (uint32_t i = 0; i < num_nodes; i++) {
+        if (region_manager->node_ids_[i] == node_id) {
+          TEST_ASSERT(node == i);
+        }
+      }
+    }
+
+    // Two core-local regions per core are taken from the pools.
+    auto num_regions = region_manager->get_num_regions();
+    auto num_free_regions = count_free_regions(region_manager);
+    TEST_ASSERT(num_free_regions + 2 * helpers::kNumCPUs == num_regions);
+
+    // Every pooled region is homed in its pool.
+    for (uint32_t node = 0; node < num_nodes; node++) {
+      auto &free_regions = region_manager->free_regions_[node];
+      for (uint32_t i = 0; i < free_regions.size(); i++) {
+        Region region;
+        TEST_ASSERT(free_regions.pop_front(&region));
+        TEST_ASSERT(region_manager->get_region_node(region.get_idx()) == node);
+        TEST_ASSERT(free_regions.push_back(region));
+      }
+    }
+
+    // Drains the pools from a single core, which falls back to the other
+    // nodes only once its own pool is empty, and hands every region back to
+    // its home pool.
+    std::vector<Region> regions;
+    preempt_disable();
+    auto core_node = region_manager->get_core_node();
+    while (true) {
+      auto own_pool_empty = !region_manager->get_num_free_regions(core_node);
+      Region region;
+      if (!region_manager->pop_free_region(&region)) {
+        break;
+      }
+      auto node = region_manager->get_region_node(region.get_idx());
+      TEST_ASSERT(node == core_node || own_pool_empty);
+      regions.emplace_back(std::move(region));
+    }
+    preempt_enable();
+    TEST_ASSERT(regions.size() == num_free_regions);
+    TEST_ASSERT(count_free_regions(region_manager) == 0);
+    for (auto &region : regions) {
+      region_manager->push_free_region(region);
+    }
+    TEST_ASSERT(count_free_regions(region_manager) == num_free_regions);
+    for (uint32_t node = 0; node < num_nodes; node++) {
+      auto &free_regions = region_manager->free_regions_[node];
+      for (uint32_t i = 0; i < free_regions.size(); i++) {
+        Region region;
+        TEST_ASSERT(free_regions.pop_front(&region));
+        TEST_ASSERT(region_manager->get_region_node(region.get_idx()) == node);
+        TEST_ASSERT(free_regions.push_back(region));
+      }
+    }
+
+    // The far-mem regions stay in a single pool.
+    TEST_ASSERT(manager->far_mem_region_manager_.get_num_nodes() == 1);
+
+    return true;
+  }
+};
+} // namespace far_memory
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+  FarMemTest test;
+  if (test.run(manager)) {
+    cout << "Passed" << endl;
+  }
+}
+
+void _main(void *arg) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,145 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+#include "thread.h"
+
+#include "array.hpp"
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+#include "rpc_protocol.hpp"
+#include "rpc_router.hpp"
+#include "rpc_stream.hpp"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 256ULL << 20;
+constexpr uint64_t kFarMemSize = 1ULL << 30;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumEntries = 1 << 20;
+constexpr uint64_t kNumStreamedItems = 1 << 20;
+
+void test_router() {
+  rpc::RpcRouter router;
+  auto iota_id = router.RegisterStream(
+      "Iota", [](rpc::StreamWriter &writer, uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+          writer << i;
+        }
+      });
+  auto add_id = router.Register("Add", [](int a, int b) { return a + b; });
+
+  // The return value, far beyond a 64 KB body, is consumed chunk by chunk.
+  uint32_t num_chunks = 0;
+  uint64_t num_items = 0;
+  rpc::StreamReader reader([&](const rpc::BufferPtr &chunk) {
+    rpc::Serializer serializer(chunk);
+    while (serializer.ReadableBytes()) {
+      TEST_ASSERT(rpc::Get<uint64_t>(serializer) == num_items++);
+    }
+  });
+  rpc::StreamWriter writer([&](const rpc::BufferPtr &chunk, bool last) {
+    TEST_ASSERT(chunk->ReadableBytes() <=
+                rpc::StreamWriter::kDefaultChunkSize + sizeof(uint64_t));
+    num_chunks++;
+    reader.OnChunk(chunk);
+  });
+  router.Call(iota_id, rpc::SerializeArgsToBuffer(kNumStreamedItems), writer);
+  TEST_ASSERT(writer.IsClosed());
+  TEST_ASSERT(reader.Succeeded());
+  TEST_ASSERT(num_items == kNumStreamedItems);
+  TEST_ASSERT(num_chunks > 1);
+
+  // The return value of a normal method comes in a single chunk along with
+  // the error code.
+  num_chunks = 0;
+  rpc::StreamWriter add_writer([&](const rpc::BufferPtr &chunk, bool last) {
+    TEST_ASSERT(last);
+    num_chunks++;
+    rpc::Serializer serializer(chunk);
+    TEST_ASSERT(rpc::Get<rpc::RpcErrorCode>(serializer) ==
+                rpc::RpcErrorCode::kSuccess);
+    TEST_ASSERT(rpc::Get<int>(serializer) == 3);
+  });
+  router.Call(add_id, rpc::SerializeArgsToBuffer(1, 2), add_writer);
+  TEST_ASSERT(num_chunks == 1);
+
+  // Ditto, materialized into a single buffer.
+  auto reply = router.Call("Iota", rpc::SerializeArgsToBuffer(kNumStreamedItems));
+  TEST_ASSERT(reply.error_code == rpc::RpcErrorCode::kSuccess);
+  TEST_ASSERT(reply.ret->ReadableBytes() == kNumStreamedItems * sizeof(uint64_t));
+  rpc::StreamReader not_found_reader(
+      [&](const rpc::BufferPtr &chunk) { TEST_ASSERT(false); });
+  rpc::StreamWriter not_found_writer(
+      [&](const rpc::BufferPtr &chunk, bool last) {
+        not_found_reader.OnChunk(chunk);
+      });
+  router.Call(rpc::kInvalidMethodID, rpc::MakeBuffer(0), not_found_writer);
+  TEST_ASSERT(!not_found_reader.Succeeded());
+}
+
+void test_array(FarMemManager *manager) {
+  auto array = std::unique_ptr<Array<uint64_t, kNumEntries>>(
+      manager->allocate_array_heap<uint64_t, kNumEntries>());
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    array->write(i, i);
+  }
+  array->register_local_stream(
+      "Scan", [&](rpc::StreamWriter &writer, uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; i++) {
+          writer << array->read(i);
+        }
+      });
+  // The fake device has no server side, so the method runs locally.
+  uint64_t next = 0;
+  TEST_ASSERT(array->call_stream(
+      array->get_method("Scan"),
+      rpc::SerializeArgsToBuffer(static_cast<uint64_t>(0), kNumEntries),
+      [&](const rpc::BufferPtr &chunk) {
+        rpc::Serializer serializer(chunk);
+        while (serializer.ReadableBytes()) {
+          TEST_ASSERT(rpc::Get<uint64_t>(serializer) == next++);
+        }
+      }));
+  TEST_ASSERT(next == kNumEntries);
+  TEST_ASSERT(!array->call_stream(array->get_method("NotFound"),
+                                  rpc::MakeBuffer(0),
+                                  [&](const rpc::BufferPtr &chunk) {}));
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+  test_router();
+  test_array(manager);
+  cout << "Passed" << endl;
+}
+
+void _main(void *arg) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
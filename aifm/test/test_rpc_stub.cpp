@@ -0,0 +1,125 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+#include "thread.h"
+
+#include "array.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+#include "rpc_protocol.hpp"
+#include "rpc_router.hpp"
+#include "rpc_stub.hpp"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 256ULL << 20;
+constexpr uint64_t kFarMemSize = 1ULL << 30;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumEntries = 1 << 10;
+
+void test_router() {
+  rpc::RpcRouter router;
+  auto add_id = router.Register("Add", [](int a, int b) { return a + b; });
+  auto concat_id = router.Register(
+      "Concat", [](std::string s, uint64_t n) { return s + std::to_string(n); });
+  TEST_ASSERT(add_id == rpc::kGetMethodsID + 1);
+  TEST_ASSERT(concat_id == add_id + 1);
+  TEST_ASSERT(router.GetMethodID("Concat") == concat_id);
+  TEST_ASSERT(router.GetMethodID("NotFound") == rpc::kInvalidMethodID);
+  TEST_ASSERT(router.Call(rpc::kInvalidMethodID, rpc::MakeBuffer(0)).error_code ==
+              rpc::RpcErrorCode::kMethodNotFound);
+
+  // The handshake method serves the names indexed by the IDs.
+  auto reply = router.Call(rpc::kGetMethodsID, rpc::MakeBuffer(0));
+  TEST_ASSERT(reply.error_code == rpc::RpcErrorCode::kSuccess);
+  auto methods =
+      rpc::GetReturnValueFromBuffer<std::vector<std::string>>(reply.ret);
+  TEST_ASSERT(methods.size() == 3);
+  TEST_ASSERT(methods[rpc::kGetMethodsID] == rpc::kGetMethodsName);
+  TEST_ASSERT(methods[add_id] == "Add");
+  TEST_ASSERT(methods[concat_id] == "Concat");
+
+  // The stub encodes the args as the registered types, e.g., the uint64_t
+  // below is sent as an int.
+  auto caller = [&](rpc::MethodID id) {
+    return [&, id](const rpc::BufferPtr &args, rpc::BufferPtr &ret) {
+      auto reply = router.Call(id, args);
+      ret = reply.ret;
+      return reply.error_code == rpc::RpcErrorCode::kSuccess;
+    };
+  };
+  rpc::Stub<int(int, int)> add(caller(add_id));
+  uint64_t a = 40;
+  TEST_ASSERT(add(a, 2) == 42);
+  rpc::Stub<std::string(const std::string &, uint64_t)> concat(
+      caller(concat_id));
+  TEST_ASSERT(concat("far", 1) == std::string("far1"));
+  rpc::Stub<void()> not_found(caller(rpc::kInvalidMethodID));
+  TEST_ASSERT(!not_found());
+  TEST_ASSERT(rpc::Stub<int(int, int)>::EncodeArgs(1, 2)->ReadableBytes() ==
+              2 * sizeof(int));
+}
+
+void test_array(FarMemManager *manager) {
+  auto array = std::unique_ptr<Array<int, kNumEntries>>(
+      manager->allocate_array_heap<int, kNumEntries>());
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    array->write(static_cast<int>(i), i);
+  }
+  array->register_local("Sum", [&](uint64_t begin, uint64_t end) {
+    int64_t sum = 0;
+    for (uint64_t i = begin; i < end; i++) {
+      sum += array->read(i);
+    }
+    return sum;
+  });
+  // The fake device has no server side, so no method is negotiated.
+  auto method = array->get_method("Sum");
+  TEST_ASSERT(method.local_id != rpc::kInvalidMethodID);
+  TEST_ASSERT(method.remote_id == rpc::kInvalidMethodID);
+
+  auto sum = array->get_stub<int64_t(uint64_t, uint64_t)>("Sum");
+  for (uint32_t i = 0; i < 2; i++) {
+    TEST_ASSERT(sum(0, kNumEntries) ==
+                static_cast<int64_t>(kNumEntries * (kNumEntries - 1) / 2));
+  }
+  TEST_ASSERT(!array->get_stub<int(int, int)>("Add")(1, 2));
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+  test_router();
+  test_array(manager);
+  cout << "Passed" << endl;
+}
+
+void _main(void *arg) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
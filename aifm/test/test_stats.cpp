@@ -0,0 +1,123 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 64 * Region::kSize;
+constexpr uint64_t kFarMemSize = (1ULL << 30);
+constexpr uint64_t kWorkSetSize = 256 * Region::kSize;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kDumpIntervalUs = 10 * 1000;
+const string kDumpPath = "/tmp/test_stats.dump";
+
+struct Data4096 {
+  char data[4096];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  remove(kDumpPath.c_str());
+  Stats::start_periodic_dump(kDumpPath, kDumpIntervalUs);
+
+  auto snapshot = std::make_unique<StatsSnapshot>();
+  Stats::snapshot(snapshot.get());
+  auto &before = snapshot->ds[kVanillaPtrDSID];
+  auto swap_ins = before.swap_ins;
+  auto swap_in_bytes = before.swap_in_bytes;
+  auto swap_outs = before.swap_outs;
+  auto swap_out_bytes = before.swap_out_bytes;
+
+  // The working set is 4x the cache, so the objects are swapped out while
+  // being written, and are swapped in again while being read.
+  std::vector<UniquePtr<Data_t>> vec;
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    {
+      DerefScope scope;
+      auto raw_mut_ptr = far_mem_ptr.deref_mut(scope);
+      memset(raw_mut_ptr->data, static_cast<char>(i), sizeof(Data_t));
+    }
+    vec.emplace_back(std::move(far_mem_ptr));
+  }
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    DerefScope scope;
+    TEST_ASSERT(vec[i].deref(scope)->data[0] == static_cast<char>(i));
+  }
+
+  Stats::snapshot(snapshot.get());
+  auto &after = snapshot->ds[kVanillaPtrDSID];
+  TEST_ASSERT(after.swap_ins > swap_ins);
+  TEST_ASSERT(after.swap_in_bytes - swap_in_bytes >=
+              (after.swap_ins - swap_ins) * sizeof(Data_t));
+  TEST_ASSERT(after.swap_outs > swap_outs);
+  TEST_ASSERT(after.swap_out_bytes - swap_out_bytes >= sizeof(Data_t));
+  TEST_ASSERT(snapshot->gc_write_back_us > 0);
+  TEST_ASSERT(Stats::get_swap_ins(kVanillaPtrDSID) >= after.swap_ins);
+  // Every swap-in of the vanilla ptrs goes through the deref slow path.
+  TEST_ASSERT(snapshot->swap_in_latency.count >= after.swap_ins - swap_ins);
+  TEST_ASSERT(snapshot->swap_in_latency.p50_ns > 0);
+  TEST_ASSERT(snapshot->swap_in_latency.p50_ns <=
+              snapshot->swap_in_latency.p99_ns);
+  TEST_ASSERT(snapshot->swap_in_latency.p99_ns <=
+              snapshot->swap_in_latency.p999_ns);
+
+  timer_sleep(2 * kDumpIntervalUs);
+  Stats::stop_periodic_dump();
+  ifstream ifs(kDumpPath);
+  string line;
+  bool found_ds = false, found_gc = false, found_latency = false;
+  while (getline(ifs, line)) {
+    found_ds |= (line.find("ds_id=0 ") != string::npos);
+    found_gc |= (line.find("gc_write_back_us=") != string::npos);
+    found_latency |= (line.find("op=swap_in ") != string::npos);
+  }
+  TEST_ASSERT(found_ds && found_gc && found_latency);
+  remove(kDumpPath.c_str());
+
+  cout << "Passed" << endl;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
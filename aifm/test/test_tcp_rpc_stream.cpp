@@ -0,0 +1,146 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+#include "thread.h"
+
+#include "array.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+#include "rpc_protocol.hpp"
+#include "rpc_serializer.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr static uint64_t kCacheSize = (256ULL << 20);
+constexpr static uint64_t kFarMemSize = (4ULL << 30);
+constexpr static uint32_t kNumGCThreads = 12;
+constexpr static uint64_t kNumEntries = (1ULL << 20);
+// A single connection, so that the frames of all streams interleave on it.
+constexpr static uint32_t kNumConnections = 1;
+constexpr static uint32_t kNumStreams = 4;
+constexpr static uint32_t kNumAdds = 1000;
+// The consumers lag behind, so that the chunk queues fill up.
+constexpr static uint32_t kNumChunksPerSleep = 4;
+constexpr static uint64_t kSleepUs = 1000;
+
+using Array_t = Array<uint64_t, kNumEntries>;
+
+bool check_stream(Array_t *array, uint64_t begin, uint64_t end) {
+  uint64_t next = begin;
+  uint32_t num_chunks = 0;
+  bool data_ok = true;
+  bool ok = array->call_stream(
+      array->get_method("ReadRange"), rpc::SerializeArgsToBuffer(begin, end),
+      [&](const rpc::BufferPtr &chunk) {
+        if (++num_chunks % kNumChunksPerSleep == 0) {
+          timer_sleep(kSleepUs);
+        }
+        rpc::Serializer serializer(chunk);
+        while (serializer.ReadableBytes()) {
+          data_ok &= (rpc::Get<uint64_t>(serializer) == next++ * 3);
+        }
+      });
+  return ok && data_ok && next == end && num_chunks > 1;
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+  std::vector<std::unique_ptr<Array_t>> arrays;
+  for (uint32_t i = 0; i < kNumStreams; i++) {
+    arrays.emplace_back(manager->allocate_array_heap<uint64_t, kNumEntries>());
+    for (uint64_t j = 0; j < kNumEntries; j++) {
+      DerefScope scope;
+      arrays[i]->at_mut(scope, j) = j * 3;
+    }
+  }
+
+  // Several long streams, each far beyond a single chunk, share the
+  // connection with short calls, whose responses must get through while the
+  // streams are consumed.
+  bool ok = true;
+  std::vector<rt::Thread> threads;
+  for (uint32_t i = 0; i < kNumStreams; i++) {
+    threads.emplace_back([&, i]() {
+      if (!check_stream(arrays[i].get(), i, kNumEntries)) {
+        ok = false;
+      }
+    });
+  }
+  for (uint32_t i = 0; i < kNumAdds; i++) {
+    rpc::BufferPtr ret;
+    if (!arrays[0]->call("Add",
+                         rpc::SerializeArgsToBuffer(1, static_cast<int>(i)),
+                         ret) ||
+        rpc::GetReturnValueFromBuffer<int>(ret) != static_cast<int>(i) + 1) {
+      ok = false;
+    }
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  if (!ok) {
+    goto fail;
+  }
+
+  // The empty stream only carries the error code.
+  if (!arrays[0]->call_stream(
+          arrays[0]->get_method("ReadRange"),
+          rpc::SerializeArgsToBuffer(static_cast<uint64_t>(0),
+                                     static_cast<uint64_t>(0)),
+          [&](const rpc::BufferPtr &chunk) { ok = false; }) ||
+      !ok) {
+    goto fail;
+  }
+
+  cout << "Passed" << endl;
+  return;
+
+fail:
+  cout << "Failed" << endl;
+}
+
+int argc;
+void _main(void *arg) {
+  char **argv = static_cast<char **>(arg);
+  std::string ip_addr_port(argv[1]);
+  auto raddr = helpers::str_to_netaddr(ip_addr_port);
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads,
+          new TCPDevice(raddr, kNumConnections, kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int _argc, char *argv[]) {
+  int ret;
+
+  if (_argc < 3) {
+    std::cerr << "usage: [cfg_file] [ip_addr:port]" << std::endl;
+    return -EINVAL;
+  }
+
+  char conf_path[strlen(argv[1]) + 1];
+  strcpy(conf_path, argv[1]);
+  for (int i = 2; i < _argc; i++) {
+    argv[i - 1] = argv[i];
+  }
+  argc = _argc - 1;
+
+  ret = runtime_init(conf_path, _main, argv);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,200 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+#include "object.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+constexpr uint64_t kCacheSize = 64 * Region::kSize;
+constexpr uint64_t kFarMemSize = 512 * Region::kSize;
+constexpr uint64_t kWorkSetSize = 256 * Region::kSize;
+constexpr uint64_t kNumGCThreads = 12;
+// Long enough for the untouched remote regions to be demoted.
+constexpr uint64_t kIdleTimeUs = 5 * 1000 * 1000;
+constexpr char kStorageFilePath[] = "test_tiered_device.img";
+constexpr char kMigrateStorageFilePath[] = "test_tiered_device_migrate.img";
+constexpr uint64_t kMigrateFarMemSize = 4 * Region::kSize;
+constexpr uint32_t kNumPromotionReads = 16;
+constexpr uint64_t kPromotionTimeUs = 100 * 1000;
+
+struct Data4096 {
+  char data[4096];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+bool check(UniquePtr<Data_t> *ptr, char value) {
+  DerefScope scope;
+  const auto raw_const_ptr = ptr->deref(scope);
+  for (uint32_t j = 0; j < sizeof(Data_t); j++) {
+    if (raw_const_ptr->data[j] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A remote object in the migrated region: the one at kSkippedOffset is
+// allocated but never written, and the one at kNoBackRefOffset carries no
+// far-mem pointer addr, so neither is found by walking the region.
+struct MigratedObject {
+  uint64_t offset;
+  bool back_ref;
+  uint16_t data_len;
+};
+
+constexpr uint64_t kSkippedOffset = 4096;
+constexpr uint64_t kNoBackRefOffset = 8192;
+constexpr MigratedObject kMigratedObjects[] = {
+    {0, true, 1000},
+    {kNoBackRefOffset, false, 2000},
+    {3 * 4096, true, 3000},
+    {Region::kSize - 4096, true, 4000}};
+
+bool check_migrated_objects(TieredDevice *device, uint64_t region_offset) {
+  uint8_t data_buf[Object::kMaxObjectDataSize];
+  for (auto &obj : kMigratedObjects) {
+    uint64_t obj_id = region_offset + obj.offset;
+    uint16_t data_len;
+    device->read_object(kVanillaPtrDSID, sizeof(obj_id),
+                        reinterpret_cast<uint8_t *>(&obj_id), &data_len,
+                        data_buf);
+    if (data_len != obj.data_len) {
+      return false;
+    }
+    for (uint32_t j = 0; j < data_len; j++) {
+      if (data_buf[j] != static_cast<uint8_t>(obj.offset / 4096 + 1)) {
+        return false;
+      }
+    }
+  }
+  // The skipped object is carried over as all zeros, so it can be written
+  // after the migration as if it had stayed in place.
+  uint64_t obj_id = region_offset + kSkippedOffset;
+  uint16_t data_len;
+  device->read_object(kVanillaPtrDSID, sizeof(obj_id),
+                      reinterpret_cast<uint8_t *>(&obj_id), &data_len,
+                      data_buf);
+  return data_len == 0;
+}
+
+bool do_migrate_work() {
+  auto guard = helpers::finally([&]() { unlink(kMigrateStorageFilePath); });
+  auto device = std::make_unique<TieredDevice>(
+      new FakeDevice(kMigrateFarMemSize),
+      new StorageDevice(kMigrateStorageFilePath, kMigrateFarMemSize));
+  uint64_t region_offset = Region::kSize;
+  uint8_t data_buf[Object::kMaxObjectDataSize];
+  for (auto &obj : kMigratedObjects) {
+    uint8_t obj_id[kVanillaPtrObjectIDSize + kVanillaPtrBackRefSize];
+    uint64_t offset = region_offset + obj.offset;
+    uint64_t ptr_addr = 0x1000 + obj.offset;
+    memcpy(obj_id, &offset, kVanillaPtrObjectIDSize);
+    memcpy(obj_id + kVanillaPtrObjectIDSize, &ptr_addr,
+           kVanillaPtrBackRefSize);
+    memset(data_buf, static_cast<uint8_t>(obj.offset / 4096 + 1),
+           obj.data_len);
+    device->write_object(kVanillaPtrDSID,
+                         obj.back_ref ? sizeof(obj_id)
+                                      : kVanillaPtrObjectIDSize,
+                         obj_id, obj.data_len, data_buf);
+  }
+
+  timer_sleep(kIdleTimeUs);
+  if (device->get_num_slow_regions() != 1 ||
+      !check_migrated_objects(device.get(), region_offset)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < kNumPromotionReads; i++) {
+    if (!check_migrated_objects(device.get(), region_offset)) {
+      return false;
+    }
+  }
+  timer_sleep(kPromotionTimeUs);
+  return device->get_num_slow_regions() == 0 &&
+         check_migrated_objects(device.get(), region_offset);
+}
+
+void do_work(FarMemManager *manager, TieredDevice *device) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  if (!do_migrate_work()) {
+    goto fail;
+  }
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    {
+      DerefScope scope;
+      auto raw_mut_ptr = far_mem_ptr.deref_mut(scope);
+      memset(raw_mut_ptr->data, static_cast<char>(i), sizeof(Data_t));
+    }
+    vec.emplace_back(std::move(far_mem_ptr));
+  }
+
+  timer_sleep(kIdleTimeUs);
+  if (!device->get_num_slow_regions()) {
+    goto fail;
+  }
+
+  for (uint32_t round = 0; round < 2; round++) {
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      if (!check(&vec[i], static_cast<char>(i))) {
+        goto fail;
+      }
+    }
+  }
+
+  cout << "Passed" << endl;
+  return;
+
+fail:
+  cout << "Failed" << endl;
+  return;
+}
+
+void _main(void *arg) {
+  auto *device = new TieredDevice(
+      new FakeDevice(kFarMemSize),
+      new StorageDevice(kStorageFilePath, kFarMemSize));
+  auto manager = std::unique_ptr<FarMemManager>(
+      FarMemManagerFactory::build(kCacheSize, kNumGCThreads, device));
+  do_work(manager.get(), device);
+  manager.reset();
+  unlink(kStorageFilePath);
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}